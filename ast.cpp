@@ -1,6 +1,7 @@
 #include <numeric>
 #include <sstream>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "ast.hpp"
@@ -8,6 +9,93 @@
 namespace ast
 {
 
+void Node::Referents(std::vector<ref::Counted *> &out)
+{
+    ForEachChild(this, [&out](Node *child) { out.push_back(child); });
+    // the names ForEachChild leaves out
+    switch (kind_)
+    {
+    case NodeKind::LET:
+        out.push_back(static_cast<LetStatement *>(this)->name_.get());
+        break;
+    case NodeKind::FOR:
+        out.push_back(static_cast<ForStatement *>(this)->iterator_.get());
+        break;
+    case NodeKind::FUNCTION:
+        for (auto &param : static_cast<FunctionLiteral *>(this)->parameters_)
+            out.push_back(param.get());
+        break;
+    default:
+        break;
+    }
+}
+
+void Release(ref::Ref<Expression> &child)
+{
+    // shared elsewhere (or nothing there) - dropping our reference is enough
+    if (child.use_count() != 1)
+    {
+        child.reset();
+        return;
+    }
+
+    std::vector<ref::Ref<Expression>> pending;
+    child->DetachChain(pending);
+    child.reset();
+    while (!pending.empty())
+    {
+        ref::Ref<Expression> node = std::move(pending.back());
+        pending.pop_back();
+        if (node.use_count() == 1)
+            node->DetachChain(pending);
+        // node goes here, with nothing left for its destructor to recurse into
+    }
+}
+
+namespace
+{
+
+void Take(ref::Ref<Expression> &child, std::vector<ref::Ref<Expression>> &out)
+{
+    if (child)
+        out.push_back(std::move(child));
+}
+
+} // namespace
+
+PrefixExpression::~PrefixExpression() { Release(right_); }
+
+void PrefixExpression::DetachChain(std::vector<ref::Ref<Expression>> &out)
+{
+    Take(right_, out);
+}
+
+InfixExpression::~InfixExpression()
+{
+    Release(left_);
+    Release(right_);
+}
+
+void InfixExpression::DetachChain(std::vector<ref::Ref<Expression>> &out)
+{
+    Take(left_, out);
+    Take(right_, out);
+}
+
+CallExpression::~CallExpression() { Release(function_); }
+
+void CallExpression::DetachChain(std::vector<ref::Ref<Expression>> &out)
+{
+    Take(function_, out);
+}
+
+IndexExpression::~IndexExpression() { Release(left_); }
+
+void IndexExpression::DetachChain(std::vector<ref::Ref<Expression>> &out)
+{
+    Take(left_, out);
+}
+
 std::string Program::TokenLiteral() const
 {
     if (!statements_.empty())
@@ -105,7 +193,7 @@ std::string IfExpression::String() const
 {
     std::stringstream ss;
     ss << "if ";
-    if (!condition_)
+    if (condition_)
         ss << condition_->String();
     ss << " ";
     if (consequence_)
@@ -136,7 +224,11 @@ std::string FunctionLiteral::String() const
                               ret += rhs;
                               return ret;
                           })
-       << ")" << body_->String();
+       << ")";
+    if (body_)
+        ss << body_->String();
+    else
+        ss << pending_body_;
 
     return ss.str();
 }
@@ -233,8 +325,14 @@ std::string InfixExpression::String() const
     return ss.str();
 }
 
-std::string Identifier::String() const { return value_; }
-std::string IntegerLiteral::String() const { return token_.literal_; }
-std::string BooleanExpression::String() const { return token_.literal_; }
+std::string Identifier::String() const { return std::string{value_}; }
+std::string IntegerLiteral::String() const
+{
+    return std::string{token_.literal_};
+}
+std::string BooleanExpression::String() const
+{
+    return std::string{token_.literal_};
+}
 
 } // namespace ast
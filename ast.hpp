@@ -1,10 +1,16 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
+#include <mutex>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <utility>
 #include <vector>
 
+#include "ref.hpp"
+#include "source.hpp"
+#include "symbol.hpp"
 #include "token.hpp"
 
 using ::token::Token;
@@ -14,19 +20,59 @@ namespace ast
 
 class BlockStatement;
 
+// The names the environment of a function call or a for loop holds, by
+// slot, as resolver::Resolve laid it out.
+struct Scope
+{
+    std::vector<symbol::Id> names;
+};
+
+// A small tag for each concrete node type, for representations (and code)
+// that want to switch on the kind of node rather than cast. Every node carries
+// its own in kind_.
+enum class NodeKind : uint8_t
+{
+    PROGRAM,
+    LET,
+    RETURN,
+    EXPRESSION_STATEMENT,
+    BLOCK,
+    FOR,
+    IDENTIFIER,
+    INTEGER,
+    STRING,
+    BOOLEAN,
+    PREFIX,
+    INFIX,
+    IF,
+    FUNCTION,
+    CALL,
+    ARRAY,
+    HASH,
+    INDEX,
+};
+
 /////////////////// NODE /////////////////
 
-class Node
+class Node : public ref::Counted
 {
   public:
-    Node() = default;
-    explicit Node(Token toke) : token_{toke} {}
+    explicit Node(NodeKind kind) : kind_{kind} {}
+    Node(NodeKind kind, Token toke) : token_{toke}, kind_{kind} {}
     virtual ~Node() = default;
-    virtual std::string TokenLiteral() const { return token_.literal_; }
+    virtual std::string TokenLiteral() const
+    {
+        return std::string{token_.literal_};
+    }
     virtual std::string String() const = 0;
 
   public:
     Token token_;
+    // which subclass this is, so it can be static_cast to it
+    const NodeKind kind_;
+
+  protected:
+    void Referents(std::vector<ref::Counted *> &out) override;
 };
 
 /////////////////// EXPRESSIONS
@@ -34,25 +80,58 @@ class Node
 class Expression : public Node
 {
   public:
-    Expression() {}
-    explicit Expression(Token token) : Node{token} {}
+    explicit Expression(NodeKind kind) : Node{kind} {}
+    Expression(NodeKind kind, Token token) : Node{kind, token} {}
+
+    // Moves out the children that can form long chains (see Release).
+    virtual void DetachChain(std::vector<ref::Ref<Expression>> & /* out */)
+    {
+    }
 };
 
+// Operator, call and index chains can be tens of thousands of nodes deep;
+// their destructors hand children here to be freed off a worklist rather
+// than one C++ frame per level.
+void Release(ref::Ref<Expression> &child);
+
 class Identifier : public Expression
 {
   public:
-    Identifier() {}
-    Identifier(Token token, std::string val) : Expression{token}, value_{val} {}
+    Identifier() : Expression{NodeKind::IDENTIFIER} {}
+    // Lexed IDENT tokens arrive already interned; anything else (a token
+    // made up by hand) is interned here.
+    Identifier(Token token, std::string_view val)
+        : Expression{NodeKind::IDENTIFIER, token}, value_{val},
+          id_{token.type_ == token::IDENT && token.value_
+                  ? static_cast<symbol::Id>(token.value_)
+                  : symbol::Intern(val)}
+    {
+    }
     std::string String() const override;
-    std::string value_;
+    std::string_view value_;
+    symbol::Id id_{symbol::kNone};
+
+    // Where resolver::Resolve found the name: depth_ environments out, in
+    // slot slot_ of that one - or looked up by name there if slot_ is
+    // kGlobal. Unresolved identifiers are looked up by name from the start.
+    static constexpr uint16_t kUnresolved = 0xffff;
+    static constexpr uint16_t kGlobal = 0xffff;
+    uint16_t depth_{kUnresolved};
+    uint16_t slot_{kGlobal};
 };
 
 class IntegerLiteral : public Expression
 {
   public:
-    IntegerLiteral() {}
-    explicit IntegerLiteral(Token token) : Expression{token} {}
-    IntegerLiteral(Token token, int64_t val) : Expression{token}, value_{val} {}
+    IntegerLiteral() : Expression{NodeKind::INTEGER} {}
+    explicit IntegerLiteral(Token token)
+        : Expression{NodeKind::INTEGER, token}
+    {
+    }
+    IntegerLiteral(Token token, int64_t val)
+        : Expression{NodeKind::INTEGER, token}, value_{val}
+    {
+    }
     std::string String() const override;
 
   public:
@@ -62,21 +141,28 @@ class IntegerLiteral : public Expression
 class StringLiteral : public Expression
 {
   public:
-    StringLiteral(Token token, std::string val) : Expression{token}, value_{val}
+    StringLiteral(Token token, std::string_view val)
+        : Expression{NodeKind::STRING, token}, value_{val}
     {
     }
-    std::string String() const override { return value_; }
+    std::string String() const override { return std::string{value_}; }
 
   public:
-    std::string value_;
+    std::string_view value_;
 };
 
 class BooleanExpression : public Expression
 {
   public:
-    BooleanExpression() {}
-    explicit BooleanExpression(Token token) : Expression{token} {}
-    BooleanExpression(Token token, bool val) : Expression{token}, value_{val} {}
+    BooleanExpression() : Expression{NodeKind::BOOLEAN} {}
+    explicit BooleanExpression(Token token)
+        : Expression{NodeKind::BOOLEAN, token}
+    {
+    }
+    BooleanExpression(Token token, bool val)
+        : Expression{NodeKind::BOOLEAN, token}, value_{val}
+    {
+    }
     std::string String() const override;
 
   public:
@@ -86,128 +172,152 @@ class BooleanExpression : public Expression
 class PrefixExpression : public Expression
 {
   public:
-    PrefixExpression() {}
-    explicit PrefixExpression(Token token) : Expression{token} {}
-    PrefixExpression(Token token, std::string op)
-        : Expression{token}, operator_{op}
+    PrefixExpression() : Expression{NodeKind::PREFIX} {}
+    explicit PrefixExpression(Token token)
+        : Expression{NodeKind::PREFIX, token}
+    {
+    }
+    PrefixExpression(Token token, std::string_view op)
+        : Expression{NodeKind::PREFIX, token}, operator_{op}
     {
     }
+    ~PrefixExpression() override;
+    void DetachChain(std::vector<ref::Ref<Expression>> &out) override;
     std::string String() const override;
 
   public:
-    std::string operator_;
-    std::shared_ptr<Expression> right_;
+    std::string_view operator_;
+    ref::Ref<Expression> right_;
 };
 
 class InfixExpression : public Expression
 {
   public:
-    InfixExpression() {}
-    explicit InfixExpression(Token token) : Expression{token} {}
-    InfixExpression(Token token, std::string op,
-                    std::shared_ptr<Expression> left)
-        : Expression{token}, operator_{op}, left_{left}
+    InfixExpression() : Expression{NodeKind::INFIX} {}
+    explicit InfixExpression(Token token)
+        : Expression{NodeKind::INFIX, token}
+    {
+    }
+    InfixExpression(Token token, std::string_view op, ref::Ref<Expression> left)
+        : Expression{NodeKind::INFIX, token}, operator_{op}, left_{left}
     {
     }
+    ~InfixExpression() override;
+    void DetachChain(std::vector<ref::Ref<Expression>> &out) override;
     std::string String() const override;
 
   public:
-    std::string operator_;
-    std::shared_ptr<Expression> left_;
-    std::shared_ptr<Expression> right_;
+    std::string_view operator_;
+    ref::Ref<Expression> left_;
+    ref::Ref<Expression> right_;
 };
 
 class IfExpression : public Expression
 {
   public:
-    IfExpression() {}
-    explicit IfExpression(Token token) : Expression{token} {}
+    IfExpression() : Expression{NodeKind::IF} {}
+    explicit IfExpression(Token token) : Expression{NodeKind::IF, token} {}
 
     std::string String() const override;
 
   public:
-    std::shared_ptr<Expression> condition_;
-    std::shared_ptr<BlockStatement> consequence_;
-    std::shared_ptr<BlockStatement> alternative_;
+    ref::Ref<Expression> condition_;
+    ref::Ref<BlockStatement> consequence_;
+    ref::Ref<BlockStatement> alternative_;
 };
 
 class FunctionLiteral : public Expression
 {
   public:
-    FunctionLiteral() {}
-    explicit FunctionLiteral(Token token) : Expression{token} {}
+    FunctionLiteral() : Expression{NodeKind::FUNCTION} {}
+    explicit FunctionLiteral(Token token)
+        : Expression{NodeKind::FUNCTION, token}
+    {
+    }
 
     std::string String() const override;
 
   public:
-    std::vector<std::shared_ptr<Identifier>> parameters_;
-    std::shared_ptr<BlockStatement> body_{nullptr};
+    std::vector<ref::Ref<Identifier>> parameters_;
+    ref::Ref<BlockStatement> body_{nullptr};
+    // keeps the text behind parameters_ and body_ alive for Function objects
+    std::shared_ptr<source::Buffer> source_;
+    // A body the parser only skimmed: its text, '{' to '}', with body_ left
+    // null until parser::ParseBody fills it in.
+    std::string_view pending_body_;
+    std::once_flag body_parsed_;
+    // the layout of a call's environment; null if the body wasn't resolved
+    std::shared_ptr<const Scope> scope_;
 };
 
 class CallExpression : public Expression
 {
   public:
-    CallExpression() {}
-    CallExpression(Token token, std::shared_ptr<Expression> func)
-        : Expression{token}, function_{func}
+    CallExpression() : Expression{NodeKind::CALL} {}
+    CallExpression(Token token, ref::Ref<Expression> func)
+        : Expression{NodeKind::CALL, token}, function_{func}
     {
     }
+    ~CallExpression() override;
+    void DetachChain(std::vector<ref::Ref<Expression>> &out) override;
 
     std::string String() const override;
 
   public:
-    std::shared_ptr<Expression> function_{nullptr};
-    std::vector<std::shared_ptr<Expression>> arguments_;
+    ref::Ref<Expression> function_{nullptr};
+    std::vector<ref::Ref<Expression>> arguments_;
 };
 
 class ArrayLiteral : public Expression
 {
   public:
-    ArrayLiteral() {}
-    explicit ArrayLiteral(Token token) : Expression{token} {}
-    ArrayLiteral(Token token, std::vector<std::shared_ptr<Expression>> elements)
-        : Expression{token}, elements_{elements}
+    ArrayLiteral() : Expression{NodeKind::ARRAY} {}
+    explicit ArrayLiteral(Token token) : Expression{NodeKind::ARRAY, token} {}
+    ArrayLiteral(Token token, std::vector<ref::Ref<Expression>> elements)
+        : Expression{NodeKind::ARRAY, token}, elements_{elements}
     {
     }
 
     std::string String() const override;
 
   public:
-    std::vector<std::shared_ptr<Expression>> elements_;
+    std::vector<ref::Ref<Expression>> elements_;
 };
 
 class HashLiteral : public Expression
 {
   public:
-    HashLiteral() {}
-    explicit HashLiteral(Token token) : Expression{token} {}
+    HashLiteral() : Expression{NodeKind::HASH} {}
+    explicit HashLiteral(Token token) : Expression{NodeKind::HASH, token} {}
 
     std::string String() const override;
 
   public:
-    std::unordered_map<std::shared_ptr<Expression>, std::shared_ptr<Expression>>
-        pairs_;
+    // in source order
+    std::vector<std::pair<ref::Ref<Expression>, ref::Ref<Expression>>> pairs_;
 };
 
 class IndexExpression : public Expression
 {
   public:
-    IndexExpression() {}
-    IndexExpression(Token token, std::shared_ptr<Expression> left)
-        : Expression{token}, left_{left}
+    IndexExpression() : Expression{NodeKind::INDEX} {}
+    IndexExpression(Token token, ref::Ref<Expression> left)
+        : Expression{NodeKind::INDEX, token}, left_{left}
     {
     }
-    IndexExpression(Token token, std::shared_ptr<Expression> left,
-                    std::shared_ptr<Expression> index)
-        : Expression{token}, left_{left}, index_{index}
+    IndexExpression(Token token, ref::Ref<Expression> left,
+                    ref::Ref<Expression> index)
+        : Expression{NodeKind::INDEX, token}, left_{left}, index_{index}
     {
     }
+    ~IndexExpression() override;
+    void DetachChain(std::vector<ref::Ref<Expression>> &out) override;
 
     std::string String() const override;
 
   public:
-    std::shared_ptr<Expression> left_{nullptr};
-    std::shared_ptr<Expression> index_{nullptr};
+    ref::Ref<Expression> left_{nullptr};
+    ref::Ref<Expression> index_{nullptr};
 };
 
 ///////////////////////////////////////////////////////////////
@@ -216,65 +326,71 @@ class IndexExpression : public Expression
 class Statement : public Node
 {
   public:
-    explicit Statement(Token toke) : Node{toke} {};
+    Statement(NodeKind kind, Token toke) : Node{kind, toke} {};
 };
 
 class LetStatement : public Statement
 {
   public:
-    explicit LetStatement(Token toke) : Statement(toke) {}
+    explicit LetStatement(Token toke) : Statement(NodeKind::LET, toke) {}
     std::string String() const override;
 
   public:
-    std::shared_ptr<Identifier> name_{nullptr};
-    std::shared_ptr<Expression> value_{nullptr};
+    ref::Ref<Identifier> name_{nullptr};
+    ref::Ref<Expression> value_{nullptr};
 };
 
 class ReturnStatement : public Statement
 {
   public:
-    explicit ReturnStatement(Token toke) : Statement(toke) {}
+    explicit ReturnStatement(Token toke) : Statement(NodeKind::RETURN, toke) {}
     std::string String() const override;
 
   public:
-    std::shared_ptr<Expression> return_value_{nullptr};
+    ref::Ref<Expression> return_value_{nullptr};
 };
 
 class ExpressionStatement : public Statement
 {
   public:
-    explicit ExpressionStatement(Token toke) : Statement(toke) {}
+    explicit ExpressionStatement(Token toke)
+        : Statement(NodeKind::EXPRESSION_STATEMENT, toke)
+    {
+    }
     std::string String() const override;
 
   public:
-    std::shared_ptr<Expression> expression_{nullptr};
+    ref::Ref<Expression> expression_{nullptr};
 };
 
 class BlockStatement : public Statement
 {
   public:
-    explicit BlockStatement(Token toke) : Statement(toke) {}
+    explicit BlockStatement(Token toke) : Statement(NodeKind::BLOCK, toke) {}
     std::string String() const override;
 
   public:
-    std::vector<std::shared_ptr<Statement>> statements_;
+    std::vector<ref::Ref<Statement>> statements_;
 };
 
 class ForStatement : public Statement
 {
   public:
-    explicit ForStatement(Token toke) : Statement(toke) {}
+    explicit ForStatement(Token toke) : Statement(NodeKind::FOR, toke) {}
     std::string String() const override;
 
   public:
-    std::shared_ptr<Identifier> iterator_{nullptr};
-    std::shared_ptr<Expression> iterator_value_{nullptr};
+    ref::Ref<Identifier> iterator_{nullptr};
+    ref::Ref<Expression> iterator_value_{nullptr};
+
+    ref::Ref<Expression> termination_condition_{nullptr};
 
-    std::shared_ptr<Expression> termination_condition_{nullptr};
+    ref::Ref<Expression> increment_{nullptr};
 
-    std::shared_ptr<Expression> increment_{nullptr};
+    ref::Ref<BlockStatement> body_;
 
-    std::shared_ptr<BlockStatement> body_;
+    // the layout of the loop's environment; null if it wasn't resolved
+    std::shared_ptr<const Scope> scope_;
 };
 
 // ROOT //////////////////////
@@ -282,12 +398,102 @@ class ForStatement : public Statement
 class Program : public Node
 {
   public:
-    Program() = default;
+    Program() : Node{NodeKind::PROGRAM} {}
     std::string TokenLiteral() const override;
     std::string String() const override;
 
   public:
-    std::vector<std::shared_ptr<Statement>> statements_;
+    std::vector<ref::Ref<Statement>> statements_;
+    std::shared_ptr<source::Buffer> source_;
+
+    // A buffer statements_ point into, and how many of them do.
+    struct Retained
+    {
+        std::shared_ptr<source::Buffer> buffer;
+        size_t statements;
+    };
+
+    // Set on programs made by parser::Reparse: where each statement starts
+    // in source_, and the buffers its statements really point into (which
+    // needn't be source_), in address order - just those, so text edited
+    // away is freed.
+    std::vector<size_t> offsets_;
+    std::vector<Retained> retained_;
 };
 
+// Calls `visit` on each statement and expression directly under `node` - a
+// function literal's body too, if it's been parsed.
+template <typename Visit> void ForEachChild(Node *node, Visit visit)
+{
+    auto each = [&visit](auto &children) {
+        for (auto &child : children)
+            visit(child.get());
+    };
+    switch (node->kind_)
+    {
+    case NodeKind::PROGRAM:
+        each(static_cast<Program *>(node)->statements_);
+        break;
+    case NodeKind::LET:
+        visit(static_cast<LetStatement *>(node)->value_.get());
+        break;
+    case NodeKind::RETURN:
+        visit(static_cast<ReturnStatement *>(node)->return_value_.get());
+        break;
+    case NodeKind::EXPRESSION_STATEMENT:
+        visit(static_cast<ExpressionStatement *>(node)->expression_.get());
+        break;
+    case NodeKind::BLOCK:
+        each(static_cast<BlockStatement *>(node)->statements_);
+        break;
+    case NodeKind::FOR:
+    {
+        auto loop = static_cast<ForStatement *>(node);
+        visit(loop->iterator_value_.get());
+        visit(loop->termination_condition_.get());
+        visit(loop->increment_.get());
+        visit(loop->body_.get());
+        break;
+    }
+    case NodeKind::PREFIX:
+        visit(static_cast<PrefixExpression *>(node)->right_.get());
+        break;
+    case NodeKind::INFIX:
+        visit(static_cast<InfixExpression *>(node)->left_.get());
+        visit(static_cast<InfixExpression *>(node)->right_.get());
+        break;
+    case NodeKind::IF:
+    {
+        auto if_expr = static_cast<IfExpression *>(node);
+        visit(if_expr->condition_.get());
+        visit(if_expr->consequence_.get());
+        visit(if_expr->alternative_.get());
+        break;
+    }
+    case NodeKind::FUNCTION:
+        visit(static_cast<FunctionLiteral *>(node)->body_.get());
+        break;
+    case NodeKind::CALL:
+        visit(static_cast<CallExpression *>(node)->function_.get());
+        each(static_cast<CallExpression *>(node)->arguments_);
+        break;
+    case NodeKind::ARRAY:
+        each(static_cast<ArrayLiteral *>(node)->elements_);
+        break;
+    case NodeKind::HASH:
+        for (auto &pair : static_cast<HashLiteral *>(node)->pairs_)
+        {
+            visit(pair.first.get());
+            visit(pair.second.get());
+        }
+        break;
+    case NodeKind::INDEX:
+        visit(static_cast<IndexExpression *>(node)->left_.get());
+        visit(static_cast<IndexExpression *>(node)->index_.get());
+        break;
+    default:
+        break;
+    }
+}
+
 } // namespace ast
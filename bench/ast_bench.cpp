@@ -0,0 +1,118 @@
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include "../compiler.hpp"
+#include "../dedup.hpp"
+#include "../evaluator.hpp"
+#include "../flat.hpp"
+#include "../lexer.hpp"
+#include "../parser.hpp"
+#include "../ref.hpp"
+#include "../source.hpp"
+#include "bench.hpp"
+
+BENCHMARK(AstFootprint)
+{
+    const std::string &script = bench::Corpus();
+    auto lex = std::make_shared<lexer::Lexer>(script);
+    parser::Parser parsley{lex};
+
+    // the parser's token stream is already built, so this is just the tree
+    bench::CountHeap(true);
+    ref::Ref<ast::Program> program = parsley.ParseProgram();
+    bench::CountHeap(false);
+    size_t tree_bytes = bench::HeapCounts().allocated;
+
+    flat::Tree tree = flat::Flatten(*program);
+    double nodes = tree.Size();
+    std::cout << "  " << tree.Size() << " nodes\n";
+    std::cout << "  tree AST: " << tree_bytes / nodes << " bytes/node\n";
+    std::cout << "  flat image: " << tree.Bytes() / nodes
+              << " bytes/node (" << sizeof(flat::Node) << " per node + lists)"
+              << std::endl;
+
+    bench::Timer free_tree;
+    program.reset();
+    bench::Report("free tree AST", free_tree.Seconds());
+    bench::Timer free_flat;
+    tree = flat::Tree{};
+    bench::Report("free flat image", free_flat.Seconds());
+}
+
+// Startup from a saved image against parsing the script it came from.
+BENCHMARK(AstImage)
+{
+    const std::string &script = bench::Corpus();
+    auto lex = std::make_shared<lexer::Lexer>(script);
+    parser::Parser parsley{lex};
+    std::ostringstream out;
+    flat::Save(flat::Flatten(*parsley.ParseProgram()), out);
+    auto image = source::FromString(out.str());
+    std::cout << "  (" << script.size() << " byte script, " << image->Size()
+              << " byte image)\n";
+
+    double secs = bench::Best(5, [&]() {
+        auto lex = std::make_shared<lexer::Lexer>(script);
+        parser::Parser parsley{lex};
+        auto program = parsley.ParseProgram();
+    });
+    bench::Report("lex+parse", secs, script.size());
+
+    secs = bench::Best(5, [&]() { auto tree = flat::Load(image); });
+    bench::Report("load image", secs, image->Size());
+
+    secs = bench::Best(5, [&]() {
+        auto program = flat::Inflate(*flat::Load(image));
+    });
+    bench::Report("load image + inflate", secs, image->Size());
+
+    secs = bench::Best(5, [&]() {
+        compiler::Globals globals;
+        auto main = compiler::Compile(flat::Load(image), globals);
+    });
+    bench::Report("load image + compile", secs, image->Size());
+}
+
+// What sharing identical constant subtrees saves on the generated corpus,
+// which repeats its hash keys, list elements and `* 3`s every few lines.
+BENCHMARK(AstDedup)
+{
+    const std::string &script = bench::Corpus();
+    auto parse = [&]() {
+        auto lex = std::make_shared<lexer::Lexer>(script);
+        parser::Parser parsley{lex};
+        return parsley.ParseProgram();
+    };
+    auto plain = parse();
+
+    bench::CountHeap(true);
+    auto shared = parse();
+    bench::Heap parsed = bench::HeapCounts();
+    size_t tree_bytes = parsed.allocated - parsed.freed;
+    bench::Timer pass;
+    dedup::Stats stats = dedup::ShareConstants(*shared);
+    double pass_secs = pass.Seconds();
+    bench::CountHeap(false);
+    bench::Heap after = bench::HeapCounts();
+    // the pass's own tables are gone by now too
+    size_t saved = after.freed - (after.allocated - tree_bytes);
+
+    std::cout << "  " << stats.expressions << " expressions, "
+              << stats.constants << " constant, " << stats.shared
+              << " replaced by a shared node\n";
+    std::cout << "  tree: " << tree_bytes / (1024.0 * 1024.0) << " MB, "
+              << saved / (1024.0 * 1024.0) << " MB freed ("
+              << 100.0 * saved / tree_bytes << "%)\n";
+    bench::Report("share constants", pass_secs, script.size());
+
+    double secs = bench::Best(5, [&]() {
+        evaluator::Eval(plain, ref::Make<object::Environment>());
+    });
+    bench::Report("eval", secs);
+    secs = bench::Best(5, [&]() {
+        evaluator::Eval(shared, ref::Make<object::Environment>());
+    });
+    bench::Report("eval shared", secs);
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Tiny benchmark harness - each bench file registers its cases with
+// BENCHMARK(name) and bench_main.cpp runs them (optionally filtered by a
+// substring given on the command line).
+
+namespace bench
+{
+
+struct Case
+{
+    std::string name;
+    std::function<void()> func;
+};
+
+inline std::vector<Case> &Registry()
+{
+    static std::vector<Case> cases;
+    return cases;
+}
+
+struct Registrar
+{
+    Registrar(std::string name, std::function<void()> func)
+    {
+        Registry().push_back({name, func});
+    }
+};
+
+class Timer
+{
+  public:
+    Timer() : start_{std::chrono::steady_clock::now()} {}
+    double Seconds() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                             start_)
+            .count();
+    }
+
+  private:
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Runs func `iterations` times and returns the best wall time in seconds.
+inline double Best(int iterations, std::function<void()> func)
+{
+    double best = 1e30;
+    for (int i = 0; i < iterations; i++)
+    {
+        Timer t;
+        func();
+        double secs = t.Seconds();
+        if (secs < best)
+            best = secs;
+    }
+    return best;
+}
+
+// Heap use, counted by the operator new and delete bench_main.cpp replaces
+// for the whole binary - but only while counting's on, so benches that
+// don't look at it don't pay for it.
+struct Heap
+{
+    size_t allocations;
+    // bytes
+    size_t allocated;
+    size_t freed;
+};
+
+// Zeroes the counts and starts counting, or stops.
+void CountHeap(bool on);
+Heap HeapCounts();
+
+// Runs func once, returning how many heap allocations it made.
+inline size_t CountAllocations(std::function<void()> func)
+{
+    CountHeap(true);
+    func();
+    size_t allocations = HeapCounts().allocations;
+    CountHeap(false);
+    return allocations;
+}
+
+// Runs func once, returning how many last-level cache misses it took in user
+// space, as the CPU counts them - or -1 if there's no counter to read, as in
+// most VMs.
+int64_t CountCacheMisses(std::function<void()> func);
+
+inline void Report(std::string name, double seconds, size_t bytes = 0)
+{
+    std::cout << "  " << name << ": " << seconds * 1000.0 << " ms";
+    if (bytes)
+        std::cout << "  (" << (bytes / (1024.0 * 1024.0)) / seconds
+                  << " MB/s)";
+    std::cout << std::endl;
+}
+
+// Identifiers can't contain digits, so spell numbers out in letters.
+inline std::string Letters(int n)
+{
+    std::string out;
+    do
+    {
+        out += static_cast<char>('a' + n % 26);
+        n /= 26;
+    } while (n);
+    return out;
+}
+
+// Deterministic machine-generated script, roughly `target_bytes` long, made
+// of independent top-level let definitions - the shape of our generated rule
+// files.
+inline std::string GenerateScript(size_t target_bytes)
+{
+    std::string out;
+    out.reserve(target_bytes + 256);
+    for (int i = 0; out.size() < target_bytes; i++)
+    {
+        std::string n = std::to_string(i);
+        std::string id = Letters(i);
+        switch (i % 5)
+        {
+        case 0:
+            out += "let value_" + id + " = (" + n + " + 42) * 3 - " + n +
+                   " / 7;\n";
+            break;
+        case 1:
+            out += "let rule_" + id + " = fn(x, y) {\n    if (x < y) {\n"
+                   "        return x + " + n + ";\n    } else {\n"
+                   "        return y * 2;\n    }\n};\n";
+            break;
+        case 2:
+            out += "let name_" + id + " = \"generated rule number " + n +
+                   "\";\n";
+            break;
+        case 3:
+            out += "let list_" + id + " = [1, 2, " + n + ", \"x\", true];\n";
+            break;
+        case 4:
+            out += "let table_" + id + " = {\"key\": " + n +
+                   ", \"flag\": false, 7: \"seven\"};\n";
+            break;
+        }
+    }
+    return out;
+}
+
+// The shared 4 MB corpus most front-end benchmarks run over.
+inline const std::string &Corpus()
+{
+    static const std::string script = GenerateScript(4 << 20);
+    return script;
+}
+
+} // namespace bench
+
+#define BENCHMARK(name)                                                        \
+    static void name();                                                        \
+    static bench::Registrar name##_registrar{#name, name};                     \
+    static void name()
@@ -0,0 +1,100 @@
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <malloc.h>
+#include <new>
+#include <string>
+
+#include "bench.hpp"
+
+// The heap counts bench::CountHeap turns on and off.
+namespace
+{
+std::atomic<bool> counting{false};
+std::atomic<size_t> allocations{0};
+std::atomic<size_t> allocated{0};
+std::atomic<size_t> freed{0};
+} // namespace
+
+void *operator new(size_t size)
+{
+    if (void *p = std::malloc(size ? size : 1))
+    {
+        if (counting.load(std::memory_order_relaxed))
+        {
+            allocations.fetch_add(1, std::memory_order_relaxed);
+            allocated.fetch_add(malloc_usable_size(p),
+                                std::memory_order_relaxed);
+        }
+        return p;
+    }
+    throw std::bad_alloc{};
+}
+
+void operator delete(void *p) noexcept
+{
+    if (p && counting.load(std::memory_order_relaxed))
+        freed.fetch_add(malloc_usable_size(p), std::memory_order_relaxed);
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept { operator delete(p); }
+
+void bench::CountHeap(bool on)
+{
+    if (on)
+    {
+        allocations = 0;
+        allocated = 0;
+        freed = 0;
+    }
+    counting = on;
+}
+
+bench::Heap bench::HeapCounts()
+{
+    return Heap{allocations.load(), allocated.load(), freed.load()};
+}
+
+int64_t bench::CountCacheMisses(std::function<void()> func)
+{
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof attr);
+    attr.size = sizeof attr;
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    // this thread, on whichever CPU it runs
+    int fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    if (fd < 0)
+        return -1;
+
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    func();
+    ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    uint64_t misses = 0;
+    bool read_them = read(fd, &misses, sizeof misses) == sizeof misses;
+    close(fd);
+    return read_them ? static_cast<int64_t>(misses) : -1;
+}
+
+int main(int argc, char **argv)
+{
+    std::string filter = argc > 1 ? argv[1] : "";
+    for (auto &c : bench::Registry())
+    {
+        if (!filter.empty() && c.name.find(filter) == std::string::npos)
+            continue;
+        std::cout << c.name << std::endl;
+        c.func();
+    }
+}
@@ -0,0 +1,31 @@
+#include <memory>
+#include <thread>
+
+#include "../cache.hpp"
+#include "../parser.hpp"
+#include "../source.hpp"
+#include "../xxhash.hpp"
+#include "bench.hpp"
+
+// What a cache hit costs next to parsing the same script from scratch.
+BENCHMARK(ProgramCache)
+{
+    auto source = source::FromString(bench::Corpus());
+
+    double secs = bench::Best(5, [&]() {
+        auto program = parser::ParseProgramParallel(
+            source, std::thread::hardware_concurrency());
+    });
+    bench::Report("parse, uncached", secs, source->Size());
+
+    secs = bench::Best(20, [&]() { xxhash::Hash64(source->Text()); });
+    bench::Report("xxh64 of the source", secs, source->Size());
+
+    cache::ProgramCache programs{1 << 30};
+    programs.Load(source);
+    secs = bench::Best(20, [&]() {
+        // a fresh copy each time, as a second load of the file would be
+        auto program = programs.Load(source::FromString(bench::Corpus()));
+    });
+    bench::Report("cache hit (copy + hash + compare)", secs, source->Size());
+}
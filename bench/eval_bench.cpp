@@ -0,0 +1,100 @@
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "../evaluator.hpp"
+#include "../lexer.hpp"
+#include "../object.hpp"
+#include "../parser.hpp"
+#include "../pool.hpp"
+#include "../ref.hpp"
+#include "../vm.hpp"
+#include "bench.hpp"
+
+namespace
+{
+
+// Recursive calls with a few locals - dominated by environment lookups.
+const char fib_script[] = R"(
+let add = fn(a, b) { a + b };
+let fib = fn(n) {
+    if (n < 2) { return n; }
+    let left = fib(n - 1);
+    let right = fib(n - 2);
+    add(left, right);
+};
+fib(22);
+)";
+
+// A tight loop of arithmetic on a handful of names - mostly small nodes.
+const char loop_script[] = R"(
+let total = 0;
+for (i = 0; i < 100000; ++i) { let total = total + i * 2 - i / 3; total }
+)";
+
+// What `run` gave, and the heap allocations one more run of it makes -
+// besides the objects and environments it takes from the pools.
+std::string Outcome(const std::string &result, std::function<void()> run)
+{
+    pool::Stats before = pool::GetStats();
+    size_t allocations = bench::CountAllocations(run);
+    pool::Stats after = pool::GetStats();
+    return result + " (" + std::to_string(allocations) + " allocations, " +
+           std::to_string(after.allocations - before.allocations) +
+           " pooled, " + std::to_string(after.reused - before.reused) +
+           " reused)";
+}
+
+} // namespace
+
+BENCHMARK(EvalCalls)
+{
+    auto lex = std::make_shared<lexer::Lexer>(fib_script);
+    parser::Parser parsley{lex};
+    auto program = parsley.ParseProgram();
+    std::string result;
+    auto run = [&]() {
+        auto env = ref::Make<object::Environment>();
+        result = evaluator::Eval(program, env).Inspect();
+    };
+    double secs = bench::Best(3, run);
+    bench::Report("fib(22) = " + Outcome(result, run), secs);
+}
+
+BENCHMARK(EvalLoops)
+{
+    auto lex = std::make_shared<lexer::Lexer>(loop_script);
+    parser::Parser parsley{lex};
+    auto program = parsley.ParseProgram();
+    std::string result;
+    auto run = [&]() {
+        auto env = ref::Make<object::Environment>();
+        result = evaluator::Eval(program, env).Inspect();
+    };
+    double secs = bench::Best(3, run);
+    bench::Report("100000 iterations = " + Outcome(result, run), secs);
+}
+
+// The same scripts compiled to bytecode and run on vm::Machine, for
+// comparing the engines.
+BENCHMARK(VmCalls)
+{
+    auto lex = std::make_shared<lexer::Lexer>(fib_script);
+    parser::Parser parsley{lex};
+    auto program = parsley.ParseProgram();
+    std::string result;
+    auto run = [&]() { result = vm::Machine{}.Run(*program).Inspect(); };
+    double secs = bench::Best(3, run);
+    bench::Report("fib(22) = " + Outcome(result, run), secs);
+}
+
+BENCHMARK(VmLoops)
+{
+    auto lex = std::make_shared<lexer::Lexer>(loop_script);
+    parser::Parser parsley{lex};
+    auto program = parsley.ParseProgram();
+    std::string result;
+    auto run = [&]() { result = vm::Machine{}.Run(*program).Inspect(); };
+    double secs = bench::Best(3, run);
+    bench::Report("100000 iterations = " + Outcome(result, run), secs);
+}
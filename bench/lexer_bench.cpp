@@ -0,0 +1,56 @@
+#include <string>
+
+#include "../lexer.hpp"
+#include "../scan.hpp"
+#include "bench.hpp"
+
+namespace
+{
+
+double LexCorpus(const std::string &script)
+{
+    auto source = source::FromString(script);
+    return bench::Best(5, [&]() {
+        lexer::Lexer lex{source};
+        while (lex.NextToken().type_ != token::EOFF)
+            ;
+    });
+}
+
+} // namespace
+
+BENCHMARK(LexThroughput)
+{
+    const std::string &script = bench::Corpus();
+    scan::Level detected = scan::Detect();
+    for (auto level :
+         {scan::Level::SCALAR, scan::Level::SSE2, scan::Level::AVX2})
+    {
+        if (!scan::Use(level))
+            continue;
+        bench::Report(std::string("lex (") + scan::LevelName(level) + ")",
+                      LexCorpus(script), script.size());
+    }
+    scan::Use(detected);
+}
+
+// Long runs are where the wide scanners pay off - indented, comment-free
+// generated code with long names and string payloads.
+BENCHMARK(LexLongRuns)
+{
+    std::string script;
+    while (script.size() < (4 << 20))
+        script += "                let a_very_long_generated_identifier_name ="
+                  " \"a long string literal payload that goes on for a while"
+                  " before it ends\"; 12345678901234;\n";
+    scan::Level detected = scan::Detect();
+    for (auto level :
+         {scan::Level::SCALAR, scan::Level::SSE2, scan::Level::AVX2})
+    {
+        if (!scan::Use(level))
+            continue;
+        bench::Report(std::string("lex (") + scan::LevelName(level) + ")",
+                      LexCorpus(script), script.size());
+    }
+    scan::Use(detected);
+}
@@ -0,0 +1,149 @@
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "../lexer.hpp"
+#include "../parser.hpp"
+#include "../source.hpp"
+#include "bench.hpp"
+
+BENCHMARK(ParseThroughput)
+{
+    const std::string &script = bench::Corpus();
+    size_t statements = 0;
+    double secs = bench::Best(5, [&]() {
+        auto lex = std::make_shared<lexer::Lexer>(script);
+        parser::Parser parsley{lex};
+        auto program = parsley.ParseProgram();
+        statements = program->statements_.size();
+    });
+    bench::Report("lex+parse " + std::to_string(statements) + " statements",
+                  secs, script.size());
+}
+
+BENCHMARK(ParseParallel)
+{
+    auto source = source::FromString(bench::Corpus());
+    unsigned cores = std::thread::hardware_concurrency();
+    std::cout << "  (" << cores << " hardware threads)\n";
+    for (unsigned threads : {1u, 2u, 4u, 8u})
+    {
+        double secs = bench::Best(5, [&]() {
+            auto program = parser::ParseProgramParallel(source, threads);
+        });
+        bench::Report("parallel lex+parse, " + std::to_string(threads) +
+                          " threads",
+                      secs, source->Size());
+    }
+}
+
+// Operator-dense expressions, so the Pratt loop rather than the statement
+// machinery is what's being timed.
+BENCHMARK(ParseExpressions)
+{
+    std::string script;
+    for (int i = 0; script.size() < (1 << 20); i++)
+    {
+        std::string n = std::to_string(i);
+        script += "a * " + n + " + b[" + n + "] - f(c, " + n +
+                  ") / -d == !e < (g + h) * " + n + " > i;\n";
+    }
+    auto parse = [&]() {
+        auto lex = std::make_shared<lexer::Lexer>(script);
+        parser::Parser parsley{lex};
+        auto program = parsley.ParseProgram();
+    };
+    bench::Report("lex+parse expressions", bench::Best(5, parse),
+                  script.size());
+
+    int64_t misses = bench::CountCacheMisses(parse);
+    if (misses < 0)
+        std::cout << "  cache misses: no hardware counters here\n";
+    else
+        std::cout << "  cache misses: " << misses << " ("
+                  << double(misses) / (script.size() >> 10) << " per KB)\n";
+}
+
+// Pathological machine-generated shapes: deep parens, long runs of prefix
+// operators and long infix/call chains. Past kMaxNesting the last two are
+// errors, but they're still parsed to the end.
+BENCHMARK(ParseDeepNesting)
+{
+    for (int depth : {1000, 100000, 1000000})
+    {
+        std::string parens = std::string(depth, '(') + "x" +
+                             std::string(depth, ')') + ";";
+        std::string prefix = std::string(depth, '!') + "x;";
+        std::string chain = "a";
+        for (int i = 0; i < depth; i++)
+            chain += i % 2 ? " + a" : " * b(c)";
+        chain += ";";
+
+        for (auto const &shape : {std::make_pair("parens", &parens),
+                                  std::make_pair("prefix", &prefix),
+                                  std::make_pair("chain", &chain)})
+        {
+            const std::string &script = *shape.second;
+            double secs = bench::Best(3, [&]() {
+                auto lex = std::make_shared<lexer::Lexer>(script);
+                parser::Parser parsley{lex};
+                auto program = parsley.ParseProgram();
+            });
+            bench::Report(std::string{shape.first} + " depth " +
+                              std::to_string(depth),
+                          secs, script.size());
+        }
+    }
+}
+
+// A library of functions of which a run only calls a few - what lazy bodies
+// are for.
+BENCHMARK(ParseLazyBodies)
+{
+    std::string script;
+    for (int i = 0; script.size() < (4 << 20); i++)
+    {
+        // prefixed so no name comes out as a keyword
+        std::string name = "z" + bench::Letters(i);
+        script += "let " + name + " = fn(a, b) { if (a < b) { return [a, b, \"" +
+                  name + "\"]; } else { let h = {\"k\": a * 2, \"v\": b}; " +
+                  "h[\"k\"] + " + name + "(b, a)[0] } };\n";
+    }
+    auto source = source::FromString(script);
+
+    for (bool lazy : {false, true})
+    {
+        double secs = bench::Best(5, [&]() {
+            auto program = parser::ParseProgramParallel(source, 1, lazy);
+        });
+        bench::Report(lazy ? "lex+parse, lazy bodies"
+                           : "lex+parse, full bodies",
+                      secs, source->Size());
+    }
+}
+
+// One character changed in the middle of a big script: parsing it all again
+// against reparsing around the edit.
+BENCHMARK(ParseIncremental)
+{
+    std::string script = bench::GenerateScript(10 << 20);
+    auto source = source::FromString(script);
+    auto program = parser::ParseProgramParallel(source, 1);
+
+    // the 42 in a `let value_... = (n + 42) * 3 - ...` halfway down
+    size_t offset = script.find("+ 42)", script.size() / 2) + 2;
+    parser::Edit edit{offset, 1, "5"};
+    double secs = bench::Best(3, [&]() {
+        std::string text = script;
+        text.replace(edit.offset, edit.removed, edit.inserted);
+        auto full = parser::ParseProgramParallel(
+            source::FromString(std::move(text)), 1);
+    });
+    bench::Report("full reparse after a 1 char edit", secs, script.size());
+
+    secs = bench::Best(20, [&]() {
+        auto edited = parser::Reparse(*program, edit);
+    });
+    bench::Report("incremental reparse", secs, script.size());
+}
@@ -0,0 +1,47 @@
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include "../lexer.hpp"
+#include "../source.hpp"
+#include "bench.hpp"
+
+namespace
+{
+
+void LexAll(lexer::Lexer &lex)
+{
+    while (lex.NextToken().type_ != token::EOFF)
+        ;
+}
+
+} // namespace
+
+BENCHMARK(ScriptLoad)
+{
+    std::string path = "/tmp/slang_bench_script.slang";
+    std::string script = bench::GenerateScript(16 << 20);
+    {
+        std::ofstream out{path};
+        out << script;
+    }
+
+    double read_secs = bench::Best(5, [&]() {
+        std::ifstream in{path};
+        std::stringstream ss;
+        ss << in.rdbuf();
+        lexer::Lexer lex{ss.str()};
+        LexAll(lex);
+    });
+    bench::Report("ifstream read + copy + lex", read_secs, script.size());
+
+    double map_secs = bench::Best(5, [&]() {
+        lexer::Lexer lex{source::FromFile(path)};
+        LexAll(lex);
+    });
+    bench::Report("mmap + lex", map_secs, script.size());
+
+    std::remove(path.c_str());
+}
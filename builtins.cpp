@@ -2,60 +2,69 @@
 
 #include <algorithm>
 #include <iostream>
-#include <memory>
 #include <sstream>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "evaluator.hpp"
+#include "ref.hpp"
 
 namespace builtin
 {
 
-std::unordered_map<std::string, std::shared_ptr<object::BuiltIn>> built_ins = {
-    {"len", std::make_shared<object::BuiltIn>(
-                [](std::vector<std::shared_ptr<object::Object>> input)
-                    -> std::shared_ptr<object::Object> {
+namespace
+{
+
+// Every interpreter in the process uses these, on whatever thread it's on,
+// so they're shared from the start.
+ref::Ref<object::BuiltIn> Shared(object::BuiltInFunc func)
+{
+    auto builtin = ref::Make<object::BuiltIn>(std::move(func));
+    builtin->Share();
+    return builtin;
+}
+
+} // namespace
+
+std::unordered_map<std::string, ref::Ref<object::BuiltIn>> built_ins = {
+    {"len", Shared(
+                [](std::vector<object::Value> input) -> object::Value {
                     if (input.size() != 1)
                         return evaluator::NewError(
                             "Too many arguments for len - can only accept one");
 
-                    std::shared_ptr<object::String> str_obj =
-                        std::dynamic_pointer_cast<object::String>(input[0]);
+                    object::String *str_obj = input[0].As<object::String>();
                     if (str_obj)
                     {
-                        return std::make_shared<object::Integer>(
-                            str_obj->value_.size());
+                        return object::Value::OfInteger(str_obj->value_.size());
                     }
 
-                    std::shared_ptr<object::Array> array_obj =
-                        std::dynamic_pointer_cast<object::Array>(input[0]);
+                    object::Array *array_obj = input[0].As<object::Array>();
                     if (array_obj)
                     {
-                        return std::make_shared<object::Integer>(
+                        return object::Value::OfInteger(
                             array_obj->elements_.size());
                     }
 
                     return evaluator::NewError(
                         "argument to `len` not supported, got %s",
-                        input[0]->Type());
+                        input[0].Type());
                 })},
     {"head",
-     std::make_shared<object::BuiltIn>(
-         [](std::vector<std::shared_ptr<object::Object>> input)
-             -> std::shared_ptr<object::Object> {
+     Shared(
+         [](std::vector<object::Value> input) -> object::Value {
              if (input.size() != 1)
                  return evaluator::NewError(
                      "Too many arguments for len - can only accept one");
 
-             std::shared_ptr<object::Array> array_obj =
-                 std::dynamic_pointer_cast<object::Array>(input[0]);
+             object::Array *array_obj = input[0].As<object::Array>();
              if (!array_obj)
              {
                  return evaluator::NewError(
                      "argument to `head` must be an array - got %s",
-                     input[0]->Type());
+                     input[0].Type());
              }
 
              if (array_obj->elements_.size() > 0)
@@ -64,27 +73,25 @@ std::unordered_map<std::string, std::shared_ptr<object::BuiltIn>> built_ins = {
              return evaluator::NULLL;
          })},
     {"tail",
-     std::make_shared<object::BuiltIn>(
-         [](std::vector<std::shared_ptr<object::Object>> input)
-             -> std::shared_ptr<object::Object> {
+     Shared(
+         [](std::vector<object::Value> input) -> object::Value {
              if (input.size() != 1)
                  return evaluator::NewError(
                      "Too many arguments for `tail` - can only accept one");
 
-             std::shared_ptr<object::Array> array_obj =
-                 std::dynamic_pointer_cast<object::Array>(input[0]);
+             object::Array *array_obj = input[0].As<object::Array>();
              if (!array_obj)
              {
                  return evaluator::NewError(
                      "argument to `tail` must be an array - got %s",
-                     input[0]->Type());
+                     input[0].Type());
              }
 
              int len_elems = array_obj->elements_.size();
              if (len_elems > 0)
              {
-                 auto return_array = std::make_shared<object::Array>(
-                     std::vector<std::shared_ptr<object::Object>>());
+                 auto return_array = ref::Make<object::Array>(
+                     std::vector<object::Value>());
 
                  for (int i = 1; i < len_elems; i++)
                      return_array->elements_.push_back(array_obj->elements_[i]);
@@ -93,20 +100,18 @@ std::unordered_map<std::string, std::shared_ptr<object::BuiltIn>> built_ins = {
              return evaluator::NULLL;
          })},
     {"last",
-     std::make_shared<object::BuiltIn>(
-         [](std::vector<std::shared_ptr<object::Object>> input)
-             -> std::shared_ptr<object::Object> {
+     Shared(
+         [](std::vector<object::Value> input) -> object::Value {
              if (input.size() != 1)
                  return evaluator::NewError(
                      "Too many arguments for `last` - can only accept one");
 
-             std::shared_ptr<object::Array> array_obj =
-                 std::dynamic_pointer_cast<object::Array>(input[0]);
+             object::Array *array_obj = input[0].As<object::Array>();
              if (!array_obj)
              {
                  return evaluator::NewError(
                      "argument to `last` must be an array - got %s",
-                     input[0]->Type());
+                     input[0].Type());
              }
 
              int len_elems = array_obj->elements_.size();
@@ -118,24 +123,22 @@ std::unordered_map<std::string, std::shared_ptr<object::BuiltIn>> built_ins = {
              return evaluator::NULLL;
          })},
     {"push",
-     std::make_shared<object::BuiltIn>(
-         [](std::vector<std::shared_ptr<object::Object>> input)
-             -> std::shared_ptr<object::Object> {
+     Shared(
+         [](std::vector<object::Value> input) -> object::Value {
              if (input.size() != 2)
                  return evaluator::NewError(
                      "`push` requires two arguments - array and object");
 
-             std::shared_ptr<object::Array> array_obj =
-                 std::dynamic_pointer_cast<object::Array>(input[0]);
+             object::Array *array_obj = input[0].As<object::Array>();
              if (!array_obj)
              {
                  return evaluator::NewError(
                      "argument to `push` must be an array - got %s",
-                     input[0]->Type());
+                     input[0].Type());
              }
 
-             auto return_array = std::make_shared<object::Array>(
-                 std::vector<std::shared_ptr<object::Object>>());
+             auto return_array = ref::Make<object::Array>(
+                 std::vector<object::Value>());
 
              int len_elems = array_obj->elements_.size();
              for (int i = 0; i < len_elems; i++)
@@ -145,13 +148,12 @@ std::unordered_map<std::string, std::shared_ptr<object::BuiltIn>> built_ins = {
 
              return return_array;
          })},
-    {"puts", std::make_shared<object::BuiltIn>(
-                 [](std::vector<std::shared_ptr<object::Object>> args)
-                     -> std::shared_ptr<object::Object> {
+    {"puts", Shared(
+                 [](std::vector<object::Value> args) -> object::Value {
                      std::stringstream out;
                      for (auto &o : args)
                      {
-                         out << o->Inspect();
+                         out << o.Inspect();
                      }
 
                      std::cout << out.str() << std::endl;
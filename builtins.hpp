@@ -1,16 +1,15 @@
 #pragma once
 
-#include <memory>
 #include <string>
 #include <unordered_map>
 
 #include "evaluator.hpp"
 #include "object.hpp"
+#include "ref.hpp"
 
 namespace builtin
 {
 
-extern std::unordered_map<std::string, std::shared_ptr<object::BuiltIn>>
-    built_ins;
+extern std::unordered_map<std::string, ref::Ref<object::BuiltIn>> built_ins;
 
 } // namespace builtin
@@ -0,0 +1,135 @@
+#include "cache.hpp"
+
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "dedup.hpp"
+#include "parser.hpp"
+#include "ref.hpp"
+#include "xxhash.hpp"
+
+namespace cache
+{
+
+namespace
+{
+
+// Parsed trees run to about 16 bytes per byte of source (see the
+// AstFootprint benchmark), on top of the source itself.
+constexpr size_t kTreeBytesPerSourceByte = 16;
+
+// 256 MiB - a few hundred typical scripts
+constexpr size_t kDefaultMaxBytes = 256 << 20;
+
+} // namespace
+
+ProgramCache::ProgramCache(size_t max_bytes) : max_bytes_{max_bytes} {}
+
+size_t ProgramCache::Cost(const source::Buffer &source)
+{
+    return source.Size() * (1 + kTreeBytesPerSourceByte);
+}
+
+ref::Ref<ast::Program> ProgramCache::Load(
+    std::shared_ptr<source::Buffer> source, bool lazy_bodies,
+    bool share_constants)
+{
+    // the options go in as the seed
+    uint64_t seed = (lazy_bodies ? 1 : 0) | (share_constants ? 2 : 0);
+    uint64_t key = xxhash::Hash64(source->Text(), seed);
+    if (auto program = Find(key, *source))
+        return program;
+
+    // Parsed outside the lock - two threads missing on the same script at
+    // once both parse it, and the second insert wins.
+    auto program = parser::ParseProgramParallel(
+        source, std::thread::hardware_concurrency(), lazy_bodies);
+    if (program)
+    {
+        if (share_constants)
+            dedup::ShareConstants(*program);
+        program->Share();
+        Insert(key, Cost(*source), program);
+    }
+    return program;
+}
+
+ref::Ref<ast::Program> ProgramCache::Find(uint64_t key,
+                                          const source::Buffer &src)
+{
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto entry = index_.find(key);
+    // A script changed under its mapping has changed under the program too,
+    // which is no use any more (and can't safely be read).
+    if (entry != index_.end() && entry->second->program->source_->Changed())
+    {
+        stats_.bytes -= entry->second->cost;
+        lru_.erase(entry->second);
+        index_.erase(entry);
+        stats_.entries = lru_.size();
+        entry = index_.end();
+    }
+    // a hash match still has to be the same text
+    if (entry == index_.end() ||
+        entry->second->program->source_->Text() != src.Text())
+    {
+        stats_.misses++;
+        return nullptr;
+    }
+
+    stats_.hits++;
+    lru_.splice(lru_.begin(), lru_, entry->second);
+    return entry->second->program;
+}
+
+void ProgramCache::Insert(uint64_t key, size_t cost,
+                          ref::Ref<ast::Program> program)
+{
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto existing = index_.find(key);
+    if (existing != index_.end())
+    {
+        stats_.bytes -= existing->second->cost;
+        lru_.erase(existing->second);
+        index_.erase(existing);
+    }
+
+    lru_.push_front(Entry{key, cost, std::move(program)});
+    index_[key] = lru_.begin();
+    stats_.bytes += cost;
+
+    // always keep the newest entry, even if it alone is over the bound
+    while (stats_.bytes > max_bytes_ && lru_.size() > 1)
+    {
+        Entry &oldest = lru_.back();
+        stats_.bytes -= oldest.cost;
+        stats_.evictions++;
+        index_.erase(oldest.key);
+        lru_.pop_back();
+    }
+    stats_.entries = lru_.size();
+}
+
+ProgramCache::Stats ProgramCache::GetStats() const
+{
+    std::lock_guard<std::mutex> lock{mutex_};
+    return stats_;
+}
+
+void ProgramCache::Clear()
+{
+    std::lock_guard<std::mutex> lock{mutex_};
+    lru_.clear();
+    index_.clear();
+    stats_ = Stats{};
+}
+
+ProgramCache &Programs()
+{
+    static ProgramCache programs{kDefaultMaxBytes};
+    return programs;
+}
+
+} // namespace cache
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "ast.hpp"
+#include "ref.hpp"
+#include "source.hpp"
+
+namespace cache
+{
+
+// Parsed programs keyed by an XXH64 of their source text, so loading a script
+// that's been seen before skips the lexer and parser entirely. Programs are
+// shared between everyone who loads the same text, so they're handed out
+// ref::Counted::Share()d - treat them as immutable.
+//
+// Bounded by an estimate of the memory each entry holds (its source plus its
+// tree); least recently used entries go first. Safe to share between
+// threads. Scripts that fail to parse aren't cached.
+//
+// A program from a mapped script points into the mapping, so the entry is
+// dropped once source::Buffer::Changed() says the file's been written to.
+// Until the next lookup notices, though, the program itself sees the change:
+// don't write to a script in place while a program made from it is running.
+class ProgramCache
+{
+  public:
+    struct Stats
+    {
+        size_t hits{0};
+        size_t misses{0};
+        size_t evictions{0};
+        size_t entries{0};
+        size_t bytes{0};
+    };
+
+    explicit ProgramCache(size_t max_bytes);
+
+    // The program for `source`'s text - from the cache, or parsed (and
+    // cached) now. nullptr, having reported the errors, if it doesn't parse.
+    // With `share_constants`, dedup::ShareConstants is run on it before it's
+    // shared. Programs parsed with each combination of options are cached
+    // separately.
+    ref::Ref<ast::Program> Load(std::shared_ptr<source::Buffer> source,
+                                bool lazy_bodies = false,
+                                bool share_constants = false);
+
+    Stats GetStats() const;
+    void Clear();
+
+    // what an entry for `source` is charged against the bound
+    static size_t Cost(const source::Buffer &source);
+
+  private:
+    struct Entry
+    {
+        uint64_t key;
+        size_t cost;
+        ref::Ref<ast::Program> program;
+    };
+
+    ref::Ref<ast::Program> Find(uint64_t key, const source::Buffer &src);
+    void Insert(uint64_t key, size_t cost, ref::Ref<ast::Program> program);
+
+    mutable std::mutex mutex_;
+    size_t max_bytes_;
+    Stats stats_;
+    // most recently used at the front
+    std::list<Entry> lru_;
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> index_;
+};
+
+// A process-wide cache, for programs embedding the interpreter that load the
+// same scripts over and over. `slang` itself runs one script per process and
+// doesn't use it: see --emit-ast and --load-ast for skipping the front end
+// across runs.
+ProgramCache &Programs();
+
+} // namespace cache
@@ -0,0 +1,101 @@
+#include "code.hpp"
+
+#include <iomanip>
+#include <sstream>
+
+namespace code
+{
+
+namespace
+{
+
+const Definition kDefinitions[NUM_OPCODES] = {
+    {"CONSTANT", {4, 0}},        {"INTEGER", {8, 0}},
+    {"PUSH_TRUE", {0, 0}},       {"PUSH_FALSE", {0, 0}},
+    {"PUSH_NULL", {0, 0}},       {"POP", {0, 0}},
+    {"ADD", {0, 0}},             {"SUB", {0, 0}},
+    {"MUL", {0, 0}},             {"DIV", {0, 0}},
+    {"LESS", {0, 0}},            {"GREATER", {0, 0}},
+    {"EQUAL", {0, 0}},           {"NOT_EQUAL", {0, 0}},
+    {"NOT", {0, 0}},             {"NEGATE", {0, 0}},
+    {"INCREMENT", {0, 0}},       {"DECREMENT", {0, 0}},
+    {"JUMP", {4, 0}},            {"JUMP_IF_FALSE", {4, 0}},
+    {"GET_LOCAL_OR", {2, 4}},    {"GET_CELL_OR", {2, 4}},
+    {"GET_FREE_OR", {2, 4}},     {"GET_GLOBAL", {4, 0}},
+    {"SET_LOCAL", {2, 0}},       {"SET_CELL", {2, 0}},
+    {"SET_GLOBAL", {4, 0}},      {"ASSIGN_LOCAL_OR", {2, 4}},
+    {"ASSIGN_CELL_OR", {2, 4}},  {"ASSIGN_FREE_OR", {2, 4}},
+    {"ASSIGN_GLOBAL", {4, 0}},   {"CLEAR_LOCAL", {2, 0}},
+    {"NEW_CELL", {2, 0}},        {"ARRAY", {4, 0}},
+    {"HASH_KEY", {0, 0}},        {"HASH", {4, 0}},
+    {"INDEX", {0, 0}},           {"CALL", {2, 0}},
+    {"RETURN", {0, 0}},          {"CLOSURE", {2, 0}},
+};
+
+void Put(std::vector<uint8_t> &code, uint64_t value, int width)
+{
+    // little-endian, whatever the host
+    for (int i = 0; i < width; i++)
+        code.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+uint64_t Get(const uint8_t *at, int width)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < width; i++)
+        value |= static_cast<uint64_t>(at[i]) << (8 * i);
+    return value;
+}
+
+} // namespace
+
+const Definition &Lookup(Opcode op) { return kDefinitions[op]; }
+
+size_t Emit(std::vector<uint8_t> &code, Opcode op, uint64_t a, uint64_t b)
+{
+    size_t offset = code.size();
+    const Definition &def = Lookup(op);
+    code.push_back(op);
+    Put(code, a, def.widths[0]);
+    Put(code, b, def.widths[1]);
+    return offset;
+}
+
+void Patch(std::vector<uint8_t> &code, size_t operand, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+        code[operand + i] = static_cast<uint8_t>(value >> (8 * i));
+}
+
+std::string Disassemble(const Function &function)
+{
+    std::ostringstream out;
+    const std::vector<uint8_t> &code = function.instructions;
+    for (size_t at = 0; at < code.size();)
+    {
+        Opcode op = static_cast<Opcode>(code[at]);
+        if (op >= NUM_OPCODES)
+        {
+            out << std::setw(4) << std::setfill('0') << at << " ???\n";
+            break;
+        }
+        const Definition &def = Lookup(op);
+        out << std::setw(4) << std::setfill('0') << at << ' ' << def.name;
+        at++;
+        for (int width : def.widths)
+        {
+            if (!width)
+                continue;
+            uint64_t operand = Get(&code[at], width);
+            if (op == INTEGER)
+                out << ' ' << static_cast<int64_t>(operand);
+            else
+                out << ' ' << operand;
+            at += width;
+        }
+        out << '\n';
+    }
+    return out.str();
+}
+
+} // namespace code
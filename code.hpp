@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "ast.hpp"
+#include "flat.hpp"
+#include "object.hpp"
+#include "ref.hpp"
+#include "symbol.hpp"
+
+namespace code
+{
+
+// Bytecode for vm::Machine, as made by compiler::Compile. An instruction is
+// a one-byte opcode then its operands, little-endian, at the widths
+// Lookup() gives. Every expression and statement leaves exactly one value on
+// the stack.
+enum Opcode : uint8_t
+{
+    CONSTANT,  // u32 index into the function's constants
+    INTEGER,   // i64
+    PUSH_TRUE,
+    PUSH_FALSE,
+    PUSH_NULL,
+    POP,
+
+    // infix operators: pop right, then left; push the result
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    LESS,
+    GREATER,
+    EQUAL,
+    NOT_EQUAL,
+
+    // prefix operators on the top of the stack
+    NOT,
+    NEGATE,
+    INCREMENT,
+    DECREMENT,
+
+    JUMP,          // u32 absolute target
+    JUMP_IF_FALSE, // u32 absolute target; pops the condition
+
+    // Reading a name tries each scope that declares it, innermost first, as
+    // the tree walker's environment chain does: the _OR forms push the
+    // variable and jump to their u32 target if it's been set, and fall
+    // through to the next scope out if not. The chain always ends at a
+    // global, which falls back to a builtin of that name.
+    GET_LOCAL_OR, // u16 slot, u32 target
+    GET_CELL_OR,  // u16 slot holding a Cell, u32 target
+    GET_FREE_OR,  // u16 index into the closure's captured cells, u32 target
+    GET_GLOBAL,   // u32 global slot
+
+    // let: pop into a variable of the current scope
+    SET_LOCAL,  // u16 slot
+    SET_CELL,   // u16 slot holding a Cell
+    SET_GLOBAL, // u32 global slot
+
+    // ++ and --: copy the top of the stack, leaving it there, into the
+    // variable a read of the name found, trying scopes as the GET_ forms do
+    ASSIGN_LOCAL_OR, // u16 slot, u32 target
+    ASSIGN_CELL_OR,  // u16 slot holding a Cell, u32 target
+    ASSIGN_FREE_OR,  // u16 index into the closure's captured cells, u32 target
+    ASSIGN_GLOBAL,   // u32 global slot
+
+    // a for loop's scope starts empty each time the loop is entered
+    CLEAR_LOCAL, // u16 slot
+    NEW_CELL,    // u16 slot
+
+    ARRAY,    // u32 element count
+    HASH_KEY, // errors unless the top of the stack can be a hash key
+    HASH,     // u32 pair count; keys and values alternate
+    INDEX,
+
+    CALL,    // u16 argument count; the callee's below the arguments
+    RETURN,  // returns the top of the stack from the current function
+    CLOSURE, // u16 index into the function's nested functions
+
+    NUM_OPCODES
+};
+
+struct Definition
+{
+    std::string_view name;
+    // operand widths in bytes, 0 for none
+    uint8_t widths[2];
+};
+
+const Definition &Lookup(Opcode op);
+
+// Appends an instruction, returning its offset.
+size_t Emit(std::vector<uint8_t> &code, Opcode op, uint64_t a = 0,
+            uint64_t b = 0);
+
+// Rewrites the u32 operand at `operand` - for forward jumps.
+void Patch(std::vector<uint8_t> &code, size_t operand, uint32_t value);
+
+template <typename T> inline T Read(const uint8_t *at)
+{
+    T value;
+    std::memcpy(&value, at, sizeof(value));
+    return value;
+}
+
+// Where a closure gets one of its captured cells from when it's made: a
+// slot of the function making it, or one of that function's own captures.
+struct Capture
+{
+    bool local;
+    uint16_t index;
+};
+
+// A compiled function literal, or the top level of a program.
+struct Function
+{
+    std::vector<uint8_t> instructions;
+    std::vector<object::Value> constants;
+    // the function literals inside this one, for CLOSURE
+    std::vector<std::shared_ptr<Function>> functions;
+    std::vector<Capture> captures;
+    // Slots some inner function captures, which hold a Cell rather than
+    // the value itself. Parameters and let names are made cells on entry;
+    // a for loop's are made by NEW_CELL.
+    std::vector<uint16_t> cells;
+    uint16_t num_parameters{0};
+    // parameters, let names, then each for loop's names
+    uint16_t num_locals{0};
+    // the flat tree it was compiled from, and its literal's node there -
+    // kNoNode for the top level
+    std::shared_ptr<const flat::Tree> tree;
+    flat::Index node{flat::kNoNode};
+    // the literal, if it was compiled from the pointer AST rather than an
+    // image
+    ref::Ref<ast::FunctionLiteral> literal;
+    // Set while the literal's body is one the parser only skimmed, which is
+    // parsed and compiled on the first call (see compiler::CompileBody).
+    // Until then `outer` holds the scopes around the literal, outermost
+    // first: each name they define, with its index in captures.
+    bool deferred{false};
+    std::vector<std::vector<std::pair<symbol::Id, uint16_t>>> outer;
+    // the body didn't parse, so calling it is an error
+    bool broken{false};
+};
+
+// One instruction per line, for tests and debugging.
+std::string Disassemble(const Function &function);
+
+} // namespace code
@@ -0,0 +1,960 @@
+#include "compiler.hpp"
+
+#include <algorithm>
+#include <map>
+#include <unordered_set>
+#include <utility>
+
+#include "builtins.hpp"
+#include "parser.hpp"
+#include "ref.hpp"
+#include "resolver.hpp"
+#include "token.hpp"
+
+namespace compiler
+{
+
+uint32_t Globals::Slot(symbol::Id name)
+{
+    auto [slot, inserted] = slots.try_emplace(name, names.size());
+    if (inserted)
+    {
+        names.emplace_back(symbol::Name(name));
+        auto builtin = builtin::built_ins.find(names.back());
+        bool found = builtin != builtin::built_ins.end();
+        builtins.push_back(found ? builtin->second : nullptr);
+    }
+    return slot->second;
+}
+
+namespace
+{
+
+using ast::NodeKind;
+using flat::Index;
+using flat::kNoNode;
+
+template <typename T> T *As(ast::Node *node) { return static_cast<T *>(node); }
+
+// Whether the parser only skimmed the literal's body, leaving it for
+// parser::ParseBody.
+bool Skimmed(const ast::FunctionLiteral &literal)
+{
+    return !literal.body_ && !literal.pending_body_.empty();
+}
+
+// The names read anywhere inside the function literals under a node - a
+// scope's variables that could be captured.
+struct Reads
+{
+    bool Has(symbol::Id name) const { return all || names.count(name); }
+
+    std::unordered_set<symbol::Id> names;
+    // a body the parser only skimmed could read any of them
+    bool all{false};
+};
+
+void ReadsInFunctions(ast::Node *node, Reads &reads, bool in_function = false)
+{
+    if (!node)
+        return;
+    switch (node->kind_)
+    {
+    case NodeKind::IDENTIFIER:
+        if (in_function)
+            reads.names.insert(As<ast::Identifier>(node)->id_);
+        break;
+    case NodeKind::FUNCTION:
+    {
+        auto literal = As<ast::FunctionLiteral>(node);
+        if (Skimmed(*literal))
+            reads.all = true;
+        else
+            ReadsInFunctions(literal->body_.get(), reads, true);
+        break;
+    }
+    default:
+        ast::ForEachChild(node, [&reads, in_function](ast::Node *child) {
+            ReadsInFunctions(child, reads, in_function);
+        });
+    }
+}
+
+// The names `let` defines in the scope node `i` runs in, as
+// resolver::Declared finds them in the pointer AST: not those in function
+// bodies, nor in the scope each for loop makes - only a loop's starting
+// value runs outside it.
+void Declared(const flat::Tree &tree, Index i, std::vector<symbol::Id> &names)
+{
+    std::vector<Index> stack{i};
+    while (!stack.empty())
+    {
+        Index top = stack.back();
+        stack.pop_back();
+        if (top == kNoNode)
+            continue;
+        const flat::Node &node = tree.At(top);
+        switch (node.kind)
+        {
+        case NodeKind::LET:
+            names.push_back(tree.Symbol(tree.At(node.a)));
+            stack.push_back(node.b);
+            break;
+        case NodeKind::FUNCTION:
+            break;
+        case NodeKind::FOR:
+            stack.push_back(tree.List(node.a)[1]);
+            break;
+        default:
+            flat::ForEachChild(tree, top,
+                               [&stack](Index child) {
+                                   stack.push_back(child);
+                               });
+        }
+    }
+}
+
+// ReadsInFunctions for a flat tree, which has no skimmed bodies.
+void ReadsInFunctions(const flat::Tree &tree, Index i, Reads &reads,
+                      bool in_function = false)
+{
+    if (i == kNoNode)
+        return;
+    const flat::Node &node = tree.At(i);
+    switch (node.kind)
+    {
+    case NodeKind::IDENTIFIER:
+        if (in_function)
+            reads.names.insert(tree.Symbol(node));
+        break;
+    case NodeKind::FUNCTION:
+        ReadsInFunctions(tree, node.c, reads, true);
+        break;
+    default:
+        flat::ForEachChild(tree, i, [&tree, &reads, in_function](Index child) {
+            ReadsInFunctions(tree, child, reads, in_function);
+        });
+    }
+}
+
+code::Opcode InfixOpcode(token::TokenType op)
+{
+    switch (op)
+    {
+    case token::PLUS:
+        return code::ADD;
+    case token::MINUS:
+        return code::SUB;
+    case token::ASTERISK:
+        return code::MUL;
+    case token::SLASH:
+        return code::DIV;
+    case token::LT:
+        return code::LESS;
+    case token::GT:
+        return code::GREATER;
+    case token::EQ:
+        return code::EQUAL;
+    default:
+        return code::NOT_EQUAL;
+    }
+}
+
+code::Opcode PrefixOpcode(token::TokenType op)
+{
+    switch (op)
+    {
+    case token::BANG:
+        return code::NOT;
+    case token::MINUS:
+        return code::NEGATE;
+    case token::INCREMENT:
+        return code::INCREMENT;
+    default:
+        return code::DECREMENT;
+    }
+}
+
+// What compiling either sort of tree comes down to: laying out scopes and
+// emitting code. AstCompiler and FlatCompiler each walk their own tree and
+// call these.
+class Generator
+{
+  protected:
+    explicit Generator(Globals &globals) : globals_{globals} {}
+
+    struct FunctionState;
+
+    // The names one environment of the tree walker would hold, each given a
+    // slot in the frame of the function it's in. Top-level names aren't kept
+    // here - they're Globals.
+    struct Scope
+    {
+        enum Kind
+        {
+            GLOBAL,
+            FUNCTION,
+            LOOP
+        };
+        Scope(Kind kind, FunctionState *owner) : kind{kind}, owner{owner} {}
+
+        Kind kind;
+        FunctionState *owner;
+        std::unordered_map<symbol::Id, uint16_t> slots;
+    };
+
+    struct FunctionState
+    {
+        FunctionState(code::Function *function, FunctionState *enclosing)
+            : function{function}, enclosing{enclosing}
+        {
+        }
+
+        code::Function *function;
+        FunctionState *enclosing;
+        // slots holding a Cell
+        std::unordered_set<uint16_t> cells;
+        // the index in function->captures of each outer variable captured
+        std::map<std::pair<const Scope *, symbol::Id>, uint16_t> free;
+    };
+
+    std::vector<uint8_t> &Code() { return function_->function->instructions; }
+
+    size_t Emit(code::Opcode op, uint64_t a = 0, uint64_t b = 0)
+    {
+        return code::Emit(Code(), op, a, b);
+    }
+
+    // Points the jump whose u32 operand is at `operand` here.
+    void Land(size_t operand)
+    {
+        code::Patch(Code(), operand, static_cast<uint32_t>(Code().size()));
+    }
+
+    // Gives each of `names` not in `scope` yet a slot in the frame of the
+    // function the scope's in.
+    void Declare(Scope &scope, const std::vector<symbol::Id> &names)
+    {
+        code::Function &function = *scope.owner->function;
+        for (symbol::Id name : names)
+            if (scope.slots.try_emplace(name, function.num_locals).second)
+                function.num_locals++;
+    }
+
+    // Loop variables live in the enclosing function's frame, and are emptied
+    // (or given new cells) each time the loop's entered, as the tree walker
+    // gives each run of a loop a new environment.
+    void EnterLoop(Scope &scope, const Reads &captured)
+    {
+        for (auto [name, slot] : scope.slots)
+        {
+            if (captured.Has(name))
+            {
+                function_->cells.insert(slot);
+                Emit(code::NEW_CELL, slot);
+            }
+            else
+                Emit(code::CLEAR_LOCAL, slot);
+        }
+        scopes_.push_back(&scope);
+    }
+
+    // Starts on the body of `state`'s function, whose names are all in
+    // `scope`.
+    void EnterFunction(FunctionState &state, Scope &scope,
+                       const Reads &captured)
+    {
+        for (auto [name, slot] : scope.slots)
+            if (captured.Has(name))
+                state.cells.insert(slot);
+        code::Function &function = *state.function;
+        function.cells.assign(state.cells.begin(), state.cells.end());
+        std::sort(function.cells.begin(), function.cells.end());
+
+        function_ = &state;
+        scopes_.push_back(&scope);
+    }
+
+    void LeaveFunction()
+    {
+        Emit(code::RETURN);
+        scopes_.pop_back();
+        function_ = function_->enclosing;
+    }
+
+    void Closure(std::shared_ptr<code::Function> function)
+    {
+        auto &functions = function_->function->functions;
+        functions.push_back(std::move(function));
+        Emit(code::CLOSURE, functions.size() - 1);
+    }
+
+    // Pops into `name` in the innermost scope, where Declared put it.
+    void Store(symbol::Id name)
+    {
+        Scope *scope = scopes_.back();
+        if (scope->kind == Scope::GLOBAL)
+        {
+            Emit(code::SET_GLOBAL, globals_.Slot(name));
+            return;
+        }
+        uint16_t slot = scope->slots.at(name);
+        Emit(function_->cells.count(slot) ? code::SET_CELL : code::SET_LOCAL,
+             slot);
+    }
+
+    // The forms of an instruction reaching a variable wherever it lives.
+    struct Access
+    {
+        code::Opcode local, cell, free, global;
+    };
+
+    void Load(symbol::Id name)
+    {
+        Chain(name, {code::GET_LOCAL_OR, code::GET_CELL_OR, code::GET_FREE_OR,
+                     code::GET_GLOBAL});
+    }
+
+    // Copies the top of the stack into wherever Load(name) would read from.
+    void Assign(symbol::Id name)
+    {
+        Chain(name, {code::ASSIGN_LOCAL_OR, code::ASSIGN_CELL_OR,
+                     code::ASSIGN_FREE_OR, code::ASSIGN_GLOBAL});
+    }
+
+    // Tries every scope `name` could have been defined in by now, innermost
+    // first, then the globals.
+    void Chain(symbol::Id name, const Access &access)
+    {
+        std::vector<size_t> found;
+        for (auto it = scopes_.rbegin(); it != scopes_.rend(); ++it)
+        {
+            const Scope *scope = *it;
+            auto slot = scope->slots.find(name);
+            if (slot == scope->slots.end())
+                continue;
+            size_t at;
+            if (scope->owner != function_)
+                at = Emit(access.free,
+                          Free(function_, scope, name, slot->second));
+            else if (function_->cells.count(slot->second))
+                at = Emit(access.cell, slot->second);
+            else
+                at = Emit(access.local, slot->second);
+            found.push_back(at + 3);
+        }
+        Emit(access.global, globals_.Slot(name));
+        for (size_t operand : found)
+            Land(operand);
+    }
+
+    // Where `function` keeps the cell for `name` in `scope`, which belongs
+    // to a function enclosing it, capturing the cell through each function
+    // in between.
+    uint16_t Free(FunctionState *function, const Scope *scope, symbol::Id name,
+                  uint16_t slot)
+    {
+        auto [free, inserted] = function->free.try_emplace({scope, name}, 0);
+        if (!inserted)
+            return free->second;
+
+        code::Capture capture{true, slot};
+        if (function->enclosing != scope->owner)
+            capture = {false, Free(function->enclosing, scope, name, slot)};
+        auto &captures = function->function->captures;
+        captures.push_back(capture);
+        free->second = captures.size() - 1;
+        return free->second;
+    }
+
+    Globals &globals_;
+    FunctionState *function_{nullptr};
+    std::vector<Scope *> scopes_;
+};
+
+class AstCompiler : Generator
+{
+  public:
+    explicit AstCompiler(Globals &globals) : Generator{globals} {}
+
+    std::shared_ptr<code::Function> Program(const ast::Program &program)
+    {
+        auto main = std::make_shared<code::Function>();
+        FunctionState state{main.get(), nullptr};
+        Scope global{Scope::GLOBAL, &state};
+        function_ = &state;
+        scopes_.push_back(&global);
+
+        if (program.statements_.empty())
+            Emit(code::PUSH_NULL);
+        for (size_t i = 0; i < program.statements_.size(); i++)
+        {
+            if (i)
+                Emit(code::POP);
+            Statement(program.statements_[i].get());
+        }
+        Emit(code::RETURN);
+        return main;
+    }
+
+    // Compiles a body Function deferred, reading the variables around its
+    // literal through the captures Defer gave it.
+    void Deferred(code::Function &function)
+    {
+        function.deferred = false;
+        auto body = parser::ParseBody(*function.literal);
+        if (!body)
+        {
+            function.broken = true;
+            function.outer.clear();
+            return;
+        }
+
+        // the scopes around the literal, each name in them already free
+        FunctionState outside{nullptr, nullptr};
+        FunctionState state{&function, nullptr};
+        Scope global{Scope::GLOBAL, &outside};
+        scopes_.push_back(&global);
+        std::vector<Scope> outer;
+        outer.reserve(function.outer.size());
+        for (auto const &names : function.outer)
+        {
+            Scope &scope = outer.emplace_back(Scope::FUNCTION, &outside);
+            for (auto [name, index] : names)
+            {
+                scope.slots[name] = index;
+                state.free[{&scope, name}] = index;
+            }
+            scopes_.push_back(&scope);
+        }
+        function.outer.clear();
+
+        Body(state, *function.literal, body.get());
+    }
+
+  private:
+    void Statement(ast::Statement *statement)
+    {
+        if (!statement)
+        {
+            Emit(code::PUSH_NULL);
+            return;
+        }
+        switch (statement->kind_)
+        {
+        case NodeKind::LET:
+        {
+            auto let = As<ast::LetStatement>(statement);
+            Expression(let->value_.get());
+            Store(let->name_->id_);
+            Emit(code::PUSH_NULL);
+            break;
+        }
+        case NodeKind::RETURN:
+            Expression(
+                As<ast::ReturnStatement>(statement)->return_value_.get());
+            Emit(code::RETURN);
+            break;
+        case NodeKind::EXPRESSION_STATEMENT:
+            Expression(
+                As<ast::ExpressionStatement>(statement)->expression_.get());
+            break;
+        case NodeKind::BLOCK:
+            Block(As<ast::BlockStatement>(statement));
+            break;
+        case NodeKind::FOR:
+            For(As<ast::ForStatement>(statement));
+            break;
+        default:
+            Emit(code::PUSH_NULL);
+        }
+    }
+
+    // leaves the value of the last statement, as the tree walker returns
+    void Block(ast::BlockStatement *block)
+    {
+        if (!block || block->statements_.empty())
+        {
+            Emit(code::PUSH_NULL);
+            return;
+        }
+        for (size_t i = 0; i < block->statements_.size(); i++)
+        {
+            if (i)
+                Emit(code::POP);
+            Statement(block->statements_[i].get());
+        }
+    }
+
+    void For(ast::ForStatement *loop)
+    {
+        Expression(loop->iterator_value_.get());
+
+        Scope scope{Scope::LOOP, function_};
+        std::vector<symbol::Id> names;
+        if (loop->iterator_)
+            names.push_back(loop->iterator_->id_);
+        resolver::Declared(loop->termination_condition_.get(), names);
+        resolver::Declared(loop->increment_.get(), names);
+        resolver::Declared(loop->body_.get(), names);
+        Declare(scope, names);
+
+        Reads captured;
+        ReadsInFunctions(loop->termination_condition_.get(), captured);
+        ReadsInFunctions(loop->increment_.get(), captured);
+        ReadsInFunctions(loop->body_.get(), captured);
+        EnterLoop(scope, captured);
+        if (loop->iterator_)
+            Store(loop->iterator_->id_);
+        else
+            Emit(code::POP);
+        // the loop's value until the body has run
+        Emit(code::PUSH_NULL);
+
+        size_t head = Code().size();
+        Expression(loop->termination_condition_.get());
+        size_t exit = Emit(code::JUMP_IF_FALSE);
+        Emit(code::POP);
+        Block(loop->body_.get());
+        Expression(loop->increment_.get());
+        Emit(code::POP);
+        Emit(code::JUMP, head);
+        Land(exit + 1);
+        scopes_.pop_back();
+    }
+
+    void Expression(ast::Expression *node)
+    {
+        if (!node)
+        {
+            Emit(code::PUSH_NULL);
+            return;
+        }
+        switch (node->kind_)
+        {
+        case NodeKind::INTEGER:
+            Emit(code::INTEGER, As<ast::IntegerLiteral>(node)->value_);
+            break;
+        case NodeKind::STRING:
+        {
+            auto &constants = function_->function->constants;
+            constants.push_back(ref::Make<object::String>(
+                std::string{As<ast::StringLiteral>(node)->value_}));
+            Emit(code::CONSTANT, constants.size() - 1);
+            break;
+        }
+        case NodeKind::BOOLEAN:
+            Emit(As<ast::BooleanExpression>(node)->value_ ? code::PUSH_TRUE
+                                                          : code::PUSH_FALSE);
+            break;
+        case NodeKind::IDENTIFIER:
+            Load(As<ast::Identifier>(node)->id_);
+            break;
+        case NodeKind::PREFIX:
+        {
+            auto prefix = As<ast::PrefixExpression>(node);
+            code::Opcode op = PrefixOpcode(prefix->token_.type_);
+            ast::Expression *right = prefix->right_.get();
+            Expression(right);
+            Emit(op);
+            // ++ and -- change the variable they're applied to
+            if ((op == code::INCREMENT || op == code::DECREMENT) && right &&
+                right->kind_ == NodeKind::IDENTIFIER)
+                Assign(As<ast::Identifier>(right)->id_);
+            break;
+        }
+        case NodeKind::INFIX:
+        {
+            auto infix = As<ast::InfixExpression>(node);
+            Expression(infix->left_.get());
+            Expression(infix->right_.get());
+            Emit(InfixOpcode(infix->token_.type_));
+            break;
+        }
+        case NodeKind::IF:
+        {
+            auto if_expr = As<ast::IfExpression>(node);
+            Expression(if_expr->condition_.get());
+            size_t otherwise = Emit(code::JUMP_IF_FALSE);
+            Block(if_expr->consequence_.get());
+            size_t end = Emit(code::JUMP);
+            Land(otherwise + 1);
+            // no alternative leaves null, as an empty one does
+            Block(if_expr->alternative_.get());
+            Land(end + 1);
+            break;
+        }
+        case NodeKind::FUNCTION:
+            Function(As<ast::FunctionLiteral>(node));
+            break;
+        case NodeKind::CALL:
+        {
+            auto call = As<ast::CallExpression>(node);
+            Expression(call->function_.get());
+            for (auto &argument : call->arguments_)
+                Expression(argument.get());
+            Emit(code::CALL, call->arguments_.size());
+            break;
+        }
+        case NodeKind::ARRAY:
+        {
+            auto &elements = As<ast::ArrayLiteral>(node)->elements_;
+            for (auto &element : elements)
+                Expression(element.get());
+            Emit(code::ARRAY, elements.size());
+            break;
+        }
+        case NodeKind::HASH:
+        {
+            auto &pairs = As<ast::HashLiteral>(node)->pairs_;
+            for (auto &pair : pairs)
+            {
+                Expression(pair.first.get());
+                Emit(code::HASH_KEY);
+                Expression(pair.second.get());
+            }
+            Emit(code::HASH, pairs.size());
+            break;
+        }
+        case NodeKind::INDEX:
+        {
+            auto index = As<ast::IndexExpression>(node);
+            Expression(index->left_.get());
+            Expression(index->index_.get());
+            Emit(code::INDEX);
+            break;
+        }
+        default:
+            Emit(code::PUSH_NULL);
+        }
+    }
+
+    void Function(ast::FunctionLiteral *literal)
+    {
+        auto proto = std::make_shared<code::Function>();
+        proto->literal = ref::Ref<ast::FunctionLiteral>{literal};
+        proto->num_parameters = literal->parameters_.size();
+
+        if (Skimmed(*literal))
+            Defer(*proto);
+        else if (!literal->body_)
+            proto->broken = true;
+        else
+        {
+            FunctionState state{proto.get(), function_};
+            Body(state, *literal, literal->body_.get());
+        }
+        Closure(std::move(proto));
+    }
+
+    // Leaves the body for CompileBody, capturing every variable around the
+    // literal - ReadsInFunctions has made each one a cell, as the body could
+    // read any of them.
+    void Defer(code::Function &function)
+    {
+        function.deferred = true;
+        FunctionState state{&function, function_};
+        for (const Scope *scope : scopes_)
+        {
+            if (scope->kind == Scope::GLOBAL)
+                continue;
+            auto &names = function.outer.emplace_back();
+            for (auto [name, slot] : scope->slots)
+                names.emplace_back(name, Free(&state, scope, name, slot));
+        }
+    }
+
+    void Body(FunctionState &state, ast::FunctionLiteral &literal,
+              ast::BlockStatement *body)
+    {
+        code::Function &function = *state.function;
+        Scope scope{Scope::FUNCTION, &state};
+        // a repeated parameter name is bound to the last argument
+        for (uint16_t i = 0; i < function.num_parameters; i++)
+            scope.slots[literal.parameters_[i]->id_] = i;
+        function.num_locals = function.num_parameters;
+        std::vector<symbol::Id> names;
+        resolver::Declared(body, names);
+        Declare(scope, names);
+
+        Reads captured;
+        ReadsInFunctions(body, captured);
+        EnterFunction(state, scope, captured);
+        Block(body);
+        LeaveFunction();
+    }
+};
+
+// The compiler for an image, which reads the flat tree as it's mapped.
+class FlatCompiler : Generator
+{
+  public:
+    FlatCompiler(std::shared_ptr<const flat::Tree> tree, Globals &globals)
+        : Generator{globals}, owner_{std::move(tree)}, tree_{*owner_}
+    {
+    }
+
+    std::shared_ptr<code::Function> Program()
+    {
+        auto main = std::make_shared<code::Function>();
+        main->tree = owner_;
+        FunctionState state{main.get(), nullptr};
+        Scope global{Scope::GLOBAL, &state};
+        function_ = &state;
+        scopes_.push_back(&global);
+
+        // a program is a block that doesn't make a scope
+        if (tree_.Root() == kNoNode)
+            Emit(code::PUSH_NULL);
+        else
+            Block(tree_.Root());
+        Emit(code::RETURN);
+        return main;
+    }
+
+  private:
+    void Statement(Index i)
+    {
+        if (i == kNoNode)
+        {
+            Emit(code::PUSH_NULL);
+            return;
+        }
+        const flat::Node &node = tree_.At(i);
+        switch (node.kind)
+        {
+        case NodeKind::LET:
+            Expression(node.b);
+            Store(tree_.Symbol(tree_.At(node.a)));
+            Emit(code::PUSH_NULL);
+            break;
+        case NodeKind::RETURN:
+            Expression(node.a);
+            Emit(code::RETURN);
+            break;
+        case NodeKind::EXPRESSION_STATEMENT:
+            Expression(node.a);
+            break;
+        case NodeKind::BLOCK:
+            Block(i);
+            break;
+        case NodeKind::FOR:
+            For(node);
+            break;
+        default:
+            Emit(code::PUSH_NULL);
+        }
+    }
+
+    void Block(Index i)
+    {
+        if (i == kNoNode || tree_.At(i).b == 0)
+        {
+            Emit(code::PUSH_NULL);
+            return;
+        }
+        const flat::Node &block = tree_.At(i);
+        const Index *statements = tree_.List(block.a);
+        for (Index s = 0; s < block.b; s++)
+        {
+            if (s)
+                Emit(code::POP);
+            Statement(statements[s]);
+        }
+    }
+
+    void For(const flat::Node &loop)
+    {
+        const Index *parts = tree_.List(loop.a);
+        Index iterator = parts[0];
+        Index condition = parts[2];
+        Index increment = parts[3];
+        Index body = parts[4];
+        Expression(parts[1]);
+
+        Scope scope{Scope::LOOP, function_};
+        std::vector<symbol::Id> names;
+        if (iterator != kNoNode)
+            names.push_back(tree_.Symbol(tree_.At(iterator)));
+        Declared(tree_, condition, names);
+        Declared(tree_, increment, names);
+        Declared(tree_, body, names);
+        Declare(scope, names);
+
+        Reads captured;
+        ReadsInFunctions(tree_, condition, captured);
+        ReadsInFunctions(tree_, increment, captured);
+        ReadsInFunctions(tree_, body, captured);
+        EnterLoop(scope, captured);
+        if (iterator != kNoNode)
+            Store(tree_.Symbol(tree_.At(iterator)));
+        else
+            Emit(code::POP);
+        Emit(code::PUSH_NULL);
+
+        size_t head = Code().size();
+        Expression(condition);
+        size_t exit = Emit(code::JUMP_IF_FALSE);
+        Emit(code::POP);
+        Block(body);
+        Expression(increment);
+        Emit(code::POP);
+        Emit(code::JUMP, head);
+        Land(exit + 1);
+        scopes_.pop_back();
+    }
+
+    // Each of the `count` expressions in the list starting at `start`.
+    void Expressions(Index start, Index count)
+    {
+        const Index *items = tree_.List(start);
+        for (Index e = 0; e < count; e++)
+            Expression(items[e]);
+    }
+
+    void Expression(Index i)
+    {
+        if (i == kNoNode)
+        {
+            Emit(code::PUSH_NULL);
+            return;
+        }
+        const flat::Node &node = tree_.At(i);
+        switch (node.kind)
+        {
+        case NodeKind::INTEGER:
+            Emit(code::INTEGER, tree_.IntValue(node));
+            break;
+        case NodeKind::STRING:
+        {
+            auto &constants = function_->function->constants;
+            constants.push_back(
+                ref::Make<object::String>(std::string{tree_.Text(node)}));
+            Emit(code::CONSTANT, constants.size() - 1);
+            break;
+        }
+        case NodeKind::BOOLEAN:
+            Emit(node.a ? code::PUSH_TRUE : code::PUSH_FALSE);
+            break;
+        case NodeKind::IDENTIFIER:
+            Load(tree_.Symbol(node));
+            break;
+        case NodeKind::PREFIX:
+        {
+            code::Opcode op = PrefixOpcode(node.token);
+            Expression(node.a);
+            Emit(op);
+            if ((op == code::INCREMENT || op == code::DECREMENT) &&
+                node.a != kNoNode &&
+                tree_.At(node.a).kind == NodeKind::IDENTIFIER)
+                Assign(tree_.Symbol(tree_.At(node.a)));
+            break;
+        }
+        case NodeKind::INFIX:
+            Expression(node.a);
+            Expression(node.b);
+            Emit(InfixOpcode(node.token));
+            break;
+        case NodeKind::IF:
+        {
+            Expression(node.a);
+            size_t otherwise = Emit(code::JUMP_IF_FALSE);
+            Block(node.b);
+            size_t end = Emit(code::JUMP);
+            Land(otherwise + 1);
+            Block(node.c);
+            Land(end + 1);
+            break;
+        }
+        case NodeKind::FUNCTION:
+            Function(i);
+            break;
+        case NodeKind::CALL:
+            Expression(node.a);
+            Expressions(node.b, node.c);
+            Emit(code::CALL, node.c);
+            break;
+        case NodeKind::ARRAY:
+            Expressions(node.a, node.b);
+            Emit(code::ARRAY, node.b);
+            break;
+        case NodeKind::HASH:
+        {
+            const Index *items = tree_.List(node.a);
+            for (Index p = 0; p < node.b; p++)
+            {
+                Expression(items[2 * p]);
+                Emit(code::HASH_KEY);
+                Expression(items[2 * p + 1]);
+            }
+            Emit(code::HASH, node.b);
+            break;
+        }
+        case NodeKind::INDEX:
+            Expression(node.a);
+            Expression(node.b);
+            Emit(code::INDEX);
+            break;
+        default:
+            Emit(code::PUSH_NULL);
+        }
+    }
+
+    void Function(Index i)
+    {
+        const flat::Node &literal = tree_.At(i);
+        auto proto = std::make_shared<code::Function>();
+        proto->tree = owner_;
+        proto->node = i;
+        proto->num_parameters = literal.b;
+
+        // flattening parses a skimmed body, leaving none if it won't parse
+        Index body = literal.c;
+        if (body == kNoNode)
+            proto->broken = true;
+        else
+        {
+            FunctionState state{proto.get(), function_};
+            Scope scope{Scope::FUNCTION, &state};
+            const Index *parameters = tree_.List(literal.a);
+            for (uint16_t p = 0; p < proto->num_parameters; p++)
+                scope.slots[tree_.Symbol(tree_.At(parameters[p]))] = p;
+            proto->num_locals = proto->num_parameters;
+            std::vector<symbol::Id> names;
+            Declared(tree_, body, names);
+            Declare(scope, names);
+
+            Reads captured;
+            ReadsInFunctions(tree_, body, captured);
+            EnterFunction(state, scope, captured);
+            Block(body);
+            LeaveFunction();
+        }
+        Closure(std::move(proto));
+    }
+
+    // the tree, which every function compiled from it keeps alive
+    std::shared_ptr<const flat::Tree> owner_;
+    const flat::Tree &tree_;
+};
+
+} // namespace
+
+std::shared_ptr<code::Function> Compile(const ast::Program &program,
+                                        Globals &globals)
+{
+    return AstCompiler{globals}.Program(program);
+}
+
+void CompileBody(code::Function &function, Globals &globals)
+{
+    AstCompiler{globals}.Deferred(function);
+}
+
+std::shared_ptr<code::Function> Compile(std::shared_ptr<const flat::Tree> tree,
+                                        Globals &globals)
+{
+    return FlatCompiler{std::move(tree), globals}.Program();
+}
+
+} // namespace compiler
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ast.hpp"
+#include "code.hpp"
+#include "flat.hpp"
+#include "object.hpp"
+#include "ref.hpp"
+#include "symbol.hpp"
+
+namespace compiler
+{
+
+// The top-level names programs have used, each with a slot in the VM's
+// global table. Kept across compiles, so a REPL or piped script can use names
+// an earlier statement defined.
+struct Globals
+{
+    // The slot for `name`, allocating it the first time it's seen.
+    uint32_t Slot(symbol::Id name);
+
+    std::unordered_map<symbol::Id, uint32_t> slots;
+    // by slot
+    std::vector<std::string> names;
+    // the builtin of each slot's name, or null - what reading the slot gives
+    // while nothing's been assigned to it
+    std::vector<ref::Ref<object::BuiltIn>> builtins;
+};
+
+// Compiles `program` to bytecode for vm::Machine: a function of no
+// parameters that leaves the program's result as its return value.
+//
+// Scoping follows the tree walker's environments: a function call and each
+// entry to a for loop make a new scope, `let` defines a name in the innermost
+// one, and a name's read from the innermost scope it's been defined in so
+// far.
+//
+// A function body the parser only skimmed is left as it is, to be compiled
+// by CompileBody on the function's first call. Since nothing can say yet
+// which variables around it the body reads, all of them are kept in cells
+// for it to capture.
+std::shared_ptr<code::Function> Compile(const ast::Program &program,
+                                        Globals &globals);
+
+// Parses and compiles the body Compile left on `function`, marking the
+// function broken if it doesn't parse.
+void CompileBody(code::Function &function, Globals &globals);
+
+// Compiles a flat tree - an image straight out of flat::Load - the same way,
+// without rebuilding the pointer AST. The functions in it keep the tree, to
+// print their source from.
+std::shared_ptr<code::Function> Compile(std::shared_ptr<const flat::Tree> tree,
+                                        Globals &globals);
+
+} // namespace compiler
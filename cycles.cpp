@@ -0,0 +1,130 @@
+#include "cycles.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace cycles
+{
+
+namespace
+{
+
+// the newest tracked thing on this thread, and how many there are
+thread_local Tracked *newest = nullptr;
+thread_local size_t tracking = 0;
+thread_local Stats stats;
+
+} // namespace
+
+Tracked::Tracked(ref::Counted *self) : self_{self}, next_{newest}
+{
+    if (newest)
+        newest->prev_ = this;
+    newest = this;
+    tracking++;
+    made++;
+}
+
+void Tracked::Unlink()
+{
+    if (!linked_)
+        return;
+    if (prev_)
+        prev_->next_ = next_;
+    else
+        newest = next_;
+    if (next_)
+        next_->prev_ = prev_;
+    linked_ = false;
+    tracking--;
+}
+
+void Forget(ref::Counted *counted)
+{
+    if (auto thing = dynamic_cast<Tracked *>(counted))
+        thing->Unlink();
+}
+
+size_t Collect()
+{
+    std::vector<Tracked *> things;
+    things.reserve(tracking);
+    std::unordered_map<ref::Counted *, size_t> index;
+    index.reserve(tracking);
+    for (Tracked *thing = newest; thing; thing = thing->next_)
+    {
+        index.emplace(thing->self_, things.size());
+        things.push_back(thing);
+    }
+
+    // What's left of each one's count once the references the tracked
+    // things hold to each other are taken away: those from outside.
+    std::vector<int64_t> outside(things.size());
+    for (size_t i = 0; i < things.size(); ++i)
+        outside[i] = things[i]->self_->UseCount();
+    std::vector<ref::Counted *> referents;
+    for (Tracked *thing : things)
+    {
+        referents.clear();
+        thing->self_->Referents(referents);
+        for (ref::Counted *referent : referents)
+        {
+            auto it = index.find(referent);
+            if (it != index.end())
+                outside[it->second]--;
+        }
+    }
+
+    // Everything reachable from something referred to from outside lives.
+    std::vector<bool> live(things.size());
+    std::vector<size_t> pending;
+    for (size_t i = 0; i < things.size(); ++i)
+    {
+        if (outside[i] > 0)
+        {
+            live[i] = true;
+            pending.push_back(i);
+        }
+    }
+    while (!pending.empty())
+    {
+        Tracked *thing = things[pending.back()];
+        pending.pop_back();
+        referents.clear();
+        thing->self_->Referents(referents);
+        for (ref::Counted *referent : referents)
+        {
+            auto it = index.find(referent);
+            if (it != index.end() && !live[it->second])
+            {
+                live[it->second] = true;
+                pending.push_back(it->second);
+            }
+        }
+    }
+
+    // Hold the rest while their references are dropped, so none is freed
+    // while another is still dropping its references to it; then let go.
+    std::vector<ref::Ref<ref::Counted>> garbage;
+    for (size_t i = 0; i < things.size(); ++i)
+        if (!live[i])
+            garbage.emplace_back(things[i]->self_);
+    for (auto &counted : garbage)
+        counted->DropReferents();
+    size_t reclaimed = garbage.size();
+    garbage.clear();
+
+    stats.collections++;
+    stats.reclaimed += reclaimed;
+    stats.last_examined = things.size();
+    stats.last_reclaimed = reclaimed;
+    made = 0;
+    threshold = std::max(kMinThreshold, tracking);
+    return reclaimed;
+}
+
+Stats GetStats() { return stats; }
+
+} // namespace cycles
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+
+#include "ref.hpp"
+
+namespace cycles
+{
+
+// A cycle collector for what reference counting can't free: a function kept
+// in the environment it closes over, say, as `let f = fn() { f }` inside a
+// call leaves behind. Things that can hold references to other objects -
+// environments, functions, arrays, hashes, the VM's cells - are tracked on a
+// list per thread. Collect() finds the ones that are referred to only by
+// each other (trial deletion: take away the references they hold to one
+// another, and whatever's left with none, and isn't reachable from something
+// with some, is garbage) and breaks their cycles with DropReferents.
+//
+// Shared things are left out: they're no longer one thread's to free.
+
+// Collections start once this many tracked things have been made, or as many
+// as were left alive after the last one, if that's more.
+constexpr size_t kMinThreshold = 10000;
+
+struct Stats
+{
+    size_t collections{0};
+    // tracked things freed, over all collections
+    size_t reclaimed{0};
+    // the last collection's: how many tracked things it looked at, and how
+    // many of those it freed
+    size_t last_examined{0};
+    size_t last_reclaimed{0};
+};
+
+// The calling thread's counts.
+Stats GetStats();
+
+// Frees the calling thread's unreachable cycles, returning how many tracked
+// things that freed. Only call it where everything tracked that the caller
+// is using is held by a Ref, and so seen as reachable: from an interpreter's
+// calls, not from within a constructor.
+size_t Collect();
+
+// Stops tracking `counted` if it's tracked, as it's being shared.
+void Forget(ref::Counted *counted);
+
+// how many tracked things this thread has made since it last collected, and
+// how many it can make before it collects again
+inline thread_local size_t made = 0;
+inline thread_local size_t threshold = kMinThreshold;
+
+// Collects if enough tracked things have been made since the last time.
+// The same rules as for Collect apply.
+inline void Poll()
+{
+    if (made >= threshold)
+        Collect();
+}
+
+// A base for the things to track, each of which passes itself in.
+class Tracked
+{
+  protected:
+    explicit Tracked(ref::Counted *self);
+    Tracked(const Tracked &) = delete;
+    Tracked &operator=(const Tracked &) = delete;
+    ~Tracked() { Unlink(); }
+
+  private:
+    friend size_t Collect();
+    friend void Forget(ref::Counted *counted);
+
+    void Unlink();
+
+    ref::Counted *self_;
+    // neighbours in the thread's list; linked_ is false once forgotten
+    Tracked *prev_{nullptr};
+    Tracked *next_{nullptr};
+    bool linked_{true};
+};
+
+} // namespace cycles
@@ -0,0 +1,254 @@
+#include "dedup.hpp"
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace dedup
+{
+
+namespace
+{
+
+using ExpressionSlot = ref::Ref<ast::Expression>;
+
+// Walks the program children-first without recursing (expressions nest as
+// deep as the parser allows), swapping each constant subtree for the first
+// identical one it saw.
+class Interner
+{
+  public:
+    Stats Run(ast::Program &program)
+    {
+        for (auto &statement : program.statements_)
+            Push(statement.get());
+
+        while (!stack_.empty())
+        {
+            Frame &top = stack_.back();
+            if (!top.expanded)
+            {
+                top.expanded = true;
+                // `top` is dangling once children are pushed
+                Children(top.node);
+                continue;
+            }
+            ExpressionSlot *slot = top.slot;
+            stack_.pop_back();
+            if (slot)
+                Intern(*slot);
+        }
+        return stats_;
+    }
+
+  private:
+    struct Frame
+    {
+        ast::Node *node;
+        // where an expression hangs from its parent; null for statements
+        ExpressionSlot *slot;
+        bool expanded;
+    };
+
+    void Push(ast::Node *statement)
+    {
+        if (statement)
+            stack_.push_back(Frame{statement, nullptr, false});
+    }
+
+    void Push(ExpressionSlot &slot)
+    {
+        if (slot)
+            stack_.push_back(Frame{slot.get(), &slot, false});
+    }
+
+    template <typename T> static T *As(ast::Node *node)
+    {
+        return static_cast<T *>(node);
+    }
+
+    void Children(ast::Node *node)
+    {
+        using ast::NodeKind;
+        switch (node->kind_)
+        {
+        case NodeKind::PREFIX:
+            Push(As<ast::PrefixExpression>(node)->right_);
+            break;
+        case NodeKind::INFIX:
+        {
+            auto infix = As<ast::InfixExpression>(node);
+            Push(infix->left_);
+            Push(infix->right_);
+            break;
+        }
+        case NodeKind::CALL:
+        {
+            auto call = As<ast::CallExpression>(node);
+            Push(call->function_);
+            for (auto &argument : call->arguments_)
+                Push(argument);
+            break;
+        }
+        case NodeKind::INDEX:
+        {
+            auto index = As<ast::IndexExpression>(node);
+            Push(index->left_);
+            Push(index->index_);
+            break;
+        }
+        case NodeKind::IF:
+        {
+            auto if_expr = As<ast::IfExpression>(node);
+            Push(if_expr->condition_);
+            Push(if_expr->consequence_.get());
+            Push(if_expr->alternative_.get());
+            break;
+        }
+        case NodeKind::FUNCTION:
+            // null while a lazy body is still pending
+            Push(As<ast::FunctionLiteral>(node)->body_.get());
+            break;
+        case NodeKind::ARRAY:
+            for (auto &element : As<ast::ArrayLiteral>(node)->elements_)
+                Push(element);
+            break;
+        case NodeKind::HASH:
+            for (auto &pair : As<ast::HashLiteral>(node)->pairs_)
+            {
+                Push(pair.first);
+                Push(pair.second);
+            }
+            break;
+        case NodeKind::LET:
+            Push(As<ast::LetStatement>(node)->value_);
+            break;
+        case NodeKind::RETURN:
+            Push(As<ast::ReturnStatement>(node)->return_value_);
+            break;
+        case NodeKind::EXPRESSION_STATEMENT:
+            Push(As<ast::ExpressionStatement>(node)->expression_);
+            break;
+        case NodeKind::BLOCK:
+            for (auto &statement : As<ast::BlockStatement>(node)->statements_)
+                Push(statement.get());
+            break;
+        case NodeKind::FOR:
+        {
+            auto for_loop = As<ast::ForStatement>(node);
+            Push(for_loop->iterator_value_);
+            Push(for_loop->termination_condition_);
+            Push(for_loop->increment_);
+            Push(for_loop->body_.get());
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    // Children have been interned already, so two constant subtrees are
+    // identical exactly when their kind, text and child pointers are.
+    void Intern(ExpressionSlot &slot)
+    {
+        stats_.expressions++;
+        key_.clear();
+        if (!Key(slot.get(), key_))
+            return;
+
+        stats_.constants++;
+        auto [canonical, inserted] = canonical_.try_emplace(key_, slot);
+        if (inserted)
+        {
+            constants_.insert(slot.get());
+            return;
+        }
+        stats_.shared++;
+        slot = canonical->second;
+    }
+
+    // The interning key for a constant `node`; false if it isn't one.
+    bool Key(ast::Expression *node, std::string &key) const
+    {
+        using ast::NodeKind;
+        switch (node->kind_)
+        {
+        case NodeKind::INTEGER:
+            return Leaf('i', node->token_.literal_, key);
+        case NodeKind::STRING:
+            return Leaf('s', As<ast::StringLiteral>(node)->value_, key);
+        case NodeKind::BOOLEAN:
+            return Leaf('b', node->token_.literal_, key);
+        case NodeKind::PREFIX:
+        {
+            auto prefix = As<ast::PrefixExpression>(node);
+            return Leaf('p', prefix->operator_, key) &&
+                   Child(prefix->right_, key);
+        }
+        case NodeKind::INFIX:
+        {
+            auto infix = As<ast::InfixExpression>(node);
+            return Leaf('n', infix->operator_, key) &&
+                   Child(infix->left_, key) && Child(infix->right_, key);
+        }
+        case NodeKind::INDEX:
+        {
+            auto index = As<ast::IndexExpression>(node);
+            return Leaf('x', {}, key) && Child(index->left_, key) &&
+                   Child(index->index_, key);
+        }
+        case NodeKind::ARRAY:
+            Leaf('a', {}, key);
+            for (auto const &element : As<ast::ArrayLiteral>(node)->elements_)
+                if (!Child(element, key))
+                    return false;
+            return true;
+        case NodeKind::HASH:
+            Leaf('h', {}, key);
+            for (auto const &pair : As<ast::HashLiteral>(node)->pairs_)
+                if (!Child(pair.first, key) || !Child(pair.second, key))
+                    return false;
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // the text is followed by a NUL, which no operator or literal contains
+    static bool Leaf(char kind, std::string_view text, std::string &key)
+    {
+        key += kind;
+        key += text;
+        key += '\0';
+        return true;
+    }
+
+    bool Child(const ExpressionSlot &child, std::string &key) const
+    {
+        if (!child || !constants_.count(child.get()))
+            return false;
+        const ast::Expression *pointer = child.get();
+        key.append(reinterpret_cast<const char *>(&pointer), sizeof(pointer));
+        return true;
+    }
+
+    std::vector<Frame> stack_;
+    // reused between nodes; only copied into canonical_ for new constants
+    std::string key_;
+    std::unordered_map<std::string, ExpressionSlot> canonical_;
+    // the nodes in canonical_, for telling whether a child is constant
+    std::unordered_set<const ast::Expression *> constants_;
+    Stats stats_;
+};
+
+} // namespace
+
+Stats ShareConstants(ast::Program &program)
+{
+    if (!program.offsets_.empty() || !program.retained_.empty())
+        return Stats{};
+    return Interner{}.Run(program);
+}
+
+} // namespace dedup
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+
+#include "ast.hpp"
+
+namespace dedup
+{
+
+// Hash-consing for constant subtrees. Generated scripts repeat the same
+// literals and constant expressions (hash keys, `60 * 60 * 24`, `[0, 0]`)
+// thousands of times; this makes every occurrence of one point at a single
+// shared node, freeing the copies.
+//
+// Constant means built only from integer, string and boolean literals with
+// prefix, infix, array, hash and index expressions - nothing that reads a
+// name or calls anything, so evaluating a shared node anywhere gives the same
+// result. Bodies of lazily parsed functions aren't parsed yet, and are left
+// alone.
+struct Stats
+{
+    // expressions visited
+    size_t expressions{0};
+    // of those, the roots of constant subtrees (counting nested ones)
+    size_t constants{0};
+    // constant subtrees replaced by an identical one seen earlier
+    size_t shared{0};
+};
+
+// Shares identical constant subtrees across `program`, in place. Nodes then
+// have more than one parent, so treat the program as immutable afterwards.
+//
+// Programs made by parser::Reparse are left as they are. Their statements
+// point into several buffers, each freed once no statement starting in it
+// is left, so a node shared from one statement into another could outlive
+// the text it points into.
+Stats ShareConstants(ast::Program &program);
+
+} // namespace dedup
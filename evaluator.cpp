@@ -1,20 +1,24 @@
 #include <iostream>
 #include <map>
-#include <memory>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include "ast.hpp"
 #include "builtins.hpp"
+#include "cycles.hpp"
 #include "evaluator.hpp"
 #include "object.hpp"
+#include "parser.hpp"
+#include "ref.hpp"
+#include "symbol.hpp"
 
 namespace
 {
-bool IsTruthy(std::shared_ptr<object::Object> obj)
+bool IsTruthy(const object::Value &obj)
 {
     if (obj == evaluator::NULLL)
         return false;
@@ -26,257 +30,272 @@ bool IsTruthy(std::shared_ptr<object::Object> obj)
     return true;
 }
 
-bool IsError(std::shared_ptr<object::Object> obj)
+bool IsError(const object::Value &obj)
 {
-    if (obj)
+    return obj.As<object::Error>() != nullptr;
+}
+
+using BuiltInsBySymbol =
+    std::unordered_map<symbol::Id, ref::Ref<object::BuiltIn>>;
+
+// built_ins re-keyed by symbol id, so a builtin call doesn't hash the name
+ref::Ref<object::BuiltIn> LookupBuiltIn(symbol::Id name)
+{
+    static const BuiltInsBySymbol by_symbol = []() {
+        BuiltInsBySymbol m;
+        for (auto const &it : builtin::built_ins)
+            m.emplace(symbol::Intern(it.first), it.second);
+        return m;
+    }();
+    auto builtin = by_symbol.find(name);
+    if (builtin == by_symbol.end())
+        return nullptr;
+    return builtin->second;
+}
+
+// Where the resolver said `name` would be, carrying on outward by name if
+// that slot's empty; by name from the start if it wasn't resolved.
+object::Value Lookup(const ast::Identifier &name, object::Environment *env)
+{
+    if (name.depth_ != ast::Identifier::kUnresolved)
     {
-        return obj->Type() == object::ERROR_OBJ;
+        object::Environment *scope = env;
+        for (uint16_t hops = name.depth_; hops && scope; hops--)
+            scope = scope->Outer();
+        if (scope && name.slot_ == ast::Identifier::kGlobal)
+            return scope->Get(name.id_);
+        if (scope && name.slot_ < scope->NumSlots())
+        {
+            if (auto const &val = scope->Slot(name.slot_))
+                return val;
+            scope = scope->Outer();
+            return scope ? scope->Get(name.id_) : nullptr;
+        }
     }
-    return false;
+    return env->Get(name.id_);
 }
 
-bool IsHashable(std::shared_ptr<object::Object> obj)
+// Sets `name` in `env`, the innermost environment. False if `env` is shared.
+bool Define(object::Environment &env, const ast::Identifier &name,
+            object::Value val)
 {
-    if (obj->Type() == object::BOOLEAN_OBJ ||
-        obj->Type() == object::INTEGER_OBJ || obj->Type() == object::STRING_OBJ)
-        return true;
-    return false;
+    if (env.IsShared())
+        return false;
+    if (name.depth_ == 0 && name.slot_ < env.NumSlots())
+        env.Slot(name.slot_) = std::move(val);
+    else
+        env.Set(name.id_, std::move(val));
+    return true;
 }
 
-object::HashKey MakeHashKey(std::shared_ptr<object::Object> hashkey)
+// Sets `name` wherever Lookup would have found it. False if that's in a
+// shared environment.
+bool Assign(const ast::Identifier &name, object::Environment *env,
+            object::Value val)
 {
-    std::shared_ptr<object::Boolean> hash_key_bool =
-        std::dynamic_pointer_cast<object::Boolean>(hashkey);
-    if (hash_key_bool)
-        return hash_key_bool->HashKey();
-
-    std::shared_ptr<object::Integer> hash_key_int =
-        std::dynamic_pointer_cast<object::Integer>(hashkey);
-    if (hash_key_int)
-        return hash_key_int->HashKey();
-
-    std::shared_ptr<object::String> hash_key_string =
-        std::dynamic_pointer_cast<object::String>(hashkey);
-    if (hash_key_string)
-        return hash_key_string->HashKey();
-
-    return object::HashKey{};
+    if (name.depth_ != ast::Identifier::kUnresolved)
+    {
+        object::Environment *scope = env;
+        for (uint16_t hops = name.depth_; hops && scope; hops--)
+            scope = scope->Outer();
+        if (scope && name.slot_ < scope->NumSlots() &&
+            scope->Slot(name.slot_))
+        {
+            if (scope->IsShared())
+                return false;
+            scope->Slot(name.slot_) = std::move(val);
+            return true;
+        }
+    }
+    return env->Assign(name.id_, std::move(val));
 }
 
+const char kSharedEnvironment[] = "can't change a shared environment";
+
 } // namespace
 
 namespace evaluator
 {
 
-std::shared_ptr<object::Object> Eval(std::shared_ptr<ast::Node> node,
-                                     std::shared_ptr<object::Environment> env)
+object::Value Eval(ref::Ref<ast::Node> node, ref::Ref<object::Environment> env)
 {
-    std::shared_ptr<ast::Program> prog_node =
-        std::dynamic_pointer_cast<ast::Program>(node);
-    if (prog_node)
-    {
-        return EvalProgram(prog_node->statements_, env);
-    }
+    return Eval(node.get(), std::move(env));
+}
 
-    std::shared_ptr<ast::BlockStatement> block_statement_node =
-        std::dynamic_pointer_cast<ast::BlockStatement>(node);
-    if (block_statement_node)
-    {
-        return EvalBlockStatement(block_statement_node, env);
-    }
+object::Value Eval(ast::Node *raw, ref::Ref<object::Environment> env)
+{
+    using ast::NodeKind;
 
-    std::shared_ptr<ast::ForStatement> for_statement_node =
-        std::dynamic_pointer_cast<ast::ForStatement>(node);
-    if (for_statement_node)
+    if (!raw)
+        return NULLL;
+    switch (raw->kind_)
     {
-        return EvalForStatement(for_statement_node, env);
-    }
+    case NodeKind::PROGRAM:
+        return EvalProgram(static_cast<ast::Program *>(raw)->statements_, env);
+
+    case NodeKind::BLOCK:
+        return EvalBlockStatement(static_cast<ast::BlockStatement *>(raw), env);
+
+    case NodeKind::FOR:
+        return EvalForStatement(static_cast<ast::ForStatement *>(raw), env);
 
-    std::shared_ptr<ast::ExpressionStatement> expr_statement_node =
-        std::dynamic_pointer_cast<ast::ExpressionStatement>(node);
-    if (expr_statement_node)
+    case NodeKind::EXPRESSION_STATEMENT:
+        return Eval(
+            static_cast<ast::ExpressionStatement *>(raw)->expression_.get(),
+            env);
+
+    case NodeKind::RETURN:
     {
-        return Eval(expr_statement_node->expression_, env);
+        auto val = Eval(
+            static_cast<ast::ReturnStatement *>(raw)->return_value_.get(), env);
+        if (IsError(val))
+            return val;
+        return ref::Make<object::ReturnValue>(val);
     }
 
-    std::shared_ptr<ast::ReturnStatement> return_statement_node =
-        std::dynamic_pointer_cast<ast::ReturnStatement>(node);
-    if (return_statement_node)
+    case NodeKind::LET:
     {
-        auto val = Eval(return_statement_node->return_value_, env);
+        auto let_expr = static_cast<ast::LetStatement *>(raw);
+        auto val = Eval(let_expr->value_.get(), env);
         if (IsError(val))
+        {
             return val;
-        return std::make_shared<object::ReturnValue>(val);
+        }
+        if (!Define(*env, *let_expr->name_, val))
+            return NewError(kSharedEnvironment);
+        return NULLL;
     }
 
     // Expressions
-    std::shared_ptr<ast::IntegerLiteral> il =
-        std::dynamic_pointer_cast<ast::IntegerLiteral>(node);
-    if (il)
-    {
-        return std::make_shared<object::Integer>(il->value_);
-    }
+    case NodeKind::INTEGER:
+        return object::Value::OfInteger(
+            static_cast<ast::IntegerLiteral *>(raw)->value_);
 
-    std::shared_ptr<ast::BooleanExpression> be =
-        std::dynamic_pointer_cast<ast::BooleanExpression>(node);
-    if (be)
-    {
-        return NativeBoolToBooleanObject(be->value_);
-    }
+    case NodeKind::BOOLEAN:
+        return NativeBoolToBooleanObject(
+            static_cast<ast::BooleanExpression *>(raw)->value_);
+
+    case NodeKind::STRING:
+        return ref::Make<object::String>(
+            std::string{static_cast<ast::StringLiteral *>(raw)->value_});
 
-    std::shared_ptr<ast::PrefixExpression> pe =
-        std::dynamic_pointer_cast<ast::PrefixExpression>(node);
-    if (pe)
+    case NodeKind::IDENTIFIER:
+        return EvalIdentifier(static_cast<ast::Identifier *>(raw), env);
+
+    case NodeKind::PREFIX:
     {
-        auto right = Eval(pe->right_, env);
+        auto pe = static_cast<ast::PrefixExpression *>(raw);
+        auto right = Eval(pe->right_.get(), env);
         if (IsError(right))
             return right;
-        return EvalPrefixExpression(pe->operator_, right);
+        auto result = EvalPrefixExpression(pe->operator_, right);
+        // ++ and -- change the variable they're applied to
+        if (pe->right_ && pe->right_->kind_ == NodeKind::IDENTIFIER &&
+            result.IsInteger() &&
+            (pe->operator_ == "++" || pe->operator_ == "--") &&
+            !Assign(*static_cast<ast::Identifier *>(pe->right_.get()),
+                    env.get(), result))
+            return NewError(kSharedEnvironment);
+        return result;
     }
 
-    std::shared_ptr<ast::InfixExpression> ie =
-        std::dynamic_pointer_cast<ast::InfixExpression>(node);
-    if (ie)
+    case NodeKind::INFIX:
     {
-        auto left = Eval(ie->left_, env);
+        auto ie = static_cast<ast::InfixExpression *>(raw);
+        auto left = Eval(ie->left_.get(), env);
         if (IsError(left))
             return left;
 
-        auto right = Eval(ie->right_, env);
+        auto right = Eval(ie->right_.get(), env);
         if (IsError(right))
             return right;
 
         return EvalInfixExpression(ie->operator_, left, right);
     }
 
-    std::shared_ptr<ast::IfExpression> if_expr =
-        std::dynamic_pointer_cast<ast::IfExpression>(node);
-    if (if_expr)
-    {
-        return EvalIfExpression(if_expr, env);
-    }
-
-    std::shared_ptr<ast::LetStatement> let_expr =
-        std::dynamic_pointer_cast<ast::LetStatement>(node);
-    if (let_expr)
-    {
-        auto val = Eval(let_expr->value_, env);
-        if (IsError(val))
-        {
-            return val;
-        }
-        env->Set(let_expr->name_->value_, val);
-    }
-
-    std::shared_ptr<ast::Identifier> ident =
-        std::dynamic_pointer_cast<ast::Identifier>(node);
-    if (ident)
-    {
-        return EvalIdentifier(ident, env);
-    }
+    case NodeKind::IF:
+        return EvalIfExpression(static_cast<ast::IfExpression *>(raw), env);
 
-    std::shared_ptr<ast::FunctionLiteral> fn =
-        std::dynamic_pointer_cast<ast::FunctionLiteral>(node);
-    if (fn)
+    case NodeKind::FUNCTION:
     {
-        auto params = fn->parameters_;
-        auto body = fn->body_;
-        return std::make_shared<object::Function>(params, env, body);
+        auto fn = static_cast<ast::FunctionLiteral *>(raw);
+        // a skimmed body is parsed when the function's first called
+        if (!fn->pending_body_.empty())
+            return ref::Make<object::Function>(
+                fn->parameters_, env, nullptr, fn->source_,
+                ref::Ref<ast::FunctionLiteral>{fn});
+        return ref::Make<object::Function>(fn->parameters_, env, fn->body_,
+                                           fn->source_, nullptr, fn->scope_);
     }
 
-    std::shared_ptr<ast::CallExpression> call_expr =
-        std::dynamic_pointer_cast<ast::CallExpression>(node);
-    if (call_expr)
+    case NodeKind::CALL:
     {
-        auto fun = Eval(call_expr->function_, env);
+        auto call_expr = static_cast<ast::CallExpression *>(raw);
+        auto fun = Eval(call_expr->function_.get(), env);
         if (IsError(fun))
             return fun;
 
-        std::vector<std::shared_ptr<object::Object>> args =
+        std::vector<object::Value> args =
             EvalExpressions(call_expr->arguments_, env);
         if (args.size() == 1 && IsError(args[0]))
             return args[0];
 
-        auto func_obj = std::dynamic_pointer_cast<object::Function>(fun);
-        if (func_obj)
-            return ApplyFunction(func_obj, args);
+        if (fun.As<object::Function>() || fun.As<object::BuiltIn>())
+            return ApplyFunction(fun, std::move(args));
 
-        auto builtin_func = std::dynamic_pointer_cast<object::BuiltIn>(fun);
-        if (builtin_func)
-            return ApplyFunction(builtin_func, args);
-
-        return NewError("Not a function object, mate:%s!", fun->Type());
+        return NewError("Not a function object, mate:%s!", fun.Type());
     }
 
-    std::shared_ptr<ast::StringLiteral> sliteral =
-        std::dynamic_pointer_cast<ast::StringLiteral>(node);
-    if (sliteral)
+    case NodeKind::ARRAY:
     {
-        return std::make_shared<object::String>(sliteral->value_);
-    }
-
-    std::shared_ptr<ast::ArrayLiteral> aliteral =
-        std::dynamic_pointer_cast<ast::ArrayLiteral>(node);
-    if (aliteral)
-    {
-        std::vector<std::shared_ptr<object::Object>> elements =
-            EvalExpressions(aliteral->elements_, env);
+        std::vector<object::Value> elements =
+            EvalExpressions(static_cast<ast::ArrayLiteral *>(raw)->elements_,
+                            env);
         if (elements.size() == 1 && IsError(elements[0]))
             return elements[0];
-        return std::make_shared<object::Array>(elements);
+        return ref::Make<object::Array>(std::move(elements));
     }
 
-    std::shared_ptr<ast::IndexExpression> index_x =
-        std::dynamic_pointer_cast<ast::IndexExpression>(node);
-    if (index_x)
+    case NodeKind::INDEX:
     {
-        std::shared_ptr<object::Object> left = Eval(index_x->left_, env);
+        auto index_x = static_cast<ast::IndexExpression *>(raw);
+        object::Value left = Eval(index_x->left_.get(), env);
         if (IsError(left))
             return left;
 
-        std::shared_ptr<object::Object> index = Eval(index_x->index_, env);
+        object::Value index = Eval(index_x->index_.get(), env);
         if (IsError(index))
             return index;
 
         return EvalIndexExpression(left, index);
     }
 
-    std::shared_ptr<ast::HashLiteral> hash_lit =
-        std::dynamic_pointer_cast<ast::HashLiteral>(node);
-    if (hash_lit)
-    {
-        return EvalHashLiteral(hash_lit, env);
+    case NodeKind::HASH:
+        return EvalHashLiteral(static_cast<ast::HashLiteral *>(raw), env);
     }
 
     return NULLL;
 }
 
-std::shared_ptr<object::Object>
-EvalIndexExpression(std::shared_ptr<object::Object> left,
-                    std::shared_ptr<object::Object> index)
+object::Value EvalIndexExpression(const object::Value &left,
+                                  const object::Value &index)
 {
-    if (left->Type() == object::ARRAY_OBJ &&
-        index->Type() == object::INTEGER_OBJ)
+    if (left.As<object::Array>() && index.IsInteger())
         return EvalArrayIndexExpression(left, index);
-    else if (left->Type() == object::HASH_OBJ)
+    else if (left.As<object::Hash>())
         return EvalHashIndexExpression(left, index);
 
-    return NewError("index operation not supported: %s", left->Type());
+    return NewError("index operation not supported: %s", left.Type());
 }
 
-std::shared_ptr<object::Object>
-EvalArrayIndexExpression(std::shared_ptr<object::Object> array_obj,
-                         std::shared_ptr<object::Object> index)
+object::Value EvalArrayIndexExpression(const object::Value &array_obj,
+                                       const object::Value &index)
 {
-    std::shared_ptr<object::Array> my_array =
-        std::dynamic_pointer_cast<object::Array>(array_obj);
-
-    std::shared_ptr<object::Integer> int_obj =
-        std::dynamic_pointer_cast<object::Integer>(index);
-    if (my_array && int_obj)
+    object::Array *my_array = array_obj.As<object::Array>();
+    if (my_array && index.IsInteger())
     {
-        int idx = int_obj->value_;
-        int num_elems = my_array->elements_.size();
+        int64_t idx = index.AsInteger();
+        int64_t num_elems = my_array->elements_.size();
         if (idx >= 0 && idx < num_elems)
             return my_array->elements_[idx];
         else
@@ -285,15 +304,13 @@ EvalArrayIndexExpression(std::shared_ptr<object::Object> array_obj,
     return NewError("Couldn't unpack yer Array OBJ!");
 }
 
-std::shared_ptr<object::Object>
-EvalHashIndexExpression(std::shared_ptr<object::Object> hash_obj,
-                        std::shared_ptr<object::Object> key)
+object::Value EvalHashIndexExpression(const object::Value &hash_obj,
+                                      const object::Value &key)
 {
-    std::shared_ptr<object::Hash> my_hash =
-        std::dynamic_pointer_cast<object::Hash>(hash_obj);
+    object::Hash *my_hash = hash_obj.As<object::Hash>();
 
     if (!IsHashable(key))
-        return NewError("Unusable as hash key: %s", key->Type());
+        return NewError("Unusable as hash key: %s", key.Type());
 
     object::HashKey hashed = MakeHashKey(key);
     auto hpair_it = my_hash->pairs_.find(hashed);
@@ -303,8 +320,8 @@ EvalHashIndexExpression(std::shared_ptr<object::Object> hash_obj,
     return evaluator::NULLL;
 }
 
-std::shared_ptr<object::Object>
-EvalPrefixExpression(std::string op, std::shared_ptr<object::Object> right)
+object::Value EvalPrefixExpression(std::string_view op,
+                                   const object::Value &right)
 {
     if (op.compare("!") == 0)
         return EvalBangOperatorExpression(right);
@@ -315,130 +332,121 @@ EvalPrefixExpression(std::string op, std::shared_ptr<object::Object> right)
     else if (op.compare("--") == 0)
         return EvalDecrementOperatorExpression(right);
     else
-        return NewError("unknown operator: %s %s ", op, right->Type());
+        return NewError("unknown operator: %s %s ", op, right.Type());
 }
 
-std::shared_ptr<object::Object>
-EvalForStatement(std::shared_ptr<ast::ForStatement> for_loop,
-                 std::shared_ptr<object::Environment> env)
+object::Value EvalForStatement(ast::ForStatement *for_loop,
+                               ref::Ref<object::Environment> env)
 {
     std::cout << "I'm A FOR LOOPO!\n";
 
-    std::shared_ptr<object::Environment> new_env =
-        std::make_shared<object::Environment>(env);
+    ref::Ref<object::Environment> new_env =
+        for_loop->scope_
+            ? ref::Make<object::Environment>(env, for_loop->scope_)
+            : ref::Make<object::Environment>(env);
 
-    auto val = Eval(for_loop->iterator_value_, env);
+    auto val = Eval(for_loop->iterator_value_.get(), env);
     if (IsError(val))
     {
         return val;
     }
-    new_env->Set(for_loop->iterator_->value_, val);
+    Define(*new_env, *for_loop->iterator_, val);
 
     std::cout << "SET " << for_loop->iterator_->String() << " with "
-              << val->Inspect() << std::endl;
+              << val.Inspect() << std::endl;
 
-    std::shared_ptr<object::Object> result;
-    while (IsTruthy(Eval(for_loop->termination_condition_, new_env)))
+    object::Value result;
+    while (IsTruthy(Eval(for_loop->termination_condition_.get(), new_env)))
     {
-        result = Eval(for_loop->body_, new_env);
-        Eval(for_loop->increment_, new_env);
+        result = Eval(for_loop->body_.get(), new_env);
+        Eval(for_loop->increment_.get(), new_env);
     }
 
     return result;
 }
 
-std::shared_ptr<object::Object>
-EvalIfExpression(std::shared_ptr<ast::IfExpression> if_expr,
-                 std::shared_ptr<object::Environment> env)
+object::Value EvalIfExpression(ast::IfExpression *if_expr,
+                               ref::Ref<object::Environment> env)
 {
-    auto condition = Eval(if_expr->condition_, env);
+    auto condition = Eval(if_expr->condition_.get(), env);
     if (IsError(condition))
         return condition;
 
     if (IsTruthy(condition))
     {
-        return Eval(if_expr->consequence_, env);
+        return Eval(if_expr->consequence_.get(), env);
     }
     else if (if_expr->alternative_)
     {
-        return Eval(if_expr->alternative_, env);
+        return Eval(if_expr->alternative_.get(), env);
     }
 
     return evaluator::NULLL;
 }
-std::shared_ptr<object::Object>
-EvalInfixExpression(std::string op, std::shared_ptr<object::Object> left,
-                    std::shared_ptr<object::Object> right)
-{
-    if (left->Type() == object::INTEGER_OBJ &&
-        right->Type() == object::INTEGER_OBJ)
-    {
-        auto leftie = std::dynamic_pointer_cast<object::Integer>(left);
-        auto rightie = std::dynamic_pointer_cast<object::Integer>(right);
-        return EvalIntegerInfixExpression(op, leftie, rightie);
-    }
-    else if (left->Type() == object::STRING_OBJ &&
-             right->Type() == object::STRING_OBJ)
-    {
-        auto leftie = std::dynamic_pointer_cast<object::String>(left);
-        auto rightie = std::dynamic_pointer_cast<object::String>(right);
-        return EvalStringInfixExpression(op, leftie, rightie);
-    }
+object::Value EvalInfixExpression(std::string_view op,
+                                  const object::Value &left,
+                                  const object::Value &right)
+{
+    object::String *left_string;
+    object::String *right_string;
+    if (left.IsInteger() && right.IsInteger())
+        return EvalIntegerInfixExpression(op, left.AsInteger(),
+                                          right.AsInteger());
+    else if ((left_string = left.As<object::String>()) &&
+             (right_string = right.As<object::String>()))
+        return EvalStringInfixExpression(op, *left_string, *right_string);
     else if (op.compare("==") == 0)
         return NativeBoolToBooleanObject(left == right);
     else if (op.compare("!=") == 0)
         return NativeBoolToBooleanObject(left != right);
-    else if (left->Type() != right->Type())
+    else if (left.Type() != right.Type())
     {
         std::cerr << "LEFT AND  RIGHT AIN'T CORRECT!\n";
-        return NewError("type mismatch: %s %s %s", left->Type(), op,
-                        right->Type());
+        return NewError("type mismatch: %s %s %s", left.Type(), op,
+                        right.Type());
     }
 
-    return NewError("unknown operator: %s %s %s", left->Type(), op,
-                    right->Type());
+    return NewError("unknown operator: %s %s %s", left.Type(), op,
+                    right.Type());
 }
 
-std::shared_ptr<object::Object>
-EvalIntegerInfixExpression(std::string op,
-                           std::shared_ptr<object::Integer> left,
-                           std::shared_ptr<object::Integer> right)
+object::Value EvalIntegerInfixExpression(std::string_view op, int64_t left,
+                                         int64_t right)
 {
 
     if (op.compare("+") == 0)
-        return std::make_shared<object::Integer>(left->value_ + right->value_);
+        return object::Value::OfInteger(left + right);
     else if (op.compare("-") == 0)
-        return std::make_shared<object::Integer>(left->value_ - right->value_);
+        return object::Value::OfInteger(left - right);
     else if (op.compare("*") == 0)
-        return std::make_shared<object::Integer>(left->value_ * right->value_);
+        return object::Value::OfInteger(left * right);
     else if (op.compare("/") == 0)
-        return std::make_shared<object::Integer>(left->value_ / right->value_);
+        return object::Value::OfInteger(left / right);
     else if (op.compare("<") == 0)
-        return NativeBoolToBooleanObject(left->value_ < right->value_);
+        return NativeBoolToBooleanObject(left < right);
     else if (op.compare(">") == 0)
-        return NativeBoolToBooleanObject(left->value_ > right->value_);
+        return NativeBoolToBooleanObject(left > right);
     else if (op.compare("==") == 0)
-        return NativeBoolToBooleanObject(left->value_ == right->value_);
+        return NativeBoolToBooleanObject(left == right);
     else if (op.compare("!=") == 0)
-        return NativeBoolToBooleanObject(left->value_ != right->value_);
+        return NativeBoolToBooleanObject(left != right);
 
-    return NewError("unknown operator: %s %s %s", left->Type(), op,
-                    right->Type());
+    return NewError("unknown operator: %s %s %s", object::INTEGER_OBJ, op,
+                    object::INTEGER_OBJ);
 }
 
-std::shared_ptr<object::Object>
-EvalStringInfixExpression(std::string op, std::shared_ptr<object::String> left,
-                          std::shared_ptr<object::String> right)
+object::Value EvalStringInfixExpression(std::string_view op,
+                                        const object::String &left,
+                                        const object::String &right)
 {
     if (op.compare("+") != 0)
-        return NewError("unknown operator: %s %s %s", left->Type(), op,
-                        right->Type());
+        return NewError("unknown operator: %s %s %s", object::STRING_OBJ, op,
+                        object::STRING_OBJ);
 
-    return std::make_shared<object::String>(left->value_ + right->value_);
+    return ref::Make<object::String>(left.value_ + right.value_);
 }
 
-std::shared_ptr<object::Object>
-EvalBangOperatorExpression(std::shared_ptr<object::Object> right)
+object::Value EvalBangOperatorExpression(const object::Value &right)
 {
     if (right == TRUE)
         return FALSE;
@@ -450,124 +458,124 @@ EvalBangOperatorExpression(std::shared_ptr<object::Object> right)
         return FALSE;
 }
 
-std::shared_ptr<object::Object>
-EvalMinusPrefixOperatorExpression(std::shared_ptr<object::Object> right)
+object::Value EvalMinusPrefixOperatorExpression(const object::Value &right)
 {
-    std::shared_ptr<object::Integer> i =
-        std::dynamic_pointer_cast<object::Integer>(right);
-    if (!i)
+    if (!right.IsInteger())
     {
-        return NewError("unknown operator: -%s", right->Type());
+        return NewError("unknown operator: -%s", right.Type());
     }
 
-    return std::make_shared<object::Integer>(-i->value_);
+    return object::Value::OfInteger(-right.AsInteger());
 }
 
-std::shared_ptr<object::Object>
-EvalIncrementOperatorExpression(std::shared_ptr<object::Object> right)
+object::Value EvalIncrementOperatorExpression(const object::Value &right)
 {
-    std::shared_ptr<object::Integer> i =
-        std::dynamic_pointer_cast<object::Integer>(right);
-    if (!i)
+    if (!right.IsInteger())
     {
-        return NewError("unknown operator: ++%s", right->Type());
+        return NewError("unknown operator: ++%s", right.Type());
     }
 
-    return std::make_shared<object::Integer>(++(i->value_));
+    return object::Value::OfInteger(right.AsInteger() + 1);
 }
 
-std::shared_ptr<object::Object>
-EvalDecrementOperatorExpression(std::shared_ptr<object::Object> right)
+object::Value EvalDecrementOperatorExpression(const object::Value &right)
 {
-    std::shared_ptr<object::Integer> i =
-        std::dynamic_pointer_cast<object::Integer>(right);
-    if (!i)
+    if (!right.IsInteger())
     {
-        return NewError("unknown operator: --%s", right->Type());
+        return NewError("unknown operator: --%s", right.Type());
     }
 
-    return std::make_shared<object::Integer>(--(i->value_));
+    return object::Value::OfInteger(right.AsInteger() - 1);
 }
 
-std::shared_ptr<object::Object>
-EvalProgram(std::vector<std::shared_ptr<ast::Statement>> const &stmts,
-            std::shared_ptr<object::Environment> env)
+object::Value
+EvalProgram(std::vector<ref::Ref<ast::Statement>> const &stmts,
+            ref::Ref<object::Environment> env)
 {
-    std::shared_ptr<object::Object> result;
+    object::Value result;
     for (auto &s : stmts)
     {
-        result = Eval(s, env);
+        result = Eval(s.get(), env);
 
-        std::shared_ptr<object::ReturnValue> r =
-            std::dynamic_pointer_cast<object::ReturnValue>(result);
-        if (r)
+        if (auto r = result.As<object::ReturnValue>())
             return r->value_;
 
-        std::shared_ptr<object::Error> e =
-            std::dynamic_pointer_cast<object::Error>(result);
-        if (e)
-            return e;
+        if (IsError(result))
+            return result;
     }
 
     return result;
 }
 
-std::shared_ptr<object::Object>
-EvalBlockStatement(std::shared_ptr<ast::BlockStatement> block,
-                   std::shared_ptr<object::Environment> env)
+object::Value EvalBlockStatement(ast::BlockStatement *block,
+                                 ref::Ref<object::Environment> env)
 {
-    std::shared_ptr<object::Object> result;
+    object::Value result;
     for (auto &s : block->statements_)
     {
-        result = Eval(s, env);
-        if (result != evaluator::NULLL)
-        {
-            if (result->Type() == object::RETURN_VALUE_OBJ ||
-                result->Type() == object::ERROR_OBJ)
-                return result;
-        }
+        result = Eval(s.get(), env);
+        if (result.As<object::ReturnValue>() || IsError(result))
+            return result;
     }
     return result;
 }
 
-std::shared_ptr<object::Boolean> NativeBoolToBooleanObject(bool input)
+bool IsHashable(const object::Value &obj)
+{
+    return obj.IsBoolean() || obj.IsInteger() || obj.As<object::String>();
+}
+
+object::HashKey MakeHashKey(const object::Value &hashkey)
+{
+    if (hashkey.IsBoolean())
+        return object::HashKey(object::BOOLEAN_OBJ, hashkey.AsBoolean());
+
+    if (hashkey.IsInteger())
+        return object::HashKey(object::INTEGER_OBJ,
+                               static_cast<uint64_t>(hashkey.AsInteger()));
+
+    if (auto hash_key_string = hashkey.As<object::String>())
+        return hash_key_string->HashKey();
+
+    return object::HashKey{};
+}
+
+object::Value NativeBoolToBooleanObject(bool input)
 {
     if (input)
         return TRUE;
     return FALSE;
 }
 
-std::shared_ptr<object::Object>
-EvalIdentifier(std::shared_ptr<ast::Identifier> ident,
-               std::shared_ptr<object::Environment> env)
+object::Value EvalIdentifier(ast::Identifier *ident,
+                             ref::Ref<object::Environment> env)
 {
-    auto val = env->Get(ident->value_);
+    auto val = Lookup(*ident, env.get());
     if (val)
         return val;
 
-    auto builtin = builtin::built_ins[ident->value_];
+    auto builtin = LookupBuiltIn(ident->id_);
     if (builtin)
         return builtin;
 
     return NewError("identifier not found: %s", ident->value_);
 }
 
-std::shared_ptr<object::Object>
-EvalHashLiteral(std::shared_ptr<ast::HashLiteral> hash_literal,
-                std::shared_ptr<object::Environment> env)
+object::Value EvalHashLiteral(ast::HashLiteral *hash_literal,
+                              ref::Ref<object::Environment> env)
 {
     std::map<object::HashKey, object::HashPair> pairs;
     for (auto const &it : hash_literal->pairs_)
     {
-        std::shared_ptr<object::Object> hashkey = Eval(it.first, env);
+        object::Value hashkey = Eval(it.first.get(), env);
         if (IsError(hashkey))
             return hashkey;
 
         if (!IsHashable(hashkey))
-            return NewError("unusable as hash key: %s", hashkey->Type());
+            return NewError("unusable as hash key: %s", hashkey.Type());
         object::HashKey hashed = MakeHashKey(hashkey);
 
-        std::shared_ptr<object::Object> val = Eval(it.second, env);
+        object::Value val = Eval(it.second.get(), env);
         if (IsError(val))
             return val;
 
@@ -575,57 +583,75 @@ EvalHashLiteral(std::shared_ptr<ast::HashLiteral> hash_literal,
             hashed, object::HashPair{hashkey, val}));
     }
 
-    return std::make_shared<object::Hash>(pairs);
+    return ref::Make<object::Hash>(pairs);
 }
 
-std::vector<std::shared_ptr<object::Object>>
-EvalExpressions(std::vector<std::shared_ptr<ast::Expression>> exps,
-                std::shared_ptr<object::Environment> env)
+std::vector<object::Value>
+EvalExpressions(std::vector<ref::Ref<ast::Expression>> const &exps,
+                ref::Ref<object::Environment> env)
 {
-    std::vector<std::shared_ptr<object::Object>> result;
+    std::vector<object::Value> result;
+    result.reserve(exps.size());
 
     for (auto const &e : exps)
     {
-        auto evaluated = Eval(e, env);
+        auto evaluated = Eval(e.get(), env);
         if (IsError(evaluated))
-            return std::vector<std::shared_ptr<object::Object>>{evaluated};
+            return std::vector<object::Value>{evaluated};
 
-        result.push_back(evaluated);
+        result.push_back(std::move(evaluated));
     }
 
     return result;
 }
 
-std::shared_ptr<object::Object>
-ApplyFunction(std::shared_ptr<object::Object> callable,
-              std::vector<std::shared_ptr<object::Object>> args)
+object::Value ApplyFunction(const object::Value &callable,
+                            std::vector<object::Value> args)
 {
-    std::shared_ptr<object::Function> func =
-        std::dynamic_pointer_cast<object::Function>(callable);
+    object::Function *func = callable.As<object::Function>();
     if (func)
     {
-        auto extended_env = ExtendFunctionEnv(func, args);
-        auto evaluated = Eval(func->body_, extended_env);
+        // between calls, everything in use is held by a Ref
+        cycles::Poll();
+        // held by `callable`, which the caller holds
+        ast::BlockStatement *body = func->body_.get();
+        ref::Ref<ast::BlockStatement> parsed;
+        if (!body && func->literal_)
+        {
+            parsed = parser::ParseBody(*func->literal_);
+            if (!parsed)
+                return NewError("syntax error in function body");
+            body = parsed.get();
+            // a shared function is left as it is; its literal keeps the body
+            if (!func->IsShared())
+            {
+                func->body_ = parsed;
+                func->literal_ = nullptr;
+            }
+        }
+        auto extended_env = ExtendFunctionEnv(*func, args);
+        auto evaluated = Eval(body, extended_env);
         return UnwrapReturnValue(evaluated);
     }
 
-    std::shared_ptr<object::BuiltIn> builtin =
-        std::dynamic_pointer_cast<object::BuiltIn>(callable);
+    object::BuiltIn *builtin = callable.As<object::BuiltIn>();
     if (builtin)
     {
-        return builtin->func_(args);
+        return builtin->func_(std::move(args));
     }
 
     return NewError("Something funky with yer functions, mate!");
 }
 
-std::shared_ptr<object::Environment>
-ExtendFunctionEnv(std::shared_ptr<object::Function> fun,
-                  std::vector<std::shared_ptr<object::Object>> const &args)
+ref::Ref<object::Environment>
+ExtendFunctionEnv(const object::Function &fun,
+                  std::vector<object::Value> const &args)
 {
-    std::shared_ptr<object::Environment> new_env =
-        std::make_shared<object::Environment>(fun->env_);
-    if (fun->parameters_.size() != args.size())
+    ref::Ref<object::Environment> new_env =
+        fun.scope_
+            ? ref::Make<object::Environment>(fun.env_, fun.scope_)
+            : ref::Make<object::Environment>(fun.env_);
+    if (fun.parameters_.size() != args.size())
     {
         std::cerr
             << "Function Eval - args and params not same size, ya numpty!\n";
@@ -635,18 +661,14 @@ ExtendFunctionEnv(std::shared_ptr<object::Function> fun,
     int args_len = args.size();
     for (int i = 0; i < args_len; i++)
     {
-        auto param = fun->parameters_[i];
-        new_env->Set(param->value_, args[i]);
+        Define(*new_env, *fun.parameters_[i], args[i]);
     }
     return new_env;
 }
 
-std::shared_ptr<object::Object>
-UnwrapReturnValue(std::shared_ptr<object::Object> obj)
+object::Value UnwrapReturnValue(object::Value obj)
 {
-    std::shared_ptr<object::ReturnValue> ret =
-        std::dynamic_pointer_cast<object::ReturnValue>(obj);
-    if (ret)
+    if (auto ret = obj.As<object::ReturnValue>())
         return ret->value_;
     return obj;
 }
@@ -691,14 +713,14 @@ void SSprintF(std::ostringstream &msg, const char *format, T value,
 }
 
 template <typename... Args>
-std::shared_ptr<object::Error> NewError(std::string format, Args... args)
+ref::Ref<object::Error> NewError(std::string format, Args... args)
 {
 
     std::ostringstream error_msg;
 
     SSprintF(error_msg, format.c_str(), std::forward<Args>(args)...);
 
-    return std::make_shared<object::Error>(error_msg.str());
+    return ref::Make<object::Error>(error_msg.str());
 }
 
 } // namespace evaluator
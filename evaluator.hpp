@@ -1,104 +1,97 @@
 #pragma once
 
-#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "ast.hpp"
 #include "object.hpp"
+#include "ref.hpp"
 
 namespace evaluator
 {
 
-inline auto const TRUE = std::make_shared<object::Boolean>(true);
-inline auto const FALSE = std::make_shared<object::Boolean>(false);
-inline auto const NULLL = std::make_shared<object::Null>();
+inline const object::Value TRUE = object::Value::OfBoolean(true);
+inline const object::Value FALSE = object::Value::OfBoolean(false);
+inline const object::Value NULLL = object::Value::OfNull();
 
-std::shared_ptr<object::Object> Eval(std::shared_ptr<ast::Node> node,
-                                     std::shared_ptr<object::Environment> env);
+object::Value Eval(ref::Ref<ast::Node> node, ref::Ref<object::Environment> env);
 
-std::shared_ptr<object::Object>
-EvalProgram(std::vector<std::shared_ptr<ast::Statement>> const &stmts,
-            std::shared_ptr<object::Environment> env);
+// The same, on a node someone else holds a reference to. What Eval recurses
+// through: a program may be Share()d, and copying a Ref to each node visited
+// would then take a locked instruction every time.
+object::Value Eval(ast::Node *node, ref::Ref<object::Environment> env);
 
-std::shared_ptr<object::Object>
-EvalBlockStatement(std::shared_ptr<ast::BlockStatement> block,
-                   std::shared_ptr<object::Environment> env);
+object::Value
+EvalProgram(std::vector<ref::Ref<ast::Statement>> const &stmts,
+            ref::Ref<object::Environment> env);
 
-std::shared_ptr<object::Object>
-EvalForStatement(std::shared_ptr<ast::ForStatement> for_loop,
-                 std::shared_ptr<object::Environment> env);
+object::Value EvalBlockStatement(ast::BlockStatement *block,
+                                 ref::Ref<object::Environment> env);
 
-std::shared_ptr<object::Object>
-EvalPrefixExpression(std::string op, std::shared_ptr<object::Object> obj);
+object::Value EvalForStatement(ast::ForStatement *for_loop,
+                               ref::Ref<object::Environment> env);
 
-std::shared_ptr<object::Object>
-EvalInfixExpression(std::string op, std::shared_ptr<object::Object> left,
-                    std::shared_ptr<object::Object> right);
+object::Value EvalPrefixExpression(std::string_view op,
+                                   const object::Value &right);
 
-std::shared_ptr<object::Object>
-EvalIntegerInfixExpression(std::string op,
-                           std::shared_ptr<object::Integer> left,
-                           std::shared_ptr<object::Integer> right);
+object::Value EvalInfixExpression(std::string_view op,
+                                  const object::Value &left,
+                                  const object::Value &right);
 
-std::shared_ptr<object::Object>
-EvalStringInfixExpression(std::string op, std::shared_ptr<object::String> left,
-                          std::shared_ptr<object::String> right);
+object::Value EvalIntegerInfixExpression(std::string_view op, int64_t left,
+                                         int64_t right);
 
-std::shared_ptr<object::Object>
-EvalBangOperatorExpression(std::shared_ptr<object::Object> right);
+object::Value EvalStringInfixExpression(std::string_view op,
+                                        const object::String &left,
+                                        const object::String &right);
 
-std::shared_ptr<object::Object>
-EvalMinusPrefixOperatorExpression(std::shared_ptr<object::Object> right);
+object::Value EvalBangOperatorExpression(const object::Value &right);
 
-std::shared_ptr<object::Object>
-EvalDecrementOperatorExpression(std::shared_ptr<object::Object> right);
+object::Value EvalMinusPrefixOperatorExpression(const object::Value &right);
 
-std::shared_ptr<object::Object>
-EvalIncrementOperatorExpression(std::shared_ptr<object::Object> right);
+object::Value EvalDecrementOperatorExpression(const object::Value &right);
 
-std::shared_ptr<object::Boolean> NativeBoolToBooleanObject(bool input);
+object::Value EvalIncrementOperatorExpression(const object::Value &right);
 
-std::shared_ptr<object::Object>
-EvalIfExpression(std::shared_ptr<ast::IfExpression> if_expr,
-                 std::shared_ptr<object::Environment> env);
+object::Value NativeBoolToBooleanObject(bool input);
 
-std::shared_ptr<object::Object>
-EvalIdentifier(std::shared_ptr<ast::Identifier> ident,
-               std::shared_ptr<object::Environment> env);
+bool IsHashable(const object::Value &obj);
 
-std::shared_ptr<object::Object>
-EvalHashLiteral(std::shared_ptr<ast::HashLiteral> hash_literal,
-                std::shared_ptr<object::Environment> env);
+object::HashKey MakeHashKey(const object::Value &hashkey);
 
-std::shared_ptr<object::Object>
-EvalHashIndexExpression(std::shared_ptr<object::Object> hash_obj,
-                        std::shared_ptr<object::Object> key);
+object::Value EvalIfExpression(ast::IfExpression *if_expr,
+                               ref::Ref<object::Environment> env);
 
-std::shared_ptr<object::Object>
-EvalIndexExpression(std::shared_ptr<object::Object> left,
-                    std::shared_ptr<object::Object> index);
+object::Value EvalIdentifier(ast::Identifier *ident,
+                             ref::Ref<object::Environment> env);
 
-std::shared_ptr<object::Object>
-EvalArrayIndexExpression(std::shared_ptr<object::Object> left,
-                         std::shared_ptr<object::Object> index);
+object::Value EvalHashLiteral(ast::HashLiteral *hash_literal,
+                              ref::Ref<object::Environment> env);
 
-std::vector<std::shared_ptr<object::Object>>
-EvalExpressions(std::vector<std::shared_ptr<ast::Expression>> exps,
-                std::shared_ptr<object::Environment> env);
+object::Value EvalHashIndexExpression(const object::Value &hash_obj,
+                                      const object::Value &key);
 
-std::shared_ptr<object::Object>
-ApplyFunction(std::shared_ptr<object::Object> callable,
-              std::vector<std::shared_ptr<object::Object>> args);
+object::Value EvalIndexExpression(const object::Value &left,
+                                  const object::Value &index);
 
-std::shared_ptr<object::Environment>
-ExtendFunctionEnv(std::shared_ptr<object::Function> fun,
-                  std::vector<std::shared_ptr<object::Object>> const &args);
+object::Value EvalArrayIndexExpression(const object::Value &left,
+                                       const object::Value &index);
 
-std::shared_ptr<object::Object>
-UnwrapReturnValue(std::shared_ptr<object::Object> obj);
+std::vector<object::Value>
+EvalExpressions(std::vector<ref::Ref<ast::Expression>> const &exps,
+                ref::Ref<object::Environment> env);
+
+object::Value ApplyFunction(const object::Value &callable,
+                            std::vector<object::Value> args);
+
+ref::Ref<object::Environment>
+ExtendFunctionEnv(const object::Function &fun,
+                  std::vector<object::Value> const &args);
+
+object::Value UnwrapReturnValue(object::Value obj);
 
 template <typename... Args>
-std::shared_ptr<object::Error> NewError(std::string format, Args... args);
+ref::Ref<object::Error> NewError(std::string format, Args... args);
 
 } // namespace evaluator
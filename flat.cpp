@@ -0,0 +1,826 @@
+#include "flat.hpp"
+
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "parser.hpp"
+#include "ref.hpp"
+#include "resolver.hpp"
+
+namespace flat
+{
+
+std::string_view Tree::Text(const Node &node) const
+{
+    if (!source_ || node.span.offset > source_->Size())
+        return std::string_view{};
+    return source_->Text().substr(node.span.offset, node.span.length);
+}
+
+int64_t Tree::IntValue(const Node &node) const
+{
+    uint64_t bits = static_cast<uint64_t>(node.b) << 32 | node.a;
+    return static_cast<int64_t>(bits);
+}
+
+size_t Tree::Bytes() const
+{
+    return node_storage_.capacity() * sizeof(Node) +
+           extra_storage_.capacity() * sizeof(Index) +
+           symbols_.capacity() * sizeof(symbol::Id);
+}
+
+// Children go in before their parent, so every index a node holds is
+// already final when the node is pushed - the root ends up last.
+class Builder
+{
+  public:
+    Builder(Tree &tree, std::shared_ptr<source::Buffer> source) : tree_{tree}
+    {
+        tree_.source_ = source;
+        if (source)
+            text_ = source->Text();
+    }
+
+    void AddProgram(const ast::Program &program)
+    {
+        // Statements a Reparse carried over point into older buffers than
+        // source_, so each one's literals are placed by where the statement
+        // starts in source_ instead.
+        std::vector<Index> items;
+        items.reserve(program.statements_.size());
+        for (size_t i = 0; i < program.statements_.size(); i++)
+        {
+            const ast::Statement *stmt = program.statements_[i].get();
+            if (i < program.offsets_.size() && stmt)
+            {
+                // the lexer leaves a string's opening quote off its literal
+                size_t quote = stmt->token_.type_ == token::STRING ? 1 : 0;
+                anchor_ = stmt->token_.literal_.data();
+                anchor_offset_ = program.offsets_[i] + quote;
+            }
+            items.push_back(Add(stmt));
+        }
+        Index statements = List(items);
+        Index count = program.statements_.size();
+        tree_.root_ = Push(ast::NodeKind::PROGRAM, token::ILLEGAL, {0, 0},
+                           statements, count);
+        tree_.node_storage_.shrink_to_fit();
+        tree_.extra_storage_.shrink_to_fit();
+        tree_.symbols_.shrink_to_fit();
+
+        tree_.nodes_ = tree_.node_storage_.data();
+        tree_.size_ = tree_.node_storage_.size();
+        tree_.extra_ = tree_.extra_storage_.data();
+        tree_.extra_size_ = tree_.extra_storage_.size();
+    }
+
+  private:
+    Index Add(const ast::Node *node);
+
+    template <typename T>
+    Index AddList(const std::vector<ref::Ref<T>> &nodes)
+    {
+        std::vector<Index> items;
+        items.reserve(nodes.size());
+        for (auto const &n : nodes)
+            items.push_back(Add(n.get()));
+        return List(items);
+    }
+
+    Index List(const std::vector<Index> &items)
+    {
+        Index start = tree_.extra_storage_.size();
+        tree_.extra_storage_.insert(tree_.extra_storage_.end(), items.begin(),
+                                    items.end());
+        return start;
+    }
+
+    // the symbol's entry in the tree's table
+    Index Symbol(symbol::Id id)
+    {
+        auto [entry, added] = symbols_.try_emplace(id, tree_.symbols_.size());
+        if (added)
+            tree_.symbols_.push_back(id);
+        return entry->second;
+    }
+
+    Index Push(ast::NodeKind kind, token::TokenType type, Span span,
+               Index a = kNoNode, Index b = kNoNode, Index c = kNoNode)
+    {
+        tree_.node_storage_.push_back({kind, type, a, b, c, span});
+        return tree_.node_storage_.size() - 1;
+    }
+
+    Index Push(ast::NodeKind kind, const ast::Node &node, Index a = kNoNode,
+               Index b = kNoNode, Index c = kNoNode)
+    {
+        return Push(kind, node.token_.type_, SpanOf(node.token_.literal_), a,
+                    b, c);
+    }
+
+    // Literals from anywhere but the source (hand-built nodes) get an empty
+    // span.
+    Span SpanOf(std::string_view literal) const
+    {
+        if (literal.empty())
+            return Span{0, 0};
+        if (anchor_)
+        {
+            // only trusted if the text there is the literal
+            size_t offset = anchor_offset_ + (literal.data() - anchor_);
+            if (offset < text_.size() &&
+                text_.substr(offset, literal.size()) == literal)
+                return Span{static_cast<uint32_t>(offset),
+                            static_cast<uint32_t>(literal.size())};
+            // not from this statement's text - a node shared with another
+            // one (see dedup.hpp) can still be in the source itself
+        }
+        const char *begin = text_.data();
+        if (literal.data() < begin ||
+            literal.data() + literal.size() > begin + text_.size())
+            return Span{0, 0};
+        return Span{static_cast<uint32_t>(literal.data() - begin),
+                    static_cast<uint32_t>(literal.size())};
+    }
+
+  private:
+    Tree &tree_;
+    std::string_view text_;
+    // the current statement's first token, and its offset in text_
+    const char *anchor_{nullptr};
+    size_t anchor_offset_{0};
+    std::unordered_map<symbol::Id, Index> symbols_;
+};
+
+Index Builder::Add(const ast::Node *node)
+{
+    using ast::NodeKind;
+
+    if (!node)
+        return kNoNode;
+
+    switch (node->kind_)
+    {
+    case NodeKind::IDENTIFIER:
+        return Push(NodeKind::IDENTIFIER, *node,
+                    Symbol(static_cast<const ast::Identifier *>(node)->id_));
+
+    case NodeKind::INTEGER:
+    {
+        auto integer = static_cast<const ast::IntegerLiteral *>(node);
+        uint64_t bits = static_cast<uint64_t>(integer->value_);
+        return Push(NodeKind::INTEGER, *node, static_cast<Index>(bits),
+                    static_cast<Index>(bits >> 32));
+    }
+
+    case NodeKind::STRING:
+        return Push(NodeKind::STRING, *node);
+
+    case NodeKind::BOOLEAN:
+        return Push(
+            NodeKind::BOOLEAN, *node,
+            static_cast<const ast::BooleanExpression *>(node)->value_ ? 1 : 0);
+
+    case NodeKind::PREFIX:
+    {
+        auto prefix = static_cast<const ast::PrefixExpression *>(node);
+        return Push(NodeKind::PREFIX, *node, Add(prefix->right_.get()));
+    }
+
+    case NodeKind::INFIX:
+    {
+        auto infix = static_cast<const ast::InfixExpression *>(node);
+        Index left = Add(infix->left_.get());
+        Index right = Add(infix->right_.get());
+        return Push(NodeKind::INFIX, *node, left, right);
+    }
+
+    case NodeKind::CALL:
+    {
+        auto call = static_cast<const ast::CallExpression *>(node);
+        Index function = Add(call->function_.get());
+        Index arguments = AddList(call->arguments_);
+        return Push(NodeKind::CALL, *node, function, arguments,
+                    call->arguments_.size());
+    }
+
+    case NodeKind::INDEX:
+    {
+        auto index = static_cast<const ast::IndexExpression *>(node);
+        Index left = Add(index->left_.get());
+        Index idx = Add(index->index_.get());
+        return Push(NodeKind::INDEX, *node, left, idx);
+    }
+
+    case NodeKind::IF:
+    {
+        auto if_expr = static_cast<const ast::IfExpression *>(node);
+        Index condition = Add(if_expr->condition_.get());
+        Index consequence = Add(if_expr->consequence_.get());
+        Index alternative = Add(if_expr->alternative_.get());
+        return Push(NodeKind::IF, *node, condition, consequence, alternative);
+    }
+
+    case NodeKind::FUNCTION:
+    {
+        auto function = static_cast<const ast::FunctionLiteral *>(node);
+        Index parameters = AddList(function->parameters_);
+        // A skimmed body is parsed now, as flat trees have no lazy form. It
+        // only fills in the literal's cache, so doesn't change the program.
+        auto literal = const_cast<ast::FunctionLiteral *>(function);
+        Index body = Add(function->pending_body_.empty()
+                             ? function->body_.get()
+                             : parser::ParseBody(*literal).get());
+        return Push(NodeKind::FUNCTION, *node, parameters,
+                    function->parameters_.size(), body);
+    }
+
+    case NodeKind::ARRAY:
+    {
+        auto array = static_cast<const ast::ArrayLiteral *>(node);
+        Index elements = AddList(array->elements_);
+        return Push(NodeKind::ARRAY, *node, elements,
+                    array->elements_.size());
+    }
+
+    case NodeKind::HASH:
+    {
+        auto hash = static_cast<const ast::HashLiteral *>(node);
+        std::vector<Index> items;
+        items.reserve(hash->pairs_.size() * 2);
+        for (auto const &pair : hash->pairs_)
+        {
+            items.push_back(Add(pair.first.get()));
+            items.push_back(Add(pair.second.get()));
+        }
+        return Push(NodeKind::HASH, *node, List(items), hash->pairs_.size());
+    }
+
+    case NodeKind::LET:
+    {
+        auto let = static_cast<const ast::LetStatement *>(node);
+        Index name = Add(let->name_.get());
+        Index value = Add(let->value_.get());
+        return Push(NodeKind::LET, *node, name, value);
+    }
+
+    case NodeKind::RETURN:
+    {
+        auto ret = static_cast<const ast::ReturnStatement *>(node);
+        return Push(NodeKind::RETURN, *node, Add(ret->return_value_.get()));
+    }
+
+    case NodeKind::EXPRESSION_STATEMENT:
+    {
+        auto stmt = static_cast<const ast::ExpressionStatement *>(node);
+        return Push(NodeKind::EXPRESSION_STATEMENT, *node,
+                    Add(stmt->expression_.get()));
+    }
+
+    case NodeKind::BLOCK:
+    {
+        auto block = static_cast<const ast::BlockStatement *>(node);
+        Index statements = AddList(block->statements_);
+        return Push(NodeKind::BLOCK, *node, statements,
+                    block->statements_.size());
+    }
+
+    case NodeKind::FOR:
+    {
+        auto for_loop = static_cast<const ast::ForStatement *>(node);
+        std::vector<Index> parts{
+            Add(for_loop->iterator_.get()),
+            Add(for_loop->iterator_value_.get()),
+            Add(for_loop->termination_condition_.get()),
+            Add(for_loop->increment_.get()),
+            Add(for_loop->body_.get()),
+        };
+        return Push(NodeKind::FOR, *node, List(parts));
+    }
+
+    case NodeKind::PROGRAM:
+        // only ever the root, which AddProgram handles
+        break;
+    }
+    return kNoNode;
+}
+
+Tree Flatten(const ast::Program &program)
+{
+    Tree tree;
+    Builder builder{tree, program.source_};
+    builder.AddProgram(program);
+    return tree;
+}
+
+namespace
+{
+
+class Inflater
+{
+  public:
+    explicit Inflater(const Tree &tree) : tree_{tree} {}
+
+    ref::Ref<ast::Program> Program(Index i)
+    {
+        auto program = ref::Make<ast::Program>();
+        program->source_ = tree_.Source();
+        const Node &node = tree_.At(i);
+        const Index *statements = tree_.List(node.a);
+        for (Index s = 0; s < node.b; s++)
+        {
+            auto stmt = Statement(statements[s]);
+            if (stmt)
+                program->statements_.push_back(stmt);
+        }
+        return program;
+    }
+
+  private:
+    token::Token TokenOf(const Node &node) const
+    {
+        return token::Token{node.token, tree_.Text(node)};
+    }
+
+    ref::Ref<ast::Identifier> Identifier(Index i)
+    {
+        if (i == kNoNode)
+            return nullptr;
+        const Node &node = tree_.At(i);
+        token::Token tok{node.token, tree_.Text(node), tree_.Symbol(node)};
+        return ref::Make<ast::Identifier>(tok, tok.literal_);
+    }
+
+    ref::Ref<ast::BlockStatement> Block(Index i)
+    {
+        if (i == kNoNode)
+            return nullptr;
+        const Node &node = tree_.At(i);
+        auto block = ref::Make<ast::BlockStatement>(TokenOf(node));
+        const Index *statements = tree_.List(node.a);
+        for (Index s = 0; s < node.b; s++)
+        {
+            auto stmt = Statement(statements[s]);
+            if (stmt)
+                block->statements_.push_back(stmt);
+        }
+        return block;
+    }
+
+    std::vector<ref::Ref<ast::Expression>> Expressions(Index start, Index count)
+    {
+        std::vector<ref::Ref<ast::Expression>> out;
+        out.reserve(count);
+        const Index *items = tree_.List(start);
+        for (Index e = 0; e < count; e++)
+            out.push_back(Expression(items[e]));
+        return out;
+    }
+
+  public:
+    ref::Ref<ast::Statement> Statement(Index i);
+    ref::Ref<ast::Expression> Expression(Index i);
+
+  private:
+    const Tree &tree_;
+};
+
+ref::Ref<ast::Statement> Inflater::Statement(Index i)
+{
+    if (i == kNoNode)
+        return nullptr;
+    const Node &node = tree_.At(i);
+
+    switch (node.kind)
+    {
+    case ast::NodeKind::LET:
+    {
+        auto let = ref::Make<ast::LetStatement>(TokenOf(node));
+        let->name_ = Identifier(node.a);
+        let->value_ = Expression(node.b);
+        return let;
+    }
+    case ast::NodeKind::RETURN:
+    {
+        auto ret = ref::Make<ast::ReturnStatement>(TokenOf(node));
+        ret->return_value_ = Expression(node.a);
+        return ret;
+    }
+    case ast::NodeKind::EXPRESSION_STATEMENT:
+    {
+        auto stmt = ref::Make<ast::ExpressionStatement>(TokenOf(node));
+        stmt->expression_ = Expression(node.a);
+        return stmt;
+    }
+    case ast::NodeKind::BLOCK:
+        return Block(i);
+    case ast::NodeKind::FOR:
+    {
+        auto for_loop = ref::Make<ast::ForStatement>(TokenOf(node));
+        const Index *parts = tree_.List(node.a);
+        for_loop->iterator_ = Identifier(parts[0]);
+        for_loop->iterator_value_ = Expression(parts[1]);
+        for_loop->termination_condition_ = Expression(parts[2]);
+        for_loop->increment_ = Expression(parts[3]);
+        for_loop->body_ = Block(parts[4]);
+        return for_loop;
+    }
+    default:
+        return nullptr;
+    }
+}
+
+ref::Ref<ast::Expression> Inflater::Expression(Index i)
+{
+    if (i == kNoNode)
+        return nullptr;
+    const Node &node = tree_.At(i);
+    token::Token tok = TokenOf(node);
+
+    switch (node.kind)
+    {
+    case ast::NodeKind::IDENTIFIER:
+        return Identifier(i);
+    case ast::NodeKind::INTEGER:
+        return ref::Make<ast::IntegerLiteral>(tok, tree_.IntValue(node));
+    case ast::NodeKind::STRING:
+        return ref::Make<ast::StringLiteral>(tok, tok.literal_);
+    case ast::NodeKind::BOOLEAN:
+        return ref::Make<ast::BooleanExpression>(tok, node.a != 0);
+    case ast::NodeKind::PREFIX:
+    {
+        auto prefix = ref::Make<ast::PrefixExpression>(tok, tok.literal_);
+        prefix->right_ = Expression(node.a);
+        return prefix;
+    }
+    case ast::NodeKind::INFIX:
+    {
+        auto infix = ref::Make<ast::InfixExpression>(
+            tok, tok.literal_, Expression(node.a));
+        infix->right_ = Expression(node.b);
+        return infix;
+    }
+    case ast::NodeKind::IF:
+    {
+        auto if_expr = ref::Make<ast::IfExpression>(tok);
+        if_expr->condition_ = Expression(node.a);
+        if_expr->consequence_ = Block(node.b);
+        if_expr->alternative_ = Block(node.c);
+        return if_expr;
+    }
+    case ast::NodeKind::FUNCTION:
+    {
+        auto function = ref::Make<ast::FunctionLiteral>(tok);
+        function->source_ = tree_.Source();
+        const Index *parameters = tree_.List(node.a);
+        for (Index p = 0; p < node.b; p++)
+            function->parameters_.push_back(Identifier(parameters[p]));
+        function->body_ = Block(node.c);
+        return function;
+    }
+    case ast::NodeKind::CALL:
+    {
+        auto call = ref::Make<ast::CallExpression>(tok, Expression(node.a));
+        call->arguments_ = Expressions(node.b, node.c);
+        return call;
+    }
+    case ast::NodeKind::ARRAY:
+        return ref::Make<ast::ArrayLiteral>(tok, Expressions(node.a, node.b));
+    case ast::NodeKind::HASH:
+    {
+        auto hash = ref::Make<ast::HashLiteral>(tok);
+        const Index *items = tree_.List(node.a);
+        for (Index p = 0; p < node.b; p++)
+            hash->pairs_.emplace_back(Expression(items[2 * p]),
+                                      Expression(items[2 * p + 1]));
+        return hash;
+    }
+    case ast::NodeKind::INDEX:
+        return ref::Make<ast::IndexExpression>(tok, Expression(node.a),
+                                               Expression(node.b));
+    default:
+        return nullptr;
+    }
+}
+
+} // namespace
+
+ref::Ref<ast::Program> Inflate(const Tree &tree)
+{
+    if (tree.Root() == kNoNode)
+        return ref::Make<ast::Program>();
+    auto program = Inflater{tree}.Program(tree.Root());
+    resolver::Resolve(*program);
+    return program;
+}
+
+ref::Ref<ast::Expression> Inflate(const Tree &tree, Index i)
+{
+    return Inflater{tree}.Expression(i);
+}
+
+namespace
+{
+
+// An image is this header, then the nodes, the lists, a span per symbol and
+// the literal pool. Every span - node literals and symbol names alike - is
+// an offset from the start of the image, so a mapping of the whole file can
+// stand in for the tree's source buffer.
+struct Header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t root;
+    uint32_t nodes;
+    uint32_t lists;
+    uint32_t symbols;
+    uint32_t pool;
+};
+
+constexpr char kMagic[8] = {'S', 'L', 'A', 'N', 'G', 'A', 'S', 'T'};
+constexpr uint32_t kVersion = 1;
+
+size_t PoolOffset(const Header &header)
+{
+    return sizeof(Header) + size_t{header.nodes} * sizeof(Node) +
+           size_t{header.lists} * sizeof(Index) +
+           size_t{header.symbols} * sizeof(Span);
+}
+
+// Each distinct literal once, at its offset in the image.
+class Pool
+{
+  public:
+    explicit Pool(size_t base) : base_{base} {}
+
+    Span Add(std::string_view text)
+    {
+        if (text.empty())
+            return Span{0, 0};
+        auto [entry, added] = offsets_.try_emplace(text, base_ + text_.size());
+        if (added)
+            text_ += text;
+        return Span{entry->second, static_cast<uint32_t>(text.size())};
+    }
+
+    const std::string &Text() const { return text_; }
+
+  private:
+    size_t base_;
+    std::string text_;
+    std::unordered_map<std::string_view, uint32_t> offsets_;
+};
+
+template <typename T> void Write(std::ostream &out, const T *items, size_t n)
+{
+    out.write(reinterpret_cast<const char *>(items), n * sizeof(T));
+}
+
+} // namespace
+
+bool Save(const Tree &tree, std::ostream &out)
+{
+    Header header;
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.root = tree.root_;
+    header.nodes = tree.size_;
+    header.lists = tree.extra_size_;
+    header.symbols = tree.symbols_.size();
+    header.pool = 0;
+
+    Pool pool{PoolOffset(header)};
+    std::vector<Node> nodes{tree.nodes_, tree.nodes_ + tree.size_};
+    for (Node &node : nodes)
+        node.span = pool.Add(tree.Text(node));
+    std::vector<Span> symbols;
+    symbols.reserve(tree.symbols_.size());
+    for (symbol::Id id : tree.symbols_)
+        symbols.push_back(pool.Add(symbol::Name(id)));
+
+    if (PoolOffset(header) + pool.Text().size() > UINT32_MAX)
+    {
+        std::cerr << "Program too big to save as an image" << std::endl;
+        return false;
+    }
+    header.pool = pool.Text().size();
+
+    Write(out, &header, 1);
+    Write(out, nodes.data(), nodes.size());
+    Write(out, tree.extra_, tree.extra_size_);
+    Write(out, symbols.data(), symbols.size());
+    Write(out, pool.Text().data(), pool.Text().size());
+    out.flush();
+    if (!out)
+    {
+        std::cerr << "Can't write the image" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Checks an image and points a tree at the arrays in it. Nodes come before
+// their parents, so every child index has to be below its parent's - which
+// also rules out cycles - and every child has to be the sort of node its slot
+// holds, as Inflate and the compiler rely on both.
+class Loader
+{
+  public:
+    explicit Loader(std::shared_ptr<source::Buffer> image)
+        : image_{std::move(image)}
+    {
+    }
+
+    std::shared_ptr<Tree> Load()
+    {
+        std::string_view bytes = image_->Text();
+        if (bytes.size() < sizeof(Header))
+            return Fail("too short");
+        Header header;
+        std::memcpy(&header, bytes.data(), sizeof(header));
+        if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0)
+            return Fail("not an AST image");
+        if (header.version != kVersion)
+            return Fail("unsupported version");
+        if (PoolOffset(header) + header.pool != bytes.size())
+            return Fail("truncated");
+        if (reinterpret_cast<uintptr_t>(bytes.data()) % alignof(Node) != 0)
+            return Fail("misaligned");
+
+        auto tree = std::make_shared<Tree>();
+        const char *at = bytes.data() + sizeof(Header);
+        tree->nodes_ = reinterpret_cast<const Node *>(at);
+        tree->size_ = header.nodes;
+        at += size_t{header.nodes} * sizeof(Node);
+        tree->extra_ = reinterpret_cast<const Index *>(at);
+        tree->extra_size_ = header.lists;
+        at += size_t{header.lists} * sizeof(Index);
+        tree->source_ = image_;
+        tree->root_ = header.root;
+        tree_ = tree.get();
+
+        // the one part that can't be used in place: names become this
+        // process's symbol ids
+        tree->symbols_.reserve(header.symbols);
+        for (uint32_t s = 0; s < header.symbols; s++)
+        {
+            Span name;
+            std::memcpy(&name, at + s * sizeof(Span), sizeof(name));
+            if (!InImage(name))
+                return Fail("bad symbol");
+            tree->symbols_.push_back(symbol::Intern(
+                bytes.substr(name.offset, name.length)));
+        }
+
+        for (Index i = 0; i < tree->size_; i++)
+        {
+            if (!Check(i))
+                return Fail("bad node " + std::to_string(i));
+        }
+        if (tree->root_ >= tree->size_ ||
+            tree->At(tree->root_).kind != ast::NodeKind::PROGRAM)
+            return Fail("no program");
+        return tree;
+    }
+
+  private:
+    enum class Slot
+    {
+        EXPRESSION,
+        STATEMENT,
+        IDENTIFIER,
+        BLOCK,
+    };
+
+    bool Check(Index i) const
+    {
+        using ast::NodeKind;
+        const Node &node = tree_->At(i);
+        if (node.token >= token::NUM_TOKEN_TYPES || !InImage(node.span))
+            return false;
+
+        switch (node.kind)
+        {
+        case NodeKind::PROGRAM:
+        case NodeKind::BLOCK:
+            return List(i, node.a, node.b, Slot::STATEMENT);
+        case NodeKind::LET:
+            return node.a != kNoNode && Child(i, node.a, Slot::IDENTIFIER) &&
+                   Child(i, node.b, Slot::EXPRESSION);
+        case NodeKind::RETURN:
+        case NodeKind::EXPRESSION_STATEMENT:
+        case NodeKind::PREFIX:
+            return Child(i, node.a, Slot::EXPRESSION);
+        case NodeKind::FOR:
+        {
+            if (!List(i, node.a, 5, Slot::EXPRESSION, 1, 4))
+                return false;
+            const Index *parts = tree_->List(node.a);
+            return Child(i, parts[0], Slot::IDENTIFIER) &&
+                   Child(i, parts[4], Slot::BLOCK);
+        }
+        case NodeKind::IDENTIFIER:
+            return node.a < tree_->symbols_.size();
+        case NodeKind::INTEGER:
+        case NodeKind::STRING:
+        case NodeKind::BOOLEAN:
+            return true;
+        case NodeKind::INFIX:
+        case NodeKind::INDEX:
+            return Child(i, node.a, Slot::EXPRESSION) &&
+                   Child(i, node.b, Slot::EXPRESSION);
+        case NodeKind::IF:
+            return Child(i, node.a, Slot::EXPRESSION) &&
+                   Child(i, node.b, Slot::BLOCK) &&
+                   Child(i, node.c, Slot::BLOCK);
+        case NodeKind::FUNCTION:
+            return List(i, node.a, node.b, Slot::IDENTIFIER) &&
+                   Child(i, node.c, Slot::BLOCK);
+        case NodeKind::CALL:
+            return Child(i, node.a, Slot::EXPRESSION) &&
+                   List(i, node.b, node.c, Slot::EXPRESSION);
+        case NodeKind::ARRAY:
+            return List(i, node.a, node.b, Slot::EXPRESSION);
+        case NodeKind::HASH:
+            return List(i, node.a, uint64_t{node.b} * 2, Slot::EXPRESSION);
+        default:
+            return false;
+        }
+    }
+
+    bool Child(Index parent, Index child, Slot slot) const
+    {
+        using ast::NodeKind;
+        if (child == kNoNode)
+            return true;
+        if (child >= parent)
+            return false;
+
+        NodeKind kind = tree_->At(child).kind;
+        switch (slot)
+        {
+        case Slot::EXPRESSION:
+            return kind >= NodeKind::IDENTIFIER && kind <= NodeKind::INDEX;
+        case Slot::STATEMENT:
+            return kind >= NodeKind::LET && kind <= NodeKind::FOR;
+        case Slot::IDENTIFIER:
+            return kind == NodeKind::IDENTIFIER;
+        case Slot::BLOCK:
+            return kind == NodeKind::BLOCK;
+        }
+        return false;
+    }
+
+    // Items [first, last) of the list are checked against `slot`; the rest
+    // only have to be in range, for the caller to check.
+    bool List(Index parent, Index start, uint64_t count, Slot slot,
+              uint64_t first = 0, uint64_t last = UINT64_MAX) const
+    {
+        if (start > tree_->extra_size_ ||
+            count > tree_->extra_size_ - start)
+            return false;
+        const Index *items = tree_->List(start);
+        for (uint64_t n = 0; n < count; n++)
+        {
+            if (n >= first && n < last && !Child(parent, items[n], slot))
+                return false;
+            // a parameter list has no gaps
+            if (slot == Slot::IDENTIFIER && items[n] == kNoNode)
+                return false;
+            if (items[n] != kNoNode && items[n] >= parent)
+                return false;
+        }
+        return true;
+    }
+
+    bool InImage(Span span) const
+    {
+        return span.offset <= image_->Size() &&
+               span.length <= image_->Size() - span.offset;
+    }
+
+    std::shared_ptr<Tree> Fail(const std::string &why) const
+    {
+        std::cerr << "Can't load AST image: " << why << std::endl;
+        return nullptr;
+    }
+
+    std::shared_ptr<source::Buffer> image_;
+    const Tree *tree_{nullptr};
+};
+
+std::shared_ptr<Tree> Load(std::shared_ptr<source::Buffer> image)
+{
+    if (!image)
+        return nullptr;
+    return Loader{std::move(image)}.Load();
+}
+
+} // namespace flat
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+#include "ast.hpp"
+#include "ref.hpp"
+#include "source.hpp"
+#include "symbol.hpp"
+#include "token.hpp"
+
+namespace flat
+{
+
+// The image format parsed programs are saved and loaded in (see Save and
+// Load): two flat arrays instead of a tree of counted nodes - fixed-size
+// nodes that refer to each other by 32-bit index, plus one array of index
+// lists (statements, arguments, parameters, hash pairs...). Node text is a
+// span into the program's source buffer rather than a token copy, so an
+// image maps in place and needs no fixing up.
+//
+// It isn't the AST programs are parsed into or run from. The parser builds
+// the pointer AST, both engines run that, and Flatten only copies it out for
+// --emit-ast. The one thing that reads a tree directly is the VM compiling a
+// loaded image for --load-ast.
+
+using Index = uint32_t;
+constexpr Index kNoNode = UINT32_MAX;
+
+struct Span
+{
+    uint32_t offset;
+    uint32_t length;
+};
+
+// What a, b and c hold depends on the kind ("list" = start in Tree::extra_,
+// with the count in the next field):
+//   PROGRAM, BLOCK           a: list of statements, b: count
+//   LET                      a: name, b: value
+//   RETURN                   a: value
+//   EXPRESSION_STATEMENT     a: expression
+//   FOR                      a: list of iterator, initial value, condition,
+//                               increment and body
+//   IDENTIFIER               a: entry in the tree's symbol table
+//   INTEGER                  a, b: low and high halves of the value
+//   BOOLEAN                  a: 0 or 1
+//   PREFIX                   a: operand
+//   INFIX                    a: left, b: right
+//   IF                       a: condition, b: consequence, c: alternative
+//   FUNCTION                 a: list of parameters, b: count, c: body
+//   CALL                     a: function, b: list of arguments, c: count
+//   ARRAY                    a: list of elements, b: count
+//   HASH                     a: list of key, value, key, value..., b: pairs
+//   INDEX                    a: left, b: index
+// `token` is the node's token kind and `span` its literal, which is all the
+// operator, name or string text a node needs.
+struct Node
+{
+    ast::NodeKind kind;
+    token::TokenType token;
+    Index a{kNoNode};
+    Index b{kNoNode};
+    Index c{kNoNode};
+    Span span{0, 0};
+};
+
+static_assert(sizeof(Node) == 24, "Node is part of the image format");
+
+// The node and list arrays are either the tree's own (from Flatten) or read
+// in place out of a loaded image. Identifiers refer to a per-tree table of
+// symbols rather than to symbol ids directly, since ids are only meaningful
+// within one process.
+class Tree
+{
+  public:
+    Tree() = default;
+    Tree(Tree &&) = default;
+    Tree &operator=(Tree &&) = default;
+    Tree(const Tree &) = delete;
+    Tree &operator=(const Tree &) = delete;
+
+    Index Root() const { return root_; }
+    size_t Size() const { return size_; }
+    const Node &At(Index i) const { return nodes_[i]; }
+    // `count` indices from the list starting at `start`
+    const Index *List(Index start) const { return extra_ + start; }
+    size_t ListSize() const { return extra_size_; }
+    std::string_view Text(const Node &node) const;
+    int64_t IntValue(const Node &node) const;
+    symbol::Id Symbol(const Node &node) const { return symbols_[node.a]; }
+
+    std::shared_ptr<source::Buffer> Source() const { return source_; }
+    // heap bytes held by the node, list and symbol arrays
+    size_t Bytes() const;
+
+  private:
+    friend class Builder;
+    friend class Loader;
+    friend bool Save(const Tree &tree, std::ostream &out);
+
+    const Node *nodes_{nullptr};
+    size_t size_{0};
+    const Index *extra_{nullptr};
+    size_t extra_size_{0};
+    std::vector<Node> node_storage_;
+    std::vector<Index> extra_storage_;
+    std::vector<symbol::Id> symbols_;
+    std::shared_ptr<source::Buffer> source_;
+    Index root_{kNoNode};
+};
+
+// Calls `visit` on the index of each statement and expression directly
+// under node `i`, kNoNode for one that isn't there, as ast::ForEachChild
+// does for the pointer AST.
+template <typename Visit>
+void ForEachChild(const Tree &tree, Index i, Visit visit)
+{
+    using ast::NodeKind;
+
+    auto each = [&tree, &visit](Index start, Index count) {
+        const Index *items = tree.List(start);
+        for (Index n = 0; n < count; n++)
+            visit(items[n]);
+    };
+    const Node &node = tree.At(i);
+    switch (node.kind)
+    {
+    case NodeKind::PROGRAM:
+    case NodeKind::BLOCK:
+    case NodeKind::ARRAY:
+        each(node.a, node.b);
+        break;
+    case NodeKind::LET:
+        visit(node.b);
+        break;
+    case NodeKind::RETURN:
+    case NodeKind::EXPRESSION_STATEMENT:
+    case NodeKind::PREFIX:
+        visit(node.a);
+        break;
+    case NodeKind::FOR:
+        // all but the iterator
+        each(node.a + 1, 4);
+        break;
+    case NodeKind::INFIX:
+    case NodeKind::INDEX:
+        visit(node.a);
+        visit(node.b);
+        break;
+    case NodeKind::IF:
+        visit(node.a);
+        visit(node.b);
+        visit(node.c);
+        break;
+    case NodeKind::FUNCTION:
+        visit(node.c);
+        break;
+    case NodeKind::CALL:
+        visit(node.a);
+        each(node.b, node.c);
+        break;
+    case NodeKind::HASH:
+        each(node.a, 2 * node.b);
+        break;
+    default:
+        break;
+    }
+}
+
+// Flat copy of `program`. Its spans point into program.source_, which the
+// tree keeps alive.
+Tree Flatten(const ast::Program &program);
+
+// Rebuilds the pointer AST the evaluator runs on.
+ref::Ref<ast::Program> Inflate(const Tree &tree);
+
+// Rebuilds just the expression at `i`: a compiled function's literal, say,
+// to print it.
+ref::Ref<ast::Expression> Inflate(const Tree &tree, Index i);
+
+// A tree can be saved as an image - a header, the node and list arrays as
+// they are in memory, the symbol table, and a pool of every literal the
+// nodes refer to - and used straight out of a mapping of that file later,
+// with no lexing or parsing. Images are in native byte order.
+//
+// Reports a failed write on stderr and returns false.
+bool Save(const Tree &tree, std::ostream &out);
+
+// The tree in `image` (typically source::FromFile of a saved image), checked
+// but not copied: its nodes, lists and literals stay in the buffer, which the
+// tree keeps alive. Returns nullptr, having said why on stderr, if `image`
+// isn't a well-formed image.
+std::shared_ptr<Tree> Load(std::shared_ptr<source::Buffer> image);
+
+} // namespace flat
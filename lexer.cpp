@@ -1,73 +1,193 @@
 #include "lexer.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <memory>
 #include <string>
+#include <string_view>
+
+#include "scan.hpp"
+#include "symbol.hpp"
 
 namespace
 {
-bool IsValidIdentifier(char c)
+
+// Most runs are short (single spaces, short names), and for those a call
+// into the wide scanners costs more than it saves. Step over the first few
+// chars inline and only hand longer runs off.
+constexpr int kInlineRun = 8;
+
+template <bool (*InRun)(char)>
+const char *SkipRun(const char *p, const char *end,
+                    const char *(*wide)(const char *, const char *))
+{
+    const char *stop = end - p > kInlineRun ? p + kInlineRun : end;
+    while (p < stop && InRun(*p))
+        ++p;
+    if (p < stop || p == end)
+        return p;
+    return wide(p, end);
+}
+
+bool IsNotQuote(char c) { return c != '"' && c != 0; }
+
+} // namespace
+
+namespace lexer
+{
+
+void TokenStream::Reset(Lexer *lexer)
 {
-    return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || c == '_';
+    lexer_ = lexer;
+    source_ = lexer->Source();
+    text_ = lexer->GetInput();
+    base_ = 0;
+    keep_ = 0;
+    done_ = false;
+    kinds_.clear();
+    spans_.clear();
+    values_.clear();
+    ints_.clear();
+    ints_base_ = 0;
+    kinds_.reserve(kWindow);
+    spans_.reserve(kWindow);
+    values_.reserve(kWindow);
+    // the first window now, while `lexer` is still on the input it has now
+    Fill(0);
 }
-bool IsDigit(char c) { return '0' <= c && c <= '9'; }
 
-bool IsBalanced(std::string &input)
+bool TokenStream::Fill(size_t i)
 {
-    // dumb algorithm counting matching number of curly braces.
-    int num_braces = 0;
-    const int len = input.length();
-    for (int i = 0; i < len; i++)
+    if (i < base_)
+        return false;
+    while (i - base_ >= kinds_.size())
     {
-        if (input[i] == '{')
-            num_braces++;
-        else if (input[i] == '}')
-            num_braces--;
+        if (done_)
+            return false;
+
+        // move what's still wanted to the front, and lex on after it
+        size_t drop = std::min(keep_ - std::min(keep_, base_), kinds_.size());
+        size_t ints = std::count(kinds_.begin(), kinds_.begin() + drop,
+                                 token::INT);
+        kinds_.erase(kinds_.begin(), kinds_.begin() + drop);
+        spans_.erase(spans_.begin(), spans_.begin() + drop);
+        values_.erase(values_.begin(), values_.begin() + drop);
+        ints_.erase(ints_.begin(), ints_.begin() + ints);
+        base_ += drop;
+        ints_base_ += ints;
+
+        for (size_t n = 0; n < kWindow && !done_; n++)
+        {
+            token::Token tok = lexer_->NextToken();
+            Push(tok);
+            done_ = tok.type_ == token::EOFF;
+        }
     }
+    return true;
+}
 
-    return num_braces == 0;
+void TokenStream::Push(const token::Token &tok)
+{
+    // an empty string literal still has a place in the text
+    uint32_t offset = text_.size();
+    if (!tok.literal_.empty() || tok.type_ == token::STRING)
+        offset = tok.literal_.data() - text_.data();
+    kinds_.push_back(tok.type_);
+    spans_.push_back({offset, static_cast<uint32_t>(tok.literal_.size())});
+    uint32_t value = 0;
+    if (tok.type_ == token::IDENT)
+        value = tok.value_;
+    else if (tok.type_ == token::INT)
+    {
+        value = ints_base_ + ints_.size();
+        ints_.push_back(tok.value_);
+    }
+    values_.push_back(value);
 }
 
-} // namespace
+Lexer::Lexer(std::string input)
+    : Lexer{source::FromString(std::move(input))}
+{
+}
 
-namespace lexer
+Lexer::Lexer(std::shared_ptr<source::Buffer> source)
+    : source_{source}, input_{source->Text()}
 {
+    ReadChar();
+}
 
-Lexer::Lexer(std::string input) : input_{input} { ReadChar(); }
+Lexer::Lexer(std::shared_ptr<source::Buffer> source, size_t begin, size_t end)
+    : source_{source}, input_{source->Text().substr(begin, end - begin)}
+{
+    ReadChar();
+}
 
 bool Lexer::ReadInput(std::string input)
 {
-    input_ += input;
-
-    if (IsBalanced(input_))
+    // Only the new line is scanned - brace depth and whether we're inside a
+    // string literal carry over from the lines before it, so pasting a long
+    // function in stays linear.
+    for (char c : input)
     {
-        ReadChar();
-        return true;
+        if (in_string_)
+        {
+            if (c == '"')
+                in_string_ = false;
+        }
+        else if (c == '"')
+            in_string_ = true;
+        else if (c == '{')
+            brace_depth_++;
+        else if (c == '}')
+            brace_depth_--;
     }
-    return false;
+    pending_ += input;
+    pending_ += '\n';
+
+    if (in_string_ || brace_depth_ > 0)
+        return false;
+
+    // The completed input becomes the next chunk to lex - the parser carries
+    // on from where it stopped rather than starting over.
+    brace_depth_ = 0;
+    source_ = source::FromString(std::move(pending_));
+    pending_.clear();
+    input_ = source_->Text();
+    current_position_ = 0;
+    next_position_ = 0;
+    ReadChar();
+    return true;
 }
 
 void Lexer::Reset()
 {
-    input_.clear();
+    source_.reset();
+    pending_.clear();
+    brace_depth_ = 0;
+    in_string_ = false;
+    input_ = std::string_view{};
     current_char_ = 0;
     current_position_ = 0;
     next_position_ = 0;
 }
 
-std::string Lexer::ReadString()
+std::string_view Lexer::ReadString()
 {
     auto pos = current_position_ + 1;
-    while (true)
-    {
-        ReadChar();
-        if (current_char_ == '"' || current_char_ == 0)
-            break;
-    }
+    const char *begin = input_.data();
+    const char *end = begin + input_.size();
+    if (pos < input_.size())
+        JumpTo(SkipRun<IsNotQuote>(begin + pos, end,
+                                   scan::Active().find_quote) -
+               begin);
+    else
+        JumpTo(input_.size());
     return input_.substr(pos, current_position_ - pos);
 }
 
 void Lexer::ReadChar()
 {
-    const int len = input_.length();
-    if (next_position_ >= len)
+    if (next_position_ >= input_.size())
         current_char_ = 0;
     else
         current_char_ = input_[next_position_];
@@ -76,9 +196,19 @@ void Lexer::ReadChar()
     next_position_ += 1;
 }
 
+void Lexer::JumpTo(size_t position)
+{
+    current_position_ = position;
+    next_position_ = position + 1;
+    if (position >= input_.size())
+        current_char_ = 0;
+    else
+        current_char_ = input_[position];
+}
+
 char Lexer::PeekChar()
 {
-    if (next_position_ >= static_cast<int>(input_.length()))
+    if (next_position_ >= input_.size())
         return 0;
     else
         return input_[next_position_];
@@ -98,12 +228,12 @@ token::Token Lexer::NextToken()
         {
             ReadChar();
             tok.type_ = token::EQ;
-            tok.literal_ = "==";
+            tok.literal_ = input_.substr(current_position_ - 1, 2);
         }
         else
         {
             tok.type_ = token::ASSIGN;
-            tok.literal_ = current_char_;
+            tok.literal_ = input_.substr(current_position_, 1);
         }
         break;
     case ('+'):
@@ -111,12 +241,12 @@ token::Token Lexer::NextToken()
         {
             ReadChar();
             tok.type_ = token::INCREMENT;
-            tok.literal_ = "++";
+            tok.literal_ = input_.substr(current_position_ - 1, 2);
         }
         else
         {
             tok.type_ = token::PLUS;
-            tok.literal_ = current_char_;
+            tok.literal_ = input_.substr(current_position_, 1);
         }
         break;
     case ('-'):
@@ -124,12 +254,12 @@ token::Token Lexer::NextToken()
         {
             ReadChar();
             tok.type_ = token::DECREMENT;
-            tok.literal_ = "--";
+            tok.literal_ = input_.substr(current_position_ - 1, 2);
         }
         else
         {
             tok.type_ = token::MINUS;
-            tok.literal_ = current_char_;
+            tok.literal_ = input_.substr(current_position_, 1);
         }
         break;
     case ('!'):
@@ -137,65 +267,65 @@ token::Token Lexer::NextToken()
         {
             ReadChar();
             tok.type_ = token::NOT_EQ;
-            tok.literal_ = "!=";
+            tok.literal_ = input_.substr(current_position_ - 1, 2);
         }
         else
         {
             tok.type_ = token::BANG;
-            tok.literal_ = current_char_;
+            tok.literal_ = input_.substr(current_position_, 1);
         }
         break;
     case ('*'):
         tok.type_ = token::ASTERISK;
-        tok.literal_ = current_char_;
+        tok.literal_ = input_.substr(current_position_, 1);
         break;
     case ('/'):
         tok.type_ = token::SLASH;
-        tok.literal_ = current_char_;
+        tok.literal_ = input_.substr(current_position_, 1);
         break;
     case ('<'):
         tok.type_ = token::LT;
-        tok.literal_ = current_char_;
+        tok.literal_ = input_.substr(current_position_, 1);
         break;
     case ('>'):
         tok.type_ = token::GT;
-        tok.literal_ = current_char_;
+        tok.literal_ = input_.substr(current_position_, 1);
         break;
     case (','):
         tok.type_ = token::COMMA;
-        tok.literal_ = current_char_;
+        tok.literal_ = input_.substr(current_position_, 1);
         break;
     case (';'):
         tok.type_ = token::SEMICOLON;
-        tok.literal_ = current_char_;
+        tok.literal_ = input_.substr(current_position_, 1);
         break;
     case ('('):
         tok.type_ = token::LPAREN;
-        tok.literal_ = current_char_;
+        tok.literal_ = input_.substr(current_position_, 1);
         break;
     case (')'):
         tok.type_ = token::RPAREN;
-        tok.literal_ = current_char_;
+        tok.literal_ = input_.substr(current_position_, 1);
         break;
     case ('{'):
         tok.type_ = token::LBRACE;
-        tok.literal_ = current_char_;
+        tok.literal_ = input_.substr(current_position_, 1);
         break;
     case ('}'):
         tok.type_ = token::RBRACE;
-        tok.literal_ = current_char_;
+        tok.literal_ = input_.substr(current_position_, 1);
         break;
     case ('['):
         tok.type_ = token::LBRACKET;
-        tok.literal_ = current_char_;
+        tok.literal_ = input_.substr(current_position_, 1);
         break;
     case (']'):
         tok.type_ = token::RBRACKET;
-        tok.literal_ = current_char_;
+        tok.literal_ = input_.substr(current_position_, 1);
         break;
     case (':'):
         tok.type_ = token::COLON;
-        tok.literal_ = current_char_;
+        tok.literal_ = input_.substr(current_position_, 1);
         break;
     case ('"'):
         tok.type_ = token::STRING;
@@ -205,22 +335,28 @@ token::Token Lexer::NextToken()
         tok.type_ = token::EOFF;
         break;
     default:
-        if (IsValidIdentifier(current_char_))
+        if (scan::IsIdentifier(current_char_))
         {
             tok.literal_ = ReadIdentifier();
             tok.type_ = token::LookupIdent(tok.literal_);
+            if (tok.type_ == token::IDENT)
+                tok.value_ = symbol::Intern(tok.literal_);
             return tok;
         }
-        else if (IsDigit(current_char_))
+        else if (scan::IsDigit(current_char_))
         {
             tok.type_ = token::INT;
             tok.literal_ = ReadNumber();
+            auto last = tok.literal_.data() + tok.literal_.size();
+            auto res = std::from_chars(tok.literal_.data(), last, tok.value_);
+            if (res.ec != std::errc())
+                tok.type_ = token::ILLEGAL;
             return tok;
         }
         else
         {
             tok.type_ = token::ILLEGAL;
-            tok.literal_ = current_char_;
+            tok.literal_ = input_.substr(current_position_, 1);
         }
     }
 
@@ -228,29 +364,46 @@ token::Token Lexer::NextToken()
     return tok;
 }
 
-std::string Lexer::ReadIdentifier()
+// The run scanners below are only called with current_char_ already known
+// to be part of the run, so they start one past it.
+
+std::string_view Lexer::ReadIdentifier()
 {
-    int position = current_position_;
-    while (IsValidIdentifier(current_char_))
-        ReadChar();
+    size_t position = current_position_;
+    const char *begin = input_.data();
+    const char *end = begin + input_.size();
+    JumpTo(SkipRun<scan::IsIdentifier>(begin + position + 1, end,
+                                       scan::Active().skip_identifier) -
+           begin);
     return input_.substr(position, current_position_ - position);
 }
 
-std::string Lexer::ReadNumber()
+std::string_view Lexer::ReadNumber()
 {
-    int position = current_position_;
-    while (IsDigit(current_char_))
-        ReadChar();
+    size_t position = current_position_;
+    const char *begin = input_.data();
+    const char *end = begin + input_.size();
+    JumpTo(SkipRun<scan::IsDigit>(begin + position + 1, end,
+                                  scan::Active().skip_digits) -
+           begin);
     return input_.substr(position, current_position_ - position);
 }
 
 void Lexer::SkipWhiteSpace()
 {
-    while (current_char_ == ' ' || current_char_ == '\t' ||
-           current_char_ == '\n' || current_char_ == '\r')
-        ReadChar();
+    if (!scan::IsWhitespace(current_char_))
+        return;
+    const char *begin = input_.data();
+    const char *end = begin + input_.size();
+    JumpTo(SkipRun<scan::IsWhitespace>(begin + current_position_ + 1, end,
+                                       scan::Active().skip_whitespace) -
+           begin);
 }
 
-std::string Lexer::GetInput() { return input_; }
+void Lexer::Tokenize(TokenStream &out) { out.Reset(this); }
+
+std::string_view Lexer::GetInput() const { return input_; }
+
+std::shared_ptr<source::Buffer> Lexer::Source() const { return source_; }
 
 } // namespace lexer
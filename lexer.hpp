@@ -1,36 +1,146 @@
 #pragma once
 
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 
+#include "source.hpp"
+#include "symbol.hpp"
 #include "token.hpp"
 
 namespace lexer
 {
 
+class Lexer;
+
+// A chunk of source's tokens in flat parallel arrays - one byte of kind per
+// token, an (offset, length) span into the source (which source::kMaxSize
+// keeps to 32 bits) and a 32-bit value: an IDENT's symbol id, or where an
+// INT's value is in a side table of them. The parser walks it by index, so
+// lookahead is just an index away.
+//
+// The tokens are lexed a window at a time as they're asked for, and the ones
+// before the last index passed to Release are dropped as the window moves
+// on, rather than holding arrays for the whole script, which run to several
+// times its size.
+class TokenStream
+{
+  public:
+    struct Span
+    {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    // how many tokens are lexed at a time
+    static constexpr size_t kWindow = 4096;
+
+    // Starts over on what's left of `lexer`'s input, lexing the first window
+    // of it.
+    void Reset(Lexer *lexer);
+    // Tokens before `i` won't be asked for again.
+    void Release(size_t i) { keep_ = i; }
+
+    // Reading lexes as far as the token read, if it's not been already.
+    // Anything past the end reads as the trailing EOF, as does anything
+    // released.
+    token::TokenType Kind(size_t i)
+    {
+        return Has(i) ? kinds_[i - base_] : token::EOFF;
+    }
+    std::string_view Literal(size_t i)
+    {
+        if (!Has(i))
+            return std::string_view{};
+        const Span &span = spans_[i - base_];
+        return text_.substr(span.offset, span.length);
+    }
+    // An INT's value, as the lexer read it.
+    int64_t Value(size_t i)
+    {
+        if (Kind(i) != token::INT)
+            return 0;
+        return ints_[values_[i - base_] - ints_base_];
+    }
+    symbol::Id Symbol(size_t i)
+    {
+        return Kind(i) == token::IDENT ? values_[i - base_] : symbol::kNone;
+    }
+    token::Token At(size_t i)
+    {
+        token::TokenType kind = Kind(i);
+        int64_t value = 0;
+        if (kind == token::INT)
+            value = Value(i);
+        else if (kind == token::IDENT)
+            value = Symbol(i);
+        return token::Token{kind, Literal(i), value};
+    }
+    std::shared_ptr<source::Buffer> Source() const { return source_; }
+
+  private:
+    bool Has(size_t i) { return i - base_ < kinds_.size() || Fill(i); }
+    // Lexes on until token `i`, returning false if the input ends first or
+    // it's been released.
+    bool Fill(size_t i);
+    void Push(const token::Token &tok);
+
+    Lexer *lexer_{nullptr};
+    std::shared_ptr<source::Buffer> source_;
+    std::string_view text_;
+    // the window: tokens from base_ on, and the INT values from ints_base_ on
+    size_t base_{0};
+    size_t keep_{0};
+    bool done_{true};
+    std::vector<token::TokenType> kinds_;
+    std::vector<Span> spans_;
+    std::vector<uint32_t> values_;
+    std::vector<int64_t> ints_;
+    size_t ints_base_{0};
+};
+
 class Lexer
 {
   public:
     Lexer() = default;
     explicit Lexer(std::string input);
+    explicit Lexer(std::shared_ptr<source::Buffer> source);
+    // Lexes only [begin, end) of `source`; the tokens still view (and keep
+    // alive) the whole buffer.
+    Lexer(std::shared_ptr<source::Buffer> source, size_t begin, size_t end);
 
     token::Token NextToken();
+    // REPL input, a line at a time. Returns true once the lines read so far
+    // form a complete input (braces balanced, no open string), which then
+    // becomes the text NextToken() works through.
     bool ReadInput(std::string mo_input);
+    // Starts `out` on everything left in the current input, which it lexes
+    // as it's read.
+    void Tokenize(TokenStream &out);
     void Reset();
-    std::string GetInput();
+    std::string_view GetInput() const;
+    std::shared_ptr<source::Buffer> Source() const;
 
   private:
     void ReadChar();
+    void JumpTo(size_t position);
     char PeekChar();
-    std::string ReadIdentifier();
-    std::string ReadNumber();
-    std::string ReadString();
+    std::string_view ReadIdentifier();
+    std::string_view ReadNumber();
+    std::string_view ReadString();
     void SkipWhiteSpace();
 
   private:
-    std::string input_;
+    std::shared_ptr<source::Buffer> source_;
+    std::string pending_;
+    int brace_depth_{0};
+    bool in_string_{false};
+    std::string_view input_;
     char current_char_{0};
-    int current_position_{0};
-    int next_position_{0};
+    size_t current_position_{0};
+    size_t next_position_{0};
 };
 
 } // namespace lexer
@@ -1,8 +1,8 @@
 #include "object.hpp"
 
-#include <memory>
 #include <sstream>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace object
@@ -64,7 +64,58 @@ object::HashKey String::HashKey()
 std::string Null::Inspect() { return "null"; }
 ObjectType Null::Type() { return NULL_OBJ; }
 
-std::string ReturnValue::Inspect() { return value_->Inspect(); }
+ObjectType Value::Type() const
+{
+    switch (kind_)
+    {
+    case Kind::NUL:
+        return NULL_OBJ;
+    case Kind::BOOLEAN:
+        return BOOLEAN_OBJ;
+    case Kind::INTEGER:
+        return INTEGER_OBJ;
+    case Kind::OBJECT:
+        return object_->Type();
+    default:
+        return "";
+    }
+}
+
+std::string Value::Inspect() const
+{
+    switch (kind_)
+    {
+    case Kind::NUL:
+        return "null";
+    case Kind::BOOLEAN:
+        return boolean_ ? "true" : "false";
+    case Kind::INTEGER:
+        return std::to_string(integer_);
+    case Kind::OBJECT:
+        return object_->Inspect();
+    default:
+        return "";
+    }
+}
+
+bool Value::operator==(const Value &other) const
+{
+    if (kind_ != other.kind_)
+        return false;
+    switch (kind_)
+    {
+    case Kind::BOOLEAN:
+        return boolean_ == other.boolean_;
+    case Kind::INTEGER:
+        return integer_ == other.integer_;
+    case Kind::OBJECT:
+        return object_ == other.object_;
+    default:
+        return true;
+    }
+}
+
+std::string ReturnValue::Inspect() { return value_.Inspect(); }
 ObjectType ReturnValue::Type() { return RETURN_VALUE_OBJ; }
 
 Error::Error(std::string err_msg) : message_{err_msg} {}
@@ -86,7 +137,11 @@ std::string Function::Inspect()
     }
     std::stringstream return_val;
     return_val << "fn(" << params.str() << ") {\n";
-    return_val << body_->String() << "\n)";
+    if (body_)
+        return_val << body_->String();
+    else if (literal_)
+        return_val << literal_->pending_body_;
+    return_val << "\n)";
 
     return return_val.str();
 }
@@ -98,7 +153,7 @@ std::string Array::Inspect()
     int i = 0;
     for (auto &e : elements_)
     {
-        elems << e->Inspect();
+        elems << e.Inspect();
         if (i < len - 1)
             elems << ", ";
         i++;
@@ -109,33 +164,117 @@ std::string Array::Inspect()
     return return_val.str();
 }
 
-std::shared_ptr<Object> Environment::Get(std::string name)
+Value Environment::Get(symbol::Id name)
 {
-    auto entry = store_.find(name);
-    if (entry == store_.end())
+    if (scope_)
     {
-        if (outer_env_)
-            return outer_env_->Get(name);
-        return nullptr;
+        const std::vector<symbol::Id> &names = scope_->names;
+        for (size_t slot = 0; slot < names.size(); slot++)
+            if (names[slot] == name && slots_[slot])
+                return slots_[slot];
     }
-    return entry->second;
+    if (!store_.empty())
+    {
+        auto entry = store_.find(name);
+        if (entry != store_.end())
+            return entry->second;
+    }
+    if (outer_env_)
+        return outer_env_->Get(name);
+    return nullptr;
 }
 
-std::shared_ptr<Object> Environment::Set(std::string key,
-                                         std::shared_ptr<Object> val)
+Value Environment::Set(symbol::Id key, Value val)
 {
+    if (IsShared())
+        return nullptr;
+    if (scope_)
+    {
+        const std::vector<symbol::Id> &names = scope_->names;
+        for (size_t slot = 0; slot < names.size(); slot++)
+            if (names[slot] == key)
+                return slots_[slot] = val;
+    }
     store_[key] = val;
     return val;
 }
 
+bool Environment::Assign(symbol::Id key, Value val)
+{
+    for (Environment *env = this; env; env = env->outer_env_.get())
+    {
+        if (env->scope_)
+        {
+            const std::vector<symbol::Id> &names = env->scope_->names;
+            for (size_t slot = 0; slot < names.size(); slot++)
+                if (names[slot] == key && env->slots_[slot])
+                {
+                    if (env->IsShared())
+                        return false;
+                    env->slots_[slot] = std::move(val);
+                    return true;
+                }
+        }
+        auto entry = env->store_.find(key);
+        if (entry != env->store_.end())
+        {
+            if (env->IsShared())
+                return false;
+            entry->second = std::move(val);
+            return true;
+        }
+    }
+    return false;
+}
+
+void Environment::Referents(std::vector<ref::Counted *> &out)
+{
+    for (auto const &val : slots_)
+        out.push_back(val.Get());
+    for (auto const &it : store_)
+        out.push_back(it.second.Get());
+    out.push_back(outer_env_.get());
+}
+
+void Environment::DropReferents()
+{
+    slots_.clear();
+    store_.clear();
+    outer_env_.reset();
+}
+
+void Array::Referents(std::vector<ref::Counted *> &out)
+{
+    for (auto const &element : elements_)
+        out.push_back(element.Get());
+}
+
+void Function::Referents(std::vector<ref::Counted *> &out)
+{
+    for (auto const &param : parameters_)
+        out.push_back(param.get());
+    out.push_back(env_.get());
+    out.push_back(body_.get());
+    out.push_back(literal_.get());
+}
+
+void Hash::Referents(std::vector<ref::Counted *> &out)
+{
+    for (auto const &it : pairs_)
+    {
+        out.push_back(it.second.key_.Get());
+        out.push_back(it.second.value_.Get());
+    }
+}
+
 std::string Hash::Inspect()
 {
     std::stringstream out;
     std::vector<std::string> pairs;
     for (auto const &it : pairs_)
     {
-        pairs.push_back(it.second.key_->Inspect() + ": " +
-                        it.second.value_->Inspect());
+        pairs.push_back(it.second.key_.Inspect() + ": " +
+                        it.second.value_.Inspect());
     }
 
     int pairs_size = pairs.size();
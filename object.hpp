@@ -1,13 +1,23 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <map>
 #include <memory>
+#include <new>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "ast.hpp"
+#include "cycles.hpp"
+#include "pool.hpp"
+#include "ref.hpp"
+#include "source.hpp"
+#include "symbol.hpp"
 
 namespace object
 {
@@ -55,7 +65,9 @@ class HashKey
 
 bool operator<(HashKey const &lhs, HashKey const &rhs);
 
-class Object
+// Objects and environments come from pool's size-class pools rather than
+// straight from the heap.
+class Object : public ref::Counted, public pool::Pooled
 {
   public:
     virtual ~Object() = default;
@@ -63,6 +75,144 @@ class Object
     virtual std::string Inspect() = 0;
 };
 
+// A value as programs pass it around. Integers, booleans and null are held
+// inline, so arithmetic and comparisons don't allocate; everything else -
+// strings, arrays, hashes, functions, and the evaluator's errors and return
+// values - is a boxed Object. An empty Value, false in a test, stands for no
+// value at all, as a null pointer did: an unset name, say.
+class Value
+{
+  public:
+    enum class Kind : uint8_t
+    {
+        EMPTY,
+        NUL,
+        BOOLEAN,
+        INTEGER,
+        OBJECT
+    };
+
+    Value() : kind_{Kind::EMPTY}, integer_{0} {}
+    Value(std::nullptr_t) : Value() {}
+    // empty if `object` is null
+    template <typename T> Value(ref::Ref<T> object) : Value()
+    {
+        if (!object)
+            return;
+        kind_ = Kind::OBJECT;
+        new (&object_) ref::Ref<Object>(std::move(object));
+    }
+    Value(const Value &other) { CopyFrom(other); }
+    Value(Value &&other) noexcept { MoveFrom(other); }
+    Value &operator=(const Value &other)
+    {
+        if (this != &other)
+        {
+            Clear();
+            CopyFrom(other);
+        }
+        return *this;
+    }
+    Value &operator=(Value &&other) noexcept
+    {
+        if (this != &other)
+        {
+            Clear();
+            MoveFrom(other);
+        }
+        return *this;
+    }
+    ~Value() { Clear(); }
+
+    static Value OfInteger(int64_t value)
+    {
+        Value v;
+        v.kind_ = Kind::INTEGER;
+        v.integer_ = value;
+        return v;
+    }
+    static Value OfBoolean(bool value)
+    {
+        Value v;
+        v.kind_ = Kind::BOOLEAN;
+        v.boolean_ = value;
+        return v;
+    }
+    static Value OfNull()
+    {
+        Value v;
+        v.kind_ = Kind::NUL;
+        return v;
+    }
+
+    Kind GetKind() const { return kind_; }
+    bool IsInteger() const { return kind_ == Kind::INTEGER; }
+    bool IsBoolean() const { return kind_ == Kind::BOOLEAN; }
+    bool IsNull() const { return kind_ == Kind::NUL; }
+    bool IsObject() const { return kind_ == Kind::OBJECT; }
+    int64_t AsInteger() const { return integer_; }
+    bool AsBoolean() const { return boolean_; }
+
+    // The boxed object, or null for an inline value.
+    Object *Get() const { return IsObject() ? object_.get() : nullptr; }
+    ref::Ref<Object> Boxed() const
+    {
+        return IsObject() ? object_ : nullptr;
+    }
+    // The boxed object if it's a T, else null.
+    template <typename T> T *As() const
+    {
+        return IsObject() ? dynamic_cast<T *>(object_.get()) : nullptr;
+    }
+
+    ObjectType Type() const;
+    std::string Inspect() const;
+
+    explicit operator bool() const { return kind_ != Kind::EMPTY; }
+    // Inline values are equal when they hold the same thing, boxed ones
+    // only when they're the same object.
+    bool operator==(const Value &other) const;
+    bool operator!=(const Value &other) const { return !(*this == other); }
+
+  private:
+    void Clear()
+    {
+        if (kind_ == Kind::OBJECT)
+            object_.~Ref();
+        kind_ = Kind::EMPTY;
+        integer_ = 0;
+    }
+    void CopyFrom(const Value &other)
+    {
+        kind_ = other.kind_;
+        if (kind_ == Kind::OBJECT)
+            new (&object_) ref::Ref<Object>(other.object_);
+        else if (kind_ == Kind::BOOLEAN)
+            boolean_ = other.boolean_;
+        else
+            integer_ = other.integer_;
+    }
+    void MoveFrom(Value &other)
+    {
+        if (other.kind_ != Kind::OBJECT)
+        {
+            CopyFrom(other);
+            return;
+        }
+        kind_ = Kind::OBJECT;
+        new (&object_) ref::Ref<Object>(std::move(other.object_));
+        other.Clear();
+    }
+
+    Kind kind_;
+    union
+    {
+        int64_t integer_;
+        bool boolean_;
+        ref::Ref<Object> object_;
+    };
+};
+
 class Integer : public Object
 {
   public:
@@ -75,16 +225,20 @@ class Integer : public Object
     int64_t value_;
 };
 
-class Array : public Object
+class Array : public Object, public cycles::Tracked
 {
   public:
-    explicit Array(std::vector<std::shared_ptr<Object>> elements)
-        : elements_{elements} {};
+    explicit Array(std::vector<Value> elements)
+        : cycles::Tracked{this}, elements_{std::move(elements)} {};
     ObjectType Type() override { return ARRAY_OBJ; }
     std::string Inspect() override;
 
   public:
-    std::vector<std::shared_ptr<Object>> elements_;
+    std::vector<Value> elements_;
+
+  protected:
+    void Referents(std::vector<ref::Counted *> &out) override;
+    void DropReferents() override { elements_.clear(); }
 };
 
 class Boolean : public Object
@@ -114,12 +268,18 @@ class String : public Object
 class ReturnValue : public Object
 {
   public:
-    explicit ReturnValue(std::shared_ptr<Object> val) : value_{val} {};
+    explicit ReturnValue(Value val) : value_{std::move(val)} {};
     ObjectType Type() override;
     std::string Inspect() override;
 
   public:
-    std::shared_ptr<Object> value_;
+    Value value_;
+
+  protected:
+    void Referents(std::vector<ref::Counted *> &out) override
+    {
+        out.push_back(value_.Get());
+    }
 };
 
 class Null : public Object
@@ -141,40 +301,82 @@ class Error : public Object
     std::string Inspect() override;
 };
 
-class Environment
+// Once shared (see ref::Counted::Share), an environment can't be changed:
+// Set and Assign refuse, and callers writing a Slot must check first.
+class Environment : public ref::Counted,
+                    public pool::Pooled,
+                    public cycles::Tracked
 {
   public:
-    Environment() = default;
-    explicit Environment(std::shared_ptr<Environment> outer_env)
-        : outer_env_{outer_env} {};
+    Environment() : cycles::Tracked{this} {}
+    explicit Environment(ref::Ref<Environment> outer_env)
+        : cycles::Tracked{this}, outer_env_{outer_env} {};
+    // An environment laid out by the resolver, with a slot for each of the
+    // scope's names.
+    Environment(ref::Ref<Environment> outer_env,
+                std::shared_ptr<const ast::Scope> scope)
+        : cycles::Tracked{this}, slots_(scope->names.size()), scope_{scope},
+          outer_env_{outer_env}
+    {
+    }
     ~Environment() = default;
-    std::shared_ptr<Object> Get(std::string key);
-    std::shared_ptr<Object> Set(std::string key, std::shared_ptr<Object> val);
+    Value Get(symbol::Id key);
+    // `val`, or empty if the environment's shared.
+    Value Set(symbol::Id key, Value val);
+    // Changes `key` where Get would find it; false if it's not set anywhere
+    // or where it's set is shared.
+    bool Assign(symbol::Id key, Value val);
+
+    // A resolved name's slot (see ast::Identifier::slot_), empty until the
+    // name's set.
+    Value &Slot(uint16_t slot) { return slots_[slot]; }
+    size_t NumSlots() const { return slots_.size(); }
+    Environment *Outer() const { return outer_env_.get(); }
+
+  protected:
+    void Referents(std::vector<ref::Counted *> &out) override;
+    void DropReferents() override;
 
   private:
-    std::unordered_map<std::string, std::shared_ptr<Object>> store_;
-    std::shared_ptr<Environment> outer_env_;
+    std::vector<Value> slots_;
+    std::shared_ptr<const ast::Scope> scope_;
+    // Names that aren't in scope_: the globals, and everything in code the
+    // resolver didn't see. Keyed by interned name, so a lookup hashes an
+    // integer, not a string.
+    std::unordered_map<symbol::Id, Value> store_;
+    ref::Ref<Environment> outer_env_;
 };
 
-class Function : public Object
+class Function : public Object, public cycles::Tracked
 {
   public:
-    Function(std::vector<std::shared_ptr<ast::Identifier>> parameters,
-             std::shared_ptr<Environment> env,
-             std::shared_ptr<ast::BlockStatement> body)
-        : parameters_{parameters}, env_{env}, body_{body} {};
+    Function(std::vector<ref::Ref<ast::Identifier>> parameters,
+             ref::Ref<Environment> env, ref::Ref<ast::BlockStatement> body,
+             std::shared_ptr<source::Buffer> source = nullptr,
+             ref::Ref<ast::FunctionLiteral> literal = nullptr,
+             std::shared_ptr<const ast::Scope> scope = nullptr)
+        : cycles::Tracked{this}, parameters_{parameters}, env_{env},
+          body_{body}, source_{source}, literal_{literal}, scope_{scope} {};
     ~Function() = default;
     ObjectType Type() override;
     std::string Inspect() override;
 
   public:
-    std::vector<std::shared_ptr<ast::Identifier>> parameters_;
-    std::shared_ptr<Environment> env_;
-    std::shared_ptr<ast::BlockStatement> body_;
+    std::vector<ref::Ref<ast::Identifier>> parameters_;
+    ref::Ref<Environment> env_;
+    ref::Ref<ast::BlockStatement> body_;
+    std::shared_ptr<source::Buffer> source_;
+    // set while body_ is still to be parsed (see parser::ParseBody)
+    ref::Ref<ast::FunctionLiteral> literal_;
+    // the layout of a call's environment, if the body was resolved
+    std::shared_ptr<const ast::Scope> scope_;
+
+  protected:
+    void Referents(std::vector<ref::Counted *> &out) override;
+    void DropReferents() override { env_.reset(); }
 };
 
-using BuiltInFunc = std::function<std::shared_ptr<object::Object>(
-    std::vector<std::shared_ptr<object::Object>>)>;
+using BuiltInFunc = std::function<Value(std::vector<Value>)>;
 
 class BuiltIn : public Object
 {
@@ -191,27 +393,34 @@ class BuiltIn : public Object
 class HashPair
 {
   public:
-    HashPair(std::shared_ptr<Object> key, std::shared_ptr<Object> value)
-        : key_{key}, value_{value}
+    HashPair(Value key, Value value)
+        : key_{std::move(key)}, value_{std::move(value)}
     {
     }
 
   public:
-    std::shared_ptr<Object> key_;
-    std::shared_ptr<Object> value_;
+    Value key_;
+    Value value_;
 };
 
-class Hash : public Object
+class Hash : public Object, public cycles::Tracked
 {
   public:
-    Hash() = default;
-    explicit Hash(std::map<HashKey, HashPair> pairs) : pairs_{pairs} {}
+    Hash() : cycles::Tracked{this} {}
+    explicit Hash(std::map<HashKey, HashPair> pairs)
+        : cycles::Tracked{this}, pairs_{pairs}
+    {
+    }
     ~Hash() = default;
     ObjectType Type() override { return HASH_OBJ; }
     std::string Inspect() override;
 
   public:
     std::map<HashKey, HashPair> pairs_;
+
+  protected:
+    void Referents(std::vector<ref::Counted *> &out) override;
+    void DropReferents() override { pairs_.clear(); }
 };
 
 } // namespace object
@@ -1,43 +1,65 @@
 #include <optional>
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
 #include <iostream>
+#include <iterator>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <utility>
 #include <vector>
 
 #include "parser.hpp"
+#include "ref.hpp"
+#include "resolver.hpp"
+#include "scan.hpp"
+#include "stream.hpp"
 
 namespace parser
 {
 
 Parser::Parser(std::shared_ptr<lexer::Lexer> lexer) : lexer_{lexer}
 {
-    NextToken();
-    NextToken();
+    lexer_->Tokenize(tokens_);
 }
 
-std::shared_ptr<ast::Program> Parser::ParseProgram()
+ref::Ref<ast::Program> Parser::ParseProgram()
 {
-    std::shared_ptr<ast::Program> program = std::make_shared<ast::Program>();
+    // In a REPL session the lexer gets more input after we've run into EOF -
+    // tokenize that and carry on from there.
+    if (CurTokenIs(token::EOFF))
+    {
+        lexer_->Tokenize(tokens_);
+        pos_ = 0;
+    }
+    errors_.clear();
+
+    ref::Ref<ast::Program> program = ref::Make<ast::Program>();
+    program->source_ = tokens_.Source();
 
-    while (cur_token_.type_ != token::EOFF)
+    while (CurType() != token::EOFF)
     {
-        std::shared_ptr<ast::Statement> stmt = ParseStatement();
+        ref::Ref<ast::Statement> stmt = ParseStatement();
         if (stmt)
             program->statements_.push_back(stmt);
         NextToken();
     }
+    resolver::Resolve(*program);
     return program;
 }
 
-std::shared_ptr<ast::Statement> Parser::ParseStatement()
+ref::Ref<ast::Statement> Parser::ParseStatement()
 {
-    if (cur_token_.type_.compare(token::LET) == 0)
+    if (CurType() == token::LET)
         return ParseLetStatement();
-    else if (cur_token_.type_.compare(token::RETURN) == 0)
+    else if (CurType() == token::RETURN)
         return ParseReturnStatement();
-    else if (cur_token_.type_.compare(token::FOR) == 0)
+    else if (CurType() == token::FOR)
     {
         std::cout << "Found FOR statement!\n";
         return ParseForStatement();
@@ -46,11 +68,10 @@ std::shared_ptr<ast::Statement> Parser::ParseStatement()
         return ParseExpressionStatement();
 }
 
-std::shared_ptr<ast::LetStatement> Parser::ParseLetStatement()
+ref::Ref<ast::LetStatement> Parser::ParseLetStatement()
 {
 
-    std::shared_ptr<ast::LetStatement> stmt =
-        std::make_shared<ast::LetStatement>(cur_token_);
+    ref::Ref<ast::LetStatement> stmt = ref::Make<ast::LetStatement>(CurToken());
 
     if (!ExpectPeek(token::IDENT))
     {
@@ -58,8 +79,7 @@ std::shared_ptr<ast::LetStatement> Parser::ParseLetStatement()
         return nullptr;
     }
 
-    stmt->name_ =
-        std::make_shared<ast::Identifier>(cur_token_, cur_token_.literal_);
+    stmt->name_ = ref::Make<ast::Identifier>(CurToken(), CurToken().literal_);
 
     if (!ExpectPeek(token::ASSIGN))
     {
@@ -77,11 +97,11 @@ std::shared_ptr<ast::LetStatement> Parser::ParseLetStatement()
     return stmt;
 }
 
-std::shared_ptr<ast::ReturnStatement> Parser::ParseReturnStatement()
+ref::Ref<ast::ReturnStatement> Parser::ParseReturnStatement()
 {
 
-    std::shared_ptr<ast::ReturnStatement> stmt =
-        std::make_shared<ast::ReturnStatement>(cur_token_);
+    ref::Ref<ast::ReturnStatement> stmt =
+        ref::Make<ast::ReturnStatement>(CurToken());
 
     NextToken();
 
@@ -93,10 +113,9 @@ std::shared_ptr<ast::ReturnStatement> Parser::ParseReturnStatement()
     return stmt;
 }
 
-std::shared_ptr<ast::ForStatement> Parser::ParseForStatement()
+ref::Ref<ast::ForStatement> Parser::ParseForStatement()
 {
-    std::shared_ptr<ast::ForStatement> stmt =
-        std::make_shared<ast::ForStatement>(cur_token_);
+    ref::Ref<ast::ForStatement> stmt = ref::Make<ast::ForStatement>(CurToken());
 
     // Starting condition //////////
 
@@ -112,15 +131,15 @@ std::shared_ptr<ast::ForStatement> Parser::ParseForStatement()
         return nullptr;
     }
 
-    std::cout << "CUR TOKEN LITERAL is " << cur_token_.literal_ << std::endl;
+    std::cout << "CUR TOKEN LITERAL is " << CurToken().literal_ << std::endl;
 
     stmt->iterator_ =
-        std::make_shared<ast::Identifier>(cur_token_, cur_token_.literal_);
+        ref::Make<ast::Identifier>(CurToken(), CurToken().literal_);
 
     std::cout << "My iterator Identifier is " << stmt->iterator_->String()
               << std::endl;
 
-    std::cout << "All good so far - CUR TOKEN is " << cur_token_.literal_
+    std::cout << "All good so far - CUR TOKEN is " << CurToken().literal_
               << std::endl;
 
     if (!ExpectPeek(token::ASSIGN))
@@ -129,7 +148,7 @@ std::shared_ptr<ast::ForStatement> Parser::ParseForStatement()
         return nullptr;
     }
     NextToken();
-    std::cout << "All good so far - CUR TOKEN is " << cur_token_.literal_
+    std::cout << "All good so far - CUR TOKEN is " << CurToken().literal_
               << std::endl;
 
     stmt->iterator_value_ = ParseExpression(Precedence::LOWEST);
@@ -147,23 +166,23 @@ std::shared_ptr<ast::ForStatement> Parser::ParseForStatement()
     std::cout << "SOFARLYSOGOOD - looking for TERMINATION\n";
     // Termination Condition /////////////
     std::cout << "Looking for TERMINATION CONDITION - CUR TOKEN is "
-              << cur_token_.literal_ << std::endl;
+              << CurToken().literal_ << std::endl;
     stmt->termination_condition_ = ParseExpression(Precedence::LOWEST);
 
     std::cout << "GOT TERMINATION CONDITION - "
               << stmt->termination_condition_->String() << ". CUR TOKEN is "
-              << cur_token_.literal_ << " Now looking for INCREMENT exression"
+              << CurToken().literal_ << " Now looking for INCREMENT exression"
               << std::endl;
 
     NextToken();
     NextToken();
-    std::cout << " __ POSITION __ cur_token:" << cur_token_.literal_
-              << " Peek_token:" << peek_token_.literal_ << std::endl;
+    std::cout << " __ POSITION __ cur_token:" << CurToken().literal_
+              << " Peek_token:" << PeekToken().literal_ << std::endl;
 
     // Increment Expression
     stmt->increment_ = ParseExpression(Precedence::LOWEST);
     std::cout << "All good so far - INCR is " << stmt->increment_->String()
-              << ". CUR TOKEN is " << cur_token_.literal_ << std::endl;
+              << ". CUR TOKEN is " << CurToken().literal_ << std::endl;
 
     // Body
     if (!ExpectPeek(token::RPAREN))
@@ -171,17 +190,17 @@ std::shared_ptr<ast::ForStatement> Parser::ParseForStatement()
     NextToken();
 
     std::cout << "pARSE BLOCK! "
-              << ". CUR TOKEN is " << cur_token_.literal_ << std::endl;
+              << ". CUR TOKEN is " << CurToken().literal_ << std::endl;
 
     stmt->body_ = ParseBlockStatement();
 
     return stmt;
 }
 
-std::shared_ptr<ast::ExpressionStatement> Parser::ParseExpressionStatement()
+ref::Ref<ast::ExpressionStatement> Parser::ParseExpressionStatement()
 {
-    std::shared_ptr<ast::ExpressionStatement> stmt =
-        std::make_shared<ast::ExpressionStatement>(cur_token_);
+    ref::Ref<ast::ExpressionStatement> stmt =
+        ref::Make<ast::ExpressionStatement>(CurToken());
     stmt->expression_ = ParseExpression(Precedence::LOWEST);
 
     if (PeekTokenIs(token::SEMICOLON))
@@ -218,146 +237,253 @@ bool Parser::ExpectPeek(token::TokenType t)
 
 void Parser::NextToken()
 {
-    cur_token_ = peek_token_;
-    peek_token_ = lexer_->NextToken();
+    // stays on the EOF at the end; nothing ever looks back
+    if (tokens_.Kind(pos_) != token::EOFF)
+        tokens_.Release(++pos_);
 }
 
 bool Parser::CurTokenIs(token::TokenType t) const
 {
-    if (cur_token_.type_.compare(t) == 0)
-        return true;
-    return false;
+    return CurType() == t;
 }
 
 bool Parser::PeekTokenIs(token::TokenType t) const
 {
-    if (peek_token_.type_.compare(t) == 0)
-        return true;
-    return false;
+    return PeekType() == t;
 }
 
 void Parser::PeekError(token::TokenType t)
 {
     std::stringstream msg;
-    msg << "Expected next token to be " << t << ", got " << peek_token_.type_
+    msg << "Expected next token to be " << t << ", got " << PeekType()
         << " instead";
     errors_.push_back(msg.str());
 }
 
-static bool IsInfixOperator(token::TokenType type)
-{
-    if (type == token::PLUS || type == token::MINUS || type == token::SLASH ||
-        type == token::ASTERISK || type == token::EQ || type == token::NOT_EQ ||
-        type == token::LT || type == token::GT || type == token::LPAREN ||
-        type == token::LBRACKET)
-    {
-        return true;
-    }
-    return false;
-}
-
 //////////////////////////////////////////////////////////////////
 
-std::shared_ptr<ast::Expression> Parser::ParseExpression(Precedence p)
-{
-    // these are the 'nuds' (null detontations) in the Vaughan Pratt paper 'top
-    // down operator precedence'.
-    std::shared_ptr<ast::Expression> left_expr = ParseForPrefixExpression();
-
-    if (!left_expr)
+// Everything the Pratt loop below needs to know about a token kind. A new
+// operator is one line here (plus its token and AST node).
+const Parser::Rules Parser::rules_ = []() {
+    Rules r{};
+    r[token::IDENT] = {&Parser::ParseIdentifier};
+    r[token::INT] = {&Parser::ParseIntegerLiteral};
+    r[token::STRING] = {&Parser::ParseStringLiteral};
+    r[token::TRUE] = {&Parser::ParseBoolean};
+    r[token::FALSE] = {&Parser::ParseBoolean};
+    r[token::BANG] = {&Parser::ParsePrefixExpression};
+    r[token::INCREMENT] = {&Parser::ParsePrefixExpression};
+    r[token::DECREMENT] = {&Parser::ParsePrefixExpression};
+    r[token::IF] = {&Parser::ParseIfExpression};
+    r[token::FUNCTION] = {&Parser::ParseFunctionLiteral};
+    r[token::LBRACE] = {&Parser::ParseHashLiteral};
+
+    r[token::MINUS] = {&Parser::ParsePrefixExpression,
+                       &Parser::ParseInfixExpression, Precedence::SUM};
+    r[token::PLUS] = {nullptr, &Parser::ParseInfixExpression, Precedence::SUM};
+    r[token::ASTERISK] = {nullptr, &Parser::ParseInfixExpression,
+                          Precedence::PRODUCT};
+    r[token::SLASH] = {nullptr, &Parser::ParseInfixExpression,
+                       Precedence::PRODUCT};
+    r[token::EQ] = {nullptr, &Parser::ParseInfixExpression,
+                    Precedence::EQUALS};
+    r[token::NOT_EQ] = {nullptr, &Parser::ParseInfixExpression,
+                        Precedence::EQUALS};
+    r[token::LT] = {nullptr, &Parser::ParseInfixExpression,
+                    Precedence::LESSGREATER};
+    r[token::GT] = {nullptr, &Parser::ParseInfixExpression,
+                    Precedence::LESSGREATER};
+    r[token::LPAREN] = {&Parser::ParseGroupedExpression,
+                        &Parser::ParseCallExpression, Precedence::CALL};
+    r[token::LBRACKET] = {&Parser::ParseArrayLiteral,
+                          &Parser::ParseIndexExpression, Precedence::INDEX};
+    return r;
+}();
+
+// The Pratt loop, run on an explicit stack. Prefix operators, infix
+// operators and parentheses - what machine-generated code nests tens of
+// thousands deep - push a frame here rather than recursing, and build
+// exactly what ParsePrefixExpression / ParseInfixExpression /
+// ParseGroupedExpression would. Everything else (calls, literals, blocks)
+// still recurses, bounded by kMaxNesting. Each expression's depth is worked
+// out as it's built, and one deeper than kMaxNesting is an error, though
+// the rest of it is still parsed.
+ref::Ref<ast::Expression> Parser::ParseExpression(Precedence p)
+{
+    if (nesting_ >= kMaxNesting)
+    {
+        errors_.push_back("expression nested more than " +
+                          std::to_string(kMaxNesting) + " levels deep");
         return nullptr;
+    }
+    nesting_++;
 
-    while (!PeekTokenIs(token::SEMICOLON) && p < PeekPrecedence())
+    struct Frame
     {
-        if (IsInfixOperator(peek_token_.type_))
+        // the prefix or infix expression waiting for its right operand, or
+        // null for a '('
+        ref::Ref<ast::Expression> node;
+        ref::Ref<ast::Expression> *operand;
+        // what to carry on at once it's complete
+        Precedence outer;
+        // how deep an infix expression's left operand is
+        size_t left_depth;
+    };
+    std::vector<Frame> stack;
+    ref::Ref<ast::Expression> left_expr;
+    // how deep left_expr is
+    size_t depth = 0;
+    bool too_deep = false;
+    auto check_depth = [this, &depth, &too_deep]() {
+        if (depth > kMaxNesting && !too_deep)
         {
+            errors_.push_back("expression nested more than " +
+                              std::to_string(kMaxNesting) + " levels deep");
+            too_deep = true;
+        }
+    };
+    // Runs a parse that may recurse into ParseExpression, returning how deep
+    // the deepest expression it parsed was.
+    auto deepest_in = [this](auto parse) {
+        size_t outer = deepest_;
+        deepest_ = 0;
+        parse();
+        size_t inner = deepest_;
+        deepest_ = outer;
+        return inner;
+    };
+
+    for (;;)
+    {
+        // these are the 'nuds' (null detontations) in the Vaughan Pratt paper
+        // 'top down operator precedence'.
+        PrefixParseFn prefix = rules_[CurType()].prefix;
+        if (prefix == &Parser::ParsePrefixExpression)
+        {
+            auto expression = ref::Make<ast::PrefixExpression>(
+                CurToken(), CurToken().literal_);
+            stack.push_back({expression, &expression->right_, p, 0});
+            p = Precedence::PREFIX;
+            NextToken();
+            continue;
+        }
+        if (prefix == &Parser::ParseGroupedExpression)
+        {
+            stack.push_back({nullptr, nullptr, p, 0});
+            p = Precedence::LOWEST;
             NextToken();
-            if (cur_token_.type_ == token::LPAREN)
-                left_expr = ParseCallExpression(left_expr);
-            else if (cur_token_.type_ == token::LBRACKET)
-                left_expr = ParseIndexExpression(left_expr);
-            else // these are the 'leds' (left denotation)
-                left_expr = ParseInfixExpression(left_expr);
+            continue;
         }
-        else
+        depth = 1 + deepest_in(
+                        [this, &left_expr]() {
+                            left_expr = ParseForPrefixExpression();
+                        });
+        check_depth();
+
+        bool want_operand = false;
+        while (!want_operand)
         {
-            return left_expr;
+            // and these are the 'leds' (left denotation) - a failed operand
+            // skips straight to handing null up a level
+            while (left_expr && !PeekTokenIs(token::SEMICOLON) &&
+                   p < PeekPrecedence())
+            {
+                InfixParseFn infix = rules_[PeekType()].infix;
+                if (!infix)
+                    break;
+
+                NextToken();
+                if (infix != &Parser::ParseInfixExpression)
+                {
+                    // a call or index, taking left_expr as its first part
+                    size_t inner = deepest_in([&]() {
+                        left_expr = (this->*infix)(left_expr);
+                    });
+                    depth = 1 + std::max(depth, inner);
+                    check_depth();
+                    continue;
+                }
+                auto expression = ref::Make<ast::InfixExpression>(
+                    CurToken(), CurToken().literal_, left_expr);
+                stack.push_back({expression, &expression->right_, p, depth});
+                p = CurPrecedence();
+                NextToken();
+                want_operand = true;
+                break;
+            }
+            if (want_operand)
+                break;
+
+            // Nothing more binds at this level, so left_expr completes the
+            // frame on top of the stack.
+            if (stack.empty())
+            {
+                nesting_--;
+                deepest_ = std::max(deepest_, depth);
+                return too_deep ? nullptr : left_expr;
+            }
+            Frame frame = std::move(stack.back());
+            stack.pop_back();
+            p = frame.outer;
+            if (frame.node)
+            {
+                *frame.operand = left_expr;
+                left_expr = frame.node;
+                depth = 1 + std::max(depth, frame.left_depth);
+                check_depth();
+            }
+            else if (!ExpectPeek(token::RPAREN))
+            {
+                left_expr = nullptr;
+            }
         }
     }
-    return left_expr;
-}
-
-std::shared_ptr<ast::Expression> Parser::ParseForPrefixExpression()
-{
-    if (cur_token_.type_ == token::IDENT)
-        return ParseIdentifier();
-    else if (cur_token_.type_ == token::INT)
-        return ParseIntegerLiteral();
-    else if (cur_token_.type_ == token::INCREMENT)
-        return ParsePrefixExpression();
-    else if (cur_token_.type_ == token::DECREMENT)
-        return ParsePrefixExpression();
-    else if (cur_token_.type_ == token::BANG)
-        return ParsePrefixExpression();
-    else if (cur_token_.type_ == token::MINUS)
-        return ParsePrefixExpression();
-    else if (cur_token_.type_ == token::TRUE)
-        return ParseBoolean();
-    else if (cur_token_.type_ == token::FALSE)
-        return ParseBoolean();
-    else if (cur_token_.type_ == token::LPAREN)
-        return ParseGroupedExpression();
-    else if (cur_token_.type_ == token::IF)
-        return ParseIfExpression();
-    else if (cur_token_.type_ == token::FUNCTION)
-        return ParseFunctionLiteral();
-    else if (cur_token_.type_ == token::STRING)
-        return ParseStringLiteral();
-    else if (cur_token_.type_ == token::LBRACKET)
-        return ParseArrayLiteral();
-    else if (cur_token_.type_ == token::LBRACE)
-        return ParseHashLiteral();
-
-    std::cout << "No Prefix parser for " << cur_token_.type_ << std::endl;
+}
+
+ref::Ref<ast::Expression> Parser::ParseForPrefixExpression()
+{
+    PrefixParseFn prefix = rules_[CurType()].prefix;
+    if (prefix)
+        return (this->*prefix)();
+
+    std::cout << "No Prefix parser for " << CurType() << std::endl;
     return nullptr;
 }
 
-std::shared_ptr<ast::Expression> Parser::ParseIdentifier()
+ref::Ref<ast::Expression> Parser::ParseIdentifier()
 {
-    return std::make_shared<ast::Identifier>(cur_token_, cur_token_.literal_);
+    return ref::Make<ast::Identifier>(CurToken(), CurToken().literal_);
 }
 
-std::shared_ptr<ast::Expression> Parser::ParseBoolean()
+ref::Ref<ast::Expression> Parser::ParseBoolean()
 {
-    return std::make_shared<ast::BooleanExpression>(cur_token_,
-                                                    CurTokenIs(token::TRUE));
+    return ref::Make<ast::BooleanExpression>(CurToken(),
+                                             CurTokenIs(token::TRUE));
 }
 
-std::shared_ptr<ast::Expression> Parser::ParseArrayLiteral()
+ref::Ref<ast::Expression> Parser::ParseArrayLiteral()
 {
-    auto array_lit = std::make_shared<ast::ArrayLiteral>(cur_token_);
+    auto array_lit = ref::Make<ast::ArrayLiteral>(CurToken());
     array_lit->elements_ = ParseExpressionList(token::RBRACKET);
     return array_lit;
 }
 
-std::shared_ptr<ast::Expression> Parser::ParseHashLiteral()
+ref::Ref<ast::Expression> Parser::ParseHashLiteral()
 {
-    auto hash_lit = std::make_shared<ast::HashLiteral>(cur_token_);
+    auto hash_lit = ref::Make<ast::HashLiteral>(CurToken());
 
     while (!PeekTokenIs(token::RBRACE))
     {
         NextToken();
-        std::shared_ptr<ast::Expression> key =
-            ParseExpression(Precedence::LOWEST);
+        ref::Ref<ast::Expression> key = ParseExpression(Precedence::LOWEST);
 
         if (!ExpectPeek(token::COLON))
             return nullptr;
 
         NextToken();
-        std::shared_ptr<ast::Expression> val =
-            ParseExpression(Precedence::LOWEST);
+        ref::Ref<ast::Expression> val = ParseExpression(Precedence::LOWEST);
 
-        hash_lit->pairs_.insert({key, val});
+        hash_lit->pairs_.emplace_back(key, val);
 
         if (!PeekTokenIs(token::RBRACE) && !ExpectPeek(token::COMMA))
             return nullptr;
@@ -370,17 +496,14 @@ std::shared_ptr<ast::Expression> Parser::ParseHashLiteral()
     return hash_lit;
 }
 
-std::shared_ptr<ast::Expression> Parser::ParseIntegerLiteral()
+ref::Ref<ast::Expression> Parser::ParseIntegerLiteral()
 {
-    auto literal = std::make_shared<ast::IntegerLiteral>(cur_token_);
-    int64_t val = std::stoll(cur_token_.literal_, nullptr, 10);
-    literal->value_ = val;
-    return literal;
+    return ref::Make<ast::IntegerLiteral>(CurToken(), tokens_.Value(pos_));
 }
 
-std::shared_ptr<ast::Expression> Parser::ParseIfExpression()
+ref::Ref<ast::Expression> Parser::ParseIfExpression()
 {
-    auto expression = std::make_shared<ast::IfExpression>(cur_token_);
+    auto expression = ref::Make<ast::IfExpression>(CurToken());
 
     if (!ExpectPeek(token::LPAREN))
         return nullptr;
@@ -409,9 +532,10 @@ std::shared_ptr<ast::Expression> Parser::ParseIfExpression()
     return expression;
 }
 
-std::shared_ptr<ast::Expression> Parser::ParseFunctionLiteral()
+ref::Ref<ast::Expression> Parser::ParseFunctionLiteral()
 {
-    auto lit = std::make_shared<ast::FunctionLiteral>(cur_token_);
+    auto lit = ref::Make<ast::FunctionLiteral>(CurToken());
+    lit->source_ = tokens_.Source();
 
     if (!ExpectPeek(token::LPAREN))
         return nullptr;
@@ -421,21 +545,46 @@ std::shared_ptr<ast::Expression> Parser::ParseFunctionLiteral()
     if (!ExpectPeek(token::LBRACE))
         return nullptr;
 
-    lit->body_ = ParseBlockStatement();
+    if (!lazy_bodies_ || !SkipBlock(*lit))
+        lit->body_ = ParseBlockStatement();
 
     return lit;
 }
 
-std::shared_ptr<ast::Expression> Parser::ParseStringLiteral()
+// Steps over the block starting at the current '{' to its matching '}',
+// leaving its text on `fn` for ParseBody. The lexer has already dealt with
+// braces inside string literals. An unclosed block isn't skipped, so that
+// parsing it reports the error now.
+bool Parser::SkipBlock(ast::FunctionLiteral &fn)
 {
-    return std::make_shared<ast::StringLiteral>(cur_token_,
-                                                cur_token_.literal_);
+    const char *begin = tokens_.Literal(pos_).data();
+    size_t depth = 0;
+    for (size_t i = pos_; tokens_.Kind(i) != token::EOFF; i++)
+    {
+        token::TokenType kind = tokens_.Kind(i);
+        if (kind == token::LBRACE)
+            depth++;
+        else if (kind == token::RBRACE && --depth == 0)
+        {
+            const char *end = tokens_.Literal(i).data() + 1;
+            fn.pending_body_ = std::string_view(begin, end - begin);
+            pos_ = i;
+            tokens_.Release(pos_);
+            return true;
+        }
+    }
+    return false;
 }
 
-std::shared_ptr<ast::Expression> Parser::ParsePrefixExpression()
+ref::Ref<ast::Expression> Parser::ParseStringLiteral()
 {
-    auto expression = std::make_shared<ast::PrefixExpression>(
-        cur_token_, cur_token_.literal_);
+    return ref::Make<ast::StringLiteral>(CurToken(), CurToken().literal_);
+}
+
+ref::Ref<ast::Expression> Parser::ParsePrefixExpression()
+{
+    auto expression = ref::Make<ast::PrefixExpression>(
+        CurToken(), CurToken().literal_);
 
     NextToken();
 
@@ -444,11 +593,11 @@ std::shared_ptr<ast::Expression> Parser::ParsePrefixExpression()
     return expression;
 }
 
-std::shared_ptr<ast::Expression>
-Parser::ParseInfixExpression(std::shared_ptr<ast::Expression> left)
+ref::Ref<ast::Expression>
+Parser::ParseInfixExpression(ref::Ref<ast::Expression> left)
 {
-    auto expression = std::make_shared<ast::InfixExpression>(
-        cur_token_, cur_token_.literal_, left);
+    auto expression = ref::Make<ast::InfixExpression>(
+        CurToken(), CurToken().literal_, left);
 
     auto precedence = CurPrecedence();
     NextToken();
@@ -457,10 +606,10 @@ Parser::ParseInfixExpression(std::shared_ptr<ast::Expression> left)
     return expression;
 }
 
-std::shared_ptr<ast::Expression> Parser::ParseGroupedExpression()
+ref::Ref<ast::Expression> Parser::ParseGroupedExpression()
 {
     NextToken();
-    std::shared_ptr<ast::Expression> expr = ParseExpression(Precedence::LOWEST);
+    ref::Ref<ast::Expression> expr = ParseExpression(Precedence::LOWEST);
     if (!ExpectPeek(token::RPAREN))
         return nullptr;
     return expr;
@@ -468,24 +617,17 @@ std::shared_ptr<ast::Expression> Parser::ParseGroupedExpression()
 
 Precedence Parser::PeekPrecedence() const
 {
-    auto it = precedences.find(peek_token_.type_);
-    if (it != precedences.end())
-        return it->second;
-
-    return Precedence::LOWEST;
+    return rules_[PeekType()].precedence;
 }
 
 Precedence Parser::CurPrecedence() const
 {
-    auto it = precedences.find(cur_token_.type_);
-    if (it != precedences.end())
-        return it->second;
-    return Precedence::LOWEST;
+    return rules_[CurType()].precedence;
 }
 
-std::shared_ptr<ast::BlockStatement> Parser::ParseBlockStatement()
+ref::Ref<ast::BlockStatement> Parser::ParseBlockStatement()
 {
-    auto block_stmt = std::make_shared<ast::BlockStatement>(cur_token_);
+    auto block_stmt = ref::Make<ast::BlockStatement>(CurToken());
 
     NextToken();
     while (!CurTokenIs(token::RBRACE) && !CurTokenIs(token::EOFF))
@@ -498,9 +640,9 @@ std::shared_ptr<ast::BlockStatement> Parser::ParseBlockStatement()
     return block_stmt;
 }
 
-std::vector<std::shared_ptr<ast::Identifier>> Parser::ParseFunctionParameters()
+std::vector<ref::Ref<ast::Identifier>> Parser::ParseFunctionParameters()
 {
-    std::vector<std::shared_ptr<ast::Identifier>> identifiers;
+    std::vector<ref::Ref<ast::Identifier>> identifiers;
 
     if (PeekTokenIs(token::RPAREN))
     {
@@ -510,40 +652,39 @@ std::vector<std::shared_ptr<ast::Identifier>> Parser::ParseFunctionParameters()
 
     NextToken();
 
-    auto ident =
-        std::make_shared<ast::Identifier>(cur_token_, cur_token_.literal_);
+    auto ident = ref::Make<ast::Identifier>(CurToken(), CurToken().literal_);
     identifiers.push_back(ident);
     while (PeekTokenIs(token::COMMA))
     {
         NextToken();
         NextToken();
         auto ident =
-            std::make_shared<ast::Identifier>(cur_token_, cur_token_.literal_);
+            ref::Make<ast::Identifier>(CurToken(), CurToken().literal_);
         identifiers.push_back(ident);
     }
 
     if (!ExpectPeek(token::RPAREN))
     {
-        return std::vector<std::shared_ptr<ast::Identifier>>();
+        return std::vector<ref::Ref<ast::Identifier>>();
     }
 
     return identifiers;
 }
 
-std::shared_ptr<ast::Expression>
-Parser::ParseCallExpression(std::shared_ptr<ast::Expression> funct)
+ref::Ref<ast::Expression>
+Parser::ParseCallExpression(ref::Ref<ast::Expression> funct)
 {
-    std::shared_ptr<ast::CallExpression> expr =
-        std::make_shared<ast::CallExpression>(cur_token_, funct);
+    ref::Ref<ast::CallExpression> expr =
+        ref::Make<ast::CallExpression>(CurToken(), funct);
     expr->arguments_ = ParseExpressionList(token::RPAREN);
     return expr;
 }
 
-std::shared_ptr<ast::Expression>
-Parser::ParseIndexExpression(std::shared_ptr<ast::Expression> left)
+ref::Ref<ast::Expression>
+Parser::ParseIndexExpression(ref::Ref<ast::Expression> left)
 {
-    std::shared_ptr<ast::IndexExpression> expr =
-        std::make_shared<ast::IndexExpression>(cur_token_, left);
+    ref::Ref<ast::IndexExpression> expr =
+        ref::Make<ast::IndexExpression>(CurToken(), left);
     NextToken();
     expr->index_ = ParseExpression(Precedence::LOWEST);
     if (!ExpectPeek(token::RBRACKET))
@@ -553,10 +694,10 @@ Parser::ParseIndexExpression(std::shared_ptr<ast::Expression> left)
     return expr;
 }
 
-std::vector<std::shared_ptr<ast::Expression>>
+std::vector<ref::Ref<ast::Expression>>
 Parser::ParseExpressionList(token::TokenType end)
 {
-    std::vector<std::shared_ptr<ast::Expression>> listy;
+    std::vector<ref::Ref<ast::Expression>> listy;
     if (PeekTokenIs(end))
     {
         NextToken();
@@ -575,9 +716,270 @@ Parser::ParseExpressionList(token::TokenType end)
 
     if (!ExpectPeek(end))
     {
-        return std::vector<std::shared_ptr<ast::Expression>>();
+        return std::vector<ref::Ref<ast::Expression>>();
     }
 
     return listy;
 }
+
+std::vector<size_t> SplitPoints(std::string_view text, size_t target)
+{
+    std::vector<size_t> points{0};
+    stream::Splitter splitter;
+    size_t next_cut = target;
+    for (size_t end = splitter.Next(text, 0); end != std::string_view::npos;
+         end = splitter.Next(text, end))
+    {
+        if (end < next_cut)
+            continue;
+        points.push_back(end);
+        next_cut = end + target;
+    }
+    if (points.back() != text.size())
+        points.push_back(text.size());
+    return points;
+}
+
+ref::Ref<ast::Program>
+ParseProgramParallel(std::shared_ptr<source::Buffer> source, unsigned threads,
+                     bool lazy_bodies)
+{
+    // below this a piece isn't worth a thread
+    constexpr size_t kMinPiece = 64 * 1024;
+
+    threads = std::max(threads, 1u);
+    // a few pieces per thread so one slow piece doesn't hold up the rest
+    size_t target = std::max(kMinPiece, source->Size() / (threads * 4));
+    std::vector<size_t> points = SplitPoints(source->Text(), target);
+    size_t pieces = points.size() - 1;
+
+    std::vector<std::unique_ptr<Parser>> parsers(pieces);
+    std::vector<ref::Ref<ast::Program>> programs(pieces);
+    std::atomic<size_t> next_piece{0};
+    auto work = [&]() {
+        for (size_t i = next_piece++; i < pieces; i = next_piece++)
+        {
+            auto lex = std::make_shared<lexer::Lexer>(source, points[i],
+                                                      points[i + 1]);
+            parsers[i] = std::make_unique<Parser>(lex);
+            parsers[i]->SetLazyBodies(lazy_bodies);
+            programs[i] = parsers[i]->ParseProgram();
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < std::min<size_t>(threads, pieces); t++)
+        pool.emplace_back(work);
+    work();
+    for (auto &t : pool)
+        t.join();
+
+    bool failed = false;
+    for (auto &p : parsers)
+        failed = p->CheckErrors() || failed;
+    if (failed)
+        return nullptr;
+
+    auto program = ref::Make<ast::Program>();
+    program->source_ = source;
+    for (auto &piece : programs)
+    {
+        program->statements_.insert(
+            program->statements_.end(),
+            std::make_move_iterator(piece->statements_.begin()),
+            std::make_move_iterator(piece->statements_.end()));
+    }
+    return program;
+}
+
+ref::Ref<ast::BlockStatement> ParseBody(ast::FunctionLiteral &fn)
+{
+    std::call_once(fn.body_parsed_, [&fn]() {
+        if (fn.body_ || fn.pending_body_.empty() || !fn.source_)
+            return;
+
+        size_t begin = fn.pending_body_.data() - fn.source_->Text().data();
+        auto lex = std::make_shared<lexer::Lexer>(
+            fn.source_, begin, begin + fn.pending_body_.size());
+        Parser parsley{lex};
+        // functions inside it are left for later too
+        parsley.SetLazyBodies(true);
+        auto body = parsley.ParseBlockStatement();
+        if (parsley.CheckErrors())
+            return;
+        // other threads may be reading fn - they'll be reading this too
+        if (fn.IsShared())
+            body->Share();
+        fn.body_ = body;
+    });
+    return fn.body_;
+}
+
+namespace
+{
+
+// Where `stmt` starts in `text`: its first token, less the opening quote the
+// lexer leaves off a string literal.
+size_t StartOf(const ast::Statement &stmt, std::string_view text)
+{
+    size_t offset = stmt.token_.literal_.data() - text.data();
+    return stmt.token_.type_ == token::STRING ? offset - 1 : offset;
+}
+
+// What a program made from `previous` points into, when its statements
+// from `first` up to `resume` are replaced by `parsed` ones from `piece`.
+// Buffers no statement points into any more are let go. Each statement is
+// parsed from a single buffer, so where its first token is says which.
+std::vector<ast::Program::Retained>
+Retain(const ast::Program &previous, size_t first, size_t resume,
+       std::shared_ptr<source::Buffer> piece, size_t parsed)
+{
+    using Retained = ast::Program::Retained;
+    std::vector<Retained> retained = previous.retained_;
+    if (retained.empty())
+        retained.push_back({previous.source_, previous.statements_.size()});
+    // the first buffer starting after `at`; std::less, as the buffers are
+    // separate allocations
+    auto after = [&retained](const char *at) {
+        return std::upper_bound(retained.begin(), retained.end(), at,
+                                [](const char *p, const Retained &r) {
+                                    return std::less<const char *>()(
+                                        p, r.buffer->Text().data());
+                                });
+    };
+
+    for (size_t i = first; i < resume; i++)
+        std::prev(after(previous.statements_[i]->token_.literal_.data()))
+            ->statements--;
+    if (parsed > 0)
+        retained.insert(after(piece->Text().data()), {piece, parsed});
+    retained.erase(std::remove_if(retained.begin(), retained.end(),
+                                  [](const Retained &r) {
+                                      return r.statements == 0;
+                                  }),
+                   retained.end());
+    return retained;
+}
+
+std::vector<size_t> StatementOffsets(const ast::Program &program)
+{
+    if (!program.offsets_.empty() || program.statements_.empty())
+        return program.offsets_;
+
+    std::vector<size_t> offsets;
+    offsets.reserve(program.statements_.size());
+    for (auto const &stmt : program.statements_)
+        offsets.push_back(StartOf(*stmt, program.source_->Text()));
+    return offsets;
+}
+
+} // namespace
+
+ref::Ref<ast::Program> Reparse(const ast::Program &previous, const Edit &edit,
+                               bool lazy_bodies)
+{
+    std::string_view old_text = previous.source_->Text();
+    if (edit.offset > old_text.size() ||
+        edit.removed > old_text.size() - edit.offset)
+    {
+        std::cerr << "Edit is outside the script" << std::endl;
+        return nullptr;
+    }
+
+    std::string text;
+    text.reserve(old_text.size() - edit.removed + edit.inserted.size());
+    text.append(old_text.substr(0, edit.offset));
+    text.append(edit.inserted);
+    text.append(old_text.substr(edit.offset + edit.removed));
+    auto source = source::FromString(std::move(text));
+    std::string_view new_text = source->Text();
+    // the new text past here is the old text past the edit
+    size_t edit_end = edit.offset + edit.inserted.size();
+    ptrdiff_t delta = ptrdiff_t(edit.inserted.size()) - ptrdiff_t(edit.removed);
+
+    // Start at the statement before the one holding the character just
+    // ahead of the edit - that character's token can be joined onto by the
+    // edit, and the statement before it peeked at its first token.
+    std::vector<size_t> starts = StatementOffsets(previous);
+    size_t n = starts.size();
+    size_t touched = edit.offset == 0 ? 0 : edit.offset - 1;
+    size_t held = std::upper_bound(starts.begin(), starts.end(), touched) -
+                  starts.begin();
+    size_t first = held >= 2 ? held - 2 : 0;
+    // Some malformed input parses into statements out of source order;
+    // then there's nothing to go on, and all of it is parsed again.
+    bool ordered = std::adjacent_find(starts.begin(), starts.end(),
+                                      std::greater_equal<size_t>()) ==
+                   starts.end();
+    if (!ordered)
+        first = 0;
+    size_t begin = first == 0 ? 0 : starts[first];
+
+    // End just past the first top-level ';' after the edit that an old
+    // statement started after too - from there on, old and new text parse
+    // the same.
+    size_t end = new_text.size();
+    size_t resume = n;
+    stream::Splitter splitter;
+    for (size_t p = begin; ordered &&
+         (p = splitter.Next(new_text, p)) != std::string_view::npos;)
+    {
+        if (p < edit_end)
+            continue;
+        size_t next = p;
+        while (next < new_text.size() && scan::IsWhitespace(new_text[next]))
+            next++;
+        if (next == new_text.size())
+            break;
+        size_t old_next = next - delta;
+        auto same = std::lower_bound(starts.begin() + first, starts.end(),
+                                     old_next);
+        if (same != starts.end() && *same == old_next)
+        {
+            end = p;
+            resume = same - starts.begin();
+            break;
+        }
+    }
+
+    // A copy of just the reparsed text, so what the new statements point
+    // into is only as big as they are.
+    auto piece = source::FromString(
+        std::string{new_text.substr(begin, end - begin)});
+    auto lex = std::make_shared<lexer::Lexer>(piece);
+    Parser parsley{lex};
+    parsley.SetLazyBodies(lazy_bodies);
+    auto reparsed = parsley.ParseProgram();
+    if (parsley.CheckErrors())
+        return nullptr;
+
+    auto program = ref::Make<ast::Program>();
+    program->source_ = source;
+
+    size_t count = first + reparsed->statements_.size() + (n - resume);
+    program->statements_.reserve(count);
+    program->offsets_.reserve(count);
+    for (size_t i = 0; i < first; i++)
+    {
+        program->statements_.push_back(previous.statements_[i]);
+        program->offsets_.push_back(starts[i]);
+    }
+    for (auto &stmt : reparsed->statements_)
+    {
+        program->offsets_.push_back(begin + StartOf(*stmt, piece->Text()));
+        program->statements_.push_back(std::move(stmt));
+    }
+    for (size_t i = resume; i < n; i++)
+    {
+        program->statements_.push_back(previous.statements_[i]);
+        program->offsets_.push_back(starts[i] + delta);
+    }
+
+    // only what the statements still point into, so edits to the same
+    // statements don't pile up the text they've replaced
+    program->retained_ = Retain(previous, first, resume, piece,
+                                reparsed->statements_.size());
+    return program;
+}
+
 } // namespace parser
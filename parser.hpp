@@ -1,13 +1,16 @@
 #pragma once
 
+#include <array>
 #include <memory>
 #include <sstream>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <vector>
 
 #include "ast.hpp"
 #include "lexer.hpp"
+#include "ref.hpp"
+#include "source.hpp"
 #include "token.hpp"
 
 namespace parser
@@ -26,60 +29,70 @@ enum class Precedence
     INDEX
 };
 
-const std::unordered_map<token::TokenType, Precedence> precedences{
-    {token::EQ, Precedence::EQUALS},
-    {token::NOT_EQ, Precedence::EQUALS},
-    {token::LT, Precedence::LESSGREATER},
-    {token::GT, Precedence::LESSGREATER},
-    {token::PLUS, Precedence::SUM},
-    {token::MINUS, Precedence::SUM},
-    {token::SLASH, Precedence::PRODUCT},
-    {token::ASTERISK, Precedence::PRODUCT},
-    {token::LPAREN, Precedence::CALL},
-    {token::LBRACKET, Precedence::INDEX}};
-
 class Parser
 {
   public:
     explicit Parser(std::shared_ptr<lexer::Lexer> lexer);
 
-    std::shared_ptr<ast::Program> ParseProgram();
+    using PrefixParseFn = ref::Ref<ast::Expression> (Parser::*)();
+    using InfixParseFn = ref::Ref<ast::Expression> (Parser::*)(
+        ref::Ref<ast::Expression>);
+
+    // How a token kind parses at the start of an expression (prefix), after
+    // one (infix), and how tightly it binds in the infix position.
+    struct Rule
+    {
+        PrefixParseFn prefix{nullptr};
+        InfixParseFn infix{nullptr};
+        Precedence precedence{Precedence::LOWEST};
+    };
+    using Rules = std::array<Rule, token::NUM_TOKEN_TYPES>;
+
+    ref::Ref<ast::Program> ParseProgram();
     bool CheckErrors();
 
+    // With lazy bodies on, function bodies are only skimmed to their closing
+    // brace - ParseBody parses each one the first time it's called.
+    void SetLazyBodies(bool lazy) { lazy_bodies_ = lazy; }
+
   private:
-    std::shared_ptr<ast::Statement> ParseStatement();
-    std::shared_ptr<ast::LetStatement> ParseLetStatement();
-    std::shared_ptr<ast::ReturnStatement> ParseReturnStatement();
-    std::shared_ptr<ast::ForStatement> ParseForStatement();
-
-    std::shared_ptr<ast::ExpressionStatement> ParseExpressionStatement();
-
-    std::shared_ptr<ast::Expression> ParseExpression(Precedence p);
-    std::shared_ptr<ast::Expression> ParseIdentifier();
-    std::shared_ptr<ast::Expression> ParseIntegerLiteral();
-    std::shared_ptr<ast::Expression> ParseBoolean();
-    std::shared_ptr<ast::Expression> ParseForPrefixExpression();
-    std::shared_ptr<ast::Expression> ParsePrefixExpression();
-    std::shared_ptr<ast::Expression>
-    ParseInfixExpression(std::shared_ptr<ast::Expression> left);
-    std::shared_ptr<ast::Expression> ParseGroupedExpression();
-    std::shared_ptr<ast::Expression> ParseIfExpression();
-
-    std::shared_ptr<ast::Expression>
-    ParseIndexExpression(std::shared_ptr<ast::Expression> left);
-
-    std::shared_ptr<ast::Expression> ParseFunctionLiteral();
-    std::shared_ptr<ast::Expression> ParseStringLiteral();
-    std::shared_ptr<ast::Expression> ParseArrayLiteral();
-    std::shared_ptr<ast::Expression> ParseHashLiteral();
-    std::vector<std::shared_ptr<ast::Identifier>> ParseFunctionParameters();
-
-    std::shared_ptr<ast::Expression>
-    ParseCallExpression(std::shared_ptr<ast::Expression> funct);
-    std::vector<std::shared_ptr<ast::Expression>>
+    friend ref::Ref<ast::BlockStatement>
+    ParseBody(ast::FunctionLiteral &fn);
+
+    ref::Ref<ast::Statement> ParseStatement();
+    ref::Ref<ast::LetStatement> ParseLetStatement();
+    ref::Ref<ast::ReturnStatement> ParseReturnStatement();
+    ref::Ref<ast::ForStatement> ParseForStatement();
+
+    ref::Ref<ast::ExpressionStatement> ParseExpressionStatement();
+
+    ref::Ref<ast::Expression> ParseExpression(Precedence p);
+    ref::Ref<ast::Expression> ParseIdentifier();
+    ref::Ref<ast::Expression> ParseIntegerLiteral();
+    ref::Ref<ast::Expression> ParseBoolean();
+    ref::Ref<ast::Expression> ParseForPrefixExpression();
+    ref::Ref<ast::Expression> ParsePrefixExpression();
+    ref::Ref<ast::Expression>
+    ParseInfixExpression(ref::Ref<ast::Expression> left);
+    ref::Ref<ast::Expression> ParseGroupedExpression();
+    ref::Ref<ast::Expression> ParseIfExpression();
+
+    ref::Ref<ast::Expression>
+    ParseIndexExpression(ref::Ref<ast::Expression> left);
+
+    ref::Ref<ast::Expression> ParseFunctionLiteral();
+    ref::Ref<ast::Expression> ParseStringLiteral();
+    ref::Ref<ast::Expression> ParseArrayLiteral();
+    ref::Ref<ast::Expression> ParseHashLiteral();
+    std::vector<ref::Ref<ast::Identifier>> ParseFunctionParameters();
+
+    ref::Ref<ast::Expression>
+    ParseCallExpression(ref::Ref<ast::Expression> funct);
+    std::vector<ref::Ref<ast::Expression>>
     ParseExpressionList(token::TokenType end);
 
-    std::shared_ptr<ast::BlockStatement> ParseBlockStatement();
+    ref::Ref<ast::BlockStatement> ParseBlockStatement();
+    bool SkipBlock(ast::FunctionLiteral &fn);
 
     bool ExpectPeek(token::TokenType t);
     bool CurTokenIs(token::TokenType t) const;
@@ -91,12 +104,77 @@ class Parser
     Precedence CurPrecedence() const;
     void NextToken();
 
+    token::TokenType CurType() const { return tokens_.Kind(pos_); }
+    token::TokenType PeekType() const { return tokens_.Kind(pos_ + 1); }
+    token::Token CurToken() const { return tokens_.At(pos_); }
+    token::Token PeekToken() const { return tokens_.At(pos_ + 1); }
+
   private:
+    // indexed by token kind - see parser.cpp
+    static const Rules rules_;
+
     std::shared_ptr<lexer::Lexer> lexer_;
-    token::Token cur_token_;
-    token::Token peek_token_;
+    // the current input's tokens; pos_ is the current one. Reading them
+    // lexes on, which doesn't change what they are, so it's done from const
+    // members too.
+    mutable lexer::TokenStream tokens_;
+    size_t pos_{0};
 
     std::vector<std::string> errors_;
+
+    // How many ParseExpression calls deep we are. Operator and paren nesting
+    // doesn't count - it's parsed on an explicit stack - but calls, literals
+    // and blocks recurse, so they're capped well short of the C++ stack.
+    //
+    // The trees that come out are capped too, as what runs them recurses:
+    // no expression may nest more than kMaxNesting deep, counting its
+    // operators, calls and indexes and everything inside its operands.
+    static constexpr int kMaxNesting = 2000;
+    int nesting_{0};
+    // the depth of the deepest expression parsed since it was last reset
+    size_t deepest_{0};
+
+    bool lazy_bodies_{false};
 };
 
+// The body of `fn`, which a parser with lazy bodies only skimmed, parsed the
+// first time it's asked for and kept on `fn` after that. Safe to call from
+// several threads at once. nullptr, having reported the errors, if the body
+// doesn't parse.
+ref::Ref<ast::BlockStatement> ParseBody(ast::FunctionLiteral &fn);
+
+// Offsets that `text` can be cut at into pieces that parse independently -
+// just after a top-level ';' - spaced at least `target` bytes apart. Starts
+// with 0 and ends with text.size().
+std::vector<size_t> SplitPoints(std::string_view text, size_t target);
+
+// Cuts `source` at SplitPoints, lexes and parses the pieces on up to
+// `threads` worker threads and stitches their statements back together in
+// source order. Small scripts are parsed in one go. Returns nullptr, having
+// reported the errors, if any piece failed to parse.
+ref::Ref<ast::Program>
+ParseProgramParallel(std::shared_ptr<source::Buffer> source, unsigned threads,
+                     bool lazy_bodies = false);
+
+// A change to a script's text: `removed` bytes at `offset` replaced by
+// `inserted`.
+struct Edit
+{
+    size_t offset;
+    size_t removed;
+    std::string inserted;
+};
+
+// `previous` - as parsed from its source_, or an earlier Reparse - with
+// `edit` applied to its text. Only the top-level statements around the edit
+// are lexed and parsed again, out to the first statement after it that
+// starts just past a top-level ';' in both the old and new text. The
+// statements either side are shared with `previous`, so edits cost the
+// size of what they touch rather than of the script. Pass the `lazy_bodies`
+// `previous` was parsed with, for the new statements to be parsed the same
+// way. Returns nullptr, having reported the errors, if the edited statements
+// don't parse.
+ref::Ref<ast::Program> Reparse(const ast::Program &previous, const Edit &edit,
+                               bool lazy_bodies = false);
+
 } // namespace parser
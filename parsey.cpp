@@ -1,23 +1,214 @@
+#include <unistd.h>
+
 #include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <memory>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <utility>
 
+#include "dedup.hpp"
 #include "evaluator.hpp"
+#include "flat.hpp"
 #include "lexer.hpp"
 #include "parser.hpp"
+#include "ref.hpp"
+#include "source.hpp"
+#include "stream.hpp"
 #include "token.hpp"
+#include "vm.hpp"
 
 constexpr char prompt[] = ">> ";
 
-int main()
+namespace
+{
+
+// Which engine --engine= picked. Scripts run on the tree walker unless it
+// was the VM; images, on the VM unless it was the tree walker.
+enum class Engine
 {
-    auto env = std::make_shared<object::Environment>();
+    DEFAULT,
+    TREE,
+    VM
+};
+Engine engine = Engine::DEFAULT;
+// --dedup: share identical constant subtrees across each program parsed from
+// source. Images keep a copy of each, as flattening copies shared nodes out.
+bool share_constants = false;
+
+// What parsing `program` ends with.
+void Finish(ast::Program &program)
+{
+    if (share_constants)
+        dedup::ShareConstants(program);
+}
+
+// What a run keeps between the programs it's given: the tree walker's
+// environment or the VM's globals.
+class Session
+{
+  public:
+    object::Value Eval(ref::Ref<ast::Program> program)
+    {
+        if (engine == Engine::VM)
+            return machine_.Run(*program);
+        return evaluator::Eval(program, env_);
+    }
+
+  private:
+    ref::Ref<object::Environment> env_ = ref::Make<object::Environment>();
+    vm::Machine machine_;
+};
+
+// How a run that ended with `evaluated` exits: in failure, having said why,
+// if it's an error.
+int Exit(const object::Value &evaluated)
+{
+    if (evaluated && evaluated.Type() == object::ERROR_OBJ)
+    {
+        std::cerr << evaluated.Inspect() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int Run(ref::Ref<ast::Program> program)
+{
+    return Exit(Session{}.Eval(program));
+}
+
+// Prints what an input came to, as the REPL always has, unless it's null.
+void Echo(const object::Value &evaluated)
+{
+    if (!evaluated)
+        return;
+    auto result = evaluated.Inspect();
+    if (result.compare("null") != 0)
+        std::cout << result << std::endl;
+}
+
+// Lexes straight out of a read-only mapping of the script - no copy into a
+// std::string, and the page cache is shared with previous runs. Big scripts
+// are parsed a piece at a time across all the cores. With `lazy_bodies`,
+// function bodies are only parsed when first called, for big libraries of
+// which a run uses little.
+//
+// A run is one process, so it doesn't go through cache::Programs(), which
+// could never hit. Scripts run over and over are better saved once with
+// --emit-ast and run with --load-ast.
+int RunFile(const std::string &path, bool lazy_bodies = false)
+{
+    std::shared_ptr<source::Buffer> script = source::FromFile(path);
+    if (!script)
+        return EXIT_FAILURE;
+
+    ref::Ref<ast::Program> program = parser::ParseProgramParallel(
+        script, std::thread::hardware_concurrency(), lazy_bodies);
+    if (!program)
+        return EXIT_FAILURE;
+    Finish(*program);
+    return Run(program);
+}
+
+// Parses the script at `path` once and saves it as an AST image at `out`,
+// for --load-ast to run without lexing or parsing it again.
+int EmitAst(const std::string &path, const std::string &out)
+{
+    std::shared_ptr<source::Buffer> script = source::FromFile(path);
+    if (!script)
+        return EXIT_FAILURE;
+    ref::Ref<ast::Program> program = parser::ParseProgramParallel(
+        script, std::thread::hardware_concurrency());
+    if (!program)
+        return EXIT_FAILURE;
+
+    std::ofstream image{out, std::ios::binary | std::ios::trunc};
+    if (!image)
+    {
+        std::cerr << "Can't open " << out << " for writing" << std::endl;
+        return EXIT_FAILURE;
+    }
+    return flat::Save(flat::Flatten(*program), image) ? EXIT_SUCCESS
+                                                      : EXIT_FAILURE;
+}
+
+// Runs an image saved by --emit-ast straight out of a mapping of it: the VM
+// compiles the tree where it lies, with no pointer AST built. The tree
+// walker needs one, so with --engine=tree the image is inflated first.
+int RunImage(const std::string &path)
+{
+    auto tree = flat::Load(source::FromFile(path));
+    if (!tree)
+        return EXIT_FAILURE;
+    if (engine == Engine::TREE)
+        return Run(flat::Inflate(*tree));
+    return Exit(vm::Machine{}.Run(tree));
+}
+
+int Usage()
+{
+    std::cerr << "usage: slang [--engine=tree|vm] [--dedup] [script | --lazy "
+                 "script | - | --emit-ast script image | --load-ast image]"
+              << std::endl;
+    return EXIT_FAILURE;
+}
+
+// Runs a script piped in on `fd` a statement at a time, as each one arrives,
+// so input of any size runs in bounded memory. It stops at the first error,
+// as a script run from a file does.
+//
+// With `echo`, each top-level statement's result is printed as the REPL
+// prints each input's - which is how input piped into `slang` has always
+// come out. `slang -` reads stdin as the script and prints only what it
+// puts, like a file.
+int RunStream(int fd, bool echo)
+{
+    stream::Reader reader{fd};
+    Session session;
+
+    while (std::shared_ptr<source::Buffer> statements = reader.Next())
+    {
+        auto lex = std::make_shared<lexer::Lexer>(statements);
+        parser::Parser parsley{lex};
+        ref::Ref<ast::Program> program = parsley.ParseProgram();
+        if (parsley.CheckErrors())
+            return EXIT_FAILURE;
+        Finish(*program);
+
+        if (!echo)
+        {
+            if (Exit(session.Eval(program)) != EXIT_SUCCESS)
+                return EXIT_FAILURE;
+            continue;
+        }
+        // a statement at a time, through the one program
+        auto one = ref::Make<ast::Program>();
+        one->source_ = program->source_;
+        one->statements_.resize(1);
+        for (auto &statement : program->statements_)
+        {
+            one->statements_[0] = statement;
+            auto evaluated = session.Eval(one);
+            if (Exit(evaluated) != EXIT_SUCCESS)
+                return EXIT_FAILURE;
+            Echo(evaluated);
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+int Repl()
+{
+    Session session;
 
     std::cout << prompt;
     auto lex = std::make_shared<lexer::Lexer>();
+    // one parser for the whole session - it picks up each new input where
+    // the previous one ended
+    parser::Parser parsley{lex};
 
     for (std::string input; std::getline(std::cin, input);)
     {
@@ -34,21 +225,54 @@ int main()
             continue;
         }
 
-        std::unique_ptr<parser::Parser> parsley =
-            std::make_unique<parser::Parser>(lex);
+        ref::Ref<ast::Program> program = parsley.ParseProgram();
+        if (parsley.CheckErrors())
+        {
+            std::cout << prompt;
+            continue;
+        }
+        Finish(*program);
+
+        Echo(session.Eval(program));
+        std::cout << prompt;
+    }
+    return EXIT_SUCCESS;
+}
 
-        std::shared_ptr<ast::Program> program = parsley->ParseProgram();
+} // namespace
 
-        auto evaluated = evaluator::Eval(program, env);
-        if (evaluated)
+int main(int argc, char **argv)
+{
+    // the options come first; the rest are read as if they weren't there
+    for (; argc > 1; argc--, argv++)
+    {
+        std::string_view choice = argv[1];
+        if (choice == "--dedup")
+            share_constants = true;
+        else if (choice.substr(0, 9) == "--engine=")
         {
-            auto result = evaluated->Inspect();
-            if (result.compare("null") != 0)
-                std::cout << result << std::endl;
+            choice.remove_prefix(9);
+            if (choice != "tree" && choice != "vm")
+                return Usage();
+            engine = choice == "vm" ? Engine::VM : Engine::TREE;
         }
+        else
+            break;
+    }
 
-        lex->Reset();
+    std::string first = argc > 1 ? argv[1] : "";
+    if (first == "--emit-ast")
+        return argc == 4 ? EmitAst(argv[2], argv[3]) : Usage();
+    if (first == "--load-ast")
+        return argc == 3 ? RunImage(argv[2]) : Usage();
+    if (first == "--lazy")
+        return argc == 3 ? RunFile(argv[2], true) : Usage();
+    if (first == "-")
+        return RunStream(STDIN_FILENO, false);
+    if (argc > 1)
+        return RunFile(argv[1]);
+    if (!isatty(STDIN_FILENO))
+        return RunStream(STDIN_FILENO, true);
 
-        std::cout << prompt;
-    }
+    return Repl();
 }
@@ -0,0 +1,171 @@
+#include "pool.hpp"
+
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace pool
+{
+
+namespace
+{
+
+constexpr size_t kGranule = 16;
+constexpr size_t kClasses = kMaxPooled / kGranule;
+constexpr size_t kSlabBytes = 64 * 1024;
+
+// a free block holds the next one in its first bytes
+struct FreeBlock
+{
+    FreeBlock *next;
+};
+
+class Pools
+{
+  public:
+    void *Allocate(size_t size)
+    {
+        size_t size_class = (size - 1) / kGranule;
+        stats_.allocations++;
+        if (FreeBlock *block = free_[size_class])
+        {
+            free_[size_class] = block->next;
+            stats_.reused++;
+            return block;
+        }
+        size_t bytes = (size_class + 1) * kGranule;
+        if (static_cast<size_t>(end_ - next_) < bytes)
+            NewSlab();
+        void *block = next_;
+        next_ += bytes;
+        return block;
+    }
+
+    void Free(void *block, size_t size)
+    {
+        size_t size_class = (size - 1) / kGranule;
+        auto freed = static_cast<FreeBlock *>(block);
+        freed->next = free_[size_class];
+        free_[size_class] = freed;
+        stats_.frees++;
+    }
+
+    void CountLarge() { stats_.large++; }
+    const Stats &GetStats() const { return stats_; }
+
+  private:
+    void NewSlab()
+    {
+        // what's left of the last one is too small to bother with
+        next_ = static_cast<char *>(::operator new(kSlabBytes));
+        end_ = next_ + kSlabBytes;
+        stats_.slabs++;
+        stats_.slab_bytes += kSlabBytes;
+    }
+
+    FreeBlock *free_[kClasses]{};
+    // the unused end of the newest slab
+    char *next_{nullptr};
+    char *end_{nullptr};
+    Stats stats_;
+};
+
+// Pools whose threads have exited, waiting for new threads. Never destroyed,
+// as objects are still being freed while the process exits.
+std::mutex &IdleMutex()
+{
+    static auto *mutex = new std::mutex;
+    return *mutex;
+}
+
+std::vector<Pools *> &Idle()
+{
+    static auto *idle = new std::vector<Pools *>;
+    return *idle;
+}
+
+thread_local Pools *current = nullptr;
+// set once this thread's pools have gone back to Idle
+thread_local bool exited = false;
+
+// Hands the thread's pools back when it exits.
+struct Release
+{
+    ~Release()
+    {
+        std::lock_guard<std::mutex> lock{IdleMutex()};
+        Idle().push_back(current);
+        current = nullptr;
+        exited = true;
+    }
+};
+
+// The calling thread's pools - null once it's exiting, when the caller has to
+// use an idle thread's pools under the lock.
+Pools *Mine()
+{
+    if (current || exited)
+        return current;
+    {
+        std::lock_guard<std::mutex> lock{IdleMutex()};
+        if (!Idle().empty())
+        {
+            current = Idle().back();
+            Idle().pop_back();
+        }
+    }
+    if (!current)
+        current = new Pools;
+    static thread_local Release release;
+    (void)release;
+    return current;
+}
+
+// Some idle pools; the caller holds IdleMutex().
+Pools &Orphanage()
+{
+    if (Idle().empty())
+        Idle().push_back(new Pools);
+    return *Idle().back();
+}
+
+} // namespace
+
+void *Allocate(size_t size)
+{
+    Pools *pools = Mine();
+    if (size > kMaxPooled)
+    {
+        if (pools)
+            pools->CountLarge();
+        return ::operator new(size);
+    }
+    if (pools)
+        return pools->Allocate(size);
+    std::lock_guard<std::mutex> lock{IdleMutex()};
+    return Orphanage().Allocate(size);
+}
+
+void Free(void *block, size_t size)
+{
+    if (size > kMaxPooled)
+    {
+        ::operator delete(block);
+        return;
+    }
+    if (Pools *pools = Mine())
+    {
+        pools->Free(block, size);
+        return;
+    }
+    std::lock_guard<std::mutex> lock{IdleMutex()};
+    Orphanage().Free(block, size);
+}
+
+Stats GetStats()
+{
+    Pools *pools = Mine();
+    return pools ? pools->GetStats() : Stats{};
+}
+
+} // namespace pool
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+
+namespace pool
+{
+
+// Size-class pools for the interpreter's small, short-lived allocations -
+// objects and environments. Blocks are carved from 64KB slabs, one free list
+// per 16-byte size class, so a freed environment is handed straight to the
+// next call that wants one instead of going back through malloc, and blocks
+// of one size don't fragment the heap for another.
+//
+// Each thread has its own pools, so nothing's locked: an interpreter runs on
+// one thread and allocates from that thread's pools. A block freed on
+// another thread (a shared object, say) joins that thread's free list.
+// Slabs are never unmapped; when a thread exits its pools are kept for the
+// next thread to start.
+
+// Anything bigger goes to operator new.
+constexpr size_t kMaxPooled = 256;
+
+void *Allocate(size_t size);
+void Free(void *block, size_t size);
+
+struct Stats
+{
+    // blocks handed out, and how many of those came off a free list
+    size_t allocations{0};
+    size_t reused{0};
+    size_t frees{0};
+    // requests over kMaxPooled, passed to operator new
+    size_t large{0};
+    size_t slabs{0};
+    size_t slab_bytes{0};
+};
+
+// The counts for the calling thread's pools, since they were made - which
+// may have been on a thread that's since exited.
+Stats GetStats();
+
+// A base that puts a class's instances in the pools.
+class Pooled
+{
+  public:
+    static void *operator new(size_t size) { return Allocate(size); }
+    static void operator delete(void *block, size_t size)
+    {
+        Free(block, size);
+    }
+};
+
+} // namespace pool
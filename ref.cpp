@@ -0,0 +1,28 @@
+#include "ref.hpp"
+
+#include <vector>
+
+#include "cycles.hpp"
+
+namespace ref
+{
+
+void Counted::Share()
+{
+    // a worklist, not recursion: an AST can be a very long chain
+    std::vector<Counted *> pending{this};
+    while (!pending.empty())
+    {
+        Counted *next = pending.back();
+        pending.pop_back();
+        if (!next || next->shared_)
+            continue;
+        next->shared_ = true;
+        // another thread may be the one to free it
+        cycles::Forget(next);
+        next->Referents(pending);
+        next->SharedReferents(pending);
+    }
+}
+
+} // namespace ref
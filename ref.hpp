@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace ref
+{
+
+// Base for AST nodes, objects and environments: things held by Ref. The
+// count lives in the object, so a Ref is one pointer, and taking or dropping
+// a reference is a plain increment - not the locked instruction a
+// std::shared_ptr uses, which is wasted on an interpreter that runs on one
+// thread.
+//
+// That makes a counted thing belong to the thread using it. To hand it to
+// others, Share() it first: from then on its count (and that of everything
+// it refers to) is kept atomically, and it mustn't be changed.
+class Counted
+{
+  public:
+    Counted() = default;
+    // a copy is a new thing, with no references to it yet
+    Counted(const Counted &) {}
+    Counted &operator=(const Counted &) { return *this; }
+    virtual ~Counted() = default;
+
+    void AddRef() const
+    {
+        if (shared_)
+            __atomic_add_fetch(&count_, 1, __ATOMIC_RELAXED);
+        else
+            ++count_;
+    }
+    void DropRef() const
+    {
+        if (shared_ ? __atomic_sub_fetch(&count_, 1, __ATOMIC_ACQ_REL) == 0
+                    : --count_ == 0)
+            delete this;
+    }
+    uint32_t UseCount() const
+    {
+        return __atomic_load_n(&count_, __ATOMIC_RELAXED);
+    }
+
+    // Makes this and everything reachable from it safe to use from several
+    // threads at once. Call it before handing the first reference over.
+    void Share();
+    bool IsShared() const { return shared_; }
+
+    // Adds the counted things this holds references to to `out`, for Share
+    // and the cycle collector. Only references this holds itself: the
+    // collector takes one off a referent's count for each time it's listed.
+    virtual void Referents(std::vector<Counted *> & /* out */) {}
+    // Adds what this reaches through something it shares with others, and
+    // holds no reference to of its own, to `out`: for Share alone.
+    virtual void SharedReferents(std::vector<Counted *> & /* out */) {}
+    // Drops the references Referents lists that could lead back here, for
+    // the cycle collector to break a cycle this is part of.
+    virtual void DropReferents() {}
+
+  private:
+    mutable uint32_t count_{0};
+    bool shared_{false};
+};
+
+// Ref<U> converts to Ref<T> when U* does to T*
+template <typename U, typename T>
+using Upcast = std::enable_if_t<std::is_convertible_v<U *, T *>>;
+
+// An owning pointer to a Counted T, shaped like the std::shared_ptr it
+// replaces. As the count is in the object, a Ref can be made from a plain
+// pointer to anything already owned - no aliasing copies needed.
+template <typename T> class Ref
+{
+  public:
+    Ref() = default;
+    Ref(std::nullptr_t) {}
+    explicit Ref(T *ptr) : ptr_{ptr}
+    {
+        if (ptr_)
+            ptr_->AddRef();
+    }
+    Ref(const Ref &other) : Ref{other.ptr_} {}
+    Ref(Ref &&other) noexcept : ptr_{std::exchange(other.ptr_, nullptr)} {}
+    template <typename U, typename = Upcast<U, T>>
+    Ref(const Ref<U> &other) : Ref{other.get()}
+    {
+    }
+    template <typename U, typename = Upcast<U, T>>
+    Ref(Ref<U> &&other) noexcept : ptr_{other.release()}
+    {
+    }
+    ~Ref()
+    {
+        if (ptr_)
+            ptr_->DropRef();
+    }
+
+    Ref &operator=(Ref other) noexcept
+    {
+        std::swap(ptr_, other.ptr_);
+        return *this;
+    }
+
+    T *get() const { return ptr_; }
+    T &operator*() const { return *ptr_; }
+    T *operator->() const { return ptr_; }
+    explicit operator bool() const { return ptr_ != nullptr; }
+    uint32_t use_count() const { return ptr_ ? ptr_->UseCount() : 0; }
+    void reset() { Ref{}.swap(*this); }
+    void swap(Ref &other) noexcept { std::swap(ptr_, other.ptr_); }
+
+    // Gives up the reference without dropping it.
+    T *release() { return std::exchange(ptr_, nullptr); }
+
+  private:
+    T *ptr_{nullptr};
+};
+
+template <typename T, typename U>
+bool operator==(const Ref<T> &lhs, const Ref<U> &rhs)
+{
+    return lhs.get() == rhs.get();
+}
+template <typename T, typename U>
+bool operator!=(const Ref<T> &lhs, const Ref<U> &rhs)
+{
+    return lhs.get() != rhs.get();
+}
+template <typename T> bool operator==(const Ref<T> &lhs, std::nullptr_t)
+{
+    return !lhs;
+}
+template <typename T> bool operator!=(const Ref<T> &lhs, std::nullptr_t)
+{
+    return static_cast<bool>(lhs);
+}
+
+// prints the address, as for a std::shared_ptr
+template <typename Char, typename Traits, typename T>
+std::basic_ostream<Char, Traits> &
+operator<<(std::basic_ostream<Char, Traits> &out, const Ref<T> &ref)
+{
+    return out << static_cast<const void *>(ref.get());
+}
+
+template <typename T, typename... Args> Ref<T> Make(Args &&...args)
+{
+    return Ref<T>{new T(std::forward<Args>(args)...)};
+}
+
+template <typename T, typename U> Ref<T> StaticCast(const Ref<U> &from)
+{
+    return Ref<T>{static_cast<T *>(from.get())};
+}
+
+template <typename T, typename U> Ref<T> DynamicCast(const Ref<U> &from)
+{
+    return Ref<T>{dynamic_cast<T *>(from.get())};
+}
+
+} // namespace ref
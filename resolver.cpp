@@ -0,0 +1,244 @@
+#include "resolver.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+
+namespace resolver
+{
+
+namespace
+{
+
+using ast::NodeKind;
+
+// Walks the program without recursing (expressions nest as deep as the
+// parser allows), keeping the scopes around the current node on a stack.
+class Resolver
+{
+  public:
+    void Run(ast::Program &program)
+    {
+        for (auto &statement : program.statements_)
+            Push(statement.get());
+
+        while (!work_.empty())
+        {
+            Work work = work_.back();
+            work_.pop_back();
+            switch (work.action)
+            {
+            case Work::VISIT:
+                Visit(work.node);
+                break;
+            case Work::ENTER_LOOP:
+                EnterLoop(static_cast<ast::ForStatement *>(work.node));
+                break;
+            case Work::LEAVE:
+                scopes_.pop_back();
+                break;
+            case Work::LEAVE_OPAQUE:
+                opaque_--;
+                break;
+            }
+        }
+    }
+
+  private:
+    struct Work
+    {
+        ast::Node *node;
+        enum Action
+        {
+            VISIT,
+            // the loop's starting value is done - now its own scope
+            ENTER_LOOP,
+            LEAVE,
+            LEAVE_OPAQUE
+        } action;
+    };
+
+    using Slots = std::unordered_map<symbol::Id, uint16_t>;
+
+    void Push(ast::Node *node, Work::Action action = Work::VISIT)
+    {
+        if (node)
+            work_.push_back(Work{node, action});
+    }
+
+    void Visit(ast::Node *node)
+    {
+        switch (node->kind_)
+        {
+        case NodeKind::IDENTIFIER:
+            Find(*static_cast<ast::Identifier *>(node));
+            break;
+        case NodeKind::LET:
+        {
+            auto let = static_cast<ast::LetStatement *>(node);
+            Bind(*let->name_);
+            Push(let->value_.get());
+            break;
+        }
+        case NodeKind::FUNCTION:
+            EnterFunction(static_cast<ast::FunctionLiteral *>(node));
+            break;
+        case NodeKind::FOR:
+        {
+            auto loop = static_cast<ast::ForStatement *>(node);
+            Push(loop, Work::ENTER_LOOP);
+            Push(loop->iterator_value_.get());
+            break;
+        }
+        default:
+            ast::ForEachChild(node, [this](ast::Node *child) { Push(child); });
+        }
+    }
+
+    void EnterFunction(ast::FunctionLiteral *literal)
+    {
+        literal->scope_ = nullptr;
+        if (!literal->body_)
+            return;
+        Slots slots;
+        // a repeated parameter name is bound to the last argument
+        for (size_t i = 0; i < literal->parameters_.size(); i++)
+            slots[literal->parameters_[i]->id_] = i;
+        std::vector<symbol::Id> names;
+        Declared(literal->body_.get(), names);
+
+        Push(literal, Enter(std::move(slots), names, literal->scope_));
+        for (auto &parameter : literal->parameters_)
+            Bind(*parameter);
+        Push(literal->body_.get());
+    }
+
+    void EnterLoop(ast::ForStatement *loop)
+    {
+        std::vector<symbol::Id> names;
+        if (loop->iterator_)
+            names.push_back(loop->iterator_->id_);
+        Declared(loop->termination_condition_.get(), names);
+        Declared(loop->increment_.get(), names);
+        Declared(loop->body_.get(), names);
+
+        Push(loop, Enter(Slots{}, names, loop->scope_));
+        if (loop->iterator_)
+            Bind(*loop->iterator_);
+        Push(loop->termination_condition_.get());
+        Push(loop->increment_.get());
+        Push(loop->body_.get());
+    }
+
+    // Lays out a new innermost scope holding `slots` and then `names`,
+    // returning how to leave it. A scope too big for ast::Identifier to
+    // address is left unresolved, along with everything in it.
+    Work::Action Enter(Slots slots, const std::vector<symbol::Id> &names,
+                       std::shared_ptr<const ast::Scope> &layout)
+    {
+        // past the highest slot taken: a repeated parameter leaves a gap
+        size_t next = 0;
+        for (auto [name, slot] : slots)
+            next = std::max(next, size_t{slot} + 1);
+        for (symbol::Id name : names)
+            if (slots.try_emplace(name, next).second)
+                next++;
+        if (opaque_ || next >= ast::Identifier::kGlobal ||
+            scopes_.size() + 1 >= ast::Identifier::kUnresolved)
+        {
+            layout = nullptr;
+            opaque_++;
+            return Work::LEAVE_OPAQUE;
+        }
+
+        auto scope = std::make_shared<ast::Scope>();
+        scope->names.resize(next);
+        for (auto [name, slot] : slots)
+            scope->names[slot] = name;
+        layout = scope;
+        scopes_.push_back(std::move(slots));
+        return Work::LEAVE;
+    }
+
+    // Where a read of `name` here looks first.
+    void Find(ast::Identifier &name)
+    {
+        if (opaque_)
+        {
+            name.depth_ = ast::Identifier::kUnresolved;
+            return;
+        }
+        for (size_t i = scopes_.size(); i-- > 0;)
+        {
+            auto slot = scopes_[i].find(name.id_);
+            if (slot != scopes_[i].end())
+            {
+                name.depth_ = scopes_.size() - 1 - i;
+                name.slot_ = slot->second;
+                return;
+            }
+        }
+        name.depth_ = scopes_.size();
+        name.slot_ = ast::Identifier::kGlobal;
+    }
+
+    // Where `name`, defined in the innermost scope, goes.
+    void Bind(ast::Identifier &name)
+    {
+        if (opaque_)
+        {
+            name.depth_ = ast::Identifier::kUnresolved;
+            return;
+        }
+        name.depth_ = 0;
+        name.slot_ = scopes_.empty() ? ast::Identifier::kGlobal
+                                     : scopes_.back().at(name.id_);
+    }
+
+    std::vector<Work> work_;
+    // the function and loop scopes around the current node, innermost last
+    std::vector<Slots> scopes_;
+    // how many of them are left unresolved (see Enter)
+    size_t opaque_{0};
+};
+
+} // namespace
+
+void Resolve(ast::Program &program) { Resolver{}.Run(program); }
+
+void Declared(ast::Node *node, std::vector<symbol::Id> &names)
+{
+    std::vector<ast::Node *> stack{node};
+    while (!stack.empty())
+    {
+        ast::Node *top = stack.back();
+        stack.pop_back();
+        if (!top)
+            continue;
+        switch (top->kind_)
+        {
+        case NodeKind::LET:
+        {
+            auto let = static_cast<ast::LetStatement *>(top);
+            names.push_back(let->name_->id_);
+            stack.push_back(let->value_.get());
+            break;
+        }
+        case NodeKind::FUNCTION:
+            break;
+        case NodeKind::FOR:
+            stack.push_back(
+                static_cast<ast::ForStatement *>(top)->iterator_value_.get());
+            break;
+        default:
+            ast::ForEachChild(top,
+                              [&stack](ast::Node *child) {
+                                  stack.push_back(child);
+                              });
+        }
+    }
+}
+
+} // namespace resolver
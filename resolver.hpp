@@ -0,0 +1,31 @@
+#pragma once
+
+#include <vector>
+
+#include "ast.hpp"
+#include "symbol.hpp"
+
+namespace resolver
+{
+
+// Works out, before a program runs, where each name it reads will be found,
+// so the tree walker can index straight into an environment rather than
+// search the chain for it. Each function call and each run of a for loop
+// gets an environment with a slot for every name its scope can define - the
+// parameters or loop variable, and every `let` in it - laid out in the
+// literal's or loop's scope_. Identifiers get the depth and slot of the
+// innermost scope defining their name (see ast::Identifier::depth_), or of
+// the global environment, where names are still kept by name.
+//
+// A `let` only defines its name once it runs, so a slot can still be empty
+// when it's read; the evaluator then carries on outward by name, just as an
+// environment chain would. Function bodies the parser only skimmed are left
+// unresolved, and run by name as before.
+void Resolve(ast::Program &program);
+
+// The names `let` defines in the environment `node` runs in: not those in
+// function bodies, nor in the environment each for loop makes - only a
+// loop's starting value runs outside it.
+void Declared(ast::Node *node, std::vector<symbol::Id> &names);
+
+} // namespace resolver
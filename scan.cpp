@@ -0,0 +1,235 @@
+#include "scan.hpp"
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define SLANG_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace scan
+{
+
+namespace
+{
+
+///////////////// scalar
+
+const char *ScalarSkipWhitespace(const char *p, const char *end)
+{
+    while (p < end && IsWhitespace(*p))
+        ++p;
+    return p;
+}
+
+const char *ScalarSkipIdentifier(const char *p, const char *end)
+{
+    while (p < end && IsIdentifier(*p))
+        ++p;
+    return p;
+}
+
+const char *ScalarSkipDigits(const char *p, const char *end)
+{
+    while (p < end && IsDigit(*p))
+        ++p;
+    return p;
+}
+
+const char *ScalarFindQuote(const char *p, const char *end)
+{
+    while (p < end && *p != '"' && *p != 0)
+        ++p;
+    return p;
+}
+
+constexpr Scanners scalar_scanners{ScalarSkipWhitespace, ScalarSkipIdentifier,
+                                   ScalarSkipDigits, ScalarFindQuote};
+
+#ifdef SLANG_SCAN_X86
+
+///////////////// SSE2 - 16 bytes a step
+//
+// Each Match* returns 0xff in every byte lane that belongs to the run. Byte
+// ranges are tested as unsigned (c - lo) <= (hi - lo), via min_epu8 since
+// SSE2 has no unsigned compare.
+
+inline __m128i InRange16(__m128i c, char lo, char hi)
+{
+    __m128i t = _mm_sub_epi8(c, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(hi - lo)), t);
+}
+
+inline __m128i MatchWhitespace16(__m128i c)
+{
+    __m128i sp = _mm_cmpeq_epi8(c, _mm_set1_epi8(' '));
+    __m128i tab = _mm_cmpeq_epi8(c, _mm_set1_epi8('\t'));
+    __m128i nl = _mm_cmpeq_epi8(c, _mm_set1_epi8('\n'));
+    __m128i cr = _mm_cmpeq_epi8(c, _mm_set1_epi8('\r'));
+    return _mm_or_si128(_mm_or_si128(sp, tab), _mm_or_si128(nl, cr));
+}
+
+inline __m128i MatchIdentifier16(__m128i c)
+{
+    // folding in 0x20 maps 'A'-'Z' onto 'a'-'z' (and nothing else onto it)
+    __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+    __m128i alpha = InRange16(lower, 'a', 'z');
+    __m128i under = _mm_cmpeq_epi8(c, _mm_set1_epi8('_'));
+    return _mm_or_si128(alpha, under);
+}
+
+inline __m128i MatchDigits16(__m128i c) { return InRange16(c, '0', '9'); }
+
+inline __m128i MatchNotQuote16(__m128i c)
+{
+    __m128i quote = _mm_cmpeq_epi8(c, _mm_set1_epi8('"'));
+    __m128i nul = _mm_cmpeq_epi8(c, _mm_setzero_si128());
+    return _mm_xor_si128(_mm_or_si128(quote, nul), _mm_set1_epi8(-1));
+}
+
+template <__m128i (*Match)(__m128i), const char *(*Tail)(const char *,
+                                                          const char *)>
+const char *Scan16(const char *p, const char *end)
+{
+    while (end - p >= 16)
+    {
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        unsigned stop = ~_mm_movemask_epi8(Match(c)) & 0xffff;
+        if (stop)
+            return p + __builtin_ctz(stop);
+        p += 16;
+    }
+    return Tail(p, end);
+}
+
+constexpr Scanners sse2_scanners{
+    Scan16<MatchWhitespace16, ScalarSkipWhitespace>,
+    Scan16<MatchIdentifier16, ScalarSkipIdentifier>,
+    Scan16<MatchDigits16, ScalarSkipDigits>,
+    Scan16<MatchNotQuote16, ScalarFindQuote>};
+
+///////////////// AVX2 - 32 bytes a step, same tests as above
+
+#define SLANG_AVX2 __attribute__((target("avx2")))
+
+SLANG_AVX2 inline __m256i InRange32(__m256i c, char lo, char hi)
+{
+    __m256i t = _mm256_sub_epi8(c, _mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(hi - lo)),
+                             t);
+}
+
+SLANG_AVX2 inline __m256i MatchWhitespace32(__m256i c)
+{
+    __m256i sp = _mm256_cmpeq_epi8(c, _mm256_set1_epi8(' '));
+    __m256i tab = _mm256_cmpeq_epi8(c, _mm256_set1_epi8('\t'));
+    __m256i nl = _mm256_cmpeq_epi8(c, _mm256_set1_epi8('\n'));
+    __m256i cr = _mm256_cmpeq_epi8(c, _mm256_set1_epi8('\r'));
+    return _mm256_or_si256(_mm256_or_si256(sp, tab), _mm256_or_si256(nl, cr));
+}
+
+SLANG_AVX2 inline __m256i MatchIdentifier32(__m256i c)
+{
+    __m256i lower = _mm256_or_si256(c, _mm256_set1_epi8(0x20));
+    __m256i alpha = InRange32(lower, 'a', 'z');
+    __m256i under = _mm256_cmpeq_epi8(c, _mm256_set1_epi8('_'));
+    return _mm256_or_si256(alpha, under);
+}
+
+SLANG_AVX2 inline __m256i MatchDigits32(__m256i c)
+{
+    return InRange32(c, '0', '9');
+}
+
+SLANG_AVX2 inline __m256i MatchNotQuote32(__m256i c)
+{
+    __m256i quote = _mm256_cmpeq_epi8(c, _mm256_set1_epi8('"'));
+    __m256i nul = _mm256_cmpeq_epi8(c, _mm256_setzero_si256());
+    return _mm256_xor_si256(_mm256_or_si256(quote, nul),
+                            _mm256_set1_epi8(-1));
+}
+
+// The matchers are spelled out per run type (rather than passed as template
+// arguments like Scan16) so they inline into the avx2-targeted loop.
+#define SLANG_SCAN32(name, match, tail)                                        \
+    SLANG_AVX2 const char *name(const char *p, const char *end)                \
+    {                                                                          \
+        while (end - p >= 32)                                                  \
+        {                                                                      \
+            __m256i c =                                                        \
+                _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));      \
+            unsigned stop = ~static_cast<unsigned>(                            \
+                _mm256_movemask_epi8(match(c)));                               \
+            if (stop)                                                          \
+                return p + __builtin_ctz(stop);                                \
+            p += 32;                                                           \
+        }                                                                      \
+        return sse2_scanners.tail(p, end);                                     \
+    }
+
+SLANG_SCAN32(Avx2SkipWhitespace, MatchWhitespace32, skip_whitespace)
+SLANG_SCAN32(Avx2SkipIdentifier, MatchIdentifier32, skip_identifier)
+SLANG_SCAN32(Avx2SkipDigits, MatchDigits32, skip_digits)
+SLANG_SCAN32(Avx2FindQuote, MatchNotQuote32, find_quote)
+
+constexpr Scanners avx2_scanners{Avx2SkipWhitespace, Avx2SkipIdentifier,
+                                 Avx2SkipDigits, Avx2FindQuote};
+
+#endif // SLANG_SCAN_X86
+
+const Scanners &ScannersFor(Level level)
+{
+#ifdef SLANG_SCAN_X86
+    if (level == Level::AVX2)
+        return avx2_scanners;
+    if (level == Level::SSE2)
+        return sse2_scanners;
+#endif
+    (void)level;
+    return scalar_scanners;
+}
+
+Level active_level = Detect();
+const Scanners *active = &ScannersFor(active_level);
+
+} // namespace
+
+Level Detect()
+{
+#ifdef SLANG_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return Level::AVX2;
+    return Level::SSE2;
+#else
+    return Level::SCALAR;
+#endif
+}
+
+bool Supported(Level level) { return level <= Detect(); }
+
+bool Use(Level level)
+{
+    if (!Supported(level))
+        return false;
+    active_level = level;
+    active = &ScannersFor(level);
+    return true;
+}
+
+const Scanners &Active() { return *active; }
+Level ActiveLevel() { return active_level; }
+
+const char *LevelName(Level level)
+{
+    switch (level)
+    {
+    case Level::AVX2:
+        return "avx2";
+    case Level::SSE2:
+        return "sse2";
+    case Level::SCALAR:
+        break;
+    }
+    return "scalar";
+}
+
+} // namespace scan
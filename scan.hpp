@@ -0,0 +1,54 @@
+#pragma once
+
+namespace scan
+{
+
+// Character-run scanners used by the lexer. Each takes [p, end) and returns
+// a pointer to the first char that isn't part of the run (or end):
+//
+//   SkipWhitespace  - ' ', '\t', '\n', '\r'
+//   SkipIdentifier  - [a-zA-Z_]
+//   SkipDigits      - [0-9]
+//   FindQuote       - stops at '"' or a NUL (which the lexer treats as EOF)
+//
+// The implementation is picked once at startup from what the CPU supports:
+// AVX2 (32 bytes a step), SSE2 (16 bytes a step) or plain scalar loops.
+
+enum class Level
+{
+    SCALAR,
+    SSE2,
+    AVX2
+};
+
+struct Scanners
+{
+    const char *(*skip_whitespace)(const char *p, const char *end);
+    const char *(*skip_identifier)(const char *p, const char *end);
+    const char *(*skip_digits)(const char *p, const char *end);
+    const char *(*find_quote)(const char *p, const char *end);
+};
+
+const Scanners &Active();
+Level ActiveLevel();
+
+// Best level this CPU can run.
+Level Detect();
+bool Supported(Level level);
+// Switches the active implementation (benchmarks/tests). Returns false and
+// leaves things alone if the CPU can't run `level`.
+bool Use(Level level);
+
+const char *LevelName(Level level);
+
+inline bool IsWhitespace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+inline bool IsIdentifier(char c)
+{
+    return ('a' <= c && c <= 'z') || ('A' <= c && c <= 'Z') || c == '_';
+}
+inline bool IsDigit(char c) { return '0' <= c && c <= '9'; }
+
+} // namespace scan
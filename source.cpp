@@ -0,0 +1,112 @@
+#include "source.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+
+namespace source
+{
+
+Buffer::Buffer(std::string text) : storage_{std::move(text)}, text_{storage_}
+{
+}
+
+Buffer::Buffer(void *mapping, size_t length, Stamp stamp)
+    : mapping_{mapping}, mapping_length_{length}, stamp_{std::move(stamp)},
+      text_{static_cast<const char *>(mapping), length}
+{
+}
+
+Buffer::~Buffer()
+{
+    if (mapping_)
+        munmap(mapping_, mapping_length_);
+}
+
+namespace
+{
+
+int64_t Modified(const struct stat &st)
+{
+    return int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+} // namespace
+
+bool Buffer::Changed() const
+{
+    if (!mapping_)
+        return false;
+    struct stat st;
+    if (stat(stamp_.path.c_str(), &st) != 0 || st.st_ino != stamp_.inode)
+        return false;
+    return uint64_t(st.st_size) != stamp_.size ||
+           Modified(st) != stamp_.modified;
+}
+
+std::shared_ptr<Buffer> FromString(std::string text)
+{
+    return std::make_shared<Buffer>(std::move(text));
+}
+
+std::shared_ptr<Buffer> FromFile(const std::string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        std::cerr << "Can't open " << path << ": " << std::strerror(errno)
+                  << std::endl;
+        return nullptr;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        std::cerr << "Can't read " << path << ": not a regular file"
+                  << std::endl;
+        close(fd);
+        return nullptr;
+    }
+
+    size_t length = st.st_size;
+    if (length > kMaxSize)
+    {
+        std::cerr << "Can't read " << path << ": scripts can be at most "
+                  << kMaxSize << " bytes" << std::endl;
+        close(fd);
+        return nullptr;
+    }
+    if (length == 0)
+    {
+        close(fd);
+        return FromString("");
+    }
+
+    int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    // the lexer touches every page anyway - fault them in up front
+    flags |= MAP_POPULATE;
+#endif
+    void *mapping = mmap(nullptr, length, PROT_READ, flags, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        std::cerr << "Can't map " << path << ": " << std::strerror(errno)
+                  << std::endl;
+        return nullptr;
+    }
+    madvise(mapping, length, MADV_SEQUENTIAL);
+
+    Buffer::Stamp stamp{path, uint64_t(st.st_ino), length, Modified(st)};
+    return std::make_shared<Buffer>(mapping, length, std::move(stamp));
+}
+
+} // namespace source
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace source
+{
+
+// The most text one Buffer can hold. Token streams and flat trees keep 32-bit
+// offsets into their source, so longer text can't be lexed.
+constexpr size_t kMaxSize = UINT32_MAX;
+
+// Immutable program text. Tokens and AST nodes hold string_views into it, so
+// anything that outlives the parse (a Program, a Function object) keeps a
+// shared_ptr to the Buffer its views point into.
+//
+// The text is either an owned string or a read-only mapping of a script file,
+// which the lexer reads in place. The mapping is private, but that doesn't
+// stop the file being changed under it: a script edited in place shows
+// through, and one truncated faults (SIGBUS) where it's read past its new
+// end. Anything holding a mapped Buffer for long - a cache, say - should
+// check Changed() before reading it again.
+class Buffer
+{
+  public:
+    // What the file a mapping was made from was like when it was mapped.
+    struct Stamp
+    {
+        std::string path;
+        uint64_t inode{0};
+        uint64_t size{0};
+        int64_t modified{0};
+    };
+
+    explicit Buffer(std::string text);
+    Buffer(void *mapping, size_t length, Stamp stamp);
+    Buffer(const Buffer &) = delete;
+    Buffer &operator=(const Buffer &) = delete;
+    ~Buffer();
+
+    std::string_view Text() const { return text_; }
+    size_t Size() const { return text_.size(); }
+    bool IsMapped() const { return mapping_ != nullptr; }
+    // Whether a mapped file has been written to or truncated since it was
+    // mapped, as far as its size and modification time tell - a write that
+    // changes neither within the clock's resolution goes unseen. A file
+    // replaced by another (as editors save) leaves the mapping as it was, so
+    // doesn't count. Always false for strings.
+    bool Changed() const;
+
+  private:
+    std::string storage_;
+    void *mapping_{nullptr};
+    size_t mapping_length_{0};
+    Stamp stamp_;
+    std::string_view text_;
+};
+
+// `text` is to be no longer than kMaxSize.
+std::shared_ptr<Buffer> FromString(std::string text);
+
+// Maps the file at `path` read-only. Returns nullptr (and reports why on
+// stderr) if it can't be opened or mapped, or is longer than kMaxSize.
+std::shared_ptr<Buffer> FromFile(const std::string &path);
+
+} // namespace source
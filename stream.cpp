@@ -0,0 +1,145 @@
+#include "stream.hpp"
+
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "scan.hpp"
+
+namespace stream
+{
+
+size_t Splitter::Next(std::string_view text, size_t from)
+{
+    for (size_t i = from; i < text.size(); i++)
+    {
+        char c = text[i];
+        if (in_string_)
+        {
+            if (c == '"')
+                in_string_ = false;
+            continue;
+        }
+
+        switch (c)
+        {
+        case '"':
+            in_string_ = true;
+            break;
+        case '(':
+        case '{':
+        case '[':
+            depth_++;
+            break;
+        case ')':
+        case '}':
+        case ']':
+            // a stray closer is the parser's problem, not ours
+            if (depth_ > 0)
+                depth_--;
+            break;
+        case ';':
+            if (depth_ == 0)
+                return i + 1;
+            break;
+        default:
+            break;
+        }
+    }
+    return std::string_view::npos;
+}
+
+Reader::Reader(int fd, size_t chunk_size) : fd_{fd}, chunk_size_{chunk_size}
+{
+}
+
+Reader::Reader(std::istream &in, size_t chunk_size)
+    : in_{&in}, chunk_size_{chunk_size}
+{
+}
+
+size_t Reader::Fill(char *out, size_t size)
+{
+    if (in_)
+    {
+        in_->read(out, size);
+        return in_->gcount();
+    }
+
+    // read(2) returns whatever the pipe has rather than waiting for a full
+    // chunk, which keeps the first results coming quickly
+    for (;;)
+    {
+        ssize_t got = ::read(fd_, out, size);
+        if (got >= 0)
+            return got;
+        if (errno == EINTR)
+            continue;
+        std::cerr << "can't read input: " << std::strerror(errno)
+                  << std::endl;
+        return 0;
+    }
+}
+
+std::shared_ptr<source::Buffer> Reader::Next()
+{
+    for (;;)
+    {
+        // Everything complete that's been read so far goes out together -
+        // one parse per chunk rather than per statement.
+        size_t end = std::string::npos;
+        for (size_t next = splitter_.Next(buffer_, scanned_);
+             next != std::string::npos; next = splitter_.Next(buffer_, next))
+            end = next;
+        if (end != std::string::npos)
+        {
+            auto statements =
+                source::FromString(buffer_.substr(begin_, end - begin_));
+            begin_ = end;
+            scanned_ = buffer_.size();
+            return statements;
+        }
+        scanned_ = buffer_.size();
+        if (eof_)
+            break;
+
+        // Statements already handed out aren't needed any more - drop them
+        // before reading the next chunk in behind what's left.
+        buffer_.erase(0, begin_);
+        scanned_ -= begin_;
+        begin_ = 0;
+        if (buffer_.size() > source::kMaxSize)
+        {
+            std::cerr << "can't read input: a statement runs past "
+                      << source::kMaxSize << " bytes" << std::endl;
+            buffer_.clear();
+            scanned_ = 0;
+            eof_ = true;
+            return nullptr;
+        }
+
+        size_t old_size = buffer_.size();
+        buffer_.resize(old_size + chunk_size_);
+        size_t got = Fill(&buffer_[old_size], chunk_size_);
+        buffer_.resize(old_size + got);
+        if (got == 0)
+            eof_ = true;
+    }
+
+    std::string_view rest{buffer_};
+    rest.remove_prefix(begin_);
+    begin_ = buffer_.size();
+    for (char c : rest)
+    {
+        if (!scan::IsWhitespace(c))
+            return source::FromString(std::string{rest});
+    }
+    return nullptr;
+}
+
+} // namespace stream
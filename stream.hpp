@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "source.hpp"
+
+namespace stream
+{
+
+// Finds the ends of top-level statements: a ';' outside any (), {} or []
+// and outside a string literal. State carries over between calls, so text
+// can be fed to it a piece at a time.
+class Splitter
+{
+  public:
+    // Scans text from `from` on. Returns the offset just past the next
+    // top-level ';', or npos if the text runs out first.
+    size_t Next(std::string_view text, size_t from);
+
+  private:
+    int depth_{0};
+    bool in_string_{false};
+};
+
+// Reads a script from a pipe, file descriptor or stream in fixed-size chunks
+// and hands it back as runs of complete top-level statements, so they can be
+// parsed and run as soon as they've arrived. Only the current chunk and the
+// statement being assembled are kept in memory - a token cut in two by a
+// chunk boundary just waits in the buffer for the rest of it.
+class Reader
+{
+  public:
+    static constexpr size_t kChunkSize = 64 * 1024;
+
+    explicit Reader(int fd, size_t chunk_size = kChunkSize);
+    explicit Reader(std::istream &in, size_t chunk_size = kChunkSize);
+
+    // All the complete statements read so far (up to and including the last
+    // top-level ';'), or whatever is left at the end of the input. nullptr
+    // once there's nothing but whitespace left.
+    std::shared_ptr<source::Buffer> Next();
+
+  private:
+    size_t Fill(char *out, size_t size);
+
+  private:
+    int fd_{-1};
+    std::istream *in_{nullptr};
+    size_t chunk_size_;
+    bool eof_{false};
+
+    Splitter splitter_;
+    std::string buffer_;
+    // start of the statement being assembled, and how far it's been scanned
+    size_t begin_{0};
+    size_t scanned_{0};
+};
+
+} // namespace stream
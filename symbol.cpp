@@ -0,0 +1,79 @@
+#include "symbol.hpp"
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace symbol
+{
+
+namespace
+{
+
+struct Table
+{
+    std::mutex mutex;
+    // Each name is stored once, here - a deque never moves its elements, so
+    // the views in `ids` stay valid as it grows. Slot 0 is kNone.
+    std::deque<std::string> names{std::string{}};
+    std::unordered_map<std::string_view, Id> ids;
+};
+
+Table &Symbols()
+{
+    static Table table;
+    return table;
+}
+
+// This thread's copies of what it's looked up in the table. Their views are
+// of the table's names, so they stay valid too.
+thread_local std::unordered_map<std::string_view, Id> seen_ids;
+thread_local std::vector<std::string_view> seen_names;
+
+} // namespace
+
+Id Intern(std::string_view name)
+{
+    auto seen = seen_ids.find(name);
+    if (seen != seen_ids.end())
+        return seen->second;
+
+    Table &table = Symbols();
+    std::lock_guard<std::mutex> lock{table.mutex};
+    auto entry = table.ids.find(name);
+    if (entry == table.ids.end())
+    {
+        Id id = table.names.size();
+        table.names.emplace_back(name);
+        entry = table.ids.emplace(table.names.back(), id).first;
+    }
+    seen_ids.emplace(entry->first, entry->second);
+    return entry->second;
+}
+
+std::string_view Name(Id id)
+{
+    if (id < seen_names.size())
+        return seen_names[id];
+
+    // catch up with everything interned since this thread last looked
+    Table &table = Symbols();
+    std::lock_guard<std::mutex> lock{table.mutex};
+    if (id >= table.names.size())
+        return std::string_view{};
+    for (size_t i = seen_names.size(); i < table.names.size(); i++)
+        seen_names.push_back(table.names[i]);
+    return seen_names[id];
+}
+
+size_t Count()
+{
+    Table &table = Symbols();
+    std::lock_guard<std::mutex> lock{table.mutex};
+    return table.names.size() - 1;
+}
+
+} // namespace symbol
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace symbol
+{
+
+// Dense ids for identifier names. The lexer interns each identifier once,
+// and from then on the AST and environments deal in ids - comparing and
+// hashing an integer rather than a string.
+using Id = uint32_t;
+
+// never handed out, so it can stand for "not interned"
+constexpr Id kNone = 0;
+
+// The id for `name`, allocating the next one the first time it's seen. The
+// table is process-wide and safe to use from several threads. Each thread
+// keeps its own copy of the ids it's looked up, so only its first sight of a
+// name takes the table's lock.
+Id Intern(std::string_view name);
+
+// The name `id` was interned from. Empty for kNone.
+std::string_view Name(Id id);
+
+// How many names have been interned.
+size_t Count();
+
+} // namespace symbol
@@ -0,0 +1,184 @@
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../cache.hpp"
+#include "../evaluator.hpp"
+#include "../object.hpp"
+#include "../ref.hpp"
+#include "../source.hpp"
+#include "../xxhash.hpp"
+
+#include "gtest/gtest.h"
+
+namespace
+{
+
+struct CacheTest : public ::testing::Test
+{
+};
+
+TEST_F(CacheTest, TestHashMatchesReferenceVectors)
+{
+    EXPECT_EQ(xxhash::Hash64(""), 0xEF46DB3751D8E999ULL);
+    EXPECT_EQ(xxhash::Hash64("a"), 0xD24EC4F1A98C6E5BULL);
+    EXPECT_EQ(xxhash::Hash64("abc"), 0x44BC2CF5AD770999ULL);
+    EXPECT_EQ(xxhash::Hash64("Nobody inspects the spammish repetition"),
+              0xFBCEA83C8A378BF1ULL);
+}
+
+TEST_F(CacheTest, TestSameTextHits)
+{
+    cache::ProgramCache programs{1 << 20};
+    auto first = programs.Load(source::FromString("let x = 1 + 2; x * 3;"));
+    // a different buffer holding the same text
+    auto second = programs.Load(source::FromString("let x = 1 + 2; x * 3;"));
+    auto other = programs.Load(source::FromString("let y = 4;"));
+
+    ASSERT_NE(first, nullptr);
+    EXPECT_EQ(first, second);
+    EXPECT_NE(first, other);
+
+    auto stats = programs.GetStats();
+    EXPECT_EQ(stats.hits, 1u);
+    EXPECT_EQ(stats.misses, 2u);
+    EXPECT_EQ(stats.entries, 2u);
+}
+
+TEST_F(CacheTest, TestLeastRecentlyUsedIsEvicted)
+{
+    auto a = source::FromString("let a = 1;");
+    auto b = source::FromString("let b = 2;");
+    auto c = source::FromString("let c = 3;");
+    // room for two of them
+    cache::ProgramCache programs{cache::ProgramCache::Cost(*a) * 2};
+
+    auto program_a = programs.Load(a);
+    programs.Load(b);
+    programs.Load(a); // a is now newer than b
+    programs.Load(c); // so b goes
+
+    auto stats = programs.GetStats();
+    EXPECT_EQ(stats.evictions, 1u);
+    EXPECT_EQ(stats.entries, 2u);
+    EXPECT_LE(stats.bytes, cache::ProgramCache::Cost(*a) * 2);
+
+    EXPECT_EQ(programs.Load(a), program_a);
+    EXPECT_EQ(programs.GetStats().hits, 2u);
+    programs.Load(b);
+    EXPECT_EQ(programs.GetStats().misses, 4u);
+}
+
+TEST_F(CacheTest, TestSharedConstantsAreCachedSeparately)
+{
+    cache::ProgramCache programs{1 << 20};
+    std::string text = "let a = [1, 2]; let b = [1, 2];";
+    auto plain = programs.Load(source::FromString(text));
+    auto shared = programs.Load(source::FromString(text), false, true);
+    ASSERT_NE(plain, nullptr);
+    ASSERT_NE(shared, nullptr);
+    EXPECT_NE(plain, shared);
+    EXPECT_EQ(programs.Load(source::FromString(text), false, true), shared);
+
+    auto value = [](const ref::Ref<ast::Program> &program, size_t i) {
+        return ref::DynamicCast<ast::LetStatement>(program->statements_[i])
+            ->value_;
+    };
+    EXPECT_NE(value(plain, 0), value(plain, 1));
+    EXPECT_EQ(value(shared, 0), value(shared, 1));
+    EXPECT_TRUE(value(shared, 0)->IsShared());
+}
+
+TEST_F(CacheTest, TestParseErrorsAreNotCached)
+{
+    cache::ProgramCache programs{1 << 20};
+    EXPECT_EQ(programs.Load(source::FromString("let = 5;")), nullptr);
+    EXPECT_EQ(programs.Load(source::FromString("let = 5;")), nullptr);
+
+    auto stats = programs.GetStats();
+    EXPECT_EQ(stats.hits, 0u);
+    EXPECT_EQ(stats.misses, 2u);
+    EXPECT_EQ(stats.entries, 0u);
+}
+
+TEST_F(CacheTest, TestScriptsWrittenToAreParsedAgain)
+{
+    std::string path = ::testing::TempDir() + "cache_test_script.slang";
+    auto write = [&path](const std::string &text) {
+        // truncated and rewritten in place, as `>` in a shell does
+        std::ofstream out{path, std::ios::trunc};
+        out << text;
+    };
+    // a few pages of it
+    std::string script;
+    while (script.size() < 16384)
+        script += "let answer = 6 * 7;\n";
+    cache::ProgramCache programs{1 << 20};
+
+    write(script);
+    auto first = programs.Load(source::FromFile(path));
+    ASSERT_NE(first, nullptr);
+    EXPECT_EQ(programs.Load(source::FromFile(path)), first);
+
+    // Cut to its first page: the cached program's text would fault past
+    // that now, and comparing it with the whole text again would read on.
+    write(script.substr(0, 4096));
+    auto again = programs.Load(source::FromString(script));
+    ASSERT_NE(again, nullptr);
+    EXPECT_NE(again, first);
+    EXPECT_EQ(again->statements_.size(),
+              script.size() / std::string{"let answer = 6 * 7;\n"}.size());
+
+    auto stats = programs.GetStats();
+    EXPECT_EQ(stats.hits, 1u);
+    EXPECT_EQ(stats.misses, 2u);
+    EXPECT_EQ(stats.entries, 1u);
+    std::remove(path.c_str());
+}
+
+TEST_F(CacheTest, TestCachedProgramsRunOnSeveralThreads)
+{
+    cache::ProgramCache programs{1 << 20};
+    // lazily parsed, so the threads also race to parse fib's body
+    auto program = programs.Load(
+        source::FromString("let count = 0; let fib = fn(n) { if (n < 2) { n "
+                           "} else { fib(n - 1) + fib(n - 2) } };"),
+        true);
+    ASSERT_NE(program, nullptr);
+    EXPECT_TRUE(program->IsShared());
+    EXPECT_TRUE(program->statements_[0]->IsShared());
+
+    auto globals = ref::Make<object::Environment>();
+    evaluator::Eval(program, globals);
+    globals->Share();
+
+    std::vector<std::string> results(4);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < results.size(); t++)
+        threads.emplace_back([&programs, &globals, &results, t]() {
+            auto call = programs.Load(source::FromString("fib(15)"));
+            auto env = ref::Make<object::Environment>(globals);
+            results[t] = evaluator::Eval(call, env).Inspect();
+        });
+    for (auto &thread : threads)
+        thread.join();
+    for (auto const &result : results)
+        EXPECT_EQ(result, "610");
+
+    // names can be defined on top of a shared environment, not changed in it
+    auto env = ref::Make<object::Environment>(globals);
+    EXPECT_EQ(
+        evaluator::Eval(programs.Load(source::FromString("++count")), env)
+            .Inspect(),
+        "ERROR: can't change a shared environment");
+    EXPECT_EQ(evaluator::Eval(
+                  programs.Load(source::FromString("let count = 5; count")),
+                  env)
+                  .Inspect(),
+              "5");
+}
+
+} // namespace
@@ -0,0 +1,100 @@
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../cycles.hpp"
+#include "../evaluator.hpp"
+#include "../object.hpp"
+#include "../ref.hpp"
+#include "../vm.hpp"
+
+#include "gtest/gtest.h"
+
+#include "parse.hpp"
+
+namespace
+{
+
+using test::Parse;
+
+// each call leaves a function in the environment it closes over
+const char kMakeCycles[] = "let mk = fn() { let g = fn() { g }; g };";
+
+struct CyclesTest : public ::testing::Test
+{
+    // starts each test with no garbage left by the others
+    CyclesTest() { cycles::Collect(); }
+
+    std::string Eval(const std::string &input)
+    {
+        auto result = evaluator::Eval(Parse(input), env_);
+        return result ? result.Inspect() : "nullptr";
+    }
+
+    ref::Ref<object::Environment> env_ = ref::Make<object::Environment>();
+};
+
+TEST_F(CyclesTest, TestCollectsClosureCycles)
+{
+    Eval(kMakeCycles);
+    Eval("mk(); mk(); mk();");
+    // each call's environment and the function in it
+    EXPECT_EQ(cycles::Collect(), 6u);
+    EXPECT_EQ(cycles::GetStats().last_reclaimed, 6u);
+    EXPECT_EQ(cycles::Collect(), 0u);
+}
+
+TEST_F(CyclesTest, TestKeepsReachableCycles)
+{
+    Eval(kMakeCycles);
+    Eval("let kept = mk(); let also = [mk(), {1: mk()}];");
+    EXPECT_EQ(cycles::Collect(), 0u);
+    EXPECT_EQ(Eval("kept() == kept"), "true");
+    EXPECT_EQ(Eval("also[1][1]() == also[1][1]"), "true");
+
+    env_.reset();
+    // the top level, mk's, the three calls', the array and the hash
+    EXPECT_EQ(cycles::Collect(), 10u);
+}
+
+TEST_F(CyclesTest, TestCollectsWhileRunning)
+{
+    Eval(kMakeCycles);
+    size_t collections = cycles::GetStats().collections;
+    Eval("let loop = fn(n) { if (n > 0) { mk(); loop(n - 1) } }; "
+         "let run = fn(i) { loop(100); if (i > 0) { run(i - 1) } }; run(100)");
+    EXPECT_GT(cycles::GetStats().collections, collections);
+}
+
+TEST_F(CyclesTest, TestCollectsVmCycles)
+{
+    vm::Machine machine;
+    machine.Run(*Parse(std::string{kMakeCycles} + "mk(); mk();"));
+    // each call's cell for g and the closure in it
+    EXPECT_EQ(cycles::Collect(), 4u);
+}
+
+TEST_F(CyclesTest, TestClosuresListOnlyTheirOwnReferences)
+{
+    vm::Machine machine;
+    auto value = machine.Run(*Parse("let f = fn() { fn() { \"s\" } }; f()"));
+    auto closure = value.As<vm::Closure>();
+    ASSERT_TRUE(closure);
+    ref::Counted *constant = closure->proto_->constants.at(0).Get();
+    ref::Counted *literal = closure->proto_->literal.get();
+    ASSERT_TRUE(constant && literal);
+
+    // every closure made from the prototype shares these, so none of them
+    // is one closure's to count
+    std::vector<ref::Counted *> owned;
+    static_cast<ref::Counted *>(closure)->Referents(owned);
+    EXPECT_EQ(std::count(owned.begin(), owned.end(), constant), 0);
+    EXPECT_EQ(std::count(owned.begin(), owned.end(), literal), 0);
+
+    value.Get()->Share();
+    EXPECT_TRUE(constant->IsShared());
+    EXPECT_TRUE(literal->IsShared());
+}
+
+} // namespace
@@ -0,0 +1,138 @@
+#include <memory>
+#include <string>
+
+#include "../ast.hpp"
+#include "../dedup.hpp"
+#include "../evaluator.hpp"
+#include "../flat.hpp"
+#include "../object.hpp"
+#include "../parser.hpp"
+#include "../ref.hpp"
+
+#include "gtest/gtest.h"
+
+#include "parse.hpp"
+
+namespace
+{
+
+using test::Parse;
+
+struct DedupTest : public ::testing::Test
+{
+    ref::Ref<ast::Expression> ValueOf(const ast::Program &program,
+                                      size_t statement)
+    {
+        auto let = ref::DynamicCast<ast::LetStatement>(
+            program.statements_[statement]);
+        EXPECT_NE(let, nullptr);
+        return let ? let->value_ : nullptr;
+    }
+};
+
+TEST_F(DedupTest, TestIdenticalConstantsAreShared)
+{
+    auto program = Parse(R"(
+let a = "key";
+let b = "key";
+let c = 60 * 60 * 24;
+let d = 60 * 60 * 24;
+let e = x + 24;
+let f = [1, -2, {"key": true}];
+let g = [1, -2, {"key": true}];
+let h = [1, -2, {"key": y}];
+)");
+    dedup::Stats stats = dedup::ShareConstants(*program);
+
+    EXPECT_EQ(ValueOf(*program, 0), ValueOf(*program, 1));
+    EXPECT_EQ(ValueOf(*program, 2), ValueOf(*program, 3));
+    EXPECT_EQ(ValueOf(*program, 5), ValueOf(*program, 6));
+    EXPECT_NE(ValueOf(*program, 6), ValueOf(*program, 7));
+
+    // a constant under something that isn't is still shared
+    auto day = ref::DynamicCast<ast::InfixExpression>(ValueOf(*program, 2));
+    auto plus = ref::DynamicCast<ast::InfixExpression>(ValueOf(*program, 4));
+    ASSERT_NE(day, nullptr);
+    ASSERT_NE(plus, nullptr);
+    EXPECT_EQ(day->right_, plus->right_);
+    EXPECT_EQ(ref::DynamicCast<ast::Identifier>(plus->left_)->value_, "x");
+
+    EXPECT_GT(stats.shared, 0u);
+    EXPECT_LT(stats.constants, stats.expressions);
+}
+
+TEST_F(DedupTest, TestSharingDoesNotChangeThePrograms)
+{
+    std::string input = R"(
+let scale = fn(x) { x * (2 + 3) };
+let h = {"one": 1, "two": 2 + 3, "three": [2 + 3, "one"]};
+for (i = 0; i < 2 + 3; ++i) { scale(i); };
+if (h["one"] == 1) { [h["two"], scale(h["three"][0]), "one"] } else { 2 + 3 };
+)";
+    auto plain = Parse(input);
+    auto shared = Parse(input);
+    dedup::Stats stats = dedup::ShareConstants(*shared);
+    EXPECT_GT(stats.shared, 0u);
+
+    EXPECT_EQ(shared->String(), plain->String());
+    // flattening copies shared nodes back out
+    EXPECT_EQ(flat::Inflate(flat::Flatten(*shared))->String(),
+              plain->String());
+    auto expected = evaluator::Eval(plain, ref::Make<object::Environment>());
+    auto result = evaluator::Eval(shared, ref::Make<object::Environment>());
+    EXPECT_EQ(result.Inspect(), expected.Inspect());
+    EXPECT_EQ(result.Inspect(), "[5, 25, one]");
+}
+
+TEST_F(DedupTest, TestDeepExpressions)
+{
+    // as deep as the parser allows
+    std::string input = "let sum = 1";
+    for (int i = 0; i < 1999; i++)
+        input += " + 1";
+    input += "; let same = 1";
+    for (int i = 0; i < 1999; i++)
+        input += " + 1";
+    input += ";";
+
+    auto program = Parse(input);
+    dedup::Stats stats = dedup::ShareConstants(*program);
+    EXPECT_EQ(ValueOf(*program, 0), ValueOf(*program, 1));
+    EXPECT_EQ(stats.constants, stats.expressions);
+}
+
+TEST_F(DedupTest, TestReparsedProgramsAreLeftAlone)
+{
+    std::string script = "let a = \"old\";\n";
+    for (int i = 0; i < 10; i++)
+        script += "let x = " + std::to_string(i) + ";\n";
+    script += "let c = \"old\";\n";
+
+    // Sharing one string with the other would leave it pointing into the
+    // other's buffer, which editing the other away frees - whichever way
+    // round it was shared.
+    for (bool last : {false, true})
+    {
+        SCOPED_TRACE(last);
+        auto program = Parse(script);
+        // the two strings, edited into buffers of their own
+        for (int i = 0; i < 2; i++)
+        {
+            size_t offset = program->source_->Text().find("old");
+            program = parser::Reparse(*program, {offset, 3, "key"});
+            ASSERT_TRUE(program);
+        }
+
+        dedup::Stats stats = dedup::ShareConstants(*program);
+        EXPECT_EQ(stats.shared, 0u);
+
+        std::string_view text = program->source_->Text();
+        size_t offset = last ? text.rfind("\"key\"") : text.find("\"key\"");
+        program = parser::Reparse(*program, {offset, 5, "1"});
+        ASSERT_TRUE(program);
+        std::string kept = program->statements_[last ? 0 : 11]->String();
+        EXPECT_EQ(kept, last ? "let a = key;" : "let c = key;");
+    }
+}
+
+} // namespace
@@ -14,48 +14,88 @@
 #include "../lexer.hpp"
 #include "../object.hpp"
 #include "../parser.hpp"
+#include "../ref.hpp"
+#include "../source.hpp"
 #include "../token.hpp"
+#include "../vm.hpp"
 
 namespace
 {
 
-struct EvaluatorTest : public ::testing::Test
+enum class Engine
 {
+    TREE,
+    VM
 };
 
-bool TestIntegerObject(std::shared_ptr<object::Object> obj, int64_t expected)
+// Every test runs on both the tree walker and the VM.
+struct EvaluatorTest : public ::testing::TestWithParam<Engine>
 {
-    std::shared_ptr<object::Integer> io =
-        std::dynamic_pointer_cast<object::Integer>(obj);
-    if (!io)
+    // Runs `program` in the test's session, which keeps the names it
+    // defines.
+    object::Value Run(ref::Ref<ast::Program> program)
+    {
+        if (GetParam() == Engine::VM)
+            return machine_.Run(*program);
+        return evaluator::Eval(program, env_);
+    }
+
+    // Parses and runs `input` on its own.
+    object::Value TestEval(std::string input)
+    {
+        auto lex = std::make_unique<lexer::Lexer>(input);
+        auto parsley = std::make_unique<parser::Parser>(std::move(lex));
+        EXPECT_FALSE(parsley->CheckErrors());
+
+        auto program = parsley->ParseProgram();
+        std::cout << "Program has " << program->statements_.size()
+                  << " statements" << std::endl;
+        if (GetParam() == Engine::VM)
+            return vm::Machine{}.Run(*program);
+        auto env = ref::Make<object::Environment>();
+        return evaluator::Eval(program, env);
+    }
+
+    ref::Ref<object::Environment> env_ = ref::Make<object::Environment>();
+    vm::Machine machine_;
+};
+
+INSTANTIATE_TEST_SUITE_P(Engines, EvaluatorTest,
+                         ::testing::Values(Engine::TREE, Engine::VM),
+                         [](const ::testing::TestParamInfo<Engine> &info) {
+                             return info.param == Engine::VM ? "Vm" : "Tree";
+                         });
+
+bool TestIntegerObject(const object::Value &obj, int64_t expected)
+{
+    if (!obj.IsInteger())
     {
         std::cerr << "NOT AN INTEGER OBJECT\n";
         return false;
     }
 
-    if (io->value_ != expected)
+    if (obj.AsInteger() != expected)
     {
         std::cerr << "TEST INTEGER OBJECT - val not correct - actual:"
-                  << io->value_ << " // expected:" << expected << std::endl;
+                  << obj.AsInteger() << " // expected:" << expected
+                  << std::endl;
         return false;
     }
     return true;
 }
 
-bool TestBooleanObject(std::shared_ptr<object::Object> obj, bool expected)
+bool TestBooleanObject(const object::Value &obj, bool expected)
 {
-    std::shared_ptr<object::Boolean> bo =
-        std::dynamic_pointer_cast<object::Boolean>(obj);
-    if (!bo)
+    if (!obj.IsBoolean())
         return false;
 
     std::cout << "Testing Boolean! - object val:"
-              << (bo->value_ ? "true" : "false")
+              << (obj.AsBoolean() ? "true" : "false")
               << " // Expected:" << (expected ? "true" : "false") << std::endl;
-    if (bo->value_ != expected)
+    if (obj.AsBoolean() != expected)
     {
         std::cerr << "TEST BOOLEAN OBJECT - val not correct - actual:"
-                  << (bo->value_ ? "true" : "false")
+                  << (obj.AsBoolean() ? "true" : "false")
                   << " // expected:" << (expected ? "true" : "false")
                   << std::endl;
         return false;
@@ -63,20 +103,7 @@ bool TestBooleanObject(std::shared_ptr<object::Object> obj, bool expected)
     return true;
 }
 
-std::shared_ptr<object::Object> TestEval(std::string input)
-{
-    auto lex = std::make_unique<lexer::Lexer>(input);
-    auto parsley = std::make_unique<parser::Parser>(std::move(lex));
-    EXPECT_FALSE(parsley->CheckErrors());
-
-    auto program = parsley->ParseProgram();
-    std::cout << "Program has " << program->statements_.size() << " statements"
-              << std::endl;
-    auto env = std::make_shared<object::Environment>();
-    return evaluator::Eval(program, env);
-}
-
-TEST_F(EvaluatorTest, TestIntegerExpression)
+TEST_P(EvaluatorTest, TestIntegerExpression)
 {
     struct TestCase
     {
@@ -106,12 +133,11 @@ TEST_F(EvaluatorTest, TestIntegerExpression)
     }
 }
 
-TEST_F(EvaluatorTest, TestString)
+TEST_P(EvaluatorTest, TestString)
 {
     std::string input = R"("Hello World!")";
-    std::shared_ptr<object::Object> evaluated = TestEval(input);
-    std::shared_ptr<object::String> sliteral =
-        std::dynamic_pointer_cast<object::String>(evaluated);
+    object::Value evaluated = TestEval(input);
+    object::String *sliteral = evaluated.As<object::String>();
     if (!sliteral)
     {
         FAIL() << "Not a StringLiteral - got " << typeid(evaluated).name();
@@ -119,7 +145,7 @@ TEST_F(EvaluatorTest, TestString)
     EXPECT_EQ(sliteral->value_, "Hello World!");
 }
 
-TEST_F(EvaluatorTest, TestBooleanExpression)
+TEST_P(EvaluatorTest, TestBooleanExpression)
 {
     struct TestCase
     {
@@ -153,7 +179,7 @@ TEST_F(EvaluatorTest, TestBooleanExpression)
     }
 } // namespace
 
-TEST_F(EvaluatorTest, TestBangOperator)
+TEST_P(EvaluatorTest, TestBangOperator)
 {
     struct TestCase
     {
@@ -171,7 +197,7 @@ TEST_F(EvaluatorTest, TestBangOperator)
     }
 }
 
-TEST_F(EvaluatorTest, TestIfElseExpression)
+TEST_P(EvaluatorTest, TestIfElseExpression)
 {
     struct TestCaseInt
     {
@@ -198,12 +224,12 @@ TEST_F(EvaluatorTest, TestIfElseExpression)
     for (auto tt : nullTests)
     {
         std::cout << "\nTesting! input: " << tt << std::endl;
-        std::shared_ptr<object::Object> evaluated = TestEval(tt);
+        object::Value evaluated = TestEval(tt);
         EXPECT_EQ(evaluated, evaluator::NULLL);
     }
 }
 
-TEST_F(EvaluatorTest, TestReturnStatements)
+TEST_P(EvaluatorTest, TestReturnStatements)
 {
     struct TestCase
     {
@@ -224,7 +250,7 @@ TEST_F(EvaluatorTest, TestReturnStatements)
     }
 }
 
-TEST_F(EvaluatorTest, TestErrorHandling)
+TEST_P(EvaluatorTest, TestErrorHandling)
 {
     struct TestCase
     {
@@ -248,8 +274,7 @@ TEST_F(EvaluatorTest, TestErrorHandling)
     {
         std::cout << "Testing input:" << tt.input << std::endl;
         auto evaluated = TestEval(tt.input);
-        std::shared_ptr<object::Error> err_obj =
-            std::dynamic_pointer_cast<object::Error>(evaluated);
+        object::Error *err_obj = evaluated.As<object::Error>();
         EXPECT_TRUE(err_obj);
         if (!err_obj)
         {
@@ -261,7 +286,7 @@ TEST_F(EvaluatorTest, TestErrorHandling)
     }
 }
 
-TEST_F(EvaluatorTest, TestLetStatements)
+TEST_P(EvaluatorTest, TestLetStatements)
 {
     struct TestCase
     {
@@ -280,12 +305,11 @@ TEST_F(EvaluatorTest, TestLetStatements)
     }
 }
 
-TEST_F(EvaluatorTest, TestFunctionObject)
+TEST_P(EvaluatorTest, TestFunctionObject)
 {
     auto input = "fn(x) { x + 2; };";
     auto evaluated = TestEval(input);
-    std::shared_ptr<object::Function> fn =
-        std::dynamic_pointer_cast<object::Function>(evaluated);
+    object::Function *fn = evaluated.As<object::Function>();
     EXPECT_TRUE(fn);
     if (!fn)
     {
@@ -297,7 +321,7 @@ TEST_F(EvaluatorTest, TestFunctionObject)
     EXPECT_EQ(fn->body_->String(), "(x+2)");
 }
 
-TEST_F(EvaluatorTest, TestFunctionApplication)
+TEST_P(EvaluatorTest, TestFunctionApplication)
 {
     struct TestCase
     {
@@ -317,7 +341,7 @@ TEST_F(EvaluatorTest, TestFunctionApplication)
     }
 }
 
-TEST_F(EvaluatorTest, TestClosures)
+TEST_P(EvaluatorTest, TestClosures)
 {
     auto input = R"(let newAdder = fn(x) {
   fn(y) { x + y; };
@@ -329,12 +353,11 @@ addTwo(2);)";
     TestIntegerObject(TestEval(input), 4);
 }
 
-TEST_F(EvaluatorTest, TestStringConcatentation)
+TEST_P(EvaluatorTest, TestStringConcatentation)
 {
     auto input = R"("Hello" + " " + "World!")";
-    std::shared_ptr<object::Object> evaluated = TestEval(input);
-    std::shared_ptr<object::String> str_obj =
-        std::dynamic_pointer_cast<object::String>(evaluated);
+    object::Value evaluated = TestEval(input);
+    object::String *str_obj = evaluated.As<object::String>();
     if (!str_obj)
     {
         FAIL() << "Object is not a String. Got " << typeid(evaluated).name()
@@ -344,7 +367,7 @@ TEST_F(EvaluatorTest, TestStringConcatentation)
     EXPECT_EQ(str_obj->value_, "Hello World!");
 }
 
-TEST_F(EvaluatorTest, TestInBuiltFunctions)
+TEST_P(EvaluatorTest, TestInBuiltFunctions)
 {
     struct TestCaseInt
     {
@@ -360,12 +383,11 @@ TEST_F(EvaluatorTest, TestInBuiltFunctions)
     }
 }
 
-TEST_F(EvaluatorTest, TestArrayLiterals)
+TEST_P(EvaluatorTest, TestArrayLiterals)
 {
     auto input = "[1, 2 * 2, 3 + 3]";
-    std::shared_ptr<object::Object> evaluated = TestEval(input);
-    std::shared_ptr<object::Array> array_obj =
-        std::dynamic_pointer_cast<object::Array>(evaluated);
+    object::Value evaluated = TestEval(input);
+    object::Array *array_obj = evaluated.As<object::Array>();
     if (!array_obj)
     {
         FAIL() << "Object is not an Array. Got " << typeid(evaluated).name()
@@ -379,7 +401,7 @@ TEST_F(EvaluatorTest, TestArrayLiterals)
     EXPECT_TRUE(TestIntegerObject(array_obj->elements_[2], 6));
 }
 
-TEST_F(EvaluatorTest, TestArrayIndexExpressions)
+TEST_P(EvaluatorTest, TestArrayIndexExpressions)
 {
     struct TestCase
     {
@@ -411,7 +433,7 @@ TEST_F(EvaluatorTest, TestArrayIndexExpressions)
     }
 }
 
-TEST_F(EvaluatorTest, TestBuiltInFunctions)
+TEST_P(EvaluatorTest, TestBuiltInFunctions)
 {
     struct TestCase
     {
@@ -455,8 +477,7 @@ TEST_F(EvaluatorTest, TestBuiltInFunctions)
     for (auto &tt : teststrings)
     {
         auto evaluated = TestEval(tt.input);
-        std::shared_ptr<object::Error> err_obj =
-            std::dynamic_pointer_cast<object::Error>(evaluated);
+        object::Error *err_obj = evaluated.As<object::Error>();
         if (!err_obj)
             FAIL() << "Object is not Error - got " << typeid(evaluated).name();
 
@@ -479,8 +500,7 @@ TEST_F(EvaluatorTest, TestBuiltInFunctions)
     for (auto &tt : test_arrays)
     {
         auto evaluated = TestEval(tt.input);
-        std::shared_ptr<object::Array> arr_obj =
-            std::dynamic_pointer_cast<object::Array>(evaluated);
+        object::Array *arr_obj = evaluated.As<object::Array>();
         if (!arr_obj)
             FAIL() << "Object is not Array - got " << typeid(evaluated).name();
 
@@ -507,7 +527,7 @@ TEST_F(EvaluatorTest, TestBuiltInFunctions)
     }
 }
 
-TEST_F(EvaluatorTest, TestForLoop)
+TEST_P(EvaluatorTest, TestForLoop)
 {
     struct TestCase
     {
@@ -516,8 +536,9 @@ TEST_F(EvaluatorTest, TestForLoop)
     };
 
     std::vector<TestCase> tests{
-        {R"(for (i = 0; i < 5; ++i) { puts(i); i; })", "5"},
-        {R"(for (i = 5; i > 0; --i) { puts(i); i; })", "0"},
+        // the value the body last gave - ++ changes i, not that value
+        {R"(for (i = 0; i < 5; ++i) { puts(i); i; })", "4"},
+        {R"(for (i = 5; i > 0; --i) { puts(i); i; })", "1"},
         {R"(let i = 7; let x = 10; for (i = 5; i > 0; --i) { let x = x + i; puts(x); }; i)",
          "7"},
         {R"(let x = 10; for (i = 5; i > 0; --i) { let x = x + i; puts(x); i; }; i;)",
@@ -528,12 +549,12 @@ TEST_F(EvaluatorTest, TestForLoop)
 
     for (auto &tt : tests)
     {
-        std::shared_ptr<object::Object> evaluated = TestEval(tt.input);
-        EXPECT_EQ(evaluated->Inspect(), tt.expected);
+        object::Value evaluated = TestEval(tt.input);
+        EXPECT_EQ(evaluated.Inspect(), tt.expected);
     }
 }
 
-TEST_F(EvaluatorTest, TestHashLiterals)
+TEST_P(EvaluatorTest, TestHashLiterals)
 {
     std::string input = R"(let two = "two";
 {
@@ -545,9 +566,8 @@ TEST_F(EvaluatorTest, TestHashLiterals)
     false: 6
 })";
 
-    std::shared_ptr<object::Object> evaluated = TestEval(input);
-    std::shared_ptr<object::Hash> hsh =
-        std::dynamic_pointer_cast<object::Hash>(evaluated);
+    object::Value evaluated = TestEval(input);
+    object::Hash *hsh = evaluated.As<object::Hash>();
     if (!hsh)
         FAIL() << "Object is not a Hash. Got " << typeid(evaluated).name()
                << "\n\n";
@@ -557,8 +577,8 @@ TEST_F(EvaluatorTest, TestHashLiterals)
         {object::String("two").HashKey(), 2},
         {object::String("three").HashKey(), 3},
         {object::Integer(4).HashKey(), 4},
-        {evaluator::TRUE->HashKey(), 5},
-        {evaluator::FALSE->HashKey(), 6},
+        {evaluator::MakeHashKey(evaluator::TRUE), 5},
+        {evaluator::MakeHashKey(evaluator::FALSE), 6},
     };
 
     if (hsh->pairs_.size() != expected.size())
@@ -580,7 +600,7 @@ TEST_F(EvaluatorTest, TestHashLiterals)
     }
 }
 
-TEST_F(EvaluatorTest, TestHashIndexExpression)
+TEST_P(EvaluatorTest, TestHashIndexExpression)
 {
     struct TestCase
     {
@@ -611,7 +631,7 @@ TEST_F(EvaluatorTest, TestHashIndexExpression)
     }
 }
 
-TEST_F(EvaluatorTest, TestIncrementOperators)
+TEST_P(EvaluatorTest, TestIncrementOperators)
 {
     struct TestCase
     {
@@ -625,6 +645,7 @@ TEST_F(EvaluatorTest, TestIncrementOperators)
         {"--0", -1},
         {"let i = 3; --i", 2},
         {"let i = 3; ++i", 4},
+        {"let i = 3; ++i; i", 4},
     };
 
     for (auto tt : tests)
@@ -633,4 +654,56 @@ TEST_F(EvaluatorTest, TestIncrementOperators)
     }
 }
 
+TEST_P(EvaluatorTest, TestLazyFunctionBodies)
+{
+    std::string input = R"(
+let make_adder = fn(n) { fn(x) { let s = "}"; x + n } };
+let broken = fn() { let = ; };
+let addtwo = make_adder(2);
+[addtwo(40), addtwo(1), make_adder(10)(5)];
+)";
+    auto lex = std::make_shared<lexer::Lexer>(input);
+    parser::Parser parsley{lex};
+    parsley.SetLazyBodies(true);
+    auto program = parsley.ParseProgram();
+    // the syntax error's in a body that's never called
+    ASSERT_FALSE(parsley.CheckErrors());
+
+    auto evaluated = Run(program);
+    EXPECT_EQ(evaluated.Inspect(), "[42, 3, 15]");
+
+    auto called =
+        Run(parser::ParseProgramParallel(source::FromString("broken()"), 1));
+    EXPECT_EQ(called.Inspect(), "ERROR: syntax error in function body");
+}
+
+TEST_P(EvaluatorTest, TestDeepOperatorChains)
+{
+    // as deep as the parser allows
+    std::string sum = "1";
+    for (int i = 1; i < 2000; i++)
+        sum += " + 1";
+    EXPECT_TRUE(TestIntegerObject(TestEval(sum), 2000));
+    // spaced, as "--" would be a decrement
+    std::string minuses;
+    for (int i = 1; i < 2000; i++)
+        minuses += "- ";
+    EXPECT_TRUE(TestIntegerObject(TestEval(minuses + "1"), -1));
+
+    // and far deeper, which is a parse error rather than a crash
+    for (int i = 2000; i < 100000; i++)
+    {
+        sum += " + 1";
+        minuses += "- ";
+    }
+    for (auto input : {sum, minuses + "1"})
+    {
+        auto lex = std::make_shared<lexer::Lexer>(input);
+        parser::Parser parsley{lex};
+        auto program = parsley.ParseProgram();
+        EXPECT_TRUE(parsley.CheckErrors());
+        Run(program);
+    }
+}
+
 } // namespace
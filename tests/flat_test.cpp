@@ -0,0 +1,178 @@
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include "../ast.hpp"
+#include "../evaluator.hpp"
+#include "../flat.hpp"
+#include "../object.hpp"
+#include "../ref.hpp"
+#include "../source.hpp"
+#include "../vm.hpp"
+
+#include "gtest/gtest.h"
+
+#include "parse.hpp"
+
+namespace
+{
+
+using test::Parse;
+
+struct FlatTest : public ::testing::Test
+{
+};
+
+TEST_F(FlatTest, TestRoundTrip)
+{
+    std::string input = R"(
+let add = fn(x, y) { return x + y * -3; };
+let h = {"one": 1, true: [1, 2, "three"], 4: add(1, 2)};
+if (!(h["one"] == 1)) { 10 } else { 20 };
+let big = 9223372036854775807;
+fn() { }();
+)";
+    auto program = Parse(input);
+    flat::Tree tree = flat::Flatten(*program);
+
+    const flat::Node &root = tree.At(tree.Root());
+    EXPECT_EQ(root.kind, ast::NodeKind::PROGRAM);
+    EXPECT_EQ(root.b, program->statements_.size());
+    EXPECT_EQ(tree.Root(), tree.Size() - 1);
+
+    auto inflated = flat::Inflate(tree);
+    EXPECT_EQ(inflated->String(), program->String());
+    EXPECT_EQ(inflated->source_, program->source_);
+}
+
+TEST_F(FlatTest, TestNodesAreSpansOverTheSource)
+{
+    auto program = Parse("let name = \"slang\"; name + \"!\";");
+    flat::Tree tree = flat::Flatten(*program);
+
+    const flat::Node &let = tree.At(tree.List(tree.At(tree.Root()).a)[0]);
+    ASSERT_EQ(let.kind, ast::NodeKind::LET);
+    const flat::Node &name = tree.At(let.a);
+    EXPECT_EQ(name.kind, ast::NodeKind::IDENTIFIER);
+    EXPECT_EQ(tree.Text(name), "name");
+    EXPECT_EQ(tree.Text(name).data(),
+              program->source_->Text().data() + name.span.offset);
+    EXPECT_EQ(tree.Text(tree.At(let.b)), "slang");
+}
+
+TEST_F(FlatTest, TestInflatedProgramEvaluates)
+{
+    auto program = Parse(R"(
+let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } };
+let xs = [fib(10), len("four")];
+{"k": xs[0] + xs[1]}["k"];
+)");
+    auto inflated = flat::Inflate(flat::Flatten(*program));
+
+    auto env = ref::Make<object::Environment>();
+    auto result = evaluator::Eval(inflated, env);
+    ASSERT_TRUE(result);
+    EXPECT_EQ(result.Inspect(), "59");
+}
+
+TEST_F(FlatTest, TestImageRoundTrip)
+{
+    auto program = Parse(R"(
+let greet = fn(name) { "hello " + name };
+let counts = {"a": 1, "b": -2};
+let total = 0;
+for (i = 0; i < 3; ++i) { let total = total + counts["a"]; };
+[greet("image"), counts["b"] * 4611686018427387903, total];
+)");
+    std::ostringstream out;
+    ASSERT_TRUE(flat::Save(flat::Flatten(*program), out));
+
+    auto tree = flat::Load(source::FromString(out.str()));
+    ASSERT_TRUE(tree);
+    auto loaded = flat::Inflate(*tree);
+    EXPECT_EQ(loaded->String(), program->String());
+
+    auto result = evaluator::Eval(loaded, ref::Make<object::Environment>());
+    auto expected = evaluator::Eval(program, ref::Make<object::Environment>());
+    ASSERT_TRUE(result);
+    EXPECT_EQ(result.Inspect(), expected.Inspect());
+    EXPECT_EQ(
+        result.Inspect().rfind("[hello image, -9223372036854775806, ", 0),
+        0u);
+}
+
+TEST_F(FlatTest, TestImageLiteralsAreInThePool)
+{
+    auto program = Parse("let x = \"dup\"; let y = \"dup\"; x + y;");
+    std::ostringstream out;
+    ASSERT_TRUE(flat::Save(flat::Flatten(*program), out));
+    std::string image = out.str();
+    // each literal is stored once, and the source itself isn't stored
+    EXPECT_EQ(image.find("dup"), image.rfind("dup"));
+    EXPECT_EQ(image.find("let x"), std::string::npos);
+
+    auto tree = flat::Load(source::FromString(image));
+    ASSERT_TRUE(tree);
+    // loaded trees point into the image rather than copying it
+    EXPECT_EQ(tree->Bytes(), 2 * sizeof(symbol::Id));
+    const flat::Node &let = tree->At(tree->List(tree->At(tree->Root()).a)[0]);
+    EXPECT_EQ(tree->Text(tree->At(let.b)), "dup");
+    EXPECT_EQ(tree->Symbol(tree->At(let.a)), symbol::Intern("x"));
+}
+
+TEST_F(FlatTest, TestImagesRunOnTheVm)
+{
+    auto program = Parse(R"(
+let adder = fn(n) { fn(x) { x + n } };
+let words = {"one": 1, "two": 2};
+let sum = fn(i) {
+  if (i < 4) { adder(i)(words["two"]) + sum(i + 1) } else { 0 }
+};
+for (i = 0; i < 2; ++i) { let last = sum(i) };
+[-sum(0), !true, "s" + "t", adder];
+)");
+    std::ostringstream out;
+    ASSERT_TRUE(flat::Save(flat::Flatten(*program), out));
+    auto tree = flat::Load(source::FromString(out.str()));
+    ASSERT_TRUE(tree);
+
+    // compiled straight from the loaded tree, with no pointer AST
+    auto result = vm::Machine{}.Run(tree);
+    auto expected = evaluator::Eval(program, ref::Make<object::Environment>());
+    ASSERT_TRUE(result);
+    EXPECT_EQ(result.Inspect(), expected.Inspect());
+    EXPECT_EQ(result.Inspect().rfind("[-14, false, st, fn(n) {", 0), 0u);
+}
+
+TEST_F(FlatTest, TestMalformedImagesAreRejected)
+{
+    // nothing in it can overflow, whatever a damaged literal's value
+    auto program = Parse("let f = fn(a) { a < 2 }; f(21);");
+    std::ostringstream out;
+    ASSERT_TRUE(flat::Save(flat::Flatten(*program), out));
+    std::string image = out.str();
+
+    EXPECT_FALSE(flat::Load(source::FromString("")));
+    EXPECT_FALSE(flat::Load(source::FromString("let x = 1;")));
+    EXPECT_FALSE(
+        flat::Load(source::FromString(image.substr(0, image.size() - 1))));
+
+    // Flip each byte of the header and node array in turn: the loader may
+    // accept the damage (a changed literal or operator is still a tree) but
+    // whatever it accepts has to inflate and run, or compile and run on the
+    // VM, without crashing.
+    size_t nodes_end = 32 + flat::Flatten(*program).Size() * sizeof(flat::Node);
+    for (size_t i = 0; i < nodes_end; i++)
+    {
+        std::string damaged = image;
+        damaged[i] ^= 0x5a;
+        auto tree = flat::Load(source::FromString(damaged));
+        if (!tree)
+            continue;
+        auto env = ref::Make<object::Environment>();
+        evaluator::Eval(flat::Inflate(*tree), env);
+        vm::Machine{}.Run(tree);
+    }
+}
+
+} // namespace
@@ -1,12 +1,21 @@
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
 #include <iostream>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <utility>
 #include <vector>
 
 #include "gtest/gtest.h"
 
 #include "../lexer.hpp"
+#include "../scan.hpp"
+#include "../source.hpp"
+#include "../symbol.hpp"
 #include "../token.hpp"
 
 namespace
@@ -119,4 +128,268 @@ TEST_F(LexerTest, TestNextToken)
     }
 }
 
+TEST_F(LexerTest, TestTokensAreSpansOverTheSource)
+{
+    std::string_view source = lex->GetInput();
+    for (;;)
+    {
+        token::Token tok = lex->NextToken();
+        if (tok.type_ == token::EOFF)
+            break;
+        EXPECT_GE(tok.literal_.data(), source.data());
+        EXPECT_LE(tok.literal_.data() + tok.literal_.size(),
+                  source.data() + source.size());
+    }
+}
+
+TEST_F(LexerTest, TestIntegerValues)
+{
+    lexer::Lexer lex{"0 7 1234 9223372036854775807 9223372036854775808"};
+    std::vector<int64_t> expected{0, 7, 1234, 9223372036854775807};
+    for (auto e : expected)
+    {
+        token::Token tok = lex.NextToken();
+        EXPECT_EQ(tok.type_, token::INT);
+        EXPECT_EQ(tok.value_, e);
+    }
+    // out of range for int64_t
+    EXPECT_EQ(lex.NextToken().type_, token::ILLEGAL);
+}
+
+TEST_F(LexerTest, TestTokenizeMatchesNextToken)
+{
+    std::string input = "let add = fn(x, y) { x + y; }; add(5, 10) == \"fifteen\";";
+    lexer::Lexer streaming{input};
+    lexer::Lexer lex{input};
+    lexer::TokenStream tokens;
+    lex.Tokenize(tokens);
+
+    size_t i = 0;
+    for (;; i++)
+    {
+        token::Token expected = streaming.NextToken();
+        EXPECT_EQ(tokens.Kind(i), expected.type_);
+        EXPECT_EQ(tokens.Literal(i), expected.literal_);
+        EXPECT_EQ(tokens.At(i).value_, expected.value_);
+        if (expected.type_ == token::EOFF)
+            break;
+    }
+    // lookahead past the end keeps reading EOF
+    EXPECT_EQ(tokens.Kind(i + 3), token::EOFF);
+}
+
+TEST_F(LexerTest, TestTokenStreamMovesItsWindowOn)
+{
+    std::string input;
+    for (int i = 0; i < 10000; i++)
+        input += "let x = " + std::to_string(i) + "; ";
+    lexer::Lexer streaming{input};
+    lexer::Lexer lex{input};
+    lexer::TokenStream tokens;
+    lex.Tokenize(tokens);
+
+    // looking a window ahead, and letting go of what's behind
+    const size_t ahead = lexer::TokenStream::kWindow;
+    size_t i = 0;
+    for (;; i++)
+    {
+        token::Token expected = streaming.NextToken();
+        tokens.Kind(i + ahead);
+        ASSERT_EQ(tokens.Kind(i), expected.type_);
+        EXPECT_EQ(tokens.Literal(i), expected.literal_);
+        EXPECT_EQ(tokens.At(i).value_, expected.value_);
+        if (expected.type_ == token::EOFF)
+            break;
+        tokens.Release(i);
+    }
+    EXPECT_EQ(i, 50000u);
+    // what's been let go of reads as EOF
+    EXPECT_EQ(tokens.Kind(0), token::EOFF);
+}
+
+TEST_F(LexerTest, TestIdentifiersAreInterned)
+{
+    lexer::Lexer lex{"foo bar foo let foo_bar"};
+    token::Token foo = lex.NextToken();
+    token::Token bar = lex.NextToken();
+    token::Token foo_again = lex.NextToken();
+    token::Token let = lex.NextToken();
+    token::Token foo_bar = lex.NextToken();
+
+    EXPECT_NE(foo.value_, symbol::kNone);
+    EXPECT_EQ(foo.value_, foo_again.value_);
+    EXPECT_NE(foo.value_, bar.value_);
+    EXPECT_NE(foo.value_, foo_bar.value_);
+    // keywords aren't identifiers
+    EXPECT_EQ(let.value_, 0);
+
+    EXPECT_EQ(symbol::Name(foo.value_), "foo");
+    EXPECT_EQ(symbol::Intern("foo_bar"), foo_bar.value_);
+}
+
+TEST_F(LexerTest, TestThreadsInternToTheSameIds)
+{
+    const int kNames = 2000;
+    // steps prime to kNames, so each thread sees every name, in its own
+    // order
+    const std::vector<int> steps{1, 3, 7, 11};
+    std::vector<std::vector<symbol::Id>> ids(
+        steps.size(), std::vector<symbol::Id>(kNames, symbol::kNone));
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < steps.size(); t++)
+    {
+        threads.emplace_back([&, t]() {
+            // the second time round, from the thread's own copy
+            for (int pass = 0; pass < 2; pass++)
+                for (int i = 0; i < kNames; i++)
+                {
+                    int n = i * steps[t] % kNames;
+                    symbol::Id id =
+                        symbol::Intern("threaded_" + std::to_string(n));
+                    EXPECT_TRUE(pass == 0 || ids[t][n] == id);
+                    ids[t][n] = id;
+                }
+        });
+    }
+    for (auto &thread : threads)
+        thread.join();
+
+    for (int n = 0; n < kNames; n++)
+    {
+        std::string name = "threaded_" + std::to_string(n);
+        EXPECT_EQ(symbol::Intern(name), ids[0][n]);
+        EXPECT_EQ(symbol::Name(ids[0][n]), name);
+        for (size_t t = 1; t < steps.size(); t++)
+            EXPECT_EQ(ids[t][n], ids[0][n]);
+    }
+}
+
+TEST_F(LexerTest, TestMappedFileInput)
+{
+    std::string path = ::testing::TempDir() + "lexer_test_script.slang";
+    {
+        std::ofstream out{path};
+        out << input;
+    }
+
+    std::shared_ptr<source::Buffer> script = source::FromFile(path);
+    ASSERT_TRUE(script);
+    EXPECT_TRUE(script->IsMapped());
+    EXPECT_EQ(script->Text(), input);
+
+    lexer::Lexer mapped_lex{script};
+    for (auto tt : testTokens)
+    {
+        token::Token tok = mapped_lex.NextToken();
+        EXPECT_EQ(tok.type_, tt.first);
+        EXPECT_EQ(tok.literal_, tt.second);
+    }
+    std::remove(path.c_str());
+
+    EXPECT_FALSE(source::FromFile(path));
+}
+
+TEST_F(LexerTest, TestScriptsLongerThanSpansReachAreRefused)
+{
+    // sparse, so it takes no room on disk
+    std::string path = ::testing::TempDir() + "lexer_test_huge.slang";
+    std::FILE *file = std::fopen(path.c_str(), "w");
+    ASSERT_TRUE(file);
+    ASSERT_EQ(truncate(path.c_str(), source::kMaxSize + 1), 0);
+    std::fclose(file);
+
+    EXPECT_FALSE(source::FromFile(path));
+    std::remove(path.c_str());
+}
+
+TEST_F(LexerTest, TestScannersAgree)
+{
+    // runs of every length around the 16 and 32 byte steps, each followed
+    // by a terminator, and also running right up to the end of the buffer
+    struct RunCase
+    {
+        std::string run;
+        std::string stop;
+        const char *(*scan::Scanners::*scanner)(const char *, const char *);
+    };
+    std::vector<RunCase> cases;
+    for (int len = 0; len < 70; len++)
+    {
+        std::string spaces, ident, digits, text;
+        for (int i = 0; i < len; i++)
+        {
+            spaces += " \t\n\r"[i % 4];
+            ident += "aZz_Aq"[i % 6];
+            digits += static_cast<char>('0' + i % 10);
+            text += "a {}\\x"[i % 6];
+        }
+        for (std::string stop : {"", "x", "\v", "\x80", "!"})
+            cases.push_back({spaces, stop, &scan::Scanners::skip_whitespace});
+        for (std::string stop : {"", "@", "[", "`", "{", "\x80", "0", " "})
+            cases.push_back({ident, stop, &scan::Scanners::skip_identifier});
+        for (std::string stop : {"", "a", "/", ":", "\xb0"})
+            cases.push_back({digits, stop, &scan::Scanners::skip_digits});
+        for (std::string stop : std::vector<std::string>{"", "\"", {'\0'}})
+            cases.push_back({text, stop, &scan::Scanners::find_quote});
+    }
+
+    scan::Level detected = scan::Detect();
+    for (auto level : {scan::Level::SCALAR, scan::Level::SSE2,
+                       scan::Level::AVX2})
+    {
+        if (!scan::Use(level))
+            continue;
+        for (auto &c : cases)
+        {
+            std::string buf = c.run + c.stop + "tail";
+            const char *begin = buf.data();
+            const char *end = begin + c.run.size() + c.stop.size();
+            EXPECT_EQ((scan::Active().*c.scanner)(begin, end) - begin,
+                      static_cast<long>(c.run.size()))
+                << scan::LevelName(level) << " len " << c.run.size();
+        }
+    }
+    scan::Use(detected);
+}
+
+TEST_F(LexerTest, TestReadInputTracksBracesAndStrings)
+{
+    lexer::Lexer repl;
+    EXPECT_FALSE(repl.ReadInput("let f = fn(x) {"));
+    EXPECT_FALSE(repl.ReadInput("  let s = \"} not a brace"));
+    EXPECT_FALSE(repl.ReadInput("  still the string { \";"));
+    EXPECT_TRUE(repl.ReadInput("};"));
+
+    std::vector<token::TokenType> expected{
+        token::LET,    token::IDENT,     token::ASSIGN, token::FUNCTION,
+        token::LPAREN, token::IDENT,     token::RPAREN, token::LBRACE,
+        token::LET,    token::IDENT,     token::ASSIGN, token::STRING,
+        token::SEMICOLON, token::RBRACE, token::SEMICOLON, token::EOFF};
+    for (auto e : expected)
+        EXPECT_EQ(repl.NextToken().type_, e);
+
+    // the next input is lexed on its own, after the first one
+    EXPECT_TRUE(repl.ReadInput("\"{\""));
+    token::Token tok = repl.NextToken();
+    EXPECT_EQ(tok.type_, token::STRING);
+    EXPECT_EQ(tok.literal_, "{");
+    EXPECT_EQ(repl.NextToken().type_, token::EOFF);
+}
+
+TEST_F(LexerTest, TestLookupIdent)
+{
+    std::vector<std::pair<std::string, token::TokenType>> tests = {
+        {"fn", token::FUNCTION},  {"if", token::IF},
+        {"let", token::LET},      {"for", token::FOR},
+        {"true", token::TRUE},    {"else", token::ELSE},
+        {"false", token::FALSE},  {"return", token::RETURN},
+        {"f", token::IDENT},      {"fnx", token::IDENT},
+        {"lets", token::IDENT},   {"iff", token::IDENT},
+        {"returns", token::IDENT}, {"False", token::IDENT},
+    };
+
+    for (auto tt : tests)
+        EXPECT_EQ(token::LookupIdent(tt.first), tt.second) << tt.first;
+}
+
 } // namespace
@@ -1,6 +1,9 @@
-#include <memory>
+#include <vector>
 
 #include "../object.hpp"
+#include "../pool.hpp"
+#include "../ref.hpp"
+#include "../symbol.hpp"
 
 #include "gtest/gtest.h"
 
@@ -11,12 +14,20 @@ struct ObjectTest : public ::testing::Test
 {
 };
 
+// counts its destructions, to see when the last Ref lets go
+struct Tracked : public ref::Counted
+{
+    explicit Tracked(int &destroyed) : destroyed_{destroyed} {}
+    ~Tracked() override { destroyed_++; }
+    int &destroyed_;
+};
+
 TEST_F(ObjectTest, TestStringHashKey)
 {
-    auto hello1 = std::make_shared<object::String>("Hello World");
-    auto hello2 = std::make_shared<object::String>("Hello World");
-    auto diff1 = std::make_shared<object::String>("My name is johnny");
-    auto diff2 = std::make_shared<object::String>("My name is johnny");
+    auto hello1 = ref::Make<object::String>("Hello World");
+    auto hello2 = ref::Make<object::String>("Hello World");
+    auto diff1 = ref::Make<object::String>("My name is johnny");
+    auto diff2 = ref::Make<object::String>("My name is johnny");
     EXPECT_EQ(hello1->HashKey(), hello2->HashKey());
     EXPECT_EQ(diff1->HashKey(), diff2->HashKey());
     EXPECT_NE(hello1->HashKey(), diff1->HashKey());
@@ -24,10 +35,10 @@ TEST_F(ObjectTest, TestStringHashKey)
 
 TEST_F(ObjectTest, TestBooleanHashKey)
 {
-    auto true1 = std::make_shared<object::Boolean>(true);
-    auto true2 = std::make_shared<object::Boolean>(true);
-    auto false1 = std::make_shared<object::Boolean>(false);
-    auto false2 = std::make_shared<object::Boolean>(false);
+    auto true1 = ref::Make<object::Boolean>(true);
+    auto true2 = ref::Make<object::Boolean>(true);
+    auto false1 = ref::Make<object::Boolean>(false);
+    auto false2 = ref::Make<object::Boolean>(false);
     EXPECT_EQ(true1->HashKey(), true2->HashKey());
     EXPECT_EQ(false1->HashKey(), false2->HashKey());
     EXPECT_NE(true1->HashKey(), false1->HashKey());
@@ -35,13 +46,83 @@ TEST_F(ObjectTest, TestBooleanHashKey)
 
 TEST_F(ObjectTest, TestIntegerHashKey)
 {
-    auto one1 = std::make_shared<object::Integer>(1);
-    auto one2 = std::make_shared<object::Integer>(1);
-    auto two1 = std::make_shared<object::Integer>(2);
-    auto two2 = std::make_shared<object::Integer>(2);
+    auto one1 = ref::Make<object::Integer>(1);
+    auto one2 = ref::Make<object::Integer>(1);
+    auto two1 = ref::Make<object::Integer>(2);
+    auto two2 = ref::Make<object::Integer>(2);
     EXPECT_EQ(one1->HashKey(), one2->HashKey());
     EXPECT_EQ(two1->HashKey(), two2->HashKey());
     EXPECT_NE(one1->HashKey(), two1->HashKey());
 }
 
+TEST_F(ObjectTest, TestRefCounts)
+{
+    int destroyed = 0;
+    auto first = ref::Make<Tracked>(destroyed);
+    EXPECT_EQ(first.use_count(), 1u);
+    {
+        auto second = first;
+        ref::Ref<ref::Counted> base = second;
+        EXPECT_EQ(first.use_count(), 3u);
+    }
+    EXPECT_EQ(first.use_count(), 1u);
+
+    // the count's in the object, so a Ref from a plain pointer joins in
+    ref::Ref<Tracked> again{first.get()};
+    EXPECT_EQ(first.use_count(), 2u);
+    first.reset();
+    EXPECT_EQ(destroyed, 0);
+    again.reset();
+    EXPECT_EQ(destroyed, 1);
+}
+
+TEST_F(ObjectTest, TestSharedEnvironmentCantChange)
+{
+    auto name = symbol::Intern("shared_name");
+    auto string = ref::Make<object::String>("held");
+    auto array = ref::Make<object::Array>(std::vector<object::Value>{
+        string, object::Value::OfInteger(1)});
+    auto outer = ref::Make<object::Environment>();
+    outer->Set(name, array);
+    auto inner = ref::Make<object::Environment>(outer);
+
+    inner->Share();
+    // everything it refers to is shared with it
+    EXPECT_TRUE(outer->IsShared());
+    EXPECT_TRUE(array->IsShared());
+    EXPECT_TRUE(string->IsShared());
+
+    EXPECT_FALSE(inner->Set(name, object::Value::OfInteger(2)));
+    EXPECT_FALSE(inner->Assign(name, object::Value::OfInteger(2)));
+    EXPECT_EQ(inner->Get(name), object::Value{array});
+
+    // a new environment on top of a shared one is the caller's to change
+    auto local = ref::Make<object::Environment>(inner);
+    EXPECT_TRUE(local->Set(name, object::Value::OfInteger(3)));
+    EXPECT_EQ(local->Get(name), object::Value::OfInteger(3));
+}
+
+TEST_F(ObjectTest, TestPooledBlocksAreReused)
+{
+    pool::Stats before = pool::GetStats();
+    object::Object *first = nullptr;
+    {
+        auto string = ref::Make<object::String>("pooled");
+        first = string.get();
+    }
+    // the freed block is the next one its size class hands out
+    auto again = ref::Make<object::String>("again");
+    EXPECT_EQ(again.get(), first);
+    pool::Stats after = pool::GetStats();
+    EXPECT_EQ(after.allocations - before.allocations, 2u);
+    // the first may have been reused too, from an earlier test
+    EXPECT_GE(after.reused - before.reused, 1u);
+    EXPECT_EQ(after.frees - before.frees, 1u);
+
+    // too big to pool
+    void *large = pool::Allocate(pool::kMaxPooled + 1);
+    pool::Free(large, pool::kMaxPooled + 1);
+    EXPECT_EQ(pool::GetStats().large - after.large, 1u);
+}
+
 } // namespace
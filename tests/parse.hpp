@@ -0,0 +1,31 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "../ast.hpp"
+#include "../lexer.hpp"
+#include "../parser.hpp"
+#include "../ref.hpp"
+
+#include "gtest/gtest.h"
+
+// Helpers the test files share.
+
+namespace test
+{
+
+// Parses `input`, failing the test if it has errors. With `lazy`, function
+// bodies are only skimmed (see parser::Parser::SetLazyBodies).
+inline ref::Ref<ast::Program> Parse(const std::string &input,
+                                    bool lazy = false)
+{
+    auto lex = std::make_shared<lexer::Lexer>(input);
+    parser::Parser parsley{lex};
+    parsley.SetLazyBodies(lazy);
+    auto program = parsley.ParseProgram();
+    EXPECT_FALSE(parsley.CheckErrors());
+    return program;
+}
+
+} // namespace test
@@ -1,5 +1,6 @@
 #include <variant>
 
+#include <algorithm>
 #include <iostream>
 #include <memory>
 #include <string>
@@ -12,6 +13,8 @@
 
 #include "../lexer.hpp"
 #include "../parser.hpp"
+#include "../ref.hpp"
+#include "../source.hpp"
 #include "../token.hpp"
 
 namespace
@@ -21,7 +24,7 @@ struct ParserTest : public ::testing::Test
 {
 };
 
-bool TestLetStatement(std::shared_ptr<ast::Statement> s, std::string name)
+bool TestLetStatement(ref::Ref<ast::Statement> s, std::string name)
 {
     std::cout << "Literal is " << s->TokenLiteral() << std::endl;
 
@@ -32,8 +35,7 @@ bool TestLetStatement(std::shared_ptr<ast::Statement> s, std::string name)
 
     std::cout << "s is of type " << typeid(s).name() << std::endl;
 
-    std::shared_ptr<ast::LetStatement> ls =
-        std::dynamic_pointer_cast<ast::LetStatement>(s);
+    ref::Ref<ast::LetStatement> ls = ref::DynamicCast<ast::LetStatement>(s);
     if (!ls)
         return false;
     std::cout << "CAST WAS All good!\n";
@@ -49,7 +51,7 @@ bool TestLetStatement(std::shared_ptr<ast::Statement> s, std::string name)
     return true;
 }
 
-bool TestForStatement(std::shared_ptr<ast::Statement> s)
+bool TestForStatement(ref::Ref<ast::Statement> s)
 {
     std::cout << "FOR STATEMENT is " << s->TokenLiteral() << std::endl;
 
@@ -60,8 +62,8 @@ bool TestForStatement(std::shared_ptr<ast::Statement> s)
 
     std::cout << "s is of type " << typeid(s).name() << std::endl;
 
-    std::shared_ptr<ast::ForStatement> for_stmt =
-        std::dynamic_pointer_cast<ast::ForStatement>(s);
+    ref::Ref<ast::ForStatement> for_stmt =
+        ref::DynamicCast<ast::ForStatement>(s);
     if (!for_stmt)
         return false;
     std::cout << "FOR CAST WAS All good!\n";
@@ -69,10 +71,9 @@ bool TestForStatement(std::shared_ptr<ast::Statement> s)
     return true;
 }
 
-bool TestIdentifier(std::shared_ptr<ast::Expression> expr, std::string val)
+bool TestIdentifier(ref::Ref<ast::Expression> expr, std::string val)
 {
-    std::shared_ptr<ast::Identifier> ident =
-        std::dynamic_pointer_cast<ast::Identifier>(expr);
+    ref::Ref<ast::Identifier> ident = ref::DynamicCast<ast::Identifier>(expr);
     if (!ident)
         return false;
     if (ident->value_ != val)
@@ -82,10 +83,10 @@ bool TestIdentifier(std::shared_ptr<ast::Expression> expr, std::string val)
     return true;
 }
 
-bool TestIntegerLiteral(std::shared_ptr<ast::Expression> expr, int64_t value)
+bool TestIntegerLiteral(ref::Ref<ast::Expression> expr, int64_t value)
 {
-    std::shared_ptr<ast::IntegerLiteral> integ =
-        std::dynamic_pointer_cast<ast::IntegerLiteral>(expr);
+    ref::Ref<ast::IntegerLiteral> integ =
+        ref::DynamicCast<ast::IntegerLiteral>(expr);
     if (!integ)
         return false;
     if (integ->value_ != value)
@@ -95,10 +96,10 @@ bool TestIntegerLiteral(std::shared_ptr<ast::Expression> expr, int64_t value)
     return true;
 }
 
-bool TestBooleanLiteral(std::shared_ptr<ast::Expression> expr, bool val)
+bool TestBooleanLiteral(ref::Ref<ast::Expression> expr, bool val)
 {
-    std::shared_ptr<ast::BooleanExpression> bool_expr =
-        std::dynamic_pointer_cast<ast::BooleanExpression>(expr);
+    ref::Ref<ast::BooleanExpression> bool_expr =
+        ref::DynamicCast<ast::BooleanExpression>(expr);
     if (!bool_expr)
     {
         std::cerr << "Not an BooleanExpression - got " << typeid(&expr).name()
@@ -114,7 +115,7 @@ bool TestBooleanLiteral(std::shared_ptr<ast::Expression> expr, bool val)
     return true;
 }
 
-bool TestLiteralExpression(std::shared_ptr<ast::Expression> expr,
+bool TestLiteralExpression(ref::Ref<ast::Expression> expr,
                            std::variant<int64_t, std::string, bool> val)
 {
 
@@ -136,13 +137,13 @@ bool TestLiteralExpression(std::shared_ptr<ast::Expression> expr,
     return false;
 }
 
-bool TestInfixExpression(std::shared_ptr<ast::Expression> expr,
+bool TestInfixExpression(ref::Ref<ast::Expression> expr,
                          std::variant<int64_t, std::string, bool> left,
                          std::string op,
                          std::variant<int64_t, std::string, bool> right)
 {
-    std::shared_ptr<ast::InfixExpression> op_expr =
-        std::dynamic_pointer_cast<ast::InfixExpression>(expr);
+    ref::Ref<ast::InfixExpression> op_expr =
+        ref::DynamicCast<ast::InfixExpression>(expr);
     if (!op_expr)
     {
         std::cerr << "Not an InfixExpression - got " << typeid(&expr).name();
@@ -193,15 +194,14 @@ TEST_F(ParserTest, TestLetStatements)
             std::make_unique<lexer::Lexer>(tt.input);
         std::unique_ptr<parser::Parser> parsley =
             std::make_unique<parser::Parser>(std::move(lex));
-        std::shared_ptr<ast::Program> program = parsley->ParseProgram();
+        ref::Ref<ast::Program> program = parsley->ParseProgram();
         EXPECT_FALSE(parsley->CheckErrors());
 
         EXPECT_TRUE(
             TestLetStatement(program->statements_[0], tt.expected_ident));
 
-        std::shared_ptr<ast::LetStatement> stmt =
-            std::dynamic_pointer_cast<ast::LetStatement>(
-                program->statements_[0]);
+        ref::Ref<ast::LetStatement> stmt =
+            ref::DynamicCast<ast::LetStatement>(program->statements_[0]);
         if (!stmt)
             FAIL() << "program->statements_[0] is not an LetStatement";
 
@@ -237,14 +237,13 @@ TEST_F(ParserTest, TestForStatements)
             std::make_unique<lexer::Lexer>(tt.input);
         std::unique_ptr<parser::Parser> parsley =
             std::make_unique<parser::Parser>(std::move(lex));
-        std::shared_ptr<ast::Program> program = parsley->ParseProgram();
+        ref::Ref<ast::Program> program = parsley->ParseProgram();
         ASSERT_FALSE(parsley->CheckErrors());
 
         EXPECT_TRUE(TestForStatement(program->statements_[0]));
 
-        std::shared_ptr<ast::ForStatement> stmt =
-            std::dynamic_pointer_cast<ast::ForStatement>(
-                program->statements_[0]);
+        ref::Ref<ast::ForStatement> stmt =
+            ref::DynamicCast<ast::ForStatement>(program->statements_[0]);
         if (!stmt)
             FAIL() << "program->statements_[0] is not an ForStatement";
 
@@ -278,13 +277,12 @@ TEST_F(ParserTest, TestReturnStatements)
             std::make_unique<lexer::Lexer>(tt.input);
         std::unique_ptr<parser::Parser> parsley =
             std::make_unique<parser::Parser>(std::move(lex));
-        std::shared_ptr<ast::Program> program = parsley->ParseProgram();
+        ref::Ref<ast::Program> program = parsley->ParseProgram();
         EXPECT_FALSE(parsley->CheckErrors());
 
         ASSERT_EQ(1, program->statements_.size());
-        std::shared_ptr<ast::ReturnStatement> stmt =
-            std::dynamic_pointer_cast<ast::ReturnStatement>(
-                program->statements_[0]);
+        ref::Ref<ast::ReturnStatement> stmt =
+            ref::DynamicCast<ast::ReturnStatement>(program->statements_[0]);
         if (!stmt)
             FAIL() << "program->statements_[0] is not an ReturnStatement";
 
@@ -304,17 +302,16 @@ TEST_F(ParserTest, TestStringLiteralExpression)
     std::shared_ptr<lexer::Lexer> lex = std::make_shared<lexer::Lexer>(input);
     std::unique_ptr<parser::Parser> parsley =
         std::make_unique<parser::Parser>(lex);
-    std::shared_ptr<ast::Program> program = parsley->ParseProgram();
+    ref::Ref<ast::Program> program = parsley->ParseProgram();
     EXPECT_FALSE(parsley->CheckErrors());
     ASSERT_EQ(1, program->statements_.size());
-    std::shared_ptr<ast::ExpressionStatement> stmt =
-        std::dynamic_pointer_cast<ast::ExpressionStatement>(
-            program->statements_[0]);
+    ref::Ref<ast::ExpressionStatement> stmt =
+        ref::DynamicCast<ast::ExpressionStatement>(program->statements_[0]);
     if (!stmt)
         FAIL() << "program->statements_[0] is not an ExpressionStatement";
 
-    std::shared_ptr<ast::StringLiteral> literal =
-        std::dynamic_pointer_cast<ast::StringLiteral>(stmt->expression_);
+    ref::Ref<ast::StringLiteral> literal =
+        ref::DynamicCast<ast::StringLiteral>(stmt->expression_);
     if (!literal)
         FAIL() << "program->statements_[0] is not a StringLiteral. Got "
                << typeid(&stmt->expression_).name();
@@ -329,11 +326,11 @@ TEST_F(ParserTest, TestString)
     std::string input = R"(let myVar = anotherVar;)";
 
     token::Token toke{token::LET, "let"};
-    auto stmt = std::make_shared<ast::LetStatement>(toke);
+    auto stmt = ref::Make<ast::LetStatement>(toke);
     token::Token name{token::IDENT, "myVar"};
-    stmt->name_ = std::make_shared<ast::Identifier>(name, "myVar");
+    stmt->name_ = ref::Make<ast::Identifier>(name, "myVar");
     token::Token val{token::IDENT, "anotherVar"};
-    stmt->value_ = std::make_shared<ast::Identifier>(val, "anotherVar");
+    stmt->value_ = ref::Make<ast::Identifier>(val, "anotherVar");
 
     std::unique_ptr<ast::Program> program = std::make_unique<ast::Program>();
     program->statements_.push_back(stmt);
@@ -347,18 +344,17 @@ TEST_F(ParserTest, TestIdentifierExpression)
     std::shared_ptr<lexer::Lexer> lex = std::make_shared<lexer::Lexer>(input);
     std::unique_ptr<parser::Parser> parsley =
         std::make_unique<parser::Parser>(lex);
-    std::shared_ptr<ast::Program> program = parsley->ParseProgram();
+    ref::Ref<ast::Program> program = parsley->ParseProgram();
     EXPECT_FALSE(parsley->CheckErrors());
     ASSERT_EQ(1, program->statements_.size());
 
-    std::shared_ptr<ast::ExpressionStatement> stmt =
-        std::dynamic_pointer_cast<ast::ExpressionStatement>(
-            program->statements_[0]);
+    ref::Ref<ast::ExpressionStatement> stmt =
+        ref::DynamicCast<ast::ExpressionStatement>(program->statements_[0]);
     if (!stmt)
         FAIL() << "program->statements_[0] is not an ExpressionStatement";
 
-    std::shared_ptr<ast::Identifier> ident =
-        std::dynamic_pointer_cast<ast::Identifier>(stmt->expression_);
+    ref::Ref<ast::Identifier> ident =
+        ref::DynamicCast<ast::Identifier>(stmt->expression_);
     if (!ident)
         FAIL() << "Not an Identifier - got "
                << typeid(&stmt->expression_).name();
@@ -373,18 +369,17 @@ TEST_F(ParserTest, TestIfExpression)
     std::unique_ptr<lexer::Lexer> lex = std::make_unique<lexer::Lexer>(input);
     std::unique_ptr<parser::Parser> parsley =
         std::make_unique<parser::Parser>(std::move(lex));
-    std::shared_ptr<ast::Program> program = parsley->ParseProgram();
+    ref::Ref<ast::Program> program = parsley->ParseProgram();
     EXPECT_FALSE(parsley->CheckErrors());
     ASSERT_EQ(1, program->statements_.size());
 
-    std::shared_ptr<ast::ExpressionStatement> stmt =
-        std::dynamic_pointer_cast<ast::ExpressionStatement>(
-            program->statements_[0]);
+    ref::Ref<ast::ExpressionStatement> stmt =
+        ref::DynamicCast<ast::ExpressionStatement>(program->statements_[0]);
     if (!stmt)
         FAIL() << "program->statements_[0] is not an ExpressionStatement";
 
-    std::shared_ptr<ast::IfExpression> expr =
-        std::dynamic_pointer_cast<ast::IfExpression>(stmt->expression_);
+    ref::Ref<ast::IfExpression> expr =
+        ref::DynamicCast<ast::IfExpression>(stmt->expression_);
     if (!expr)
         FAIL() << "Not an IfExpression - got "
                << typeid(&stmt->expression_).name();
@@ -395,8 +390,8 @@ TEST_F(ParserTest, TestIfExpression)
     ASSERT_TRUE(TestInfixExpression(expr->condition_, left, "<", right));
 
     ASSERT_EQ(1, expr->consequence_->statements_.size());
-    std::shared_ptr<ast::ExpressionStatement> consequence =
-        std::dynamic_pointer_cast<ast::ExpressionStatement>(
+    ref::Ref<ast::ExpressionStatement> consequence =
+        ref::DynamicCast<ast::ExpressionStatement>(
             expr->consequence_->statements_[0]);
     if (!consequence)
         FAIL() << "Not an Expression Statement! - got "
@@ -407,6 +402,8 @@ TEST_F(ParserTest, TestIfExpression)
 
     if (expr->alternative_ != nullptr)
         FAIL() << "Expression Alternative wasn't null!\n";
+
+    EXPECT_EQ(expr->String(), "if (x<y) x");
 }
 
 TEST_F(ParserTest, TestIfElseExpression)
@@ -416,18 +413,17 @@ TEST_F(ParserTest, TestIfElseExpression)
     std::unique_ptr<lexer::Lexer> lex = std::make_unique<lexer::Lexer>(input);
     std::unique_ptr<parser::Parser> parsley =
         std::make_unique<parser::Parser>(std::move(lex));
-    std::shared_ptr<ast::Program> program = parsley->ParseProgram();
+    ref::Ref<ast::Program> program = parsley->ParseProgram();
     EXPECT_FALSE(parsley->CheckErrors());
     ASSERT_EQ(1, program->statements_.size());
 
-    std::shared_ptr<ast::ExpressionStatement> stmt =
-        std::dynamic_pointer_cast<ast::ExpressionStatement>(
-            program->statements_[0]);
+    ref::Ref<ast::ExpressionStatement> stmt =
+        ref::DynamicCast<ast::ExpressionStatement>(program->statements_[0]);
     if (!stmt)
         FAIL() << "program->statements_[0] is not an ExpressionStatement";
 
-    std::shared_ptr<ast::IfExpression> expr =
-        std::dynamic_pointer_cast<ast::IfExpression>(stmt->expression_);
+    ref::Ref<ast::IfExpression> expr =
+        ref::DynamicCast<ast::IfExpression>(stmt->expression_);
     if (!expr)
         FAIL() << "Not an IfExpression - got "
                << typeid(&stmt->expression_).name();
@@ -439,8 +435,8 @@ TEST_F(ParserTest, TestIfElseExpression)
 
     ASSERT_EQ(1, expr->consequence_->statements_.size());
 
-    std::shared_ptr<ast::ExpressionStatement> consequence =
-        std::dynamic_pointer_cast<ast::ExpressionStatement>(
+    ref::Ref<ast::ExpressionStatement> consequence =
+        ref::DynamicCast<ast::ExpressionStatement>(
             expr->consequence_->statements_[0]);
     if (!consequence)
         FAIL() << "Not an Expression Statement! - got "
@@ -450,8 +446,8 @@ TEST_F(ParserTest, TestIfElseExpression)
         FAIL() << "Not an IdentifierExpression!\n";
 
     ASSERT_EQ(1, expr->alternative_->statements_.size());
-    std::shared_ptr<ast::ExpressionStatement> alternative =
-        std::dynamic_pointer_cast<ast::ExpressionStatement>(
+    ref::Ref<ast::ExpressionStatement> alternative =
+        ref::DynamicCast<ast::ExpressionStatement>(
             expr->alternative_->statements_[0]);
     if (!alternative)
         FAIL() << "Not an Expression Statement! - got "
@@ -466,18 +462,17 @@ TEST_F(ParserTest, TestIntegerLiteralExpression)
     std::unique_ptr<lexer::Lexer> lex = std::make_unique<lexer::Lexer>(input);
     std::unique_ptr<parser::Parser> parsley =
         std::make_unique<parser::Parser>(std::move(lex));
-    std::shared_ptr<ast::Program> program = parsley->ParseProgram();
+    ref::Ref<ast::Program> program = parsley->ParseProgram();
     EXPECT_FALSE(parsley->CheckErrors());
     ASSERT_EQ(1, program->statements_.size());
 
-    std::shared_ptr<ast::ExpressionStatement> stmt =
-        std::dynamic_pointer_cast<ast::ExpressionStatement>(
-            program->statements_[0]);
+    ref::Ref<ast::ExpressionStatement> stmt =
+        ref::DynamicCast<ast::ExpressionStatement>(program->statements_[0]);
     if (!stmt)
         FAIL() << "program_->statements_[0] is not an ExpressionStatement";
 
-    std::shared_ptr<ast::IntegerLiteral> literal =
-        std::dynamic_pointer_cast<ast::IntegerLiteral>(stmt->expression_);
+    ref::Ref<ast::IntegerLiteral> literal =
+        ref::DynamicCast<ast::IntegerLiteral>(stmt->expression_);
     if (!literal)
         FAIL() << "Not an IntegerLiteral - got "
                << typeid(&stmt->expression_).name();
@@ -505,18 +500,17 @@ TEST_F(ParserTest, TestPrefixExpressions)
             std::make_unique<lexer::Lexer>(tt.input);
         std::unique_ptr<parser::Parser> parsley =
             std::make_unique<parser::Parser>(std::move(lex));
-        std::shared_ptr<ast::Program> program = parsley->ParseProgram();
+        ref::Ref<ast::Program> program = parsley->ParseProgram();
         EXPECT_FALSE(parsley->CheckErrors());
         ASSERT_EQ(1, program->statements_.size());
 
-        std::shared_ptr<ast::ExpressionStatement> stmt =
-            std::dynamic_pointer_cast<ast::ExpressionStatement>(
-                program->statements_[0]);
+        ref::Ref<ast::ExpressionStatement> stmt =
+            ref::DynamicCast<ast::ExpressionStatement>(program->statements_[0]);
         if (!stmt)
             FAIL() << "program_->statements_[0] is not an ExpressionStatement";
 
-        std::shared_ptr<ast::PrefixExpression> expr =
-            std::dynamic_pointer_cast<ast::PrefixExpression>(stmt->expression_);
+        ref::Ref<ast::PrefixExpression> expr =
+            ref::DynamicCast<ast::PrefixExpression>(stmt->expression_);
         if (!expr)
             FAIL() << "Not a Prefix Expression - got "
                    << typeid(&stmt->expression_).name();
@@ -561,12 +555,11 @@ TEST_F(ParserTest, TestInfixExpressions)
             std::make_unique<lexer::Lexer>(tt.input);
         std::unique_ptr<parser::Parser> parsley =
             std::make_unique<parser::Parser>(std::move(lex));
-        std::shared_ptr<ast::Program> program = parsley->ParseProgram();
+        ref::Ref<ast::Program> program = parsley->ParseProgram();
         EXPECT_FALSE(parsley->CheckErrors());
 
-        std::shared_ptr<ast::ExpressionStatement> stmt =
-            std::dynamic_pointer_cast<ast::ExpressionStatement>(
-                program->statements_[0]);
+        ref::Ref<ast::ExpressionStatement> stmt =
+            ref::DynamicCast<ast::ExpressionStatement>(program->statements_[0]);
         if (!stmt)
             FAIL() << "program_->statements_[0] is not an ExpressionStatement";
 
@@ -617,7 +610,7 @@ TEST_F(ParserTest, TestOperatorPrecedence)
             std::make_unique<lexer::Lexer>(tt.input);
         std::unique_ptr<parser::Parser> parsley =
             std::make_unique<parser::Parser>(std::move(lex));
-        std::shared_ptr<ast::Program> program = parsley->ParseProgram();
+        ref::Ref<ast::Program> program = parsley->ParseProgram();
         EXPECT_FALSE(parsley->CheckErrors());
 
         auto actual = program->String();
@@ -633,18 +626,17 @@ TEST_F(ParserTest, TestFunctionLiteral)
     std::unique_ptr<lexer::Lexer> lex = std::make_unique<lexer::Lexer>(input);
     std::unique_ptr<parser::Parser> parsley =
         std::make_unique<parser::Parser>(std::move(lex));
-    std::shared_ptr<ast::Program> program = parsley->ParseProgram();
+    ref::Ref<ast::Program> program = parsley->ParseProgram();
     EXPECT_FALSE(parsley->CheckErrors());
     ASSERT_EQ(1, program->statements_.size());
 
-    std::shared_ptr<ast::ExpressionStatement> stmt =
-        std::dynamic_pointer_cast<ast::ExpressionStatement>(
-            program->statements_[0]);
+    ref::Ref<ast::ExpressionStatement> stmt =
+        ref::DynamicCast<ast::ExpressionStatement>(program->statements_[0]);
     if (!stmt)
         FAIL() << "program->statements_[0] is not an ExpressionStatement";
 
-    std::shared_ptr<ast::FunctionLiteral> fnlit =
-        std::dynamic_pointer_cast<ast::FunctionLiteral>(stmt->expression_);
+    ref::Ref<ast::FunctionLiteral> fnlit =
+        ref::DynamicCast<ast::FunctionLiteral>(stmt->expression_);
     if (!fnlit)
         FAIL() << "Not an FunctionLiteral - got "
                << typeid(&stmt->expression_).name();
@@ -657,8 +649,8 @@ TEST_F(ParserTest, TestFunctionLiteral)
 
     ASSERT_EQ(1, fnlit->body_->statements_.size());
 
-    std::shared_ptr<ast::ExpressionStatement> body_stmt =
-        std::dynamic_pointer_cast<ast::ExpressionStatement>(
+    ref::Ref<ast::ExpressionStatement> body_stmt =
+        ref::DynamicCast<ast::ExpressionStatement>(
             fnlit->body_->statements_[0]);
 
     if (!body_stmt)
@@ -685,19 +677,18 @@ TEST_F(ParserTest, TestFunctionParameterParsing)
             std::make_unique<lexer::Lexer>(tt.input);
         std::unique_ptr<parser::Parser> parsley =
             std::make_unique<parser::Parser>(std::move(lex));
-        std::shared_ptr<ast::Program> program = parsley->ParseProgram();
+        ref::Ref<ast::Program> program = parsley->ParseProgram();
         EXPECT_FALSE(parsley->CheckErrors());
         ASSERT_EQ(1, program->statements_.size());
 
-        std::shared_ptr<ast::ExpressionStatement> stmt =
-            std::dynamic_pointer_cast<ast::ExpressionStatement>(
-                program->statements_[0]);
+        ref::Ref<ast::ExpressionStatement> stmt =
+            ref::DynamicCast<ast::ExpressionStatement>(program->statements_[0]);
 
         if (!stmt)
             FAIL() << "Not an ExpressionStatement - got "
                    << typeid(program->statements_[0]).name();
-        std::shared_ptr<ast::FunctionLiteral> fnlit =
-            std::dynamic_pointer_cast<ast::FunctionLiteral>(stmt->expression_);
+        ref::Ref<ast::FunctionLiteral> fnlit =
+            ref::DynamicCast<ast::FunctionLiteral>(stmt->expression_);
 
         if (!fnlit)
             FAIL() << "Not an FunctionLiteral - got "
@@ -721,7 +712,7 @@ TEST_F(ParserTest, TestParsingArray)
     std::unique_ptr<lexer::Lexer> lex = std::make_unique<lexer::Lexer>(input);
     std::unique_ptr<parser::Parser> parsley =
         std::make_unique<parser::Parser>(std::move(lex));
-    std::shared_ptr<ast::Program> program = parsley->ParseProgram();
+    ref::Ref<ast::Program> program = parsley->ParseProgram();
     EXPECT_FALSE(parsley->CheckErrors());
     EXPECT_EQ(1, program->statements_.size());
     if (program->statements_.size() != 1)
@@ -729,14 +720,13 @@ TEST_F(ParserTest, TestParsingArray)
         for (auto s : program->statements_)
             std::cout << s->String() << std::endl;
     }
-    std::shared_ptr<ast::ExpressionStatement> stmt =
-        std::dynamic_pointer_cast<ast::ExpressionStatement>(
-            program->statements_[0]);
+    ref::Ref<ast::ExpressionStatement> stmt =
+        ref::DynamicCast<ast::ExpressionStatement>(program->statements_[0]);
     if (!stmt)
         FAIL() << "program->statements_[0] is not an ExpressionStatement";
 
-    std::shared_ptr<ast::ArrayLiteral> array_lit =
-        std::dynamic_pointer_cast<ast::ArrayLiteral>(stmt->expression_);
+    ref::Ref<ast::ArrayLiteral> array_lit =
+        ref::DynamicCast<ast::ArrayLiteral>(stmt->expression_);
     if (!array_lit)
         FAIL() << "Not an ArrayLiteral - got "
                << typeid(&stmt->expression_).name();
@@ -756,7 +746,7 @@ TEST_F(ParserTest, TestParsingHashLiteral)
     std::unique_ptr<lexer::Lexer> lex = std::make_unique<lexer::Lexer>(input);
     std::unique_ptr<parser::Parser> parsley =
         std::make_unique<parser::Parser>(std::move(lex));
-    std::shared_ptr<ast::Program> program = parsley->ParseProgram();
+    ref::Ref<ast::Program> program = parsley->ParseProgram();
     EXPECT_FALSE(parsley->CheckErrors());
     EXPECT_EQ(1, program->statements_.size());
     if (program->statements_.size() != 1)
@@ -764,14 +754,13 @@ TEST_F(ParserTest, TestParsingHashLiteral)
         for (auto s : program->statements_)
             std::cout << s->String() << std::endl;
     }
-    std::shared_ptr<ast::ExpressionStatement> stmt =
-        std::dynamic_pointer_cast<ast::ExpressionStatement>(
-            program->statements_[0]);
+    ref::Ref<ast::ExpressionStatement> stmt =
+        ref::DynamicCast<ast::ExpressionStatement>(program->statements_[0]);
     if (!stmt)
         FAIL() << "program->statements_[0] is not an ExpressionStatement";
 
-    std::shared_ptr<ast::HashLiteral> hash_lit =
-        std::dynamic_pointer_cast<ast::HashLiteral>(stmt->expression_);
+    ref::Ref<ast::HashLiteral> hash_lit =
+        ref::DynamicCast<ast::HashLiteral>(stmt->expression_);
     if (!hash_lit)
         FAIL() << "Not a HashLiteral - got "
                << typeid(&stmt->expression_).name();
@@ -784,8 +773,8 @@ TEST_F(ParserTest, TestParsingHashLiteral)
 
     for (auto &it : hash_lit->pairs_)
     {
-        std::shared_ptr<ast::StringLiteral> string_lit =
-            std::dynamic_pointer_cast<ast::StringLiteral>(it.first);
+        ref::Ref<ast::StringLiteral> string_lit =
+            ref::DynamicCast<ast::StringLiteral>(it.first);
         if (!string_lit)
             FAIL() << "Not a StringLiteral - got " << typeid(it.first).name();
 
@@ -801,7 +790,7 @@ TEST_F(ParserTest, TestParsingEmptyHash)
     std::unique_ptr<lexer::Lexer> lex = std::make_unique<lexer::Lexer>(input);
     std::unique_ptr<parser::Parser> parsley =
         std::make_unique<parser::Parser>(std::move(lex));
-    std::shared_ptr<ast::Program> program = parsley->ParseProgram();
+    ref::Ref<ast::Program> program = parsley->ParseProgram();
     EXPECT_FALSE(parsley->CheckErrors());
     EXPECT_EQ(1, program->statements_.size());
     if (program->statements_.size() != 1)
@@ -809,14 +798,13 @@ TEST_F(ParserTest, TestParsingEmptyHash)
         for (auto s : program->statements_)
             std::cout << s->String() << std::endl;
     }
-    std::shared_ptr<ast::ExpressionStatement> stmt =
-        std::dynamic_pointer_cast<ast::ExpressionStatement>(
-            program->statements_[0]);
+    ref::Ref<ast::ExpressionStatement> stmt =
+        ref::DynamicCast<ast::ExpressionStatement>(program->statements_[0]);
     if (!stmt)
         FAIL() << "program->statements_[0] is not an ExpressionStatement";
 
-    std::shared_ptr<ast::HashLiteral> hash_lit =
-        std::dynamic_pointer_cast<ast::HashLiteral>(stmt->expression_);
+    ref::Ref<ast::HashLiteral> hash_lit =
+        ref::DynamicCast<ast::HashLiteral>(stmt->expression_);
     if (!hash_lit)
         FAIL() << "Not a HashLiteral - got "
                << typeid(&stmt->expression_).name();
@@ -832,7 +820,7 @@ TEST_F(ParserTest, TestParsingHashLiteralsWithExpressions)
     std::unique_ptr<lexer::Lexer> lex = std::make_unique<lexer::Lexer>(input);
     std::unique_ptr<parser::Parser> parsley =
         std::make_unique<parser::Parser>(std::move(lex));
-    std::shared_ptr<ast::Program> program = parsley->ParseProgram();
+    ref::Ref<ast::Program> program = parsley->ParseProgram();
     EXPECT_FALSE(parsley->CheckErrors());
     EXPECT_EQ(1, program->statements_.size());
     if (program->statements_.size() != 1)
@@ -840,14 +828,13 @@ TEST_F(ParserTest, TestParsingHashLiteralsWithExpressions)
         for (auto s : program->statements_)
             std::cout << s->String() << std::endl;
     }
-    std::shared_ptr<ast::ExpressionStatement> stmt =
-        std::dynamic_pointer_cast<ast::ExpressionStatement>(
-            program->statements_[0]);
+    ref::Ref<ast::ExpressionStatement> stmt =
+        ref::DynamicCast<ast::ExpressionStatement>(program->statements_[0]);
     if (!stmt)
         FAIL() << "program->statements_[0] is not an ExpressionStatement";
 
-    std::shared_ptr<ast::HashLiteral> hash_lit =
-        std::dynamic_pointer_cast<ast::HashLiteral>(stmt->expression_);
+    ref::Ref<ast::HashLiteral> hash_lit =
+        ref::DynamicCast<ast::HashLiteral>(stmt->expression_);
     if (!hash_lit)
         FAIL() << "Not a HashLiteral - got "
                << typeid(&stmt->expression_).name();
@@ -857,27 +844,27 @@ TEST_F(ParserTest, TestParsingHashLiteralsWithExpressions)
                << hash_lit->pairs_.size();
 
     std::unordered_map<std::string,
-                       std::function<void(std::shared_ptr<ast::Expression>)>>
+                       std::function<void(ref::Ref<ast::Expression>)>>
         tests{
             {"one",
-             [](std::shared_ptr<ast::Expression> e) {
+             [](ref::Ref<ast::Expression> e) {
                  TestInfixExpression(e, (int64_t)0, "+", (int64_t)1);
              }},
 
             {"two",
-             [](std::shared_ptr<ast::Expression> e) {
+             [](ref::Ref<ast::Expression> e) {
                  TestInfixExpression(e, (int64_t)10, "-", (int64_t)8);
              }},
 
             {"three",
-             [](std::shared_ptr<ast::Expression> e) {
+             [](ref::Ref<ast::Expression> e) {
                  TestInfixExpression(e, (int64_t)15, "/", (int64_t)5);
              }},
         };
 
     for (auto &it : hash_lit->pairs_)
     {
-        auto lit = std::dynamic_pointer_cast<ast::StringLiteral>(it.first);
+        auto lit = ref::DynamicCast<ast::StringLiteral>(it.first);
         if (!lit)
             FAIL() << "Key not  a StringLiteral - got "
                    << typeid(it.first).name();
@@ -894,7 +881,7 @@ TEST_F(ParserTest, TestParsingIndexExpressions)
     std::unique_ptr<lexer::Lexer> lex = std::make_unique<lexer::Lexer>(input);
     std::unique_ptr<parser::Parser> parsley =
         std::make_unique<parser::Parser>(std::move(lex));
-    std::shared_ptr<ast::Program> program = parsley->ParseProgram();
+    ref::Ref<ast::Program> program = parsley->ParseProgram();
     EXPECT_FALSE(parsley->CheckErrors());
     EXPECT_EQ(1, program->statements_.size());
     if (program->statements_.size() != 1)
@@ -902,14 +889,13 @@ TEST_F(ParserTest, TestParsingIndexExpressions)
         for (auto s : program->statements_)
             std::cout << s->String() << std::endl;
     }
-    std::shared_ptr<ast::ExpressionStatement> stmt =
-        std::dynamic_pointer_cast<ast::ExpressionStatement>(
-            program->statements_[0]);
+    ref::Ref<ast::ExpressionStatement> stmt =
+        ref::DynamicCast<ast::ExpressionStatement>(program->statements_[0]);
     if (!stmt)
         FAIL() << "program->statements_[0] is not an ExpressionStatement";
 
-    std::shared_ptr<ast::IndexExpression> index_x =
-        std::dynamic_pointer_cast<ast::IndexExpression>(stmt->expression_);
+    ref::Ref<ast::IndexExpression> index_x =
+        ref::DynamicCast<ast::IndexExpression>(stmt->expression_);
     if (!index_x)
         FAIL() << "Not an IndexExpression - got "
                << typeid(&stmt->expression_).name();
@@ -926,7 +912,7 @@ TEST_F(ParserTest, TestCallExpression)
     std::unique_ptr<lexer::Lexer> lex = std::make_unique<lexer::Lexer>(input);
     std::unique_ptr<parser::Parser> parsley =
         std::make_unique<parser::Parser>(std::move(lex));
-    std::shared_ptr<ast::Program> program = parsley->ParseProgram();
+    ref::Ref<ast::Program> program = parsley->ParseProgram();
     EXPECT_FALSE(parsley->CheckErrors());
     EXPECT_EQ(1, program->statements_.size());
     if (program->statements_.size() != 1)
@@ -935,14 +921,13 @@ TEST_F(ParserTest, TestCallExpression)
             std::cout << s->String() << std::endl;
     }
 
-    std::shared_ptr<ast::ExpressionStatement> stmt =
-        std::dynamic_pointer_cast<ast::ExpressionStatement>(
-            program->statements_[0]);
+    ref::Ref<ast::ExpressionStatement> stmt =
+        ref::DynamicCast<ast::ExpressionStatement>(program->statements_[0]);
     if (!stmt)
         FAIL() << "program->statements_[0] is not an ExpressionStatement";
 
-    std::shared_ptr<ast::CallExpression> expr =
-        std::dynamic_pointer_cast<ast::CallExpression>(stmt->expression_);
+    ref::Ref<ast::CallExpression> expr =
+        ref::DynamicCast<ast::CallExpression>(stmt->expression_);
     if (!expr)
         FAIL() << "Not an FunctionLiteral - got "
                << typeid(&stmt->expression_).name();
@@ -957,6 +942,341 @@ TEST_F(ParserTest, TestCallExpression)
         TestInfixExpression(expr->arguments_[2], (int64_t)4, "+", (int64_t)5));
 }
 
+TEST_F(ParserTest, TestNodesCarryTheirKind)
+{
+    using ast::NodeKind;
+    auto lex = std::make_shared<lexer::Lexer>(
+        "let f = fn(a) { return [a, \"s\", true, -a, {1: a}[1]]; }; f(2);");
+    parser::Parser parsley{lex};
+    auto program = parsley.ParseProgram();
+    EXPECT_FALSE(parsley.CheckErrors());
+    ASSERT_EQ(program->statements_.size(), 2u);
+    EXPECT_EQ(program->kind_, NodeKind::PROGRAM);
+
+    auto let = ref::StaticCast<ast::LetStatement>(program->statements_[0]);
+    ASSERT_EQ(let->kind_, NodeKind::LET);
+    EXPECT_EQ(let->name_->kind_, NodeKind::IDENTIFIER);
+    auto fn = ref::StaticCast<ast::FunctionLiteral>(let->value_);
+    ASSERT_EQ(fn->kind_, NodeKind::FUNCTION);
+    ASSERT_EQ(fn->body_->kind_, NodeKind::BLOCK);
+    auto ret = ref::StaticCast<ast::ReturnStatement>(fn->body_->statements_[0]);
+    ASSERT_EQ(ret->kind_, NodeKind::RETURN);
+    auto array = ref::StaticCast<ast::ArrayLiteral>(ret->return_value_);
+    ASSERT_EQ(array->kind_, NodeKind::ARRAY);
+    EXPECT_EQ(array->elements_[1]->kind_, NodeKind::STRING);
+    EXPECT_EQ(array->elements_[2]->kind_, NodeKind::BOOLEAN);
+    EXPECT_EQ(array->elements_[3]->kind_, NodeKind::PREFIX);
+    auto index = ref::StaticCast<ast::IndexExpression>(array->elements_[4]);
+    ASSERT_EQ(index->kind_, NodeKind::INDEX);
+    EXPECT_EQ(index->left_->kind_, NodeKind::HASH);
+    EXPECT_EQ(index->index_->kind_, NodeKind::INTEGER);
+
+    auto call = ref::StaticCast<ast::ExpressionStatement>(
+        program->statements_[1]);
+    ASSERT_EQ(call->kind_, NodeKind::EXPRESSION_STATEMENT);
+    EXPECT_EQ(call->expression_->kind_, NodeKind::CALL);
+}
+
+TEST_F(ParserTest, TestReplSessionResumes)
+{
+    auto lex = std::make_shared<lexer::Lexer>();
+    parser::Parser parsley{lex};
+
+    std::vector<std::pair<std::vector<std::string>, std::string>> inputs{
+        {{"let add = fn(x, y) {", "  x + y;", "};"},
+         "let add = fn(x, y)(x+y);"},
+        {{"add(1, 2) * 3"}, "(add(1, 2)*3)"},
+        {{"let s = \"{\";"}, "let s = {;"},
+    };
+    for (auto &in : inputs)
+    {
+        bool complete = false;
+        for (auto &line : in.first)
+            complete = lex->ReadInput(line);
+        ASSERT_TRUE(complete);
+
+        ref::Ref<ast::Program> program = parsley.ParseProgram();
+        EXPECT_FALSE(parsley.CheckErrors());
+        ASSERT_EQ(1, program->statements_.size());
+        EXPECT_EQ(program->String(), in.second);
+    }
+}
+
+TEST_F(ParserTest, TestDeeplyNestedExpressions)
+{
+    // parentheses don't make the tree any deeper; operators do, up to the
+    // limit
+    const int depth = 100000;
+    const int operators = 1990;
+    std::string parens = std::string(depth, '(') + "x" +
+                         std::string(depth, ')') + " + " +
+                         std::string(operators / 2, '-') + "y * " +
+                         std::string(operators / 2, '!') + "true;";
+    std::string chain = "a";
+    for (int i = 0; i < operators / 3; i++)
+        chain += i % 2 ? " + a" : " * b[0](c)";
+    chain += ";";
+
+    for (auto const &input : {parens, chain})
+    {
+        auto lex = std::make_shared<lexer::Lexer>(input);
+        parser::Parser parsley{lex};
+        ref::Ref<ast::Program> program = parsley.ParseProgram();
+        EXPECT_FALSE(parsley.CheckErrors());
+        ASSERT_EQ(program->statements_.size(), 1);
+    }
+
+    // the same shapes, shallow enough to print, come out as before
+    std::vector<std::pair<std::string, std::string>> shallow{
+        {"((((x)))) + ---y * !!true;", "(x+((--(-y))*(!(!true))))"},
+        {"a * b[0](c) + a * b[0](c);",
+         "((a*(b[0])(c))+(a*(b[0])(c)))"},
+        {"-(a + b) * c;", "((-(a+b))*c)"},
+    };
+    for (auto const &tt : shallow)
+    {
+        auto lex = std::make_shared<lexer::Lexer>(tt.first);
+        parser::Parser parsley{lex};
+        ref::Ref<ast::Program> program = parsley.ParseProgram();
+        EXPECT_FALSE(parsley.CheckErrors());
+        EXPECT_EQ(program->String(), tt.second);
+    }
+}
+
+TEST_F(ParserTest, TestNestingLimitIsAnErrorNotACrash)
+{
+    const int depth = 100000;
+    std::string input = "";
+    for (int i = 0; i < depth; i++)
+        input += "f([";
+    input += "1";
+    for (int i = 0; i < depth; i++)
+        input += "])";
+
+    auto lex = std::make_shared<lexer::Lexer>(input);
+    parser::Parser parsley{lex};
+    parsley.ParseProgram();
+    EXPECT_TRUE(parsley.CheckErrors());
+}
+
+TEST_F(ParserTest, TestDeepOperatorChainsAreAnErrorNotACrash)
+{
+    const int depth = 100000;
+    std::string sum = "1";
+    for (int i = 0; i < depth; i++)
+        sum += " + 1";
+    std::vector<std::string> inputs{
+        sum + ";",
+        std::string(depth, '-') + "1;",
+        "let x = f(" + std::string(depth, '(') + sum +
+            std::string(depth, ')') + ");",
+    };
+
+    for (auto const &input : inputs)
+    {
+        auto lex = std::make_shared<lexer::Lexer>(input);
+        parser::Parser parsley{lex};
+        parsley.ParseProgram();
+        EXPECT_TRUE(parsley.CheckErrors());
+    }
+}
+
+TEST_F(ParserTest, TestParallelParseKeepsSourceOrder)
+{
+    std::string script;
+    for (int i = 0; i < 20000; i++)
+    {
+        script += "let f = fn(x) { let s = \"};\"; x + " + std::to_string(i) +
+                  "; };\n";
+        script += "if (f(1) > 2) { [1, 2][0] } else { {\"k\": 3}[\"k\"] };\n";
+    }
+    auto source = source::FromString(script);
+
+    // pieces only ever start right after a top-level ';' - here, the ones
+    // that end a line
+    std::vector<size_t> points = parser::SplitPoints(source->Text(), 4096);
+    ASSERT_GT(points.size(), 10);
+    EXPECT_EQ(points.front(), 0);
+    EXPECT_EQ(points.back(), script.size());
+    for (size_t i = 1; i + 1 < points.size(); i++)
+    {
+        EXPECT_EQ(script[points[i] - 1], ';');
+        EXPECT_EQ(script[points[i]], '\n');
+    }
+
+    auto lex = std::make_shared<lexer::Lexer>(source);
+    parser::Parser parsley{lex};
+    ref::Ref<ast::Program> sequential = parsley.ParseProgram();
+    ASSERT_FALSE(parsley.CheckErrors());
+
+    ref::Ref<ast::Program> parallel = parser::ParseProgramParallel(source, 4);
+    ASSERT_TRUE(parallel);
+    EXPECT_EQ(parallel->statements_.size(), sequential->statements_.size());
+    EXPECT_EQ(parallel->String(), sequential->String());
+}
+
+TEST_F(ParserTest, TestLazyFunctionBodies)
+{
+    std::string input = R"(let f = fn(a, b) { let s = "{ }}"; fn(c) { a + c }(b) };
+f(1, 2);)";
+    auto lex = std::make_shared<lexer::Lexer>(input);
+    parser::Parser lazy{lex};
+    lazy.SetLazyBodies(true);
+    auto program = lazy.ParseProgram();
+    ASSERT_FALSE(lazy.CheckErrors());
+    ASSERT_EQ(program->statements_.size(), 2u);
+
+    auto let = ref::DynamicCast<ast::LetStatement>(program->statements_[0]);
+    ASSERT_TRUE(let);
+    auto fn = ref::DynamicCast<ast::FunctionLiteral>(let->value_);
+    ASSERT_TRUE(fn);
+    EXPECT_EQ(fn->parameters_.size(), 2u);
+    EXPECT_FALSE(fn->body_);
+    EXPECT_EQ(fn->pending_body_,
+              R"({ let s = "{ }}"; fn(c) { a + c }(b) })");
+
+    auto body = parser::ParseBody(*fn);
+    ASSERT_TRUE(body);
+    EXPECT_EQ(fn->body_, body);
+    EXPECT_EQ(parser::ParseBody(*fn), body);
+    // the inner function's body is left for its own first call
+    EXPECT_EQ(program->String(),
+              "let f = fn(a, b)let s = { }};fn(c){ a + c }(b);f(1, 2)");
+}
+
+TEST_F(ParserTest, TestReparseMatchesAFullParse)
+{
+    std::string script = R"(let a = 1;
+let f = fn(x) { let s = "};"; x * a };
+"text"; "";
+if (a > 0) { f(a) } else { [a, {"k": a}] }
+a - 1;
+-a;
+for (i = 0; i < 3; ++i) { puts(i); };
+f(2)
+)";
+    auto parse = [](const std::string &text) {
+        auto lex = std::make_shared<lexer::Lexer>(source::FromString(text));
+        parser::Parser parsley{lex};
+        auto program = parsley.ParseProgram();
+        return parsley.CheckErrors() ? nullptr : program;
+    };
+    auto program = parse(script);
+    ASSERT_TRUE(program);
+
+    // each edit is made at the first `at` in the text as it is by then
+    struct TestCase
+    {
+        std::string at;
+        size_t skip;
+        size_t removed;
+        std::string inserted;
+    };
+    std::vector<TestCase> tests{
+        {"1;", 0, 1, "2"},               // a literal
+        {"let a", 0, 0, "let z = 3;\n"}, // a new first statement
+        {"f(2)\n", 5, 0, "f(9);"},       // and a last one
+        {"text", 0, 4, "a;} b"},         // separators inside a string
+        {"a - 1", 1, 0, "a"},            // joins onto the identifier
+        {"\n-a;", 0, 1, ""},             // the newline before `-a`
+        {"f(2)", 0, 4, "f(3) + f(4)"},
+        {"\"\";", 0, 0, "x"},             // before an empty string
+        {"{ puts", 0, 0, "{ "},          // unclosed, which isn't an error
+    };
+    for (auto const &tt : tests)
+    {
+        SCOPED_TRACE(tt.at);
+        std::string text = std::string{program->source_->Text()};
+        size_t offset = text.find(tt.at);
+        ASSERT_NE(offset, std::string::npos);
+        parser::Edit edit{offset + tt.skip, tt.removed, tt.inserted};
+        text.replace(edit.offset, edit.removed, edit.inserted);
+
+        auto full = parse(text);
+        auto reparsed = parser::Reparse(*program, edit);
+        ASSERT_EQ(bool(reparsed), bool(full));
+        if (!reparsed)
+            continue;
+        EXPECT_EQ(reparsed->source_->Text(), text);
+        EXPECT_EQ(reparsed->String(), full->String());
+        // every statement is counted against the buffer it points into
+        size_t counted = 0;
+        for (auto const &retained : reparsed->retained_)
+            counted += retained.statements;
+        EXPECT_EQ(counted, reparsed->statements_.size());
+        program = reparsed;
+    }
+}
+
+TEST_F(ParserTest, TestReparseReusesUntouchedStatements)
+{
+    std::string script;
+    for (int i = 0; i < 1000; i++)
+        script += "let x = fn(a) { a + " + std::to_string(i) + " };\n";
+    auto program = parser::ParseProgramParallel(source::FromString(script), 1);
+    ASSERT_TRUE(program);
+
+    size_t offset = script.find("+ 500 ") + 2;
+    auto edited = parser::Reparse(*program, {offset, 3, "5000"});
+    ASSERT_TRUE(edited);
+    ASSERT_EQ(edited->statements_.size(), 1000u);
+    size_t reused = 0;
+    for (size_t i = 0; i < 1000; i++)
+        reused += edited->statements_[i] == program->statements_[i];
+    // the edited statement and its neighbour
+    EXPECT_EQ(reused, 998u);
+    EXPECT_NE(edited->statements_[500]->String().find("5000"),
+              std::string::npos);
+}
+
+TEST_F(ParserTest, TestReparseDropsReplacedText)
+{
+    std::string script;
+    for (int i = 0; i < 100; i++)
+        script += "let x = " + std::to_string(i) + ";\n";
+    auto program = parser::ParseProgramParallel(source::FromString(script), 1);
+    ASSERT_TRUE(program);
+    std::weak_ptr<source::Buffer> original = program->source_;
+
+    // editing the same statement over and over keeps the original text, for
+    // the statements either side, and the latest edit's
+    size_t offset = script.find("= 50;") + 2;
+    for (int i = 0; i < 100; i++)
+    {
+        program = parser::Reparse(*program, {offset, 2, "51"});
+        ASSERT_TRUE(program);
+        EXPECT_EQ(program->retained_.size(), 2u);
+    }
+
+    // once every statement's been replaced, none of the original is needed
+    program = parser::Reparse(*program, {0, script.size(), "let y = 1;"});
+    ASSERT_TRUE(program);
+    EXPECT_EQ(program->retained_.size(), 1u);
+    EXPECT_TRUE(original.expired());
+    EXPECT_EQ(program->String(), "let y = 1;");
+}
+
+TEST_F(ParserTest, TestReparseKeepsLazyBodies)
+{
+    std::string script = "let f = fn(a) { a + 1 };\nf(1);";
+    auto program = parser::ParseProgramParallel(source::FromString(script), 1,
+                                                true);
+    ASSERT_TRUE(program);
+
+    size_t offset = script.find("+ 1") + 2;
+    for (bool lazy : {true, false})
+    {
+        auto edited = parser::Reparse(*program, {offset, 1, "2"}, lazy);
+        ASSERT_TRUE(edited);
+        auto let = ref::DynamicCast<ast::LetStatement>(edited->statements_[0]);
+        ASSERT_TRUE(let);
+        auto fn = ref::DynamicCast<ast::FunctionLiteral>(let->value_);
+        ASSERT_TRUE(fn);
+        EXPECT_EQ(bool(fn->body_), !lazy);
+        EXPECT_EQ(parser::ParseBody(*fn)->String(), "(a+2)");
+    }
+}
+
 TEST_F(ParserTest, TestCallExpressionParsing)
 {
     struct TestCase
@@ -977,19 +1297,18 @@ TEST_F(ParserTest, TestCallExpressionParsing)
             std::make_unique<lexer::Lexer>(tt.input);
         std::unique_ptr<parser::Parser> parsley =
             std::make_unique<parser::Parser>(std::move(lex));
-        std::shared_ptr<ast::Program> program = parsley->ParseProgram();
+        ref::Ref<ast::Program> program = parsley->ParseProgram();
         EXPECT_FALSE(parsley->CheckErrors());
         ASSERT_EQ(1, program->statements_.size());
 
-        std::shared_ptr<ast::ExpressionStatement> stmt =
-            std::dynamic_pointer_cast<ast::ExpressionStatement>(
-                program->statements_[0]);
+        ref::Ref<ast::ExpressionStatement> stmt =
+            ref::DynamicCast<ast::ExpressionStatement>(program->statements_[0]);
         if (!stmt)
             FAIL() << "Not an ExpressionStatement - got "
                    << typeid(program->statements_[0]).name();
 
-        std::shared_ptr<ast::CallExpression> expr =
-            std::dynamic_pointer_cast<ast::CallExpression>(stmt->expression_);
+        ref::Ref<ast::CallExpression> expr =
+            ref::DynamicCast<ast::CallExpression>(stmt->expression_);
         if (!expr)
             FAIL() << "Not an CallExpression - got "
                    << typeid(&stmt->expression_).name();
@@ -0,0 +1,120 @@
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../ast.hpp"
+#include "../evaluator.hpp"
+#include "../object.hpp"
+#include "../ref.hpp"
+#include "../resolver.hpp"
+
+#include "gtest/gtest.h"
+
+#include "parse.hpp"
+
+namespace
+{
+
+using test::Parse;
+
+struct ResolverTest : public ::testing::Test
+{
+    // Where each name under `node` was resolved to, in source order: `x@1.2`
+    // for slot 2 one environment out, `x^1` for by name one out, `x?` for
+    // unresolved. Names a `let` defines are marked `let`.
+    void Describe(ast::Node *node, std::vector<std::string> &out)
+    {
+        if (!node)
+            return;
+        if (node->kind_ == ast::NodeKind::IDENTIFIER)
+            out.push_back(Describe(*static_cast<ast::Identifier *>(node)));
+        if (node->kind_ == ast::NodeKind::LET)
+            out.push_back(
+                "let " +
+                Describe(*static_cast<ast::LetStatement *>(node)->name_));
+        ast::ForEachChild(node,
+                          [&](ast::Node *child) { Describe(child, out); });
+    }
+
+    std::string Describe(const ast::Identifier &name)
+    {
+        std::string where{name.value_};
+        if (name.depth_ == ast::Identifier::kUnresolved)
+            return where + "?";
+        if (name.slot_ == ast::Identifier::kGlobal)
+            return where + "^" + std::to_string(name.depth_);
+        return where + "@" + std::to_string(name.depth_) + "." +
+               std::to_string(name.slot_);
+    }
+
+    std::vector<std::string> Describe(const std::string &input)
+    {
+        std::vector<std::string> out;
+        Describe(Parse(input).get(), out);
+        return out;
+    }
+
+    std::string Eval(const std::string &input)
+    {
+        auto env = ref::Make<object::Environment>();
+        auto result = evaluator::Eval(Parse(input), env);
+        return result ? result.Inspect() : "nullptr";
+    }
+};
+
+TEST_F(ResolverTest, TestFunctionScopes)
+{
+    std::vector<std::string> expected{
+        "let x^0", "let f^0", "let c@0.2", "a@0.0", "x^1", "c@0.2",
+        "c@1.2",   "b@1.1",   "f^0",
+    };
+    EXPECT_EQ(Describe("let x = 1; let f = fn(a, b) { let c = a + x; "
+                       "c; fn() { c + b } }; f"),
+              expected);
+}
+
+TEST_F(ResolverTest, TestLoopScopes)
+{
+    // a loop's starting value runs outside it; blocks don't make scopes
+    std::vector<std::string> expected{
+        "n@0.0", "i@0.0", "n@1.0", "i@0.0", "let t@0.1", "i@0.0", "t@0.1",
+    };
+    EXPECT_EQ(Describe("fn(n) { for (i = n; i < n; ++i) { if (true) { "
+                       "let t = i; t } } }"),
+              expected);
+}
+
+TEST_F(ResolverTest, TestLazyBodiesStayUnresolved)
+{
+    auto program = Parse("let f = fn(a) { a }; f", true);
+    std::vector<std::string> out;
+    Describe(program.get(), out);
+    EXPECT_EQ(out, (std::vector<std::string>{"let f^0", "f^0"}));
+
+    auto literal = ref::StaticCast<ast::FunctionLiteral>(
+        ref::StaticCast<ast::LetStatement>(program->statements_[0])
+            ->value_);
+    EXPECT_EQ(literal->scope_, nullptr);
+    auto env = ref::Make<object::Environment>();
+    EXPECT_EQ(evaluator::Eval(Parse("let f = fn(a) { a * 2 }; f(4)", true),
+                              env)
+                  .Inspect(),
+              "8");
+}
+
+TEST_F(ResolverTest, TestEmptySlotsFallBackOutward)
+{
+    // a slot stays empty until its `let` runs, and reads carry on outward
+    EXPECT_EQ(Eval("let x = 1; let f = fn() { let y = x; let x = 2; [y, x] };"
+                   "f()"),
+              "[1, 2]");
+    EXPECT_EQ(Eval("let x = 1; let f = fn(c) { if (c) { let x = 2; }; x }; "
+                   "[f(false), f(true)]"),
+              "[1, 2]");
+    // the loop's environment lasts all its iterations
+    EXPECT_EQ(Eval("let x = 10; for (i = 3; i > 0; --i) { let x = x + i; x }"),
+              "16");
+    EXPECT_EQ(Eval("let f = fn(a, a) { a }; f(1, 2)"), "2");
+}
+
+} // namespace
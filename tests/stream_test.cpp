@@ -0,0 +1,106 @@
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../evaluator.hpp"
+#include "../lexer.hpp"
+#include "../object.hpp"
+#include "../parser.hpp"
+#include "../ref.hpp"
+#include "../stream.hpp"
+
+#include "gtest/gtest.h"
+
+namespace
+{
+
+struct StreamTest : public ::testing::Test
+{
+    std::vector<std::string> ReadAll(const std::string &input,
+                                      size_t chunk_size)
+    {
+        std::istringstream in{input};
+        stream::Reader reader{in, chunk_size};
+        std::vector<std::string> statements;
+        while (auto statement = reader.Next())
+            statements.emplace_back(statement->Text());
+        return statements;
+    }
+};
+
+TEST_F(StreamTest, TestSplitsTopLevelStatements)
+{
+    std::string input = R"(let add = fn(x, y) { let z = x + y; z; };
+let s = "a;b";
+let h = {"k": [1, 2]; };
+add(1, 2)
+)";
+    std::vector<size_t> ends;
+    stream::Splitter splitter;
+    for (size_t end = splitter.Next(input, 0); end != std::string::npos;
+         end = splitter.Next(input, end))
+        ends.push_back(end);
+
+    std::vector<size_t> expected{
+        input.find("};\n") + 2,
+        input.find("\";\n") + 2,
+        input.rfind("; };\n") + 4,
+    };
+    EXPECT_EQ(ends, expected);
+}
+
+TEST_F(StreamTest, TestChunkBoundaries)
+{
+    std::string input = R"(let add = fn(x, y) { let z = x + y; z; };
+let s = "a;b";
+let h = {"k": [1, 2]; };
+add(1, 2))";
+
+    // every chunk size, so that every token and string gets cut in two
+    for (size_t chunk_size = 1; chunk_size <= input.size(); chunk_size++)
+    {
+        std::vector<std::string> pieces = ReadAll(input, chunk_size);
+        std::string joined;
+        for (size_t i = 0; i < pieces.size(); i++)
+        {
+            // only the tail of the input can come out without its ';'
+            if (i + 1 < pieces.size())
+            {
+                EXPECT_EQ(pieces[i].back(), ';') << chunk_size;
+            }
+            joined += pieces[i];
+        }
+        EXPECT_EQ(joined, input) << chunk_size;
+    }
+}
+
+TEST_F(StreamTest, TestTrailingWhitespaceIsDropped)
+{
+    EXPECT_EQ(ReadAll("let a = 1;\n\n  \n", 4),
+              std::vector<std::string>{"let a = 1;"});
+    EXPECT_TRUE(ReadAll("", 4).empty());
+}
+
+TEST_F(StreamTest, TestStatementsRunAsTheyArrive)
+{
+    std::istringstream in{
+        "let f = fn(x) { x * 2 };\nlet a = f(21);\nlet b = a + 1;\nb;"};
+    stream::Reader reader{in, 7};
+    auto env = ref::Make<object::Environment>();
+
+    object::Value last;
+    while (auto statement = reader.Next())
+    {
+        auto lex = std::make_shared<lexer::Lexer>(statement);
+        parser::Parser parsley{lex};
+        auto program = parsley.ParseProgram();
+        ASSERT_FALSE(parsley.CheckErrors());
+        last = evaluator::Eval(program, env);
+    }
+
+    ASSERT_TRUE(last);
+    EXPECT_EQ(last.Inspect(), "43");
+}
+
+} // namespace
@@ -0,0 +1,156 @@
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../ast.hpp"
+#include "../code.hpp"
+#include "../compiler.hpp"
+#include "../evaluator.hpp"
+#include "../object.hpp"
+#include "../ref.hpp"
+#include "../vm.hpp"
+
+#include "gtest/gtest.h"
+
+#include "parse.hpp"
+
+namespace
+{
+
+using test::Parse;
+
+struct VmTest : public ::testing::Test
+{
+    std::string Run(const std::string &input)
+    {
+        auto result = machine_.Run(*Parse(input));
+        return result ? result.Inspect() : "nullptr";
+    }
+
+    vm::Machine machine_;
+};
+
+TEST_F(VmTest, TestDisassembly)
+{
+    compiler::Globals globals;
+    auto main = compiler::Compile(*Parse("let a = 1; a + 2"), globals);
+    EXPECT_EQ(code::Disassemble(*main), "0000 INTEGER 1\n"
+                                        "0009 SET_GLOBAL 0\n"
+                                        "0014 PUSH_NULL\n"
+                                        "0015 POP\n"
+                                        "0016 GET_GLOBAL 0\n"
+                                        "0021 INTEGER 2\n"
+                                        "0030 ADD\n"
+                                        "0031 RETURN\n");
+    EXPECT_EQ(globals.names, std::vector<std::string>{"a"});
+}
+
+TEST_F(VmTest, TestMatchesTheTreeWalker)
+{
+    std::vector<std::string> programs{
+        // recursion through a global, and through a captured local
+        "let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } };"
+        "fib(15)",
+        "let f = fn() { let fact = fn(n) { if (n < 1) { 1 } else { n * "
+        "fact(n - 1) } }; fact(10) }; f()",
+        // a closure sees a name its scope defines after it's made
+        "let f = fn() { let g = fn() { h() }; let h = fn() { 7 }; g() }; f()",
+        // captured three functions out
+        "fn(a) { fn(b) { fn(c) { a + b + c } } }(1)(2)(3)",
+        // a loop's variables are shared by its closures, and new each time
+        // it's entered
+        "let make = fn(n) { for (i = 0; i < n; ++i) { let fs = push(fs, fn() "
+        "{ i * 10 }); fs } }; let fs = []; let a = make(3); let b = make(2); "
+        "[a[0](), a[2](), b[1](), len(a), len(b)]",
+        // a name is read from the innermost scope that's defined it so far
+        "let x = 1; let f = fn() { let y = x; let x = 2; [y, x] }; f()",
+        "let x = 10; for (i = 5; i > 0; --i) { let x = x + i; x }",
+        // ++ changes the variable it's applied to, wherever that's defined
+        "let i = 3; let j = i; ++j; [i, j]",
+        "let f = fn() { let n = 0; let up = fn() { ++n }; up(); up(); n }; "
+        "[f(), --f()]",
+        "let h = {\"a\": 1, \"a\": 2, 3: [4]}; [h[\"a\"], h[3][0], h[4]]",
+        "let s = \"ab\"; [s + \"c\", len(s), !s, -(1 - 3)]",
+        "let f = fn(a, b) { [a, b] }; let a = 5; f(1)",
+        "if (true) {}",
+        "puts(1); head([])",
+        "5 + true; 1",
+        "let f = fn() { [nope] }; f()",
+        "{[1]: 2}",
+        "1(2)",
+    };
+    for (auto &input : programs)
+    {
+        auto env = ref::Make<object::Environment>();
+        auto expected = evaluator::Eval(Parse(input), env);
+        auto result = vm::Machine{}.Run(*Parse(input));
+        ASSERT_TRUE(result) << input;
+        EXPECT_EQ(result.Inspect(), expected ? expected.Inspect() : "null")
+            << input;
+    }
+}
+
+TEST_F(VmTest, TestGlobalsLastBetweenRuns)
+{
+    EXPECT_EQ(Run("let show = fn() { [a, len] }"), "null");
+    EXPECT_EQ(Run("show()"), "ERROR: identifier not found: a");
+    EXPECT_EQ(Run("let a = 5; let len = 6;"), "null");
+    EXPECT_EQ(Run("show()"), "[5, 6]");
+    EXPECT_EQ(Run(""), "nullptr");
+}
+
+TEST_F(VmTest, TestReturnLeavesALoop)
+{
+    // the tree walker finishes the loop first, and gives 99
+    EXPECT_EQ(Run("let f = fn() { for (i = 0; i < 10; ++i) { if (i == 2) { "
+                  "return i; } }; 99 }; f()"),
+              "2");
+}
+
+TEST_F(VmTest, TestDeepRecursion)
+{
+    EXPECT_EQ(Run("let down = fn(n) { if (n == 0) { 0 } else { down(n - 1) } "
+                  "}; down(10000)"),
+              "0");
+    EXPECT_EQ(Run("let forever = fn() { forever() }; forever()"),
+              "ERROR: stack overflow");
+}
+
+TEST_F(VmTest, TestSkimmedBodiesCompileOnFirstCall)
+{
+    auto program = Parse("let f = fn(a) { a + 1 }; f", true);
+    auto literal = static_cast<ast::FunctionLiteral *>(
+        static_cast<ast::LetStatement *>(program->statements_[0].get())
+            ->value_.get());
+    EXPECT_EQ(machine_.Run(*program).Inspect(), "fn(a) {\n{ a + 1 }\n)");
+    EXPECT_FALSE(literal->body_);
+    EXPECT_EQ(Run("f(2)"), "3");
+    EXPECT_TRUE(literal->body_);
+
+    // one that doesn't parse is only an error once it's called
+    auto broken = Parse("let g = fn() { let = ; }; 2", true);
+    EXPECT_EQ(machine_.Run(*broken).Inspect(), "2");
+    EXPECT_EQ(Run("g()"), "ERROR: syntax error in function body");
+
+    std::vector<std::string> programs{
+        "let f = fn() { let g = fn() { h() }; let h = fn() { 7 }; g() }; f()",
+        "fn(a) { fn(b) { fn(c) { a + b + c } } }(1)(2)(3)",
+        "let make = fn(n) { for (i = 0; i < n; ++i) { let fs = push(fs, fn() "
+        "{ i * 10 }); fs } }; let fs = []; let a = make(3); let b = make(2); "
+        "[a[0](), a[2](), b[1](), len(a), len(b)]",
+        "let x = 1; let f = fn() { let y = x; let x = 2; [y, x] }; f()",
+        "let f = fn() { let n = 0; let up = fn() { ++n }; up(); up(); n }; "
+        "[f(), --f()]",
+        "let a = 1; for (i = 0; i < 2; ++i) { let b = i; let g = fn(c) { "
+        "[a, b, c, i] }; g(5) }",
+    };
+    for (auto &input : programs)
+    {
+        auto expected = vm::Machine{}.Run(*Parse(input));
+        auto result = vm::Machine{}.Run(*Parse(input, true));
+        ASSERT_TRUE(result) << input;
+        EXPECT_EQ(result.Inspect(), expected.Inspect()) << input;
+    }
+}
+
+} // namespace
@@ -1,22 +1,43 @@
 #include <iostream>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 
 #include "token.hpp"
 
 namespace token
 {
-const std::unordered_map<std::string, TokenType> keywords{
-    {"else", ELSE}, {"false", FALSE}, {"for", FOR},   {"fn", FUNCTION},
-    {"if", IF},     {"let", LET},     {"true", TRUE}, {"return", RETURN}};
 
-TokenType LookupIdent(std::string ident)
+static_assert(LookupIdent("let") == LET && LookupIdent("fn") == FUNCTION &&
+                  LookupIdent("return") == RETURN &&
+                  LookupIdent("lets") == IDENT && LookupIdent("f") == IDENT,
+              "keyword table out of step with the keywords");
+
+namespace
+{
+constexpr std::string_view type_names[NUM_TOKEN_TYPES] = {
+    "ILLEGAL", "EOF",                                          //
+    "IDENT",   "INT",      "STRING",                           //
+    "=",       "+",        "-",      "!",    "*",     "/",     //
+    "<",       ">",                                            //
+    ",",       ":",        ";",                                //
+    "(",       ")",        "{",      "}",    "[",     "]",     //
+    "FOR",     "FUNCTION", "LET",    "TRUE", "FALSE", "IF",    //
+    "ELSE",    "RETURN",                                       //
+    "==",      "!=",                                           //
+    "++",      "--"};
+} // namespace
+
+std::string_view TypeName(TokenType type)
 {
-    std::unordered_map<std::string, TokenType>::const_iterator got =
-        keywords.find(ident);
-    if (got != keywords.end())
-        return got->second;
-    return IDENT;
+    if (type >= NUM_TOKEN_TYPES)
+        return "ILLEGAL";
+    return type_names[type];
+}
+
+std::ostream &operator<<(std::ostream &out, TokenType type)
+{
+    out << TypeName(type);
+    return out;
 }
 
 std::ostream &operator<<(std::ostream &out, const Token &tok)
@@ -1,68 +1,120 @@
 #pragma once
 
+#include <cstdint>
+#include <ostream>
 #include <string>
+#include <string_view>
 
 namespace token
 {
-using TokenType = std::string;
-
-const TokenType ILLEGAL = "ILLEGAL";
-const TokenType EOFF = "EOF";
-
-const TokenType IDENT = "IDENT";
-const TokenType INT = "INT";
-const TokenType STRING = "STRING";
-
-const TokenType ASSIGN = "=";
-const TokenType PLUS = "+";
-const TokenType MINUS = "-";
-const TokenType BANG = "!";
-const TokenType ASTERISK = "*";
-const TokenType SLASH = "/";
-
-const TokenType LT = "<";
-const TokenType GT = ">";
-
-const TokenType COMMA = ",";
-const TokenType COLON = ":";
-const TokenType SEMICOLON = ";";
-
-const TokenType LPAREN = "(";
-const TokenType RPAREN = ")";
-const TokenType LBRACE = "{";
-const TokenType RBRACE = "}";
-const TokenType LBRACKET = "[";
-const TokenType RBRACKET = "]";
-
-const TokenType FOR = "FOR";
-const TokenType FUNCTION = "FUNCTION";
-const TokenType LET = "LET";
-const TokenType TRUE = "TRUE";
-const TokenType FALSE = "FALSE";
-const TokenType IF = "IF";
-const TokenType ELSE = "ELSE";
-const TokenType RETURN = "RETURN";
-
-const TokenType EQ = "==";
-const TokenType NOT_EQ = "!=";
-
-const TokenType INCREMENT = "++";
-const TokenType DECREMENT = "--";
 
+// Token kinds are a dense enum so the parser can compare and index on them
+// directly - TypeName() gives back the printable name.
+enum TokenType : uint8_t
+{
+    ILLEGAL,
+    EOFF,
+
+    IDENT,
+    INT,
+    STRING,
+
+    ASSIGN,
+    PLUS,
+    MINUS,
+    BANG,
+    ASTERISK,
+    SLASH,
+
+    LT,
+    GT,
+
+    COMMA,
+    COLON,
+    SEMICOLON,
+
+    LPAREN,
+    RPAREN,
+    LBRACE,
+    RBRACE,
+    LBRACKET,
+    RBRACKET,
+
+    FOR,
+    FUNCTION,
+    LET,
+    TRUE,
+    FALSE,
+    IF,
+    ELSE,
+    RETURN,
+
+    EQ,
+    NOT_EQ,
+
+    INCREMENT,
+    DECREMENT,
+
+    NUM_TOKEN_TYPES
+};
+
+std::string_view TypeName(TokenType type);
+std::ostream &operator<<(std::ostream &, TokenType);
+
+// literal_ is a view into the source::Buffer being lexed (or a string
+// literal), never an owned copy. INT tokens carry their parsed value_, IDENT
+// tokens their interned symbol id.
 class Token
 {
   public:
     Token() {}
-    Token(TokenType type, std::string literal)
+    Token(TokenType type, std::string_view literal)
         : type_{type}, literal_{literal} {};
+    Token(TokenType type, std::string_view literal, int64_t value)
+        : type_{type}, literal_{literal}, value_{value} {};
 
     friend std::ostream &operator<<(std::ostream &, const Token &);
 
   public:
-    TokenType type_;
-    std::string literal_;
+    TokenType type_{ILLEGAL};
+    std::string_view literal_;
+    int64_t value_{0};
 };
 
-TokenType LookupIdent(std::string ident);
+// Keyword recognizer - dispatches on length so each identifier is compared
+// against at most two keywords, and can be evaluated at compile time.
+constexpr TokenType LookupIdent(std::string_view ident)
+{
+    switch (ident.size())
+    {
+    case 2:
+        if (ident == "fn")
+            return FUNCTION;
+        if (ident == "if")
+            return IF;
+        break;
+    case 3:
+        if (ident == "let")
+            return LET;
+        if (ident == "for")
+            return FOR;
+        break;
+    case 4:
+        if (ident == "true")
+            return TRUE;
+        if (ident == "else")
+            return ELSE;
+        break;
+    case 5:
+        if (ident == "false")
+            return FALSE;
+        break;
+    case 6:
+        if (ident == "return")
+            return RETURN;
+        break;
+    }
+    return IDENT;
+}
 
 } // namespace token
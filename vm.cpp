@@ -0,0 +1,517 @@
+#include "vm.hpp"
+
+#include <iostream>
+#include <map>
+#include <typeinfo>
+#include <utility>
+
+#include "cycles.hpp"
+#include "evaluator.hpp"
+#include "flat.hpp"
+#include "ref.hpp"
+
+namespace vm
+{
+
+namespace
+{
+
+using object::Value;
+
+template <typename T> bool Is(const Value &value)
+{
+    return value.IsObject() && typeid(*value.Get()) == typeid(T);
+}
+
+bool IsTruthy(const Value &value)
+{
+    return value != evaluator::NULLL && value != evaluator::FALSE;
+}
+
+ref::Ref<object::Error> NewError(std::string message)
+{
+    return ref::Make<object::Error>(std::move(message));
+}
+
+std::string_view InfixOperator(code::Opcode op)
+{
+    switch (op)
+    {
+    case code::ADD:
+        return "+";
+    case code::SUB:
+        return "-";
+    case code::MUL:
+        return "*";
+    case code::DIV:
+        return "/";
+    case code::LESS:
+        return "<";
+    case code::GREATER:
+        return ">";
+    case code::EQUAL:
+        return "==";
+    default:
+        return "!=";
+    }
+}
+
+// Integers are worked out here; anything else goes through the evaluator.
+Value Infix(code::Opcode op, const Value &left, const Value &right)
+{
+    if (!left.IsInteger() || !right.IsInteger())
+        return evaluator::EvalInfixExpression(InfixOperator(op), left, right);
+
+    int64_t a = left.AsInteger();
+    int64_t b = right.AsInteger();
+    switch (op)
+    {
+    case code::ADD:
+        return Value::OfInteger(a + b);
+    case code::SUB:
+        return Value::OfInteger(a - b);
+    case code::MUL:
+        return Value::OfInteger(a * b);
+    case code::DIV:
+        return Value::OfInteger(a / b);
+    case code::LESS:
+        return evaluator::NativeBoolToBooleanObject(a < b);
+    case code::GREATER:
+        return evaluator::NativeBoolToBooleanObject(a > b);
+    case code::EQUAL:
+        return evaluator::NativeBoolToBooleanObject(a == b);
+    default:
+        return evaluator::NativeBoolToBooleanObject(a != b);
+    }
+}
+
+Value Prefix(code::Opcode op, const Value &right)
+{
+    switch (op)
+    {
+    case code::NOT:
+        return evaluator::EvalBangOperatorExpression(right);
+    case code::NEGATE:
+        return evaluator::EvalMinusPrefixOperatorExpression(right);
+    case code::INCREMENT:
+        return evaluator::EvalIncrementOperatorExpression(right);
+    default:
+        return evaluator::EvalDecrementOperatorExpression(right);
+    }
+}
+
+// The constants and literals of a prototype and the ones nested inside it,
+// which every closure made from it shares.
+void ProtoReferents(const code::Function &proto,
+                    std::vector<ref::Counted *> &out)
+{
+    for (auto const &constant : proto.constants)
+        out.push_back(constant.Get());
+    out.push_back(proto.literal.get());
+    for (auto const &inner : proto.functions)
+        ProtoReferents(*inner, out);
+}
+
+const char kSharedCell[] = "can't change a shared variable";
+
+} // namespace
+
+Closure::Closure(std::shared_ptr<code::Function> proto,
+                 std::vector<ref::Ref<Cell>> free)
+    : object::Function{{}, nullptr, nullptr}, proto_{std::move(proto)},
+      free_{std::move(free)}
+{
+    // one compiled from an image has none: see Inspect
+    if (auto &literal = proto_->literal)
+    {
+        parameters_ = literal->parameters_;
+        body_ = literal->body_;
+        source_ = literal->source_;
+        // printed from its text while it's still to be parsed
+        if (!body_)
+            literal_ = literal;
+    }
+}
+
+std::string Closure::Inspect()
+{
+    if (proto_->literal || !proto_->tree)
+        return object::Function::Inspect();
+    // the literal's only rebuilt from the image to be printed
+    auto literal = ref::StaticCast<ast::FunctionLiteral>(
+        flat::Inflate(*proto_->tree, proto_->node));
+    return ref::Make<object::Function>(literal->parameters_, nullptr,
+                                       literal->body_)
+        ->Inspect();
+}
+
+void Closure::Referents(std::vector<ref::Counted *> &out)
+{
+    object::Function::Referents(out);
+    for (auto const &cell : free_)
+        out.push_back(cell.get());
+}
+
+void Closure::SharedReferents(std::vector<ref::Counted *> &out)
+{
+    ProtoReferents(*proto_, out);
+}
+
+void Closure::DropReferents()
+{
+    object::Function::DropReferents();
+    free_.clear();
+}
+
+Value Machine::Run(const ast::Program &program)
+{
+    if (program.statements_.empty())
+        return nullptr;
+    return Start(compiler::Compile(program, globals_));
+}
+
+Value Machine::Run(std::shared_ptr<const flat::Tree> tree)
+{
+    if (tree->Root() == flat::kNoNode || tree->At(tree->Root()).b == 0)
+        return nullptr;
+    return Start(compiler::Compile(std::move(tree), globals_));
+}
+
+Value Machine::Start(std::shared_ptr<code::Function> main)
+{
+    global_values_.resize(globals_.names.size());
+    auto result = Execute(*main);
+    stack_.clear();
+    frames_.clear();
+    return result;
+}
+
+Value Machine::Execute(const code::Function &main)
+{
+    using code::Read;
+
+    stack_.assign(main.num_locals, Value{});
+    frames_.push_back(Frame{&main, nullptr, main.instructions.data(), 0});
+
+    // the current frame's, kept out of frames_ while it runs
+    const code::Function *function = &main;
+    const uint8_t *code = main.instructions.data();
+    const uint8_t *ip = code;
+    size_t base = 0;
+
+    auto push = [this](Value value) { stack_.push_back(std::move(value)); };
+    auto pop = [this]() {
+        Value value = std::move(stack_.back());
+        stack_.pop_back();
+        return value;
+    };
+
+    for (;;)
+    {
+        auto op = static_cast<code::Opcode>(*ip++);
+        switch (op)
+        {
+        case code::CONSTANT:
+            push(function->constants[Read<uint32_t>(ip)]);
+            ip += 4;
+            break;
+        case code::INTEGER:
+            push(Value::OfInteger(Read<int64_t>(ip)));
+            ip += 8;
+            break;
+        case code::PUSH_TRUE:
+            push(evaluator::TRUE);
+            break;
+        case code::PUSH_FALSE:
+            push(evaluator::FALSE);
+            break;
+        case code::PUSH_NULL:
+            push(evaluator::NULLL);
+            break;
+        case code::POP:
+            stack_.pop_back();
+            break;
+
+        case code::ADD:
+        case code::SUB:
+        case code::MUL:
+        case code::DIV:
+        case code::LESS:
+        case code::GREATER:
+        case code::EQUAL:
+        case code::NOT_EQUAL:
+        {
+            Value right = pop();
+            Value &left = stack_.back();
+            left = Infix(op, left, right);
+            if (Is<object::Error>(left))
+                return left;
+            break;
+        }
+
+        case code::NOT:
+        case code::NEGATE:
+        case code::INCREMENT:
+        case code::DECREMENT:
+        {
+            Value &right = stack_.back();
+            right = Prefix(op, right);
+            if (Is<object::Error>(right))
+                return right;
+            break;
+        }
+
+        case code::JUMP:
+            ip = code + Read<uint32_t>(ip);
+            break;
+        case code::JUMP_IF_FALSE:
+            if (IsTruthy(pop()))
+                ip += 4;
+            else
+                ip = code + Read<uint32_t>(ip);
+            break;
+
+        case code::GET_LOCAL_OR:
+        {
+            Value value = stack_[base + Read<uint16_t>(ip)];
+            if (!value)
+            {
+                ip += 6;
+                break;
+            }
+            push(std::move(value));
+            ip = code + Read<uint32_t>(ip + 2);
+            break;
+        }
+        case code::GET_CELL_OR:
+        case code::GET_FREE_OR:
+        {
+            uint16_t index = Read<uint16_t>(ip);
+            Cell *cell =
+                op == code::GET_CELL_OR
+                    ? static_cast<Cell *>(stack_[base + index].Get())
+                    : frames_.back().closure->free_[index].get();
+            if (!cell->value_)
+            {
+                ip += 6;
+                break;
+            }
+            push(cell->value_);
+            ip = code + Read<uint32_t>(ip + 2);
+            break;
+        }
+        case code::GET_GLOBAL:
+        {
+            uint32_t slot = Read<uint32_t>(ip);
+            ip += 4;
+            if (global_values_[slot])
+                push(global_values_[slot]);
+            else if (globals_.builtins[slot])
+                push(globals_.builtins[slot]);
+            else
+                return NewError("identifier not found: " +
+                                globals_.names[slot]);
+            break;
+        }
+
+        case code::SET_LOCAL:
+            stack_[base + Read<uint16_t>(ip)] = pop();
+            ip += 2;
+            break;
+        case code::SET_CELL:
+        {
+            auto cell =
+                static_cast<Cell *>(stack_[base + Read<uint16_t>(ip)].Get());
+            if (cell->IsShared())
+                return NewError(kSharedCell);
+            cell->value_ = pop();
+            ip += 2;
+            break;
+        }
+        case code::SET_GLOBAL:
+            global_values_[Read<uint32_t>(ip)] = pop();
+            ip += 4;
+            break;
+
+        case code::ASSIGN_LOCAL_OR:
+        {
+            Value &local = stack_[base + Read<uint16_t>(ip)];
+            if (!local)
+            {
+                ip += 6;
+                break;
+            }
+            local = stack_.back();
+            ip = code + Read<uint32_t>(ip + 2);
+            break;
+        }
+        case code::ASSIGN_CELL_OR:
+        case code::ASSIGN_FREE_OR:
+        {
+            uint16_t index = Read<uint16_t>(ip);
+            Cell *cell =
+                op == code::ASSIGN_CELL_OR
+                    ? static_cast<Cell *>(stack_[base + index].Get())
+                    : frames_.back().closure->free_[index].get();
+            if (!cell->value_)
+            {
+                ip += 6;
+                break;
+            }
+            if (cell->IsShared())
+                return NewError(kSharedCell);
+            cell->value_ = stack_.back();
+            ip = code + Read<uint32_t>(ip + 2);
+            break;
+        }
+        case code::ASSIGN_GLOBAL:
+            global_values_[Read<uint32_t>(ip)] = stack_.back();
+            ip += 4;
+            break;
+
+        case code::CLEAR_LOCAL:
+            stack_[base + Read<uint16_t>(ip)] = nullptr;
+            ip += 2;
+            break;
+        case code::NEW_CELL:
+            stack_[base + Read<uint16_t>(ip)] = ref::Make<Cell>(nullptr);
+            ip += 2;
+            break;
+
+        case code::ARRAY:
+        {
+            uint32_t count = Read<uint32_t>(ip);
+            ip += 4;
+            auto first = stack_.end() - count;
+            auto array = ref::Make<object::Array>(
+                std::vector<Value>(first, stack_.end()));
+            stack_.erase(first, stack_.end());
+            push(std::move(array));
+            break;
+        }
+        case code::HASH_KEY:
+            if (!evaluator::IsHashable(stack_.back()))
+                return NewError("unusable as hash key: " +
+                                stack_.back().Type());
+            break;
+        case code::HASH:
+        {
+            uint32_t count = Read<uint32_t>(ip);
+            ip += 4;
+            auto first = stack_.end() - 2 * count;
+            std::map<object::HashKey, object::HashPair> pairs;
+            for (auto it = first; it != stack_.end(); it += 2)
+                // the first of two equal keys wins, as in the tree walker
+                pairs.insert({evaluator::MakeHashKey(*it),
+                              object::HashPair{*it, *(it + 1)}});
+            stack_.erase(first, stack_.end());
+            push(ref::Make<object::Hash>(std::move(pairs)));
+            break;
+        }
+        case code::INDEX:
+        {
+            Value index = pop();
+            Value &left = stack_.back();
+            left = evaluator::EvalIndexExpression(left, index);
+            if (Is<object::Error>(left))
+                return left;
+            break;
+        }
+
+        case code::CALL:
+        {
+            // everything in use is on the stack or in a global
+            cycles::Poll();
+            uint16_t count = Read<uint16_t>(ip);
+            ip += 2;
+            size_t callee = stack_.size() - count - 1;
+            const Value &callable = stack_[callee];
+            if (Is<object::BuiltIn>(callable))
+            {
+                auto builtin = static_cast<object::BuiltIn *>(callable.Get());
+                Value result = builtin->func_(std::vector<Value>(
+                    stack_.begin() + callee + 1, stack_.end()));
+                if (!result)
+                    result = evaluator::NULLL;
+                else if (Is<object::Error>(result))
+                    return result;
+                stack_.resize(callee);
+                push(std::move(result));
+                break;
+            }
+            if (!Is<Closure>(callable))
+                return NewError("Not a function object, mate:" +
+                                callable.Type() + "!");
+
+            auto closure = static_cast<Closure *>(callable.Get());
+            code::Function &proto = *closure->proto_;
+            if (proto.deferred)
+            {
+                compiler::CompileBody(proto, globals_);
+                global_values_.resize(globals_.names.size());
+            }
+            if (proto.broken)
+                return NewError("syntax error in function body");
+            if (frames_.size() == kMaxFrames)
+                return NewError("stack overflow");
+
+            frames_.back().ip = ip;
+            base = callee + 1;
+            if (count != proto.num_parameters)
+            {
+                std::cerr << "Function Eval - args and params not same size, "
+                             "ya numpty!\n";
+                // the parameters are left unset
+                stack_.resize(base);
+            }
+            stack_.resize(base + proto.num_locals);
+            for (uint16_t slot : proto.cells)
+                stack_[base + slot] =
+                    ref::Make<Cell>(std::move(stack_[base + slot]));
+
+            frames_.push_back(
+                Frame{&proto, closure, proto.instructions.data(), base});
+            function = &proto;
+            code = ip = proto.instructions.data();
+            break;
+        }
+        case code::RETURN:
+        {
+            Value result = pop();
+            if (frames_.size() == 1)
+                return result;
+            // drops the callee along with the frame's slots
+            stack_.resize(base - 1);
+            frames_.pop_back();
+            push(std::move(result));
+
+            const Frame &caller = frames_.back();
+            function = caller.function;
+            code = function->instructions.data();
+            ip = caller.ip;
+            base = caller.base;
+            break;
+        }
+        case code::CLOSURE:
+        {
+            const auto &proto = function->functions[Read<uint16_t>(ip)];
+            ip += 2;
+            std::vector<ref::Ref<Cell>> free;
+            free.reserve(proto->captures.size());
+            for (code::Capture capture : proto->captures)
+                free.push_back(
+                    capture.local
+                        ? ref::StaticCast<Cell>(
+                              stack_[base + capture.index].Boxed())
+                        : frames_.back().closure->free_[capture.index]);
+            push(ref::Make<Closure>(proto, std::move(free)));
+            break;
+        }
+
+        default:
+            return NewError("bad opcode");
+        }
+    }
+}
+
+} // namespace vm
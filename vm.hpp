@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ast.hpp"
+#include "code.hpp"
+#include "compiler.hpp"
+#include "cycles.hpp"
+#include "flat.hpp"
+#include "object.hpp"
+#include "ref.hpp"
+
+namespace vm
+{
+
+constexpr char CELL_OBJ[] = "CELL";
+
+// A variable that a closure captures, boxed so the function defining it and
+// every closure that captured it see the same value. Empty until the
+// variable's set; can't be set once shared.
+class Cell : public object::Object, public cycles::Tracked
+{
+  public:
+    explicit Cell(object::Value value)
+        : cycles::Tracked{this}, value_{std::move(value)}
+    {
+    }
+    object::ObjectType Type() override { return CELL_OBJ; }
+    std::string Inspect() override
+    {
+        return value_ ? value_.Inspect() : "null";
+    }
+
+  public:
+    object::Value value_;
+
+  protected:
+    void Referents(std::vector<ref::Counted *> &out) override
+    {
+        out.push_back(value_.Get());
+    }
+    void DropReferents() override { value_ = object::Value{}; }
+};
+
+// A function value made by the VM: the literal's parameters and body, as the
+// tree walker's functions have, plus its bytecode and the cells it captured.
+// One compiled from an image has no literal, so no parameters or body.
+class Closure : public object::Function
+{
+  public:
+    Closure(std::shared_ptr<code::Function> proto,
+            std::vector<ref::Ref<Cell>> free);
+    std::string Inspect() override;
+
+  public:
+    std::shared_ptr<code::Function> proto_;
+    std::vector<ref::Ref<Cell>> free_;
+
+  protected:
+    void Referents(std::vector<ref::Counted *> &out) override;
+    void SharedReferents(std::vector<ref::Counted *> &out) override;
+    void DropReferents() override;
+};
+
+// Runs programs as bytecode, an alternative to evaluator::Eval with the same
+// object model and builtins. Differences from the tree walker: an error
+// stops the program at once, and `return` inside a for loop returns from the
+// function rather than being ignored until the loop ends.
+class Machine
+{
+  public:
+    // Compiles and runs `program`. Top-level names it defines stay defined
+    // for later runs. Returns the program's value or the error that stopped
+    // it - empty if it has no statements.
+    object::Value Run(const ast::Program &program);
+    // The same for a flat tree: an image straight out of flat::Load, say.
+    object::Value Run(std::shared_ptr<const flat::Tree> tree);
+
+  private:
+    struct Frame
+    {
+        const code::Function *function;
+        // null for the top level
+        Closure *closure;
+        const uint8_t *ip;
+        // where the function's slots start on the stack
+        size_t base;
+    };
+
+    // Runs a compiled program.
+    object::Value Start(std::shared_ptr<code::Function> main);
+    object::Value Execute(const code::Function &main);
+
+    static constexpr size_t kMaxFrames = 1 << 16;
+
+    compiler::Globals globals_;
+    std::vector<object::Value> global_values_;
+    // each frame's slots, then its operands
+    std::vector<object::Value> stack_;
+    std::vector<Frame> frames_;
+};
+
+} // namespace vm
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace xxhash
+{
+
+// XXH64 (https://github.com/Cyan4973/xxHash) - a fast non-cryptographic
+// 64-bit hash, used to key caches on whole source texts.
+uint64_t Hash64(std::string_view data, uint64_t seed = 0);
+
+} // namespace xxhash